@@ -0,0 +1,274 @@
+﻿// AudioDsp.cpp
+#include "audiodsp.h"
+#include <cmath>
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AUDIODSP_SSE2 1
+#endif
+
+namespace AudioDsp
+{
+AudioLevel measureS16(const int16_t* samples, int count)
+{
+    AudioLevel level;
+    if (!samples || count <= 0) {
+        return level;
+    }
+
+    int peak = 0;
+    uint64_t sumSq = 0;
+    int i = 0;
+
+#ifdef AUDIODSP_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vPeak = zero;
+    __m128i vSum = zero;    // 2个64位累加器
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+        // |x|，饱和减法使-32768取绝对值为32767
+        __m128i absX = _mm_max_epi16(x, _mm_subs_epi16(zero, x));
+        vPeak = _mm_max_epi16(vPeak, absX);
+        // x*x两两相加为32位，最大值2^31按无符号扩展到64位累加
+        __m128i sq = _mm_madd_epi16(x, x);
+        vSum = _mm_add_epi64(vSum, _mm_unpacklo_epi32(sq, zero));
+        vSum = _mm_add_epi64(vSum, _mm_unpackhi_epi32(sq, zero));
+    }
+    alignas(16) int16_t peaks[8];
+    alignas(16) uint64_t sums[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(peaks), vPeak);
+    _mm_store_si128(reinterpret_cast<__m128i*>(sums), vSum);
+    for (int k = 0; k < 8; ++k) {
+        peak = qMax(peak, int(peaks[k]));
+    }
+    sumSq = sums[0] + sums[1];
+#endif
+
+    for (; i < count; ++i) {
+        int v = samples[i];
+        peak = qMax(peak, std::abs(v));
+        sumSq += uint64_t(int64_t(v) * v);
+    }
+
+    level.peak = qMin(1.0f, peak / 32768.0f);
+    level.rms = float(std::sqrt(double(sumSq) / count) / 32768.0);
+    return level;
+}
+
+AudioLevel measureFloat(const float* samples, int count)
+{
+    AudioLevel level;
+    if (!samples || count <= 0) {
+        return level;
+    }
+
+    float peak = 0.0f;
+    double sumSq = 0.0;
+    int i = 0;
+
+#ifdef AUDIODSP_SSE2
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 vPeak = _mm_setzero_ps();
+    __m128 vSum = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(samples + i);
+        vPeak = _mm_max_ps(vPeak, _mm_and_ps(x, absMask));
+        vSum = _mm_add_ps(vSum, _mm_mul_ps(x, x));
+    }
+    alignas(16) float peaks[4];
+    alignas(16) float sums[4];
+    _mm_store_ps(peaks, vPeak);
+    _mm_store_ps(sums, vSum);
+    for (int k = 0; k < 4; ++k) {
+        peak = qMax(peak, peaks[k]);
+        sumSq += sums[k];
+    }
+#endif
+
+    for (; i < count; ++i) {
+        float v = samples[i];
+        peak = qMax(peak, std::fabs(v));
+        sumSq += double(v) * v;
+    }
+
+    level.peak = qMin(1.0f, peak);
+    level.rms = float(std::sqrt(sumSq / count));
+    return level;
+}
+
+void fillComfortNoiseS16(int16_t* dst, int count, float amplitude, uint32_t* seed)
+{
+    uint32_t s = *seed;
+    const float scale = amplitude * 32767.0f / 2147483648.0f;
+    for (int i = 0; i < count; ++i) {
+        s = s * 1664525u + 1013904223u;     // LCG，舒适噪声无需高质量随机数
+        dst[i] = int16_t(float(int32_t(s)) * scale);
+    }
+    *seed = s;
+}
+
+void fillComfortNoiseFloat(float* dst, int count, float amplitude, uint32_t* seed)
+{
+    uint32_t s = *seed;
+    const float scale = amplitude / 2147483648.0f;
+    for (int i = 0; i < count; ++i) {
+        s = s * 1664525u + 1013904223u;
+        dst[i] = float(int32_t(s)) * scale;
+    }
+    *seed = s;
+}
+
+AudioLevel measureFrame(uint8_t* const* data, AVSampleFormat format, int samples, int channels)
+{
+    AudioLevel level;
+    bool planar = av_sample_fmt_is_planar(format);
+    int planes = planar ? channels : 1;
+    int count = planar ? samples : samples * channels;
+    float sumSq = 0.0f;
+
+    for (int p = 0; p < planes; ++p) {
+        AudioLevel l;
+        switch (av_get_packed_sample_fmt(format)) {
+        case AV_SAMPLE_FMT_S16:
+            l = measureS16(reinterpret_cast<const int16_t*>(data[p]), count);
+            break;
+        case AV_SAMPLE_FMT_FLT:
+            l = measureFloat(reinterpret_cast<const float*>(data[p]), count);
+            break;
+        default:
+            l.peak = l.rms = 1.0f;
+            break;
+        }
+        level.peak = qMax(level.peak, l.peak);
+        sumSq += l.rms * l.rms;
+    }
+    level.rms = planes > 0 ? std::sqrt(sumSq / planes) : 0.0f;
+    return level;
+}
+
+void fillComfortNoiseFrame(uint8_t* const* data, AVSampleFormat format, int samples, int channels,
+                           float amplitude, uint32_t* seed)
+{
+    bool planar = av_sample_fmt_is_planar(format);
+    int planes = planar ? channels : 1;
+    int count = planar ? samples : samples * channels;
+
+    for (int p = 0; p < planes; ++p) {
+        switch (av_get_packed_sample_fmt(format)) {
+        case AV_SAMPLE_FMT_S16:
+            fillComfortNoiseS16(reinterpret_cast<int16_t*>(data[p]), count, amplitude, seed);
+            break;
+        case AV_SAMPLE_FMT_FLT:
+            fillComfortNoiseFloat(reinterpret_cast<float*>(data[p]), count, amplitude, seed);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+float dbToLinear(double db)
+{
+    return float(std::pow(10.0, db / 20.0));
+}
+
+void mixAddScaled(float* dst, const float* src, float gain, int count)
+{
+    int i = 0;
+#ifdef AUDIODSP_SSE2
+    const __m128 vGain = _mm_set1_ps(gain);
+    for (; i + 8 <= count; i += 8) {
+        __m128 d0 = _mm_loadu_ps(dst + i);
+        __m128 d1 = _mm_loadu_ps(dst + i + 4);
+        d0 = _mm_add_ps(d0, _mm_mul_ps(_mm_loadu_ps(src + i), vGain));
+        d1 = _mm_add_ps(d1, _mm_mul_ps(_mm_loadu_ps(src + i + 4), vGain));
+        _mm_storeu_ps(dst + i, d0);
+        _mm_storeu_ps(dst + i + 4, d1);
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] += src[i] * gain;
+    }
+}
+
+void floatToS16(const float* src, int16_t* dst, int count)
+{
+    int i = 0;
+#ifdef AUDIODSP_SSE2
+    const __m128 vScale = _mm_set1_ps(32767.0f);
+    const __m128 vMax = _mm_set1_ps(1.0f);
+    const __m128 vMin = _mm_set1_ps(-1.0f);
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), vMin), vMax);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), vMin), vMax);
+        __m128i ia = _mm_cvtps_epi32(_mm_mul_ps(a, vScale));
+        __m128i ib = _mm_cvtps_epi32(_mm_mul_ps(b, vScale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(ia, ib));
+    }
+#endif
+    for (; i < count; ++i) {
+        float v = qBound(-1.0f, src[i], 1.0f);
+        dst[i] = int16_t(std::lrint(v * 32767.0f));
+    }
+}
+} // namespace AudioDsp
+
+void SilenceGate::setThresholdDb(double db)
+{
+    m_threshold = AudioDsp::dbToLinear(db);
+}
+
+bool SilenceGate::process(const AudioLevel& level, int frameSamples, int sampleRate)
+{
+    ++m_totalFrames;
+    if (level.peak >= m_threshold || level.rms >= m_threshold) {
+        m_silentSamples = 0;
+        return false;
+    }
+
+    m_silentSamples += frameSamples;
+    if (sampleRate <= 0 || m_silentSamples * 1000 < qint64(m_hangoverMs) * sampleRate) {
+        return false;   // 静音时长未超过hangover，仍正常编码，避免切掉语音尾音
+    }
+    ++m_silentFrames;
+    return true;
+}
+
+bool SilenceGate::processFrame(uint8_t* const* data, AVSampleFormat format, int samples, int channels,
+                               int sampleRate, bool* reportDue)
+{
+    *reportDue = false;
+    if (m_mode == SilenceMode::off || samples <= 0) {
+        return false;
+    }
+    AudioLevel level = AudioDsp::measureFrame(data, format, samples, channels);
+    bool silent = process(level, samples, sampleRate);
+    int reportFrames = qMax(1, SILENCE_REPORT_INTERVAL_MS * sampleRate / (1000 * samples));
+    *reportDue = m_totalFrames % reportFrames == 0;
+    if (!silent) {
+        m_silentRun = 0;
+        return false;
+    }
+
+    int noiseFrames = qMax(1, COMFORT_NOISE_INTERVAL_MS * sampleRate / (1000 * samples));
+    if (m_mode == SilenceMode::comfortNoise && (m_silentRun++ % noiseFrames == 0)) {
+        // 舒适噪声保持接收端解码器与RTP流活跃
+        AudioDsp::fillComfortNoiseFrame(data, format, samples, channels, COMFORT_NOISE_AMPLITUDE, &m_noiseSeed);
+        return false;
+    }
+    return true;
+}
+
+void SilenceGate::reset()
+{
+    m_silentSamples = 0;
+    m_totalFrames = 0;
+    m_silentFrames = 0;
+    m_silentRun = 0;
+}
+
+double SilenceGate::silenceRatio() const
+{
+    return m_totalFrames > 0 ? double(m_silentFrames) / m_totalFrames : 0.0;
+}
@@ -0,0 +1,83 @@
+﻿// AudioDsp.h
+#ifndef AUDIODSP_H
+#define AUDIODSP_H
+
+#include <QtGlobal>
+#include <cstdint>
+#include "DataStruct.h"
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+}
+
+// 音频电平，归一化到[0,1]
+struct AudioLevel {
+    float peak = 0.0f;
+    float rms = 0.0f;
+};
+
+namespace AudioDsp
+{
+// 计算S16交错PCM的峰值与均方根（SSE2向量化，其他平台走标量实现）
+AudioLevel measureS16(const int16_t* samples, int count);
+
+// 计算float PCM的峰值与均方根
+AudioLevel measureFloat(const float* samples, int count);
+
+// 生成低电平白噪声作为舒适噪声，amplitude为线性幅度[0,1]
+void fillComfortNoiseS16(int16_t* dst, int count, float amplitude, uint32_t* seed);
+void fillComfortNoiseFloat(float* dst, int count, float amplitude, uint32_t* seed);
+
+// 按编码器采样格式处理一帧（S16/FLT及其平面格式），data为各平面指针；
+// 其他格式电平返回满幅，即不判为静音
+AudioLevel measureFrame(uint8_t* const* data, AVSampleFormat format, int samples, int channels);
+void fillComfortNoiseFrame(uint8_t* const* data, AVSampleFormat format, int samples, int channels,
+                           float amplitude, uint32_t* seed);
+
+float dbToLinear(double db);
+
+// dst[i] += src[i] * gain（混音累加）
+void mixAddScaled(float* dst, const float* src, float gain, int count);
+
+// float[-1,1] 转 S16，超出范围饱和截断
+void floatToS16(const float* src, int16_t* dst, int count);
+} // namespace AudioDsp
+
+// 静音门限：电平持续低于阈值超过hangover后判定为静音
+class SilenceGate
+{
+public:
+    void setMode(SilenceMode mode) { m_mode = mode; }
+    SilenceMode mode() const { return m_mode; }
+    void setThresholdDb(double db);
+    void setHangoverMs(int ms) { m_hangoverMs = ms; }
+
+    // 处理一帧，返回true表示该帧处于持续静音中
+    bool process(const AudioLevel& level, int frameSamples, int sampleRate);
+    // 按模式处理一帧编码输入（编码器采样格式），返回true表示跳过编码；舒适噪声模式下每隔
+    // COMFORT_NOISE_INTERVAL_MS把一帧静音改写为噪声并照常编码。每隔SILENCE_REPORT_INTERVAL_MS
+    // 把*reportDue置为true，调用方据此上报统计。off模式下直接返回false
+    bool processFrame(uint8_t* const* data, AVSampleFormat format, int samples, int channels, int sampleRate,
+                      bool* reportDue);
+    void reset();
+
+    qint64 totalFrames() const { return m_totalFrames; }
+    qint64 silentFrames() const { return m_silentFrames; }
+    double silenceRatio() const;
+
+private:
+    SilenceMode m_mode = SilenceMode::off;
+    float m_threshold = 0.001f;     // -60dBFS
+    int m_hangoverMs = 300;
+    qint64 m_silentSamples = 0;     // 当前连续静音采样数
+    qint64 m_totalFrames = 0;
+    qint64 m_silentFrames = 0;
+    int m_silentRun = 0;            // 当前连续静音帧数
+    uint32_t m_noiseSeed = 1;
+
+    static const int COMFORT_NOISE_INTERVAL_MS = 200;   // 舒适噪声帧间隔
+    static const int SILENCE_REPORT_INTERVAL_MS = 1000; // 静音统计上报间隔
+    static constexpr float COMFORT_NOISE_AMPLITUDE = 0.0003f;   // -70dBFS
+};
+
+#endif // AUDIODSP_H
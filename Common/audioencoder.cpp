@@ -0,0 +1,108 @@
+﻿// AudioEncoder.cpp
+#include "audioencoder.h"
+#include "Logger.h"
+
+namespace AudioEncoder
+{
+static bool isSampleFmtSupported(const AVCodec* codec, AVSampleFormat fmt)
+{
+    if (!codec->sample_fmts) {
+        return false;
+    }
+    for (const AVSampleFormat* p = codec->sample_fmts; *p != AV_SAMPLE_FMT_NONE; ++p) {
+        if (*p == fmt) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int encoderSampleRate(AudioCodecType codec, int sampleRate)
+{
+    if (codec == AudioCodecType::opus) {
+        switch (sampleRate) {
+        case 8000:
+        case 12000:
+        case 16000:
+        case 24000:
+        case 48000:
+            return sampleRate;
+        default:
+            return 48000;
+        }
+    }
+    return sampleRate;
+}
+
+QString codecName(AudioCodecType codec)
+{
+    return codec == AudioCodecType::opus ? "opus" : "aac";
+}
+
+AVCodecContext* open(const AudioEncoderParam& param, AVSampleFormat preferFmt, QString* errMsg)
+{
+    const AVCodec* codec = nullptr;
+    if (param.codec == AudioCodecType::opus) {
+        // FFmpeg原生opus编码器仍为实验性质且只支持20ms以上帧长，这里固定使用libopus
+        codec = avcodec_find_encoder_by_name("libopus");
+    } else {
+        codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+    }
+    if (!codec) {
+        if (errMsg) {
+            *errMsg = QString("找不到%1编码器").arg(codecName(param.codec));
+        }
+        return nullptr;
+    }
+
+    AVCodecContext* ctx = avcodec_alloc_context3(codec);
+    if (!ctx) {
+        if (errMsg) {
+            *errMsg = "无法分配音频编码器上下文";
+        }
+        return nullptr;
+    }
+
+    int sampleRate = encoderSampleRate(param.codec, param.sampleRate);
+    ctx->codec_type = AVMEDIA_TYPE_AUDIO;
+    ctx->codec_id = codec->id;
+    ctx->sample_rate = sampleRate;
+    ctx->channels = param.channels;
+    ctx->channel_layout = av_get_default_channel_layout(param.channels);
+    ctx->sample_fmt = isSampleFmtSupported(codec, preferFmt) ? preferFmt : codec->sample_fmts[0];
+    ctx->bit_rate = param.bitrate;
+    ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    ctx->time_base = {1, sampleRate};
+
+    AVDictionary* opts = nullptr;
+    if (param.codec == AudioCodecType::opus) {
+        // 桌面会话以语音为主，voip模式下SILK/混合模式才能启用DTX
+        int frameMs = (param.opusFrameMs == 10) ? 10 : 20;
+        av_dict_set(&opts, "application", "voip", 0);
+        av_dict_set_int(&opts, "frame_duration", frameMs, 0);
+        av_dict_set(&opts, "vbr", "constrained", 0);
+        if (param.opusDtx) {
+            av_dict_set(&opts, "dtx", "1", 0);
+        }
+    } else {
+        av_dict_set(&opts, "strict", "experimental", 0);
+    }
+
+    int ret = avcodec_open2(ctx, codec, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        char errbuf[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, errbuf, AV_ERROR_MAX_STRING_SIZE);
+        if (errMsg) {
+            *errMsg = QString("打开%1编码器失败: %2").arg(codecName(param.codec)).arg(errbuf);
+        }
+        avcodec_free_context(&ctx);
+        return nullptr;
+    }
+
+    LogInfo << QString("【音频编码】%1 采样率:%2 通道数:%3 码率:%4 帧长:%5采样")
+                   .arg(codecName(param.codec)).arg(ctx->sample_rate).arg(ctx->channels)
+                   .arg(ctx->bit_rate).arg(ctx->frame_size);
+    return ctx;
+}
+} // namespace AudioEncoder
@@ -0,0 +1,34 @@
+﻿// AudioEncoder.h
+#ifndef AUDIOENCODER_H
+#define AUDIOENCODER_H
+
+#include <QString>
+#include "DataStruct.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// 音频编码参数
+struct AudioEncoderParam {
+    AudioCodecType codec = AudioCodecType::aac;
+    int sampleRate = 44100;
+    int channels = 2;
+    int bitrate = 64000;        // bps
+    int opusFrameMs = 20;       // Opus帧长，支持10/20ms
+    bool opusDtx = false;       // Opus静音不连续传输(DTX)
+};
+
+namespace AudioEncoder
+{
+// 编码器实际使用的采样率（Opus仅支持8/12/16/24/48kHz，其余统一使用48kHz）
+int encoderSampleRate(AudioCodecType codec, int sampleRate);
+
+// 创建并打开音频编码器，preferFmt不被编码器支持时使用编码器首选格式
+// 失败返回nullptr，errMsg中给出原因
+AVCodecContext* open(const AudioEncoderParam& param, AVSampleFormat preferFmt, QString* errMsg);
+
+QString codecName(AudioCodecType codec);
+} // namespace AudioEncoder
+
+#endif // AUDIOENCODER_H
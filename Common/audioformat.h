@@ -0,0 +1,87 @@
+﻿// AudioFormat.h
+#ifndef AUDIOFORMAT_H
+#define AUDIOFORMAT_H
+
+#include <QAudioFormat>
+#include <QAudioDeviceInfo>
+#include <QString>
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+}
+
+namespace AudioFormat
+{
+// Qt采集格式对应的FFmpeg采样格式，不支持时返回AV_SAMPLE_FMT_NONE
+inline AVSampleFormat toSampleFormat(const QAudioFormat& format)
+{
+    if (format.byteOrder() != QAudioFormat::LittleEndian) {
+        return AV_SAMPLE_FMT_NONE;
+    }
+    switch (format.sampleSize()) {
+    case 8:
+        return format.sampleType() == QAudioFormat::UnSignedInt ? AV_SAMPLE_FMT_U8 : AV_SAMPLE_FMT_NONE;
+    case 16:
+        return format.sampleType() == QAudioFormat::SignedInt ? AV_SAMPLE_FMT_S16 : AV_SAMPLE_FMT_NONE;
+    case 32:
+        if (format.sampleType() == QAudioFormat::SignedInt) {
+            return AV_SAMPLE_FMT_S32;
+        }
+        return format.sampleType() == QAudioFormat::Float ? AV_SAMPLE_FMT_FLT : AV_SAMPLE_FMT_NONE;
+    default:
+        return AV_SAMPLE_FMT_NONE;
+    }
+}
+
+// FFmpeg交错采样格式对应的Qt格式，用于按录制文件的格式回放
+inline bool fromSampleFormat(AVSampleFormat sampleFmt, int sampleRate, int channels, QAudioFormat* format)
+{
+    switch (sampleFmt) {
+    case AV_SAMPLE_FMT_U8:
+        format->setSampleSize(8);
+        format->setSampleType(QAudioFormat::UnSignedInt);
+        break;
+    case AV_SAMPLE_FMT_S16:
+        format->setSampleSize(16);
+        format->setSampleType(QAudioFormat::SignedInt);
+        break;
+    case AV_SAMPLE_FMT_S32:
+        format->setSampleSize(32);
+        format->setSampleType(QAudioFormat::SignedInt);
+        break;
+    case AV_SAMPLE_FMT_FLT:
+        format->setSampleSize(32);
+        format->setSampleType(QAudioFormat::Float);
+        break;
+    default:
+        return false;
+    }
+    format->setSampleRate(sampleRate);
+    format->setChannelCount(channels);
+    format->setCodec("audio/pcm");
+    format->setByteOrder(QAudioFormat::LittleEndian);
+    return true;
+}
+
+inline QString describe(const QAudioFormat& format)
+{
+    return QString("%1Hz %2ch %3bit").arg(format.sampleRate())
+        .arg(format.channelCount()).arg(format.sampleSize());
+}
+
+// 按名称查找输入设备（包含匹配，空或"default"为默认输入设备），找不到返回空设备
+inline QAudioDeviceInfo findInputDevice(const QString& name)
+{
+    if (name.isEmpty() || name == "default") {
+        return QAudioDeviceInfo::defaultInputDevice();
+    }
+    for (auto &dev : QAudioDeviceInfo::availableDevices(QAudio::AudioInput)) {
+        if (dev.deviceName().contains(name, Qt::CaseInsensitive)) {
+            return dev;
+        }
+    }
+    return QAudioDeviceInfo();
+}
+} // namespace AudioFormat
+
+#endif // AUDIOFORMAT_H
@@ -0,0 +1,155 @@
+﻿// AudioResampler.cpp
+#include "audioresampler.h"
+#include "Logger.h"
+
+extern "C" {
+#include <libswresample/swresample.h>
+#include <libavutil/audio_fifo.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+}
+
+AudioResampler::~AudioResampler()
+{
+    release();
+}
+
+static SwrContext* allocContext(int inRate, int inChannels, AVSampleFormat inFmt,
+                                int outRate, int outChannels, AVSampleFormat outFmt, bool soxr)
+{
+    SwrContext* swr = swr_alloc_set_opts(nullptr,
+                                         av_get_default_channel_layout(outChannels), outFmt, outRate,
+                                         av_get_default_channel_layout(inChannels), inFmt, inRate,
+                                         0, nullptr);
+    if (!swr) {
+        return nullptr;
+    }
+    if (inRate != outRate) {
+        if (soxr) {
+            av_opt_set_int(swr, "resampler", SWR_ENGINE_SOXR, 0);
+            av_opt_set_int(swr, "precision", 20, 0);        // 20bit精度，对应soxr HQ
+        } else {
+            // 滤波器参数用swr默认值；S16输入时内部也按float平面处理，走swr的SSE/AVX重采样路径
+            av_opt_set_sample_fmt(swr, "internal_sample_fmt", AV_SAMPLE_FMT_FLTP, 0);
+        }
+    }
+    if (swr_init(swr) < 0) {
+        swr_free(&swr);
+        return nullptr;
+    }
+    return swr;
+}
+
+SwrContext* AudioResampler::createContext(int inRate, int inChannels, AVSampleFormat inFmt,
+                                          int outRate, int outChannels, AVSampleFormat outFmt,
+                                          QString* engine, bool allowSoxr)
+{
+    SwrContext* swr = nullptr;
+    if (inRate != outRate && allowSoxr) {
+        swr = allocContext(inRate, inChannels, inFmt, outRate, outChannels, outFmt, true);
+        if (swr) {
+            if (engine) {
+                *engine = "soxr";
+            }
+            return swr;
+        }
+    }
+    swr = allocContext(inRate, inChannels, inFmt, outRate, outChannels, outFmt, false);
+    if (swr && engine) {
+        *engine = (inRate != outRate) ? "swr" : "none";
+    }
+    return swr;
+}
+
+bool AudioResampler::init(int inRate, int inChannels, AVSampleFormat inFmt,
+                          int outRate, int outChannels, AVSampleFormat outFmt)
+{
+    release();
+    m_swrCtx = createContext(inRate, inChannels, inFmt, outRate, outChannels, outFmt, &m_engine);
+    if (!m_swrCtx) {
+        LogErr << "【重采样】swr上下文初始化失败";
+        return false;
+    }
+    m_fifo = av_audio_fifo_alloc(outFmt, outChannels, outRate / 10);
+    if (!m_fifo) {
+        release();
+        return false;
+    }
+    m_inRate = inRate;
+    m_outRate = outRate;
+    m_outChannels = outChannels;
+    m_outFmt = outFmt;
+    m_inBytesPerFrame = av_get_bytes_per_sample(inFmt) * inChannels;
+
+    LogInfo << QString("【重采样】%1Hz/%2ch/%3 -> %4Hz/%5ch/%6 引擎:%7")
+                   .arg(inRate).arg(inChannels).arg(av_get_sample_fmt_name(inFmt))
+                   .arg(outRate).arg(outChannels).arg(av_get_sample_fmt_name(outFmt)).arg(m_engine);
+    return true;
+}
+
+void AudioResampler::release()
+{
+    if (m_swrCtx) {
+        swr_free(&m_swrCtx);
+    }
+    if (m_fifo) {
+        av_audio_fifo_free(m_fifo);
+        m_fifo = nullptr;
+    }
+    if (m_convData) {
+        av_freep(&m_convData[0]);
+        av_freep(&m_convData);
+    }
+    m_convCapacity = 0;
+}
+
+bool AudioResampler::write(const uint8_t* data, int inSamples)
+{
+    if (!m_swrCtx || !data || inSamples <= 0) {
+        return false;
+    }
+
+    int outCap = swr_get_out_samples(m_swrCtx, inSamples);
+    if (outCap > m_convCapacity) {
+        if (m_convData) {
+            av_freep(&m_convData[0]);
+            av_freep(&m_convData);
+        }
+        if (av_samples_alloc_array_and_samples(&m_convData, nullptr, m_outChannels,
+                                               outCap, m_outFmt, 0) < 0) {
+            m_convCapacity = 0;
+            return false;
+        }
+        m_convCapacity = outCap;
+    }
+
+    int got = swr_convert(m_swrCtx, m_convData, outCap, &data, inSamples);
+    if (got < 0) {
+        return false;
+    }
+    return av_audio_fifo_write(m_fifo, reinterpret_cast<void**>(m_convData), got) == got;
+}
+
+int AudioResampler::available() const
+{
+    return m_fifo ? av_audio_fifo_size(m_fifo) : 0;
+}
+
+int AudioResampler::read(AVFrame* frame, int samples)
+{
+    if (!m_fifo || !frame) {
+        return 0;
+    }
+    return av_audio_fifo_read(m_fifo, reinterpret_cast<void**>(frame->data), samples);
+}
+
+void AudioResampler::reset()
+{
+    if (m_fifo) {
+        av_audio_fifo_reset(m_fifo);
+    }
+    if (m_swrCtx) {
+        // 丢弃重采样器内部缓存的延迟采样
+        swr_init(m_swrCtx);
+    }
+}
@@ -0,0 +1,60 @@
+﻿// AudioResampler.h
+#ifndef AUDIORESAMPLER_H
+#define AUDIORESAMPLER_H
+
+#include <QString>
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+#include <libavutil/frame.h>
+}
+
+struct SwrContext;
+struct AVAudioFifo;
+
+// 采集格式到编码格式的重采样：输入为任意交错PCM，输出按编码器格式缓存在FIFO中，
+// 采样率不同时输入/输出采样数不再一一对应，编码帧只能从输出侧按frame_size取出
+class AudioResampler
+{
+public:
+    AudioResampler() = default;
+    ~AudioResampler();
+    AudioResampler(const AudioResampler&) = delete;
+    AudioResampler& operator=(const AudioResampler&) = delete;
+
+    // 创建高质量重采样上下文：优先soxr，未编译soxr时使用swr内置重采样器（内部float平面格式，走SIMD路径）
+    static SwrContext* createContext(int inRate, int inChannels, AVSampleFormat inFmt,
+                                     int outRate, int outChannels, AVSampleFormat outFmt,
+                                     QString* engine = nullptr, bool allowSoxr = true);
+
+    bool init(int inRate, int inChannels, AVSampleFormat inFmt,
+              int outRate, int outChannels, AVSampleFormat outFmt);
+    void release();
+
+    // 转换交错输入PCM并写入FIFO，inSamples为每通道采样数
+    bool write(const uint8_t* data, int inSamples);
+    // FIFO中可读的输出采样数
+    int available() const;
+    // 从FIFO读取samples个采样到frame（frame需已按输出格式分配缓冲）
+    int read(AVFrame* frame, int samples);
+    void reset();
+
+    int inRate() const { return m_inRate; }
+    int outRate() const { return m_outRate; }
+    int inBytesPerFrame() const { return m_inBytesPerFrame; }
+    QString engine() const { return m_engine; }
+
+private:
+    SwrContext* m_swrCtx = nullptr;
+    AVAudioFifo* m_fifo = nullptr;
+    uint8_t** m_convData = nullptr;     // 转换中间缓冲
+    int m_convCapacity = 0;
+    int m_inRate = 0;
+    int m_outRate = 0;
+    int m_outChannels = 0;
+    AVSampleFormat m_outFmt = AV_SAMPLE_FMT_NONE;
+    int m_inBytesPerFrame = 0;
+    QString m_engine;
+};
+
+#endif // AUDIORESAMPLER_H
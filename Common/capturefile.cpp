@@ -0,0 +1,494 @@
+﻿// CaptureFile.cpp
+#include "capturefile.h"
+#include "Logger.h"
+#include <QThread>
+#include <climits>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/samplefmt.h>
+#include <libavutil/time.h>
+}
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+using namespace CaptureFile;
+
+namespace
+{
+const char FILE_MAGIC[8] = {'P', 'S', 'C', 'A', 'P', 0, 0, 1};
+const uint32_t FILE_VERSION = 1;
+const int FILE_HEADER_BYTES = 64;
+const int RECORD_ALIGN = 64;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerBytes;
+    int64_t createdWallUs;      // 录制开始的墙钟时间，仅供查看
+    uint8_t reserved[40];
+};
+static_assert(sizeof(FileHeader) == FILE_HEADER_BYTES, "capture file header layout");
+
+// 小端主机直接按内存布局读写
+struct RecordHeader {
+    uint8_t type;
+    uint8_t compression;
+    uint16_t reserved;
+    uint32_t storedBytes;
+    uint32_t rawBytes;
+    int32_t width;
+    int32_t height;
+    int32_t format;
+    int64_t captureUs;
+};
+static_assert(sizeof(RecordHeader) == 32, "capture record header layout");
+
+qint64 alignUp(qint64 value)
+{
+    return (value + RECORD_ALIGN - 1) / RECORD_ALIGN * RECORD_ALIGN;
+}
+
+// 记录头的尺寸与格式必须与负载长度一致，回放时按这些字段解释负载，不一致会越界读取
+QString checkRecord(const RecordHeader& rh)
+{
+    if (rh.compression != uint8_t(Compression::none) && rh.compression != uint8_t(Compression::lz4)) {
+        return QString("未知的压缩方式%1").arg(rh.compression);
+    }
+    if (rh.rawBytes == 0 || rh.rawBytes > uint32_t(INT_MAX) ||
+        (rh.compression == uint8_t(Compression::none) && rh.storedBytes != rh.rawBytes)) {
+        return QString("负载长度不一致(存储%1/原始%2字节)").arg(rh.storedBytes).arg(rh.rawBytes);
+    }
+    if (rh.type == uint8_t(RecordType::video)) {
+        const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(AVPixelFormat(rh.format));
+        int expected = desc && rh.width > 0 && rh.height > 0
+                           ? av_image_get_buffer_size(AVPixelFormat(rh.format), rh.width, rh.height, 1)
+                           : -1;
+        if (expected <= 0 || uint32_t(expected) != rh.rawBytes) {
+            return QString("视频帧%1x%2 格式%3 与负载%4字节不符")
+                .arg(rh.width).arg(rh.height).arg(rh.format).arg(rh.rawBytes);
+        }
+    } else {
+        int sampleBytes = rh.format >= 0 && rh.format < AV_SAMPLE_FMT_NB
+                              ? av_get_bytes_per_sample(AVSampleFormat(rh.format)) : 0;
+        if (sampleBytes <= 0 || rh.width <= 0 || rh.height <= 0 || rh.height > 64 ||
+            rh.rawBytes % uint32_t(sampleBytes * rh.height) != 0) {
+            return QString("音频分片%1Hz/%2ch 格式%3 与负载%4字节不符")
+                .arg(rh.width).arg(rh.height).arg(rh.format).arg(rh.rawBytes);
+        }
+    }
+    return QString();
+}
+} // namespace
+
+bool CaptureFile::lz4Available()
+{
+#ifdef HAVE_LZ4
+    return true;
+#else
+    return false;
+#endif
+}
+
+CaptureFileWriter::~CaptureFileWriter()
+{
+    close();
+}
+
+bool CaptureFileWriter::open(const QString& path, bool compress, QString* errMsg)
+{
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (errMsg) {
+            *errMsg = QString("创建录制文件失败: %1").arg(m_file.errorString());
+        }
+        return false;
+    }
+    if (compress && !lz4Available()) {
+        LogWarn << "【录制】未编译LZ4支持，按未压缩格式录制";
+    }
+    m_compress = compress && lz4Available();
+
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = FILE_VERSION;
+    header.headerBytes = FILE_HEADER_BYTES;
+    header.createdWallUs = av_gettime();
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    m_baseUs = av_gettime_relative();
+    m_records = 0;
+    m_bytesWritten = m_file.pos();
+    m_writeFailed = false;
+
+    QMutexLocker locker(&m_mutex);
+    m_queue.clear();
+    m_queuedBytes = 0;
+    m_dropped = 0;
+    m_stopping = false;
+    m_open = true;
+    m_writer = QThread::create([this] { writerLoop(); });
+    m_writer->setObjectName("CaptureWriter");
+    m_writer->start();
+    return true;
+}
+
+void CaptureFileWriter::close()
+{
+    QThread* writer = nullptr;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_open = false;
+        m_stopping = true;
+        m_queueReady.wakeAll();
+        writer = m_writer;
+        m_writer = nullptr;
+    }
+    if (writer) {
+        // 写出线程写完队列中剩余的记录后退出
+        writer->wait();
+        delete writer;
+    }
+    if (m_file.isOpen()) {
+        LogInfo << "【录制】录制结束:" << m_file.fileName() << m_records.load() << "条记录" << m_file.size()
+                << "字节，丢弃" << droppedCount() << "条";
+        m_file.close();
+    }
+    QMutexLocker locker(&m_mutex);
+    m_queue.clear();
+    m_queuedBytes = 0;
+    m_spareBuffers.clear();
+    m_compressBuffer.clear();
+}
+
+bool CaptureFileWriter::isOpen() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_open;
+}
+
+qint64 CaptureFileWriter::recordCount() const
+{
+    return m_records.load(std::memory_order_relaxed);
+}
+
+qint64 CaptureFileWriter::bytesWritten() const
+{
+    return m_bytesWritten.load(std::memory_order_relaxed);
+}
+
+qint64 CaptureFileWriter::droppedCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_dropped;
+}
+
+bool CaptureFileWriter::reserve(const RecordInfo& info, QByteArray* buffer)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_open) {
+        return false;
+    }
+    if (m_queuedBytes + info.rawBytes > MAX_QUEUED_BYTES) {
+        if (m_dropped++ % 100 == 0) {
+            LogWarn << "【录制】写出跟不上采集，队列已满，累计丢弃" << m_dropped << "条记录";
+        }
+        return false;
+    }
+    m_queuedBytes += info.rawBytes;
+    if (info.type == RecordType::video && !m_spareBuffers.isEmpty()) {
+        *buffer = m_spareBuffers.takeLast();
+    }
+    buffer->resize(info.rawBytes);
+    return true;
+}
+
+void CaptureFileWriter::enqueue(const RecordInfo& info, const QByteArray& data)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_open) {
+        m_queuedBytes -= info.rawBytes;     // reserve之后录制已关闭
+        return;
+    }
+    m_queue.enqueue(PendingRecord{info, data});
+    m_queueReady.wakeOne();
+}
+
+void CaptureFileWriter::writerLoop()
+{
+    QMutexLocker locker(&m_mutex);
+    while (true) {
+        while (m_queue.isEmpty() && !m_stopping) {
+            m_queueReady.wait(&m_mutex);
+        }
+        if (m_queue.isEmpty()) {
+            break;
+        }
+        PendingRecord record = m_queue.dequeue();
+        locker.unlock();
+        bool ok = writeRecord(record.info, reinterpret_cast<const uint8_t*>(record.data.constData()));
+        locker.relock();
+        m_queuedBytes -= record.info.rawBytes;
+        if (!ok) {
+            ++m_dropped;
+        }
+        if (record.info.type == RecordType::video && m_spareBuffers.size() < SPARE_BUFFERS) {
+            m_spareBuffers.append(record.data);
+        }
+    }
+}
+
+bool CaptureFileWriter::writeVideo(const AVFrame* frame, int64_t captureUs)
+{
+    if (!frame || frame->width <= 0 || frame->height <= 0) {
+        return false;
+    }
+    AVPixelFormat fmt = AVPixelFormat(frame->format);
+    int bytes = av_image_get_buffer_size(fmt, frame->width, frame->height, 1);
+    if (bytes <= 0) {
+        return false;
+    }
+
+    RecordInfo info;
+    info.type = RecordType::video;
+    info.captureUs = captureUs;
+    info.width = frame->width;
+    info.height = frame->height;
+    info.format = frame->format;
+    info.rawBytes = bytes;
+
+    QByteArray buffer;
+    if (!reserve(info, &buffer)) {
+        return false;
+    }
+    // 帧缓冲会被采集端复用，拷成紧凑排列后入队（带行填充或多平面时同时整理）
+    av_image_copy_to_buffer(reinterpret_cast<uint8_t*>(buffer.data()), bytes,
+                            frame->data, frame->linesize, fmt, frame->width, frame->height, 1);
+    enqueue(info, buffer);
+    return true;
+}
+
+bool CaptureFileWriter::writeAudio(const uint8_t* data, int bytes, int sampleRate, int channels,
+                                   int sampleFormat, int64_t captureUs)
+{
+    if (!data || bytes <= 0) {
+        return false;
+    }
+    RecordInfo info;
+    info.type = RecordType::audio;
+    info.captureUs = captureUs;
+    info.width = sampleRate;
+    info.height = channels;
+    info.format = sampleFormat;
+    info.rawBytes = bytes;
+
+    QByteArray buffer;
+    if (!reserve(info, &buffer)) {
+        return false;
+    }
+    memcpy(buffer.data(), data, size_t(bytes));
+    enqueue(info, buffer);
+    return true;
+}
+
+bool CaptureFileWriter::writeRecord(RecordInfo info, const uint8_t* data)
+{
+    const uint8_t* stored = data;
+    info.storedBytes = info.rawBytes;
+    info.compression = Compression::none;
+#ifdef HAVE_LZ4
+    if (m_compress) {
+        m_compressBuffer.resize(LZ4_compressBound(info.rawBytes));
+        int compressed = LZ4_compress_default(reinterpret_cast<const char*>(data), m_compressBuffer.data(),
+                                              info.rawBytes, m_compressBuffer.size());
+        if (compressed > 0 && compressed < info.rawBytes) {
+            stored = reinterpret_cast<const uint8_t*>(m_compressBuffer.constData());
+            info.storedBytes = compressed;
+            info.compression = Compression::lz4;
+        }
+    }
+#endif
+
+    RecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.type = uint8_t(info.type);
+    header.compression = uint8_t(info.compression);
+    header.storedBytes = uint32_t(info.storedBytes);
+    header.rawBytes = uint32_t(info.rawBytes);
+    header.width = info.width;
+    header.height = info.height;
+    header.format = info.format;
+    header.captureUs = info.captureUs - m_baseUs;
+
+    qint64 start = m_file.pos();
+    qint64 end = alignUp(start + qint64(sizeof(header)) + info.storedBytes);
+    static const char zeros[RECORD_ALIGN] = {};
+    bool ok = m_file.write(reinterpret_cast<const char*>(&header), sizeof(header)) == qint64(sizeof(header)) &&
+              m_file.write(reinterpret_cast<const char*>(stored), info.storedBytes) == info.storedBytes &&
+              m_file.write(zeros, end - m_file.pos()) >= 0;
+    if (!ok) {
+        if (!m_writeFailed) {
+            m_writeFailed = true;
+            LogErr << "【录制】写入录制文件失败:" << m_file.errorString();
+        }
+        return false;
+    }
+    ++m_records;
+    m_bytesWritten = m_file.pos();
+    return true;
+}
+
+CaptureFileReader::~CaptureFileReader()
+{
+    close();
+}
+
+bool CaptureFileReader::open(const QString& path, QString* errMsg)
+{
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        if (errMsg) {
+            *errMsg = QString("打开录制文件失败: %1").arg(m_file.errorString());
+        }
+        return false;
+    }
+    m_size = m_file.size();
+    m_data = m_size >= FILE_HEADER_BYTES ? m_file.map(0, m_size) : nullptr;
+    const FileHeader* header = reinterpret_cast<const FileHeader*>(m_data);
+    if (!m_data || memcmp(header->magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || header->version != FILE_VERSION ||
+        header->headerBytes < uint32_t(FILE_HEADER_BYTES) || header->headerBytes > m_size) {
+        if (errMsg) {
+            *errMsg = QString("不是有效的录制文件: %1").arg(path);
+        }
+        close();
+        return false;
+    }
+
+    bool compressed = false;
+    qint64 pos = header->headerBytes;
+    while (pos + qint64(sizeof(RecordHeader)) <= m_size) {
+        RecordHeader rh;
+        memcpy(&rh, m_data + pos, sizeof(rh));
+        qint64 payloadPos = pos + qint64(sizeof(rh));
+        if ((rh.type != uint8_t(RecordType::video) && rh.type != uint8_t(RecordType::audio)) ||
+            payloadPos + rh.storedBytes > m_size) {
+            LogWarn << "【回放】录制文件在偏移" << pos << "处不完整，忽略之后的数据";
+            break;
+        }
+        QString bad = checkRecord(rh);
+        if (!bad.isEmpty()) {
+            if (errMsg) {
+                *errMsg = QString("录制文件在偏移%1处的记录无效: %2").arg(pos).arg(bad);
+            }
+            close();
+            return false;
+        }
+        RecordInfo info;
+        info.type = RecordType(rh.type);
+        info.compression = Compression(rh.compression);
+        info.captureUs = rh.captureUs;
+        info.width = rh.width;
+        info.height = rh.height;
+        info.format = rh.format;
+        info.offset = payloadPos;
+        info.storedBytes = int(rh.storedBytes);
+        info.rawBytes = int(rh.rawBytes);
+        compressed |= info.compression != Compression::none;
+        m_records.append(info);
+        pos = alignUp(payloadPos + rh.storedBytes);
+    }
+
+    if (compressed && !lz4Available()) {
+        if (errMsg) {
+            *errMsg = "录制文件为LZ4压缩，当前程序未编译LZ4支持";
+        }
+        close();
+        return false;
+    }
+    if (m_records.isEmpty()) {
+        if (errMsg) {
+            *errMsg = QString("录制文件中没有记录: %1").arg(path);
+        }
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CaptureFileReader::close()
+{
+    if (m_data) {
+        m_file.unmap(m_data);
+        m_data = nullptr;
+    }
+    m_file.close();
+    m_size = 0;
+    m_records.clear();
+}
+
+QVector<int> CaptureFileReader::indicesOf(RecordType type) const
+{
+    QVector<int> indices;
+    for (int i = 0; i < m_records.size(); ++i) {
+        if (m_records[i].type == type) {
+            indices.append(i);
+        }
+    }
+    return indices;
+}
+
+const uint8_t* CaptureFileReader::payload(const RecordInfo& record) const
+{
+    if (!m_data || record.compression != Compression::none) {
+        return nullptr;
+    }
+    return m_data + record.offset;
+}
+
+bool CaptureFileReader::read(const RecordInfo& record, uint8_t* dst) const
+{
+    if (!m_data) {
+        return false;
+    }
+    const uint8_t* src = m_data + record.offset;
+    if (record.compression == Compression::none) {
+        memcpy(dst, src, size_t(record.rawBytes));
+        return true;
+    }
+#ifdef HAVE_LZ4
+    return LZ4_decompress_safe(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst),
+                               record.storedBytes, record.rawBytes) == record.rawBytes;
+#else
+    return false;
+#endif
+}
+
+int64_t CaptureFileReader::firstCaptureUs() const
+{
+    int64_t first = m_records.isEmpty() ? 0 : m_records.first().captureUs;
+    for (const RecordInfo& record : m_records) {
+        first = qMin(first, record.captureUs);    // 音视频写入顺序与采集顺序可能略有交错
+    }
+    return first;
+}
+
+int64_t CaptureFileReader::loopDurationUs() const
+{
+    int64_t last = firstCaptureUs();
+    for (const RecordInfo& record : m_records) {
+        last = qMax(last, record.captureUs);
+    }
+    QVector<int> video = indicesOf(RecordType::video);
+    int64_t frameGapUs = video.size() > 1
+                             ? (m_records[video.last()].captureUs - m_records[video.first()].captureUs) / (video.size() - 1)
+                             : 0;
+    return last - firstCaptureUs() + qMax<int64_t>(frameGapUs, 1);
+}
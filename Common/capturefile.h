@@ -0,0 +1,140 @@
+﻿// CaptureFile.h
+#ifndef CAPTUREFILE_H
+#define CAPTUREFILE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
+#include <cstdint>
+
+struct AVFrame;
+class QThread;
+
+// 采集录制文件（.pscap）：原始采集帧与设备PCM按到达顺序追加，回放时以相同内容和相同时序送回编码链路，
+// 用于复现真实桌面负载下的性能问题。
+// 布局：64字节文件头，之后每条记录为32字节记录头 + 负载，记录起始按64字节对齐，负载紧跟记录头因而只按32字节对齐
+// （未压缩负载可直接在映射内存上零拷贝使用）。
+// 时间为相对录制开始的微秒。文件不带索引，打开时顺序扫描记录头，录制异常中断时截断到最后一条完整记录仍可回放
+namespace CaptureFile
+{
+enum class RecordType : uint8_t {
+    video = 1,      // 像素数据，按av_image_copy_to_buffer(align=1)紧凑排列
+    audio = 2       // 设备送来的交错PCM，保持原始分片
+};
+
+enum class Compression : uint8_t {
+    none = 0,
+    lz4 = 1         // 逐条LZ4块压缩，需以HAVE_LZ4编译
+};
+
+struct RecordInfo {
+    RecordType type = RecordType::video;
+    Compression compression = Compression::none;
+    int64_t captureUs = 0;
+    int32_t width = 0;          // 视频宽度；音频为采样率
+    int32_t height = 0;         // 视频高度；音频为声道数
+    int32_t format = -1;        // AVPixelFormat / AVSampleFormat
+    qint64 offset = 0;          // 负载在文件中的偏移
+    int storedBytes = 0;
+    int rawBytes = 0;
+
+    int sampleRate() const { return width; }
+    int channels() const { return height; }
+};
+
+bool lz4Available();
+} // namespace CaptureFile
+
+// 录制端，视频采集线程与音频回调线程可并发写入。写入只拷贝数据放入有界队列，压缩与写文件在
+// 专用写出线程上进行，采集线程不会等磁盘；队列满时丢弃该条记录并计数
+class CaptureFileWriter
+{
+public:
+    CaptureFileWriter() = default;
+    ~CaptureFileWriter();
+
+    // compress为true且编译了LZ4时逐条压缩（压缩后不变小的记录仍按原样保存）
+    bool open(const QString& path, bool compress, QString* errMsg);
+    void close();
+    bool isOpen() const;
+
+    // captureUs为av_gettime_relative()时刻；返回false表示未录制（未打开或队列已满）
+    bool writeVideo(const AVFrame* frame, int64_t captureUs);
+    bool writeAudio(const uint8_t* data, int bytes, int sampleRate, int channels, int sampleFormat,
+                    int64_t captureUs);
+
+    qint64 recordCount() const;
+    qint64 bytesWritten() const;
+    // 队列已满或写文件失败而未录下的记录数
+    qint64 droppedCount() const;
+
+private:
+    struct PendingRecord {
+        CaptureFile::RecordInfo info;
+        QByteArray data;
+    };
+    // 在队列中预留info.rawBytes字节并取一块缓冲（视频优先复用写完的帧缓冲），超出队列上限时记为丢弃并返回false
+    bool reserve(const CaptureFile::RecordInfo& info, QByteArray* buffer);
+    void enqueue(const CaptureFile::RecordInfo& info, const QByteArray& data);
+    void writerLoop();
+    bool writeRecord(CaptureFile::RecordInfo info, const uint8_t* data);
+
+    mutable QMutex m_mutex;         // 保护以下队列与状态
+    QWaitCondition m_queueReady;
+    QQueue<PendingRecord> m_queue;
+    QVector<QByteArray> m_spareBuffers;     // 写完的视频帧缓冲，下一帧复用，避免每帧分配数MB
+    qint64 m_queuedBytes = 0;
+    qint64 m_dropped = 0;
+    bool m_open = false;
+    bool m_stopping = false;
+    QThread* m_writer = nullptr;
+
+    // 以下只在写出线程上访问（open在线程启动前、close在线程退出后访问）
+    QFile m_file;
+    bool m_compress = false;
+    bool m_writeFailed = false;
+    int64_t m_baseUs = 0;
+    QByteArray m_compressBuffer;
+    std::atomic<qint64> m_records{0};
+    std::atomic<qint64> m_bytesWritten{0};
+
+    static const qint64 MAX_QUEUED_BYTES = 256 * 1024 * 1024;  // 1080p BGRA约30帧
+    static const int SPARE_BUFFERS = 4;
+};
+
+// 回放端，整个文件只读映射
+class CaptureFileReader
+{
+public:
+    CaptureFileReader() = default;
+    ~CaptureFileReader();
+
+    bool open(const QString& path, QString* errMsg);
+    void close();
+
+    const QVector<CaptureFile::RecordInfo>& records() const { return m_records; }
+    QVector<int> indicesOf(CaptureFile::RecordType type) const;
+
+    // 未压缩记录的负载指针（指向映射内存），压缩记录返回nullptr
+    const uint8_t* payload(const CaptureFile::RecordInfo& record) const;
+    // 把负载解压或拷贝到dst，dst至少rawBytes字节
+    bool read(const CaptureFile::RecordInfo& record, uint8_t* dst) const;
+
+    // 首条记录时间，回放以此为零点
+    int64_t firstCaptureUs() const;
+    // 循环回放的周期：首尾记录间隔加一个平均视频帧间隔，音视频两路共用以保持循环后的对齐
+    int64_t loopDurationUs() const;
+
+private:
+    QFile m_file;
+    uchar* m_data = nullptr;
+    qint64 m_size = 0;
+    QVector<CaptureFile::RecordInfo> m_records;
+};
+
+#endif // CAPTUREFILE_H
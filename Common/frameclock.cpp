@@ -0,0 +1,128 @@
+﻿// FrameClock.cpp
+#include "frameclock.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#elif defined(Q_OS_LINUX)
+#include <cerrno>
+#include <time.h>
+#else
+#include <chrono>
+#include <thread>
+#endif
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+#ifdef Q_OS_WIN
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+namespace
+{
+// 每个线程一个可等待计时器，线程退出时关闭句柄
+struct ThreadTimer {
+    HANDLE handle = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    ~ThreadTimer()
+    {
+        if (handle) {
+            CloseHandle(handle);
+        }
+    }
+};
+} // namespace
+#endif
+
+FrameClock::FrameClock(int fps)
+{
+    setFrameRate(fps);
+}
+
+void FrameClock::setFrameRate(int fps)
+{
+    m_fps = qMax(1, fps);
+    reset();
+}
+
+void FrameClock::reset()
+{
+    m_startUs = -1;
+    m_next = 0;
+}
+
+int64_t FrameClock::nowUs()
+{
+    return av_gettime_relative();
+}
+
+void FrameClock::sleepUntilUs(int64_t deadlineUs)
+{
+#ifdef Q_OS_WIN
+    // Windows没有按单调时钟的绝对睡眠，用高精度可等待计时器按剩余时长等待
+    int64_t remainUs = deadlineUs - nowUs();
+    if (remainUs <= 0) {
+        return;
+    }
+    thread_local ThreadTimer threadTimer;
+    HANDLE timer = threadTimer.handle;
+    LARGE_INTEGER due;
+    due.QuadPart = -remainUs * 10;      // 负值为相对时间，100ns单位
+    if (timer && SetWaitableTimer(timer, &due, 0, nullptr, nullptr, FALSE)) {
+        WaitForSingleObject(timer, INFINITE);
+    } else {
+        av_usleep(unsigned(remainUs));
+    }
+#elif defined(Q_OS_LINUX)
+    // av_gettime_relative在Linux上取自CLOCK_MONOTONIC，可直接作为绝对截止时刻
+    timespec ts;
+    ts.tv_sec = time_t(deadlineUs / 1000000);
+    ts.tv_nsec = long(deadlineUs % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+#else
+    // macOS等没有clock_nanosleep，且av_gettime_relative的时钟源不一定是steady_clock，换算到steady_clock上等待
+    int64_t remainUs = deadlineUs - nowUs();
+    if (remainUs > 0) {
+        std::this_thread::sleep_until(std::chrono::steady_clock::now() + std::chrono::microseconds(remainUs));
+    }
+#endif
+}
+
+FrameClock::Tick FrameClock::wait()
+{
+    int64_t now = nowUs();
+    if (m_startUs < 0) {
+        m_startUs = now;
+        m_next = 0;
+    }
+
+    Tick tick;
+    int64_t periodUs = 1000000 / m_fps;
+    int64_t dueUs = tickUs(m_next);
+    int64_t behindUs = now - dueUs;
+    if (behindUs > periodUs / 2) {
+        // 错过截止时刻：跳到离当前最近的后续tick，而不是把欠下的帧连续补出
+        int64_t skip = (behindUs + periodUs / 2) / periodUs;
+        m_next += skip;
+        tick.skipped = int(skip);
+        m_skipped.fetch_add(skip, std::memory_order_relaxed);
+        m_missed.fetch_add(1, std::memory_order_relaxed);
+        dueUs = tickUs(m_next);
+    }
+    if (dueUs > now) {
+        sleepUntilUs(dueUs);
+        now = nowUs();
+    }
+
+    tick.index = m_next++;
+    tick.dueUs = dueUs;
+    tick.latenessUs = qMax<int64_t>(0, now - dueUs);
+    m_ticks.fetch_add(1, std::memory_order_relaxed);
+    int64_t prevMax = m_maxLatenessUs.load(std::memory_order_relaxed);
+    while (tick.latenessUs > prevMax &&
+           !m_maxLatenessUs.compare_exchange_weak(prevMax, tick.latenessUs, std::memory_order_relaxed)) {
+    }
+    return tick;
+}
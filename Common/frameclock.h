@@ -0,0 +1,55 @@
+﻿// FrameClock.h
+#ifndef FRAMECLOCK_H
+#define FRAMECLOCK_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <cstdint>
+
+// 采集帧时钟：第k个tick的时刻为 起点 + k * 1s/fps，按绝对时刻睡眠（Linux为
+// clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME)），睡眠误差不会逐帧累积。
+// 上一帧处理超时而落后超过半个周期时，直接跳过已错过的tick对齐到下一个tick，
+// 不连续突发补帧，保证编码器拿到的帧间隔均匀
+class FrameClock
+{
+public:
+    struct Tick {
+        int64_t index = 0;          // tick序号
+        int64_t dueUs = 0;          // 计划时刻（av_gettime_relative时基）
+        int64_t latenessUs = 0;     // 实际唤醒晚于计划时刻的时长，即采集抖动
+        int skipped = 0;            // 本次跳过的tick数，>0表示错过了截止时刻
+    };
+
+    explicit FrameClock(int fps = 30);
+
+    void setFrameRate(int fps);
+    int frameRate() const { return m_fps; }
+    // 下次wait()以当前时刻为起点重新计时
+    void reset();
+    // 阻塞到下一个tick
+    Tick wait();
+
+    // 累计统计，可在其他线程读取
+    qint64 ticks() const { return m_ticks.load(std::memory_order_relaxed); }
+    qint64 skippedTicks() const { return m_skipped.load(std::memory_order_relaxed); }
+    qint64 missedDeadlines() const { return m_missed.load(std::memory_order_relaxed); }
+    qint64 maxLatenessUs() const { return m_maxLatenessUs.load(std::memory_order_relaxed); }
+
+    // 单调时钟（微秒），与av_gettime_relative同一时基
+    static int64_t nowUs();
+    // 睡眠到单调时钟的绝对时刻
+    static void sleepUntilUs(int64_t deadlineUs);
+
+private:
+    int64_t tickUs(int64_t index) const { return m_startUs + index * 1000000 / m_fps; }
+
+    int m_fps = 30;
+    int64_t m_startUs = -1;
+    int64_t m_next = 0;
+    std::atomic<int64_t> m_ticks{0};
+    std::atomic<int64_t> m_skipped{0};
+    std::atomic<int64_t> m_missed{0};
+    std::atomic<int64_t> m_maxLatenessUs{0};
+};
+
+#endif // FRAMECLOCK_H
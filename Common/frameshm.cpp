@@ -0,0 +1,435 @@
+﻿// FrameShm.cpp
+#include "frameshm.h"
+#include <cstring>
+#include "Logger.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace FrameShm;
+
+namespace
+{
+const int MIN_SLOTS = 2;
+const int MAX_SLOTS = 64;
+
+qint64 align64(qint64 n)
+{
+    return (n + 63) & ~qint64(63);
+}
+
+#ifdef Q_OS_WIN
+QString objectName(const QString& name)
+{
+    return "Local\\" + name;
+}
+#else
+QByteArray objectName(const QString& name)
+{
+    return "/" + name.toUtf8();
+}
+#endif
+
+bool validName(const QString& name, QString* errMsg)
+{
+    if (name.isEmpty() || name.contains('/') || name.contains('\\') || name.size() > 200) {
+        *errMsg = QString("invalid shared memory name: %1").arg(name);
+        return false;
+    }
+    return true;
+}
+
+bool createMapping(const QString& name, qint64 size, Mapping* out, QString* errMsg)
+{
+#ifdef Q_OS_WIN
+    HANDLE handle = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(size >> 32),
+                                       DWORD(size & 0xffffffff), reinterpret_cast<LPCWSTR>(objectName(name).utf16()));
+    if (!handle) {
+        *errMsg = QString("CreateFileMapping failed: %1").arg(GetLastError());
+        return false;
+    }
+    // 同名对象只要还有句柄（如读端未退出）就不会被销毁，此时得到的是旧对象，大小为旧的大小
+    bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+    void* base = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (!base || VirtualQuery(base, &info, sizeof(info)) == 0) {
+        *errMsg = QString("MapViewOfFile failed: %1").arg(GetLastError());
+        if (base) {
+            UnmapViewOfFile(base);
+        }
+        CloseHandle(handle);
+        return false;
+    }
+    if (qint64(info.RegionSize) < size) {
+        *errMsg = QString("existing shared memory is %1 bytes, %2 required; close readers of the previous session")
+                      .arg(qint64(info.RegionSize)).arg(size);
+        UnmapViewOfFile(base);
+        CloseHandle(handle);
+        return false;
+    }
+    out->handle = handle;
+    out->existed = existed;
+#else
+    // 上次异常退出留下的同名对象直接替换，已映射旧对象的读端不受影响
+    QByteArray path = objectName(name);
+    shm_unlink(path.constData());
+    int fd = shm_open(path.constData(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        *errMsg = QString("shm_open %1 failed: %2").arg(QString(path), strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, off_t(size)) != 0) {
+        *errMsg = QString("ftruncate failed: %1").arg(strerror(errno));
+        ::close(fd);
+        shm_unlink(path.constData());
+        return false;
+    }
+    void* base = mmap(nullptr, size_t(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        *errMsg = QString("mmap failed: %1").arg(strerror(errno));
+        ::close(fd);
+        shm_unlink(path.constData());
+        return false;
+    }
+    out->fd = fd;
+#endif
+    out->base = static_cast<uint8_t*>(base);
+    out->size = size;
+    return true;
+}
+
+bool openMapping(const QString& name, Mapping* out, QString* errMsg)
+{
+#ifdef Q_OS_WIN
+    HANDLE handle = OpenFileMappingW(FILE_MAP_READ, FALSE, reinterpret_cast<LPCWSTR>(objectName(name).utf16()));
+    if (!handle) {
+        *errMsg = QString("OpenFileMapping failed: %1").arg(GetLastError());
+        return false;
+    }
+    void* base = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+    MEMORY_BASIC_INFORMATION info;
+    if (!base || VirtualQuery(base, &info, sizeof(info)) == 0) {
+        *errMsg = QString("MapViewOfFile failed: %1").arg(GetLastError());
+        if (base) {
+            UnmapViewOfFile(base);
+        }
+        CloseHandle(handle);
+        return false;
+    }
+    out->handle = handle;
+    out->size = qint64(info.RegionSize);
+#else
+    QByteArray path = objectName(name);
+    int fd = shm_open(path.constData(), O_RDONLY, 0);
+    if (fd < 0) {
+        *errMsg = QString("shm_open %1 failed: %2").arg(QString(path), strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < HEADER_BYTES) {
+        *errMsg = "shared memory not ready";
+        ::close(fd);
+        return false;
+    }
+    void* base = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        *errMsg = QString("mmap failed: %1").arg(strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    out->fd = fd;
+    out->size = st.st_size;
+#endif
+    out->base = static_cast<uint8_t*>(base);
+    return true;
+}
+
+void releaseMapping(Mapping* mapping)
+{
+    if (!mapping->base) {
+        return;
+    }
+#ifdef Q_OS_WIN
+    UnmapViewOfFile(mapping->base);
+    CloseHandle(mapping->handle);
+    mapping->handle = nullptr;
+#else
+    munmap(mapping->base, size_t(mapping->size));
+    ::close(mapping->fd);
+    mapping->fd = -1;
+#endif
+    mapping->base = nullptr;
+    mapping->size = 0;
+}
+
+SlotHeader* slotAt(uint8_t* base, const Header* header, uint32_t index)
+{
+    return reinterpret_cast<SlotHeader*>(base + HEADER_BYTES + qint64(index) * header->slotBytes);
+}
+} // namespace
+
+FrameShmPublisher::~FrameShmPublisher()
+{
+    close();
+}
+
+bool FrameShmPublisher::open(const QString& name, Source source, int slotCount, QString* errMsg)
+{
+    if (!validName(name, errMsg)) {
+        return false;
+    }
+    if (slotCount < MIN_SLOTS || slotCount > MAX_SLOTS) {
+        *errMsg = QString("shared memory slot count must be %1-%2").arg(MIN_SLOTS).arg(MAX_SLOTS);
+        return false;
+    }
+    close();
+    QMutexLocker locker(&m_mutex);
+    m_name = name;
+    m_source = source;
+    m_slotCount = slotCount;
+    m_open = true;
+    m_failed = false;
+    m_published = 0;
+    m_publishedBase = 0;
+    m_dropped = 0;
+    return true;
+}
+
+void FrameShmPublisher::close()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_open) {
+        return;
+    }
+    unmap();
+    m_open = false;
+    if (m_published > m_publishedBase || m_dropped > 0) {
+        LogInfo << "【共享内存】" << m_name << "关闭，发布" << m_published - m_publishedBase << "帧，丢弃" << m_dropped << "帧";
+    }
+}
+
+bool FrameShmPublisher::isOpen() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_open;
+}
+
+bool FrameShmPublisher::map(int frameBytes)
+{
+    // 数据区留出余量，源帧尺寸小幅变化（如窗口采集）时无需重建
+    qint64 maxFrameBytes = align64(frameBytes + frameBytes / 4);
+    qint64 slotBytes = SLOT_HEADER_BYTES + maxFrameBytes;
+    if (slotBytes > UINT32_MAX) {
+        LogErr << "【共享内存】单帧过大:" << frameBytes;
+        return false;
+    }
+    QString errMsg;
+    if (!createMapping(m_name, HEADER_BYTES + slotBytes * m_slotCount, &m_mapping, &errMsg)) {
+        LogErr << "【共享内存】创建失败:" << errMsg;
+        return false;
+    }
+    m_header = reinterpret_cast<Header*>(m_mapping.base);
+#ifdef Q_OS_WIN
+    if (m_mapping.existed) {
+        // 沿用旧对象时布局必须完全一致且上一个发布端已关闭，否则写入会越界或与另一个发布端冲突。
+        // 槽的sequence与published继续递增，仍映射着的读端可直接读到新帧
+        const Header* old = m_header;
+        if (old->magic.load(std::memory_order_acquire) != MAGIC || old->version != VERSION ||
+            old->slotCount != uint32_t(m_slotCount) || old->slotBytes != uint32_t(slotBytes) ||
+            old->maxFrameBytes != uint32_t(maxFrameBytes) || old->closed.load(std::memory_order_acquire) == 0) {
+            LogErr << "【共享内存】同名共享内存仍被占用且布局不同:" << m_name;
+            m_header = nullptr;
+            releaseMapping(&m_mapping);
+            return false;
+        }
+        m_header->source = uint32_t(m_source);
+        uint64_t published = m_header->published.load(std::memory_order_acquire);
+        m_publishedBase += published - m_published;
+        m_published = published;
+        m_header->closed.store(0, std::memory_order_release);
+        LogInfo << "【共享内存】沿用" << m_name << m_slotCount << "槽，每槽" << slotBytes / 1024 << "KB";
+        return true;
+    }
+#endif
+    // 新建的共享内存为全零，即各槽sequence为0（空闲）；magic最后写入，读端据此判断就绪
+    m_header->version = VERSION;
+    m_header->slotCount = uint32_t(m_slotCount);
+    m_header->slotBytes = uint32_t(slotBytes);
+    m_header->maxFrameBytes = uint32_t(maxFrameBytes);
+    m_header->source = uint32_t(m_source);
+    m_header->magic.store(MAGIC, std::memory_order_release);
+    LogInfo << "【共享内存】" << m_name << m_slotCount << "槽，每槽" << slotBytes / 1024 << "KB";
+    return true;
+}
+
+void FrameShmPublisher::unmap()
+{
+    if (!m_header) {
+        return;
+    }
+    m_header->closed.store(1, std::memory_order_release);
+    releaseMapping(&m_mapping);
+    m_header = nullptr;
+#ifndef Q_OS_WIN
+    shm_unlink(objectName(m_name).constData());
+#endif
+}
+
+bool FrameShmPublisher::publish(const AVFrame* frame, int64_t captureUs)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_open || m_failed) {
+        return false;
+    }
+    int frameBytes = av_image_get_buffer_size(AVPixelFormat(frame->format), frame->width, frame->height, 1);
+    if (frameBytes <= 0) {
+        ++m_dropped;
+        return false;
+    }
+    if (!m_header && !map(frameBytes)) {
+        m_failed = true;
+        ++m_dropped;
+        return false;
+    }
+    if (uint32_t(frameBytes) > m_header->maxFrameBytes) {
+        if (m_dropped++ == 0) {
+            LogWarn << "【共享内存】帧大小超出槽容量，丢弃:" << frame->width << "x" << frame->height
+                    << av_get_pix_fmt_name(AVPixelFormat(frame->format));
+        }
+        return false;
+    }
+
+    uint32_t index = uint32_t(m_published % m_header->slotCount);
+    SlotHeader* slot = slotAt(m_mapping.base, m_header, index);
+    uint8_t* data = reinterpret_cast<uint8_t*>(slot) + SLOT_HEADER_BYTES;
+
+    // seqlock写：置奇数 -> 写元数据与像素 -> 置偶数，读端校验前后sequence一致
+    uint32_t seq = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    av_image_copy_to_buffer(data, frameBytes, frame->data, frame->linesize, AVPixelFormat(frame->format),
+                            frame->width, frame->height, 1);
+    uint8_t* planes[4] = {nullptr, nullptr, nullptr, nullptr};
+    int linesize[4] = {0, 0, 0, 0};
+    av_image_fill_arrays(planes, linesize, data, AVPixelFormat(frame->format), frame->width, frame->height, 1);
+    for (int i = 0; i < 4; ++i) {
+        slot->linesize[i] = linesize[i];
+        slot->planeOffset[i] = planes[i] ? uint32_t(planes[i] - data) : 0;
+    }
+    slot->width = frame->width;
+    slot->height = frame->height;
+    slot->format = frame->format;
+    slot->dataBytes = uint32_t(frameBytes);
+    slot->frameIndex = m_published;
+    slot->captureUs = captureUs;
+
+    slot->sequence.store(seq + 2, std::memory_order_release);
+    m_header->published.store(++m_published, std::memory_order_release);
+    return true;
+}
+
+qint64 FrameShmPublisher::published() const
+{
+    QMutexLocker locker(&m_mutex);
+    return qint64(m_published - m_publishedBase);
+}
+
+qint64 FrameShmPublisher::dropped() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_dropped;
+}
+
+FrameShmReader::~FrameShmReader()
+{
+    close();
+}
+
+bool FrameShmReader::open(const QString& name, QString* errMsg)
+{
+    close();
+    if (!validName(name, errMsg) || !openMapping(name, &m_mapping, errMsg)) {
+        return false;
+    }
+    const Header* header = reinterpret_cast<const Header*>(m_mapping.base);
+    uint32_t magic = header->magic.load(std::memory_order_acquire);
+    if (magic != MAGIC || header->version != VERSION ||
+        m_mapping.size < HEADER_BYTES + qint64(header->slotBytes) * header->slotCount) {
+        *errMsg = magic == 0 ? QString("shared memory not ready") : QString("not a frame ring: %1").arg(name);
+        releaseMapping(&m_mapping);
+        return false;
+    }
+    m_header = header;
+    return true;
+}
+
+void FrameShmReader::close()
+{
+    releaseMapping(&m_mapping);
+    m_header = nullptr;
+}
+
+bool FrameShmReader::latest(FrameView* view) const
+{
+    if (!m_header) {
+        return false;
+    }
+    uint64_t published = m_header->published.load(std::memory_order_acquire);
+    if (published == 0) {
+        return false;
+    }
+    uint32_t index = uint32_t((published - 1) % m_header->slotCount);
+    const SlotHeader* slot = slotAt(m_mapping.base, m_header, index);
+    uint32_t seq = slot->sequence.load(std::memory_order_acquire);
+    if (seq & 1) {
+        return false;   // 写端已绕回到该槽
+    }
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(slot) + SLOT_HEADER_BYTES;
+    for (int i = 0; i < 4; ++i) {
+        view->linesize[i] = slot->linesize[i];
+        view->data[i] = slot->linesize[i] > 0 ? data + slot->planeOffset[i] : nullptr;
+    }
+    view->width = slot->width;
+    view->height = slot->height;
+    view->format = slot->format;
+    view->dataBytes = int(slot->dataBytes);
+    view->frameIndex = slot->frameIndex;
+    view->captureUs = slot->captureUs;
+    view->slot = int(index);
+    view->sequence = seq;
+    // 元数据读完后再校验一次，避免拿到半新半旧的偏移
+    return validate(*view);
+}
+
+bool FrameShmReader::validate(const FrameView& view) const
+{
+    if (!m_header || view.slot < 0) {
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const SlotHeader* slot = slotAt(m_mapping.base, m_header, uint32_t(view.slot));
+    return slot->sequence.load(std::memory_order_relaxed) == view.sequence;
+}
+
+uint64_t FrameShmReader::published() const
+{
+    return m_header ? m_header->published.load(std::memory_order_acquire) : 0;
+}
+
+bool FrameShmReader::publisherClosed() const
+{
+    return !m_header || m_header->closed.load(std::memory_order_acquire) != 0;
+}
@@ -0,0 +1,157 @@
+﻿// FrameShm.h
+#ifndef FRAMESHM_H
+#define FRAMESHM_H
+
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+
+struct AVFrame;
+
+// 原始视频帧共享内存环：推流进程把每帧写入共享内存，本机其他进程（录制、分析、预览）只读映射后
+// 直接使用，不必各自再开一路x11grab。POSIX下为shm_open对象（/dev/shm/<name>），Windows下为
+// Local\<name>命名文件映射。
+// 布局：64字节文件头，之后slotCount个槽，每个槽为128字节槽头 + 像素数据（按64字节对齐）。
+// 像素按av_image_copy_to_buffer(align=1)紧凑排列，各平面的偏移与行字节记录在槽头中。
+// 每个槽用seqlock保护：写入前sequence置为奇数，写完置为下一个偶数；读端读数据前后各取一次
+// sequence，相同且为偶数才说明读到的是完整的一帧。写端从不等待读端，读端慢于slotCount帧时会读到
+// 被覆盖的槽（校验失败），此时取最新帧即可
+namespace FrameShm
+{
+const uint32_t MAGIC = 0x4d465350;      // "PSFM"
+const uint32_t VERSION = 1;
+const int HEADER_BYTES = 64;
+const int SLOT_HEADER_BYTES = 128;
+
+// 发布的帧：采集到的原始帧（屏幕一般为BGRA，尺寸为源尺寸）或转换后送入编码器的YUV帧
+enum class Source {
+    captured = 0,
+    converted
+};
+
+struct Header {
+    std::atomic<uint32_t> magic;        // 最后写入，非MAGIC时尚未就绪
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotBytes;                 // 槽头 + 数据区，64字节对齐
+    uint32_t maxFrameBytes;             // 单帧像素数据上限，更大的帧不发布
+    uint32_t source;                    // Source
+    std::atomic<uint32_t> closed;       // 发布端已关闭，之后不会再有新帧
+    uint32_t reserved0;
+    std::atomic<uint64_t> published;    // 已发布的帧数，最新一帧在槽(published-1)%slotCount
+    uint8_t reserved[24];
+};
+
+struct SlotHeader {
+    std::atomic<uint32_t> sequence;     // 奇数为写入中
+    int32_t width;
+    int32_t height;
+    int32_t format;                     // AVPixelFormat
+    int32_t linesize[4];
+    uint32_t planeOffset[4];            // 相对数据区起始
+    uint32_t dataBytes;
+    uint32_t reserved0;
+    uint64_t frameIndex;                // 从0起的发布序号
+    int64_t captureUs;                  // 采集时刻，av_gettime_relative（Linux为CLOCK_MONOTONIC，跨进程可比）
+    uint8_t reserved[56];
+};
+
+static_assert(sizeof(Header) == HEADER_BYTES, "FrameShm::Header layout");
+static_assert(sizeof(SlotHeader) == SLOT_HEADER_BYTES, "FrameShm::SlotHeader layout");
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+              "shared memory atomics must be lock free");
+
+// 读端拿到的一帧，data指向共享内存，不拷贝
+struct FrameView {
+    const uint8_t* data[4] = {nullptr, nullptr, nullptr, nullptr};
+    int linesize[4] = {0, 0, 0, 0};
+    int width = 0;
+    int height = 0;
+    int format = -1;
+    int dataBytes = 0;
+    uint64_t frameIndex = 0;
+    int64_t captureUs = 0;
+    // seqlock校验用
+    int slot = -1;
+    uint32_t sequence = 0;
+};
+
+// 平台相关的共享内存映射
+struct Mapping {
+    uint8_t* base = nullptr;
+    qint64 size = 0;
+#ifdef Q_OS_WIN
+    void* handle = nullptr;
+    bool existed = false;       // 同名对象仍被读端打开，内容为上次发布端留下的
+#else
+    int fd = -1;
+#endif
+};
+} // namespace FrameShm
+
+// 发布端，由视频编码线程调用publish；容量由第一帧决定，首帧到达时才创建共享内存
+class FrameShmPublisher
+{
+public:
+    FrameShmPublisher() = default;
+    ~FrameShmPublisher();
+
+    // name为不带路径的对象名；slotCount为环上的帧数（2-64），读端需在slotCount-1个帧间隔内用完一帧
+    bool open(const QString& name, FrameShm::Source source, int slotCount, QString* errMsg);
+    // 标记关闭并移除共享内存名，已映射的读端仍可读完最后的帧
+    void close();
+    bool isOpen() const;
+    FrameShm::Source source() const { return m_source; }
+
+    // captureUs为av_gettime_relative()时刻
+    bool publish(const AVFrame* frame, int64_t captureUs);
+
+    qint64 published() const;
+    qint64 dropped() const;
+
+private:
+    bool map(int frameBytes);
+    void unmap();
+
+    mutable QMutex m_mutex;
+    QString m_name;
+    FrameShm::Source m_source = FrameShm::Source::converted;
+    int m_slotCount = 0;
+    bool m_open = false;
+    bool m_failed = false;          // 创建映射失败后不再尝试，只计丢弃
+    FrameShm::Mapping m_mapping;
+    FrameShm::Header* m_header = nullptr;
+    uint64_t m_published = 0;          // 写入共享内存的发布序号，沿用旧对象时从旧值继续
+    uint64_t m_publishedBase = 0;      // open后本发布端发布的帧数为m_published - m_publishedBase
+    qint64 m_dropped = 0;
+};
+
+// 读端，只读映射。典型用法：
+//   FrameShm::FrameView view;
+//   if (reader.latest(&view)) { 处理view.data...; if (!reader.validate(view)) 丢弃结果; }
+class FrameShmReader
+{
+public:
+    FrameShmReader() = default;
+    ~FrameShmReader();
+
+    // 发布端尚未收到第一帧时共享内存还未就绪，返回false，稍后重试
+    bool open(const QString& name, QString* errMsg);
+    void close();
+    bool isOpen() const { return m_header != nullptr; }
+
+    // 取最新的完整帧；没有新帧或恰好被覆盖时返回false
+    bool latest(FrameShm::FrameView* view) const;
+    // 在用完view之后调用：返回false表示期间该槽已被写端覆盖，读到的内容不可信
+    bool validate(const FrameShm::FrameView& view) const;
+    uint64_t published() const;
+    // 发布端已关闭（推流进程退出）
+    bool publisherClosed() const;
+
+private:
+    FrameShm::Mapping m_mapping;
+    const FrameShm::Header* m_header = nullptr;
+};
+
+#endif // FRAMESHM_H
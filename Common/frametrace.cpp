@@ -0,0 +1,221 @@
+﻿// FrameTrace.cpp
+#include "frametrace.h"
+#include "Logger.h"
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/time.h>
+}
+
+namespace FrameTrace
+{
+std::atomic<bool> g_enabled{false};
+
+namespace
+{
+std::atomic<bool> g_stampsRequired{false};
+
+struct Event {
+    const char* stage;
+    int64_t frameId;
+    int64_t beginUs;
+    int64_t endUs;
+    Stream stream;
+};
+
+// 单写者环形缓冲：写满后覆盖最旧记录，导出时按写指针校验被覆盖的区间
+struct ThreadBuffer {
+    static const uint64_t CAPACITY = 32768;
+    Event events[CAPACITY];
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> clearedAt{0};
+    QString threadName;
+    int tid = 0;
+    bool inUse = true;          // 所属线程仍在运行，受g_registryMutex保护
+};
+
+QMutex g_registryMutex;
+// 线程退出后缓冲保留到被新线程复用为止，便于事后导出；缓冲个数不超过同时运行过的线程数
+std::vector<std::unique_ptr<ThreadBuffer>> g_buffers;
+thread_local ThreadBuffer* t_buffer = nullptr;
+
+// 线程退出时归还缓冲。与t_buffer分开，埋点的快速路径不经过thread_local析构的初始化检查
+struct BufferOwner {
+    ThreadBuffer* buffer = nullptr;
+    ~BufferOwner()
+    {
+        if (buffer) {
+            QMutexLocker locker(&g_registryMutex);
+            buffer->inUse = false;
+        }
+    }
+};
+thread_local BufferOwner t_owner;
+
+ThreadBuffer* threadBuffer()
+{
+    if (!t_buffer) {
+        QThread* thread = QThread::currentThread();
+        QString name = thread && !thread->objectName().isEmpty()
+                           ? thread->objectName()
+                           : QString(thread ? thread->metaObject()->className() : "thread");
+        QMutexLocker locker(&g_registryMutex);
+        for (const std::unique_ptr<ThreadBuffer>& buffer : g_buffers) {
+            if (!buffer->inUse) {
+                // 复用已退出线程的缓冲，丢弃其中的旧记录
+                buffer->inUse = true;
+                buffer->threadName = name;
+                buffer->clearedAt.store(buffer->head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                t_buffer = buffer.get();
+                break;
+            }
+        }
+        if (!t_buffer) {
+            std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer);
+            buffer->threadName = name;
+            buffer->tid = int(g_buffers.size()) + 1;
+            t_buffer = buffer.get();
+            g_buffers.push_back(std::move(buffer));
+        }
+        t_owner.buffer = t_buffer;
+    }
+    return t_buffer;
+}
+
+void freeStamps(void*, uint8_t* data)
+{
+    delete reinterpret_cast<FrameStamps*>(data);
+}
+} // namespace
+
+void setEnabled(bool on)
+{
+    g_enabled.store(on, std::memory_order_relaxed);
+    LogInfo << "【帧追踪】" << (on ? "已开启" : "已关闭");
+}
+
+int64_t nowUs()
+{
+    return av_gettime_relative();
+}
+
+void requireStamps()
+{
+    g_stampsRequired.store(true, std::memory_order_relaxed);
+}
+
+void record(const char* stage, Stream stream, int64_t frameId, int64_t beginUs, int64_t endUs)
+{
+    if (!enabled()) {
+        return;
+    }
+    ThreadBuffer* buffer = threadBuffer();
+    uint64_t index = buffer->head.load(std::memory_order_relaxed);
+    Event& ev = buffer->events[index % ThreadBuffer::CAPACITY];
+    ev.stage = stage;
+    ev.frameId = frameId;
+    ev.beginUs = beginUs;
+    ev.endUs = endUs;
+    ev.stream = stream;
+    buffer->head.store(index + 1, std::memory_order_release);
+}
+
+void attachStamps(AVFrame* frame, const FrameStamps& stamps)
+{
+    if (!frame || (!enabled() && !g_stampsRequired.load(std::memory_order_relaxed))) {
+        return;
+    }
+    FrameStamps* copy = new FrameStamps(stamps);
+    av_buffer_unref(&frame->opaque_ref);
+    frame->opaque_ref = av_buffer_create(reinterpret_cast<uint8_t*>(copy), sizeof(FrameStamps),
+                                         freeStamps, nullptr, 0);
+    if (!frame->opaque_ref) {
+        delete copy;
+    }
+}
+
+const FrameStamps* stamps(const AVFrame* frame)
+{
+    if (!frame || !frame->opaque_ref || frame->opaque_ref->size != int(sizeof(FrameStamps))) {
+        return nullptr;
+    }
+    return reinterpret_cast<const FrameStamps*>(frame->opaque_ref->data);
+}
+
+bool dumpChromeTrace(const QString& path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        LogErr << "【帧追踪】无法写入" << path;
+        return false;
+    }
+
+    QByteArray out("{\"traceEvents\":[\n");
+    bool first = true;
+    qint64 count = 0;
+    auto append = [&](const QByteArray& line) {
+        if (!first) {
+            out.append(",\n");
+        }
+        first = false;
+        out.append(line);
+    };
+
+    QMutexLocker locker(&g_registryMutex);
+    for (const std::unique_ptr<ThreadBuffer>& buffer : g_buffers) {
+        append(QString("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%1,\"args\":{\"name\":\"%2\"}}")
+                   .arg(buffer->tid).arg(buffer->threadName).toUtf8());
+
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t begin = head > ThreadBuffer::CAPACITY ? head - ThreadBuffer::CAPACITY : 0;
+        begin = qMax(begin, buffer->clearedAt.load(std::memory_order_relaxed));
+        std::vector<Event> events;
+        events.reserve(head - begin);
+        for (uint64_t i = begin; i < head; ++i) {
+            events.push_back(buffer->events[i % ThreadBuffer::CAPACITY]);
+        }
+        // 拷贝期间写线程可能已覆盖最旧的记录，丢弃这一段；newHead - CAPACITY所在的槽位
+        // 正被（或已被）第newHead条记录覆盖，同样丢弃
+        uint64_t newHead = buffer->head.load(std::memory_order_acquire);
+        uint64_t overwritten = newHead >= ThreadBuffer::CAPACITY ? newHead - ThreadBuffer::CAPACITY + 1 : 0;
+        for (uint64_t i = begin; i < head; ++i) {
+            if (i < overwritten) {
+                continue;
+            }
+            const Event& ev = events[i - begin];
+            append(QString("{\"ph\":\"X\",\"name\":\"%1\",\"cat\":\"%2\",\"pid\":1,\"tid\":%3,"
+                           "\"ts\":%4,\"dur\":%5,\"args\":{\"frame\":%6}}")
+                       .arg(ev.stage)
+                       .arg(ev.stream == Stream::video ? "video" : "audio")
+                       .arg(buffer->tid)
+                       .arg(ev.beginUs)
+                       .arg(qMax<int64_t>(0, ev.endUs - ev.beginUs))
+                       .arg(ev.frameId)
+                       .toUtf8());
+            ++count;
+        }
+    }
+    locker.unlock();
+
+    out.append("\n],\"displayTimeUnit\":\"ms\"}\n");
+    if (file.write(out) != out.size()) {
+        LogErr << "【帧追踪】写入失败" << path;
+        return false;
+    }
+    LogInfo << "【帧追踪】导出" << count << "条记录到" << path;
+    return true;
+}
+
+void clear()
+{
+    QMutexLocker locker(&g_registryMutex);
+    for (const std::unique_ptr<ThreadBuffer>& buffer : g_buffers) {
+        buffer->clearedAt.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+} // namespace FrameTrace
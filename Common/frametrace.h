@@ -0,0 +1,74 @@
+﻿// FrameTrace.h
+#ifndef FRAMETRACE_H
+#define FRAMETRACE_H
+
+#include <QString>
+#include <atomic>
+#include <cstdint>
+
+struct AVFrame;
+
+// 逐帧阶段耗时追踪：各线程把阶段区间写入自己的无锁环形缓冲，可导出为Chrome/Perfetto trace JSON。
+// 关闭时每个埋点只有一次relaxed原子读，运行中可随时开关
+namespace FrameTrace
+{
+enum class Stream : uint8_t {
+    video = 0,
+    audio
+};
+
+// 采集/解码阶段的时间戳，随采集帧通过AVFrame::opaque_ref传到编码线程。
+// 只在追踪开启或有延迟指标的使用方（requireStamps）时附加，否则每帧不做分配
+struct FrameStamps {
+    int64_t readBeginUs = 0;
+    int64_t readEndUs = 0;
+    int64_t decodeEndUs = 0;
+};
+
+extern std::atomic<bool> g_enabled;
+
+inline bool enabled()
+{
+    return g_enabled.load(std::memory_order_relaxed);
+}
+
+void setEnabled(bool on);
+int64_t nowUs();
+// 延迟指标端点、延迟SEI等依赖采集时刻（readEndUs）的功能开启时调用，之后与追踪开关无关总是附加
+void requireStamps();
+
+// 记录一个阶段区间，stage需为字符串字面量；frameId为流内帧标识（编码器时间基下的pts）
+void record(const char* stage, Stream stream, int64_t frameId, int64_t beginUs, int64_t endUs);
+
+// 附加/读取采集时间戳
+void attachStamps(AVFrame* frame, const FrameStamps& stamps);
+const FrameStamps* stamps(const AVFrame* frame);
+
+// 合并所有线程缓冲写出trace JSON（chrome://tracing 或 ui.perfetto.dev 打开）
+bool dumpChromeTrace(const QString& path);
+void clear();
+} // namespace FrameTrace
+
+// 作用域内的阶段区间，析构时记录；追踪关闭时不取时间
+class TraceSpan
+{
+public:
+    TraceSpan(const char* stage, FrameTrace::Stream stream, int64_t frameId = -1)
+        : m_stage(stage), m_stream(stream), m_frameId(frameId)
+        , m_beginUs(FrameTrace::enabled() ? FrameTrace::nowUs() : -1) {}
+    ~TraceSpan()
+    {
+        if (m_beginUs >= 0) {
+            FrameTrace::record(m_stage, m_stream, m_frameId, m_beginUs, FrameTrace::nowUs());
+        }
+    }
+    void setFrameId(int64_t frameId) { m_frameId = frameId; }
+
+private:
+    const char* m_stage;
+    FrameTrace::Stream m_stream;
+    int64_t m_frameId;
+    int64_t m_beginUs;
+};
+
+#endif // FRAMETRACE_H
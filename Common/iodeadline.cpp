@@ -0,0 +1,53 @@
+﻿// IoDeadline.cpp
+#include "iodeadline.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+}
+
+void IoDeadline::install(AVFormatContext* ctx)
+{
+    if (ctx) {
+        ctx->interrupt_callback.callback = &IoDeadline::interrupt;
+        ctx->interrupt_callback.opaque = this;
+    }
+}
+
+void IoDeadline::arm(int timeoutMs)
+{
+    m_expired.store(false, std::memory_order_relaxed);
+    m_deadlineUs.store(timeoutMs > 0 ? av_gettime_relative() + int64_t(timeoutMs) * 1000 : 0,
+                       std::memory_order_relaxed);
+}
+
+void IoDeadline::disarm()
+{
+    m_deadlineUs.store(0, std::memory_order_relaxed);
+}
+
+void IoDeadline::abort()
+{
+    m_aborted.store(true, std::memory_order_relaxed);
+}
+
+void IoDeadline::reset()
+{
+    m_aborted.store(false, std::memory_order_relaxed);
+    m_expired.store(false, std::memory_order_relaxed);
+    m_deadlineUs.store(0, std::memory_order_relaxed);
+}
+
+int IoDeadline::interrupt(void* opaque)
+{
+    IoDeadline* self = static_cast<IoDeadline*>(opaque);
+    if (self->m_aborted.load(std::memory_order_relaxed)) {
+        return 1;
+    }
+    int64_t deadlineUs = self->m_deadlineUs.load(std::memory_order_relaxed);
+    if (deadlineUs > 0 && av_gettime_relative() > deadlineUs) {
+        self->m_expired.store(true, std::memory_order_relaxed);
+        return 1;
+    }
+    return 0;
+}
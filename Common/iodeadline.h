@@ -0,0 +1,41 @@
+﻿// IoDeadline.h
+#ifndef IODEADLINE_H
+#define IODEADLINE_H
+
+#include <atomic>
+#include <cstdint>
+
+struct AVFormatContext;
+
+// 输出上下文的I/O截止时刻：安装为AVFormatContext::interrupt_callback后，
+// 网络读写（RTSP握手、TCP发送）超过截止时刻或被中止时返回AVERROR_EXIT，
+// 服务端卡住不会让写出无限阻塞。FFmpeg在阻塞等待socket时约每100ms检查一次回调
+class IoDeadline
+{
+public:
+    IoDeadline() = default;
+
+    // 安装到输出上下文，本对象需比上下文的最后一次I/O活得久
+    void install(AVFormatContext* ctx);
+    // 从现在起timeoutMs后超时；<=0为不限时
+    void arm(int timeoutMs);
+    void disarm();
+    // 立即到期：连接已失效时只需让muxer走完关闭流程、释放socket
+    void expire() { m_deadlineUs.store(1, std::memory_order_relaxed); }
+    // 立即中断当前与后续的I/O，直到reset
+    void abort();
+    void reset();
+
+    bool aborted() const { return m_aborted.load(std::memory_order_relaxed); }
+    // 最近一次I/O是否因超过截止时刻被中断（不含abort）
+    bool expired() const { return m_expired.load(std::memory_order_relaxed); }
+
+private:
+    static int interrupt(void* opaque);
+
+    std::atomic<int64_t> m_deadlineUs{0};     // 0为未设置
+    std::atomic<bool> m_aborted{false};
+    std::atomic<bool> m_expired{false};
+};
+
+#endif // IODEADLINE_H
@@ -0,0 +1,101 @@
+﻿// LatencyHistogram.cpp
+#include "latencyhistogram.h"
+#include <vector>
+
+namespace
+{
+int highestBit(uint64_t v)
+{
+    int bit = 0;
+    while (v >>= 1) {
+        ++bit;
+    }
+    return bit;
+}
+} // namespace
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+int LatencyHistogram::bucketIndex(int64_t valueUs)
+{
+    uint64_t v = valueUs > 0 ? uint64_t(valueUs) : 0;
+    const uint64_t maxValue = (uint64_t(1) << MAX_VALUE_BITS) - 1;
+    if (v > maxValue) {
+        v = maxValue;
+    }
+    // 小于2*SUB_BUCKETS的值直接按1us分桶；更大的值保留最高SUB_BUCKET_BITS+1位
+    int shift = highestBit(v) - SUB_BUCKET_BITS;
+    if (shift < 0) {
+        shift = 0;
+    }
+    return shift * SUB_BUCKETS + int(v >> shift);
+}
+
+int64_t LatencyHistogram::bucketUpperBound(int index)
+{
+    if (index < 2 * SUB_BUCKETS) {
+        return index;
+    }
+    int shift = index / SUB_BUCKETS - 1;
+    int64_t mantissa = index - shift * SUB_BUCKETS;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t valueUs)
+{
+    if (valueUs < 0) {
+        valueUs = 0;
+    }
+    m_counts[bucketIndex(valueUs)].fetch_add(1, std::memory_order_relaxed);
+    m_total.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(valueUs, std::memory_order_relaxed);
+    int64_t cur = m_max.load(std::memory_order_relaxed);
+    while (valueUs > cur && !m_max.compare_exchange_weak(cur, valueUs, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    for (std::atomic<uint64_t>& c : m_counts) {
+        c.store(0, std::memory_order_relaxed);
+    }
+    m_total.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+LatencySummary LatencyHistogram::summary() const
+{
+    LatencySummary s;
+    std::vector<uint64_t> counts(BUCKET_COUNT);
+    uint64_t total = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        counts[i] = m_counts[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return s;
+    }
+
+    s.count = qint64(total);
+    s.sumUs = m_sum.load(std::memory_order_relaxed);
+    s.meanUs = s.sumUs / s.count;
+    s.maxUs = m_max.load(std::memory_order_relaxed);
+
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    qint64* outs[] = {&s.p50Us, &s.p90Us, &s.p99Us, &s.p999Us};
+    int q = 0;
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT && q < 4; ++i) {
+        seen += counts[i];
+        while (q < 4 && seen >= uint64_t(quantiles[q] * total + 0.5) && seen > 0) {
+            // 上界不超过实际最大值
+            *outs[q] = qMin<qint64>(bucketUpperBound(i), s.maxUs);
+            ++q;
+        }
+    }
+    return s;
+}
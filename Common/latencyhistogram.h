@@ -0,0 +1,48 @@
+﻿// LatencyHistogram.h
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <cstdint>
+
+// 延迟分位统计，单位微秒
+struct LatencySummary {
+    qint64 count = 0;
+    qint64 meanUs = 0;
+    qint64 p50Us = 0;
+    qint64 p90Us = 0;
+    qint64 p99Us = 0;
+    qint64 p999Us = 0;
+    qint64 maxUs = 0;
+    qint64 sumUs = 0;
+};
+
+// HDR风格的对数-线性直方图：每个2的幂区间再分32个子桶，相对误差约3%，
+// 覆盖1us到约2^28us（4分半钟）。记录为无锁原子累加，可在任意线程并发调用
+class LatencyHistogram
+{
+public:
+    static const int SUB_BUCKET_BITS = 5;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int MAX_VALUE_BITS = 28;
+    static const int BUCKET_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS) * SUB_BUCKETS + 2 * SUB_BUCKETS;
+
+    LatencyHistogram();
+
+    void record(int64_t valueUs);
+    void reset();
+    LatencySummary summary() const;
+
+    static int bucketIndex(int64_t valueUs);
+    // 桶内上界，分位值按上界报告，保证不低估
+    static int64_t bucketUpperBound(int index);
+
+private:
+    std::atomic<uint64_t> m_counts[BUCKET_COUNT];
+    std::atomic<int64_t> m_total{0};
+    std::atomic<int64_t> m_sum{0};
+    std::atomic<int64_t> m_max{0};
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -0,0 +1,190 @@
+﻿// LatencySei.cpp
+#include "latencysei.h"
+#include <cstring>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/time.h>
+}
+
+namespace LatencySei
+{
+namespace
+{
+// user_data_unregistered的uuid_iso_iec_11578，用于与编码器自带SEI（如x264版本信息）区分
+const uint8_t SEI_UUID[16] = {
+    0x6c, 0x61, 0x74, 0x2d, 0x70, 0x72, 0x6f, 0x62,
+    0x9e, 0x1d, 0x4a, 0x53, 0xb0, 0x27, 0x3c, 0x51
+};
+const int SEI_PAYLOAD_TYPE = 5;
+const int SEI_PAYLOAD_SIZE = 16 + 8 + 4;
+const int NAL_SEI = 6;
+
+void putBe(uint8_t* out, uint64_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; --i) {
+        out[i] = uint8_t(value & 0xff);
+        value >>= 8;
+    }
+}
+
+uint64_t getBe(const uint8_t* in, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | in[i];
+    }
+    return value;
+}
+
+// 下一个起始码(00 00 01)的位置，未找到返回size
+int nextStartCode(const uint8_t* data, int size, int from)
+{
+    for (int i = from; i + 2 < size; ++i) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            return i;
+        }
+    }
+    return size;
+}
+
+// 去除防竞争字节(00 00 03 -> 00 00)
+QByteArray unescape(const uint8_t* data, int size)
+{
+    QByteArray rbsp;
+    rbsp.reserve(size);
+    int zeros = 0;
+    for (int i = 0; i < size; ++i) {
+        if (zeros >= 2 && data[i] == 3) {
+            zeros = 0;
+            continue;
+        }
+        zeros = data[i] == 0 ? zeros + 1 : 0;
+        rbsp.append(char(data[i]));
+    }
+    return rbsp;
+}
+
+bool parseSei(const QByteArray& rbsp, Payload* payload)
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(rbsp.constData());
+    int size = rbsp.size();
+    int pos = 0;
+    // 末尾为rbsp_trailing_bits(0x80)
+    while (pos < size && p[pos] != 0x80) {
+        int type = 0;
+        while (pos < size && p[pos] == 0xff) {
+            type += 255;
+            ++pos;
+        }
+        if (pos >= size) {
+            return false;
+        }
+        type += p[pos++];
+        int len = 0;
+        while (pos < size && p[pos] == 0xff) {
+            len += 255;
+            ++pos;
+        }
+        if (pos >= size) {
+            return false;
+        }
+        len += p[pos++];
+        if (pos + len > size) {
+            return false;
+        }
+        if (type == SEI_PAYLOAD_TYPE && len >= SEI_PAYLOAD_SIZE &&
+            memcmp(p + pos, SEI_UUID, sizeof(SEI_UUID)) == 0) {
+            payload->captureWallUs = int64_t(getBe(p + pos + 16, 8));
+            payload->sequence = uint32_t(getBe(p + pos + 24, 4));
+            return true;
+        }
+        pos += len;
+    }
+    return false;
+}
+} // namespace
+
+QByteArray buildNal(const Payload& payload)
+{
+    uint8_t rbsp[2 + SEI_PAYLOAD_SIZE + 1];
+    rbsp[0] = SEI_PAYLOAD_TYPE;
+    rbsp[1] = SEI_PAYLOAD_SIZE;
+    memcpy(rbsp + 2, SEI_UUID, sizeof(SEI_UUID));
+    putBe(rbsp + 2 + 16, uint64_t(payload.captureWallUs), 8);
+    putBe(rbsp + 2 + 24, payload.sequence, 4);
+    rbsp[sizeof(rbsp) - 1] = 0x80;
+
+    QByteArray nal("\x00\x00\x00\x01", 4);
+    nal.append(char(NAL_SEI));
+    int zeros = 0;
+    for (uint8_t byte : rbsp) {
+        // 连续两个0后出现<=3的字节需插入防竞争字节
+        if (zeros >= 2 && byte <= 3) {
+            nal.append(char(3));
+            zeros = 0;
+        }
+        zeros = byte == 0 ? zeros + 1 : 0;
+        nal.append(char(byte));
+    }
+    return nal;
+}
+
+bool insert(AVPacket* pkt, const Payload& payload)
+{
+    if (!pkt || !pkt->data || pkt->size < 4) {
+        return false;
+    }
+
+    // 找到第一个slice（nal_unit_type 1~5），SEI须位于其前；SPS/PPS保持在最前
+    int insertPos = -1;
+    int start = nextStartCode(pkt->data, pkt->size, 0);
+    while (start < pkt->size) {
+        int nalPos = start + 3;
+        if (nalPos >= pkt->size) {
+            break;
+        }
+        int type = pkt->data[nalPos] & 0x1f;
+        if (type >= 1 && type <= 5) {
+            insertPos = (start > 0 && pkt->data[start - 1] == 0) ? start - 1 : start;
+            break;
+        }
+        start = nextStartCode(pkt->data, pkt->size, nalPos);
+    }
+    if (insertPos < 0) {
+        return false;   // 非Annex B或不含slice
+    }
+
+    QByteArray nal = buildNal(payload);
+    int oldSize = pkt->size;
+    if (av_grow_packet(pkt, nal.size()) < 0) {
+        return false;
+    }
+    memmove(pkt->data + insertPos + nal.size(), pkt->data + insertPos, size_t(oldSize - insertPos));
+    memcpy(pkt->data + insertPos, nal.constData(), size_t(nal.size()));
+    return true;
+}
+
+bool find(const uint8_t* data, int size, Payload* payload)
+{
+    int start = nextStartCode(data, size, 0);
+    while (start < size) {
+        int nalPos = start + 3;
+        if (nalPos >= size) {
+            break;
+        }
+        int next = nextStartCode(data, size, nalPos);
+        if ((data[nalPos] & 0x1f) == NAL_SEI &&
+            parseSei(unescape(data + nalPos + 1, next - nalPos - 1), payload)) {
+            return true;
+        }
+        start = next;
+    }
+    return false;
+}
+
+int64_t toWallClock(int64_t relativeUs)
+{
+    return av_gettime() - (av_gettime_relative() - relativeUs);
+}
+} // namespace LatencySei
@@ -0,0 +1,32 @@
+﻿// LatencySei.h
+#ifndef LATENCYSEI_H
+#define LATENCYSEI_H
+
+#include <QByteArray>
+#include <cstdint>
+
+struct AVPacket;
+
+// H.264 user_data_unregistered SEI（payloadType 5）携带采集时刻与序号，
+// 接收端据此计算端到端（glass-to-glass）延迟与丢帧。时间为墙钟微秒，跨机器测量需NTP/PTP对时
+namespace LatencySei
+{
+struct Payload {
+    int64_t captureWallUs = 0;  // 采集完成时刻，av_gettime()墙钟
+    uint32_t sequence = 0;      // 编码帧序号，连续递增
+};
+
+// 生成Annex B格式的SEI NAL（含起始码与防竞争字节）
+QByteArray buildNal(const Payload& payload);
+
+// 在包内第一个slice NAL之前插入SEI，要求包为Annex B；失败时包保持不变
+bool insert(AVPacket* pkt, const Payload& payload);
+
+// 在Annex B数据中查找本模块写入的SEI
+bool find(const uint8_t* data, int size, Payload* payload);
+
+// av_gettime_relative()时刻换算为墙钟
+int64_t toWallClock(int64_t relativeUs);
+} // namespace LatencySei
+
+#endif // LATENCYSEI_H
@@ -0,0 +1,130 @@
+﻿// MetricsServer.cpp
+#include "metricsserver.h"
+#include "Logger.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+MetricsServer::MetricsServer(PushMetrics* metrics, QObject* parent)
+    : QObject(parent)
+    , m_metrics(metrics)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    close();
+}
+
+bool MetricsServer::listen(quint16 port, const QString& localName)
+{
+    close();
+    if (port > 0) {
+        m_tcpServer = new QTcpServer(this);
+        connect(m_tcpServer, &QTcpServer::newConnection, this, &MetricsServer::onNewTcpConnection);
+        // 只监听回环地址，指标不对外暴露
+        if (!m_tcpServer->listen(QHostAddress::LocalHost, port)) {
+            LogErr << "【指标】监听端口失败:" << port << m_tcpServer->errorString();
+            close();
+            return false;
+        }
+        LogInfo << "【指标】Prometheus端点: http://127.0.0.1:" << port << "/metrics";
+    }
+    if (!localName.isEmpty()) {
+        m_localServer = new QLocalServer(this);
+        connect(m_localServer, &QLocalServer::newConnection, this, &MetricsServer::onNewLocalConnection);
+        QLocalServer::removeServer(localName);      // 清理上次异常退出残留的套接字文件
+        if (!m_localServer->listen(localName)) {
+            LogErr << "【指标】监听本地套接字失败:" << localName << m_localServer->errorString();
+            close();
+            return false;
+        }
+        LogInfo << "【指标】本地套接字端点:" << m_localServer->fullServerName();
+    }
+    return isListening();
+}
+
+void MetricsServer::close()
+{
+    if (m_tcpServer) {
+        m_tcpServer->close();
+        m_tcpServer->deleteLater();
+        m_tcpServer = nullptr;
+    }
+    if (m_localServer) {
+        m_localServer->close();
+        m_localServer->deleteLater();
+        m_localServer = nullptr;
+    }
+}
+
+bool MetricsServer::isListening() const
+{
+    return (m_tcpServer && m_tcpServer->isListening()) || (m_localServer && m_localServer->isListening());
+}
+
+void MetricsServer::updateStatistics(const PushStatistics& stats)
+{
+    m_lastStats = stats;
+}
+
+void MetricsServer::onNewTcpConnection()
+{
+    while (QTcpSocket* socket = m_tcpServer->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        handleConnection(socket);
+    }
+}
+
+void MetricsServer::onNewLocalConnection()
+{
+    while (QLocalSocket* socket = m_localServer->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        handleConnection(socket);
+    }
+}
+
+void MetricsServer::handleConnection(QIODevice* socket)
+{
+    connect(socket, &QIODevice::readyRead, this, [this, socket]() {
+        QByteArray& request = m_requests[socket];
+        request.append(socket->readAll());
+        int headerEnd = request.indexOf("\r\n\r\n");
+        if (headerEnd < 0 && request.size() < MAX_REQUEST_BYTES) {
+            return;     // 请求头未收完
+        }
+        QByteArray requestLine = request.left(request.indexOf("\r\n"));
+        m_requests.remove(socket);
+        respond(socket, requestLine);
+    });
+    connect(socket, &QObject::destroyed, this, [this, socket]() {
+        m_requests.remove(socket);
+    });
+}
+
+void MetricsServer::respond(QIODevice* socket, const QByteArray& requestLine)
+{
+    QList<QByteArray> parts = requestLine.split(' ');
+    QByteArray status;
+    QByteArray body;
+    QByteArray contentType = "text/plain; charset=utf-8";
+    if (parts.size() < 2 || parts[0] != "GET") {
+        status = "405 Method Not Allowed";
+        body = "only GET is supported\n";
+    } else if (parts[1] == "/metrics" || parts[1].startsWith("/metrics?")) {
+        status = "200 OK";
+        contentType = "text/plain; version=0.0.4; charset=utf-8";
+        body = PushMetrics::toPrometheus(m_metrics->report(), m_lastStats);
+    } else {
+        status = "404 Not Found";
+        body = "see /metrics\n";
+    }
+
+    QByteArray response = "HTTP/1.1 " + status + "\r\n"
+                          "Content-Type: " + contentType + "\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                          "Connection: close\r\n\r\n" + body;
+    socket->write(response);
+    socket->close();    // 套接字在缓冲写完后断开
+}
@@ -0,0 +1,46 @@
+﻿// MetricsServer.h
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QHash>
+#include "pushmetrics.h"
+
+class QTcpServer;
+class QLocalServer;
+class QIODevice;
+
+// 本地指标端点：在127.0.0.1:port和/或本地套接字上以Prometheus文本格式响应 GET /metrics。
+// 延迟直方图在请求时实时读取，计数类统计取最近一次updateStatistics的结果
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsServer(PushMetrics* metrics, QObject* parent = nullptr);
+    ~MetricsServer();
+
+    // port为0时不监听TCP；localName为空时不监听本地套接字（Linux下可为绝对路径）
+    bool listen(quint16 port, const QString& localName = QString());
+    void close();
+    bool isListening() const;
+
+public slots:
+    void updateStatistics(const PushStatistics& stats);
+
+private slots:
+    void onNewTcpConnection();
+    void onNewLocalConnection();
+
+private:
+    void handleConnection(QIODevice* socket);
+    void respond(QIODevice* socket, const QByteArray& requestLine);
+
+    PushMetrics* m_metrics;
+    PushStatistics m_lastStats;
+    QTcpServer* m_tcpServer = nullptr;
+    QLocalServer* m_localServer = nullptr;
+    QHash<QIODevice*, QByteArray> m_requests;  // 未读完的请求头
+    static const int MAX_REQUEST_BYTES = 8192;
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,77 @@
+﻿// OutputFormat.cpp
+#include "outputformat.h"
+#include <QFileInfo>
+#include <QUrl>
+
+namespace
+{
+QString scheme(const QString& url)
+{
+    return QUrl(url).scheme().toLower();
+}
+
+void setInt(AVDictionary** dict, const char* key, qint64 value)
+{
+    av_dict_set(dict, key, QByteArray::number(value).constData(), 0);
+}
+} // namespace
+
+QString OutputFormat::muxerForUrl(const QString& url)
+{
+    QString s = scheme(url);
+    if (s == "rtsp") {
+        return "rtsp";
+    }
+    if (s == "rtmp" || s == "rtmps") {
+        return "flv";
+    }
+    if (s == "udp" || s == "srt") {
+        return "mpegts";
+    }
+    if (s == "rtp") {
+        return "rtp_mpegts";    // TS封装在RTP中，rtp协议本身不加RTP头
+    }
+    QString ext = QFileInfo(QUrl(url).path()).suffix().toLower();
+    if (ext == "flv") {
+        return "flv";
+    }
+    if (ext == "ts") {
+        return "mpegts";
+    }
+    if (ext == "mkv") {
+        return "matroska";
+    }
+    return "mp4";
+}
+
+void OutputFormat::muxerOptions(const QString& muxer, const OutputOptions& options, AVDictionary** dict)
+{
+    if (muxer == "mpegts") {
+        setInt(dict, "pcr_period", options.pcrPeriodMs);
+        av_dict_set(dict, "pat_period", QByteArray::number(options.patPeriodMs / 1000.0).constData(), 0);
+        av_dict_set(dict, "flush_packets", "0", 0);
+    } else if (muxer == "flv") {
+        // 直播流没有可回写的文件头，结束时不再seek回写时长与大小
+        av_dict_set(dict, "flvflags", "no_duration_filesize", 0);
+    }
+}
+
+void OutputFormat::ioOptions(const QString& url, const OutputOptions& options, AVDictionary** dict)
+{
+    QString s = scheme(url);
+    if (s == "udp" || s == "rtp") {
+        setInt(dict, "pkt_size", options.tsPacketSize);
+    } else if (s == "srt") {
+        setInt(dict, "payload_size", options.tsPacketSize);
+        setInt(dict, "latency", qint64(options.srtLatencyMs) * 1000);  // 微秒
+    }
+}
+
+bool OutputFormat::canMux(const AVOutputFormat* format, AVCodecID codecId, QString* errMsg)
+{
+    if (avformat_query_codec(format, codecId, FF_COMPLIANCE_NORMAL) == 0) {
+        *errMsg = QString("%1封装不支持%2编码").arg(format->name, avcodec_get_name(codecId));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,28 @@
+﻿// OutputFormat.h
+#ifndef OUTPUTFORMAT_H
+#define OUTPUTFORMAT_H
+
+#include <QString>
+#include "DataStruct.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+// 按目的地址选择复用格式：rtsp:// → rtsp，rtmp(s):// → flv，udp:// 与 srt:// → mpegts，
+// rtp:// → rtp_mpegts，其余按文件扩展名（.flv/.ts/.mkv，默认mp4）
+namespace OutputFormat
+{
+QString muxerForUrl(const QString& url);
+
+// 写文件头时的复用器选项。网络MPEG-TS关闭逐包flush，avio只按tsPacketSize整块写出，
+// 每个UDP/SRT数据报正好是整数个TS包
+void muxerOptions(const QString& muxer, const OutputOptions& options, AVDictionary** dict);
+// 打开输出IO（avio_open2）时的协议选项
+void ioOptions(const QString& url, const OutputOptions& options, AVDictionary** dict);
+
+// 复用器能否封装该编码（如FLV不支持Opus），不能时errMsg给出原因；复用器未声明时按支持处理
+bool canMux(const AVOutputFormat* format, AVCodecID codecId, QString* errMsg);
+} // namespace OutputFormat
+
+#endif // OUTPUTFORMAT_H
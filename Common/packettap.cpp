@@ -0,0 +1,202 @@
+﻿// PacketTap.cpp
+#include "packettap.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QtEndian>
+#include <cstdint>
+#include <cstring>
+#include "Logger.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/mathematics.h>
+}
+
+namespace
+{
+QByteArray makeRecord(quint8 type, quint8 stream, quint8 flags, qint64 pts, qint64 dts,
+                      const char* payload, int payloadBytes, const QByteArray& prefix = QByteArray())
+{
+    QByteArray record(PacketTap::RECORD_HEADER_BYTES + prefix.size() + payloadBytes, Qt::Uninitialized);
+    uchar* p = reinterpret_cast<uchar*>(record.data());
+    p[0] = type;
+    p[1] = stream;
+    p[2] = flags;
+    p[3] = 0;
+    qToLittleEndian<quint32>(quint32(prefix.size() + payloadBytes), p + 4);
+    qToLittleEndian<qint64>(pts, p + 8);
+    qToLittleEndian<qint64>(dts, p + 16);
+    memcpy(p + PacketTap::RECORD_HEADER_BYTES, prefix.constData(), size_t(prefix.size()));
+    if (payloadBytes > 0) {
+        memcpy(p + PacketTap::RECORD_HEADER_BYTES + prefix.size(), payload, size_t(payloadBytes));
+    }
+    return record;
+}
+} // namespace
+
+PacketTap::PacketTap(QObject* parent)
+    : QObject(parent)
+{
+}
+
+PacketTap::~PacketTap()
+{
+    close();
+}
+
+bool PacketTap::listen(const QString& name)
+{
+    close();
+    m_server = new QLocalServer(this);
+    connect(m_server, &QLocalServer::newConnection, this, &PacketTap::onNewConnection);
+    QLocalServer::removeServer(name);      // 清理上次异常退出残留的套接字文件
+    if (!m_server->listen(name)) {
+        LogErr << "【包分发】监听本地套接字失败:" << name << m_server->errorString();
+        close();
+        return false;
+    }
+    LogInfo << "【包分发】本地套接字:" << m_server->fullServerName();
+    return true;
+}
+
+void PacketTap::close()
+{
+    for (QLocalSocket* socket : m_clients.keys()) {
+        removeClient(socket);
+    }
+    if (m_server) {
+        m_server->close();
+        m_server->deleteLater();
+        m_server = nullptr;
+    }
+}
+
+bool PacketTap::isListening() const
+{
+    return m_server && m_server->isListening();
+}
+
+void PacketTap::setStream(int streamIndex, bool isVideo, const AVCodecContext* codecCtx)
+{
+    Stream stream;
+    stream.isVideo = isVideo;
+    stream.timeBaseNum = codecCtx->time_base.num;
+    stream.timeBaseDen = codecCtx->time_base.den;
+    QByteArray prefix(12, Qt::Uninitialized);
+    uchar* p = reinterpret_cast<uchar*>(prefix.data());
+    qToLittleEndian<quint32>(quint32(codecCtx->codec_id), p);
+    qToLittleEndian<qint32>(isVideo ? codecCtx->width : codecCtx->sample_rate, p + 4);
+    qToLittleEndian<qint32>(isVideo ? codecCtx->height : codecCtx->channels, p + 8);
+    stream.info = makeRecord(streamInfo, isVideo ? 0 : 1, 0, 0, 0,
+                             reinterpret_cast<const char*>(codecCtx->extradata), codecCtx->extradata_size, prefix);
+    m_streams.insert(streamIndex, stream);
+
+    // 编码器重建后旧的参数集失效，已连接的读端从新的流信息与IDR重新开始
+    for (Client* client : m_clients) {
+        client->queue.clear();
+        client->queuedBytes = 0;
+        client->synced = false;
+    }
+}
+
+void PacketTap::publish(const AVPacket* pkt)
+{
+    if (m_clients.isEmpty()) {
+        return;
+    }
+    auto it = m_streams.constFind(pkt->stream_index);
+    if (it == m_streams.constEnd()) {
+        return;
+    }
+    const Stream& stream = it.value();
+    AVRational timeBase = {stream.timeBaseNum, stream.timeBaseDen};
+    auto toUs = [timeBase](int64_t ts) {
+        return ts == AV_NOPTS_VALUE ? INT64_MIN : av_rescale_q(ts, timeBase, {1, 1000000});
+    };
+    bool key = stream.isVideo && (pkt->flags & AV_PKT_FLAG_KEY);
+    // 一份记录被所有读端队列共享（隐式共享，不逐个拷贝）
+    QByteArray record = makeRecord(packet, stream.isVideo ? 0 : 1, key ? 1 : 0, toUs(pkt->pts), toUs(pkt->dts),
+                                   reinterpret_cast<const char*>(pkt->data), pkt->size);
+    for (Client* client : m_clients) {
+        if (!client->synced) {
+            if (!key) {
+                continue;
+            }
+            // 每次从IDR开始前先发流信息，读端可据此（重新）初始化解码器
+            client->synced = true;
+            sendStreamInfo(client);
+        }
+        if (client->queuedBytes + record.size() > m_queueLimitBytes) {
+            // 读端跟不上：丢掉积压，从下一个IDR重新开始
+            client->dropped += qint64(client->queue.size()) + 1;
+            client->queue.clear();
+            client->queuedBytes = 0;
+            client->synced = false;
+            LogWarn << "【包分发】读端积压超过" << m_queueLimitBytes / 1024 << "KB，等待下一个IDR";
+            continue;
+        }
+        enqueue(client, record);
+        pump(client);
+    }
+}
+
+void PacketTap::onNewConnection()
+{
+    while (QLocalSocket* socket = m_server->nextPendingConnection()) {
+        Client* client = new Client;
+        client->socket = socket;
+        m_clients.insert(socket, client);
+        connect(socket, &QLocalSocket::bytesWritten, this, [this, socket] {
+            if (Client* c = m_clients.value(socket)) {
+                pump(c);
+            }
+        });
+        // 读端不需要发送任何内容，收到的数据直接丢弃
+        connect(socket, &QLocalSocket::readyRead, socket, [socket] { socket->readAll(); });
+        // 排队处理：写出时同步触发的断开不会在遍历读端的过程中删除读端
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket] { removeClient(socket); },
+                Qt::QueuedConnection);
+        LogInfo << "【包分发】读端接入，当前" << m_clients.size() << "个";
+    }
+}
+
+void PacketTap::sendStreamInfo(Client* client)
+{
+    for (const Stream& stream : m_streams) {
+        enqueue(client, stream.info);
+    }
+}
+
+void PacketTap::enqueue(Client* client, const QByteArray& record)
+{
+    client->queue.push_back(record);
+    client->queuedBytes += record.size();
+}
+
+void PacketTap::pump(Client* client)
+{
+    // 套接字内部缓冲不设上限，只在其低于水位时从自己的有界队列中取
+    while (!client->queue.empty() && client->socket->bytesToWrite() < WRITE_HIGH_WATER) {
+        const QByteArray& record = client->queue.front();
+        if (client->socket->write(record) != record.size()) {
+            break;      // 连接已断开，由disconnected清理
+        }
+        client->queuedBytes -= record.size();
+        client->queue.pop_front();
+        ++client->sent;
+    }
+}
+
+void PacketTap::removeClient(QLocalSocket* socket)
+{
+    Client* client = m_clients.take(socket);
+    if (!client) {
+        return;
+    }
+    LogInfo << "【包分发】读端断开，发送" << client->sent << "条记录，丢弃" << client->dropped
+            << "个包，剩余" << m_clients.size() << "个";
+    delete client;
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+}
@@ -0,0 +1,87 @@
+﻿// PacketTap.h
+#ifndef PACKETTAP_H
+#define PACKETTAP_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <deque>
+
+class QLocalServer;
+class QLocalSocket;
+struct AVCodecContext;
+struct AVPacket;
+
+// 编码包本地分发：在本地套接字（Linux下为Unix域套接字，可为绝对路径）上把编码后的H.264/AAC(Opus)
+// 基本流包原样发给任意多个本地读端，不重新编码也不经过RTSP服务器。读端可随时连上或断开，
+// 连上后从下一个视频IDR开始收包（IDR之前的音频包也跳过），IDR之前先收到各路流信息。
+// 每个读端有自己的发送队列，积压超过上限时清空队列并等下一个IDR重新开始，不影响推流与其他读端。
+//
+// 记录格式（小端）：24字节记录头 + 负载
+//   uint8  type        1=流信息 2=数据包
+//   uint8  stream      0=视频 1=音频
+//   uint8  flags       bit0 关键帧
+//   uint8  reserved
+//   uint32 size        负载字节数
+//   int64  pts         微秒，无效为INT64_MIN；流信息为0
+//   int64  dts         同上
+// 流信息负载：uint32 AVCodecID，int32 宽度/采样率，int32 高度/声道数，之后为extradata
+// （H.264为Annex B的SPS/PPS，AAC为AudioSpecificConfig）。数据包负载为编码器输出的原始字节
+class PacketTap : public QObject
+{
+    Q_OBJECT
+public:
+    enum RecordType : quint8 {
+        streamInfo = 1,
+        packet = 2
+    };
+    static const int RECORD_HEADER_BYTES = 24;
+
+    explicit PacketTap(QObject* parent = nullptr);
+    ~PacketTap();
+
+    bool listen(const QString& name);
+    void close();
+    bool isListening() const;
+    int clientCount() const { return m_clients.size(); }
+    // 每个读端的积压上限（字节），默认4MB
+    void setQueueLimit(int bytes) { m_queueLimitBytes = bytes; }
+
+    // 编码器打开后登记流，包时间戳按codecCtx->time_base换算为微秒。重新登记后已连接的读端
+    // 重新收到流信息并等待下一个IDR
+    void setStream(int streamIndex, bool isVideo, const AVCodecContext* codecCtx);
+    // 在所属线程调用，不接管pkt；没有读端时直接返回
+    void publish(const AVPacket* pkt);
+
+private slots:
+    void onNewConnection();
+
+private:
+    struct Stream {
+        bool isVideo = true;
+        int timeBaseNum = 1;
+        int timeBaseDen = 1000000;
+        QByteArray info;            // 完整的流信息记录
+    };
+    struct Client {
+        QLocalSocket* socket = nullptr;
+        std::deque<QByteArray> queue;   // 记录共享同一份数据
+        qint64 queuedBytes = 0;
+        bool synced = false;        // 已从IDR开始
+        qint64 sent = 0;
+        qint64 dropped = 0;
+    };
+    void sendStreamInfo(Client* client);
+    void enqueue(Client* client, const QByteArray& record);
+    void pump(Client* client);
+    void removeClient(QLocalSocket* socket);
+
+    QLocalServer* m_server = nullptr;
+    QHash<int, Stream> m_streams;
+    QHash<QLocalSocket*, Client*> m_clients;
+    int m_queueLimitBytes = 4 * 1024 * 1024;
+    static const int WRITE_HIGH_WATER = 256 * 1024;     // 套接字内部缓冲超过此值时暂停写入
+};
+
+#endif // PACKETTAP_H
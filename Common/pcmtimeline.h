@@ -0,0 +1,71 @@
+﻿// PcmTimeline.h
+#ifndef PCMTIMELINE_H
+#define PCMTIMELINE_H
+
+#include <QQueue>
+#include <QtGlobal>
+#include <cstdint>
+
+// 记录PCM字节流中每段数据的采集时刻，按消费偏移换算出任意采样的采集时间，
+// 用于统计采集到编码的延迟
+class PcmTimeline
+{
+public:
+    void reset(int bytesPerSecond)
+    {
+        m_segments.clear();
+        m_inBytes = 0;
+        m_outBytes = 0;
+        m_outSamples = 0;
+        m_bytesPerSecond = bytesPerSecond;
+    }
+
+    // 追加一段数据，captureTimeUs为该段首个采样的采集时刻（av_gettime_relative）
+    void append(qint64 bytes, int64_t captureTimeUs)
+    {
+        if (bytes <= 0) {
+            return;
+        }
+        m_segments.enqueue({m_inBytes, captureTimeUs});
+        m_inBytes += bytes;
+    }
+
+    // 消费bytes字节，返回被消费数据首个采样的采集时刻，无记录时返回-1
+    int64_t consume(qint64 bytes)
+    {
+        while (m_segments.size() > 1 && m_segments.at(1).offset <= m_outBytes) {
+            m_segments.dequeue();
+        }
+        int64_t timeUs = -1;
+        if (!m_segments.isEmpty() && m_bytesPerSecond > 0) {
+            const Segment& seg = m_segments.head();
+            timeUs = seg.timeUs + (m_outBytes - seg.offset) * 1000000 / m_bytesPerSecond;
+        }
+        m_outBytes += bytes;
+        return timeUs;
+    }
+
+    // 按重采样后的输出采样消费，outRate为输出采样率；累计换算回输入字节，避免逐帧取整误差
+    int64_t consumeSamples(qint64 samples, int outRate)
+    {
+        if (outRate <= 0) {
+            return -1;
+        }
+        m_outSamples += samples;
+        qint64 target = m_outSamples * m_bytesPerSecond / outRate;
+        return consume(target - m_outBytes);
+    }
+
+private:
+    struct Segment {
+        qint64 offset;      // 该段在字节流中的起始偏移
+        int64_t timeUs;
+    };
+    QQueue<Segment> m_segments;
+    qint64 m_inBytes = 0;
+    qint64 m_outBytes = 0;
+    qint64 m_outSamples = 0;
+    int m_bytesPerSecond = 0;
+};
+
+#endif // PCMTIMELINE_H
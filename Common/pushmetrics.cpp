@@ -0,0 +1,133 @@
+﻿// PushMetrics.cpp
+#include "pushmetrics.h"
+
+void PushMetrics::reset()
+{
+    for (LatencyHistogram& h : m_histograms) {
+        h.reset();
+    }
+}
+
+LatencyReport PushMetrics::report() const
+{
+    LatencyReport report;
+    for (int i = 0; i < int(LatencyMetric::count); ++i) {
+        report.metrics[i] = m_histograms[i].summary();
+    }
+    return report;
+}
+
+const char* PushMetrics::metricName(LatencyMetric metric)
+{
+    switch (metric) {
+    case LatencyMetric::captureToEncode: return "capture_to_encode";
+    case LatencyMetric::encodeDuration: return "encode_duration";
+    case LatencyMetric::encodeToWire: return "encode_to_wire";
+    case LatencyMetric::audioToWire: return "audio_to_wire";
+    case LatencyMetric::audioSchedule: return "audio_schedule";
+    case LatencyMetric::captureJitter: return "capture_jitter";
+    default: return "unknown";
+    }
+}
+
+namespace
+{
+QString seconds(qint64 us)
+{
+    return QString::number(us / 1e6, 'g', 9);
+}
+
+void appendStream(QString& out, const char* name, const char* help, const char* type,
+                  qint64 video, qint64 audio)
+{
+    out += QString("# HELP %1 %2\n# TYPE %1 %3\n").arg(name).arg(help).arg(type);
+    out += QString("%1{stream=\"video\"} %2\n").arg(name).arg(video);
+    out += QString("%1{stream=\"audio\"} %2\n").arg(name).arg(audio);
+}
+} // namespace
+
+QByteArray PushMetrics::toPrometheus(const LatencyReport& latency, const PushStatistics& stats)
+{
+    QString out;
+    out += "# HELP push_latency_seconds Push pipeline stage latency.\n"
+           "# TYPE push_latency_seconds summary\n";
+    const char* quantiles[] = {"0.5", "0.9", "0.99", "0.999"};
+    for (int i = 0; i < int(LatencyMetric::count); ++i) {
+        const LatencySummary& s = latency.metrics[i];
+        const char* stage = metricName(LatencyMetric(i));
+        qint64 values[] = {s.p50Us, s.p90Us, s.p99Us, s.p999Us};
+        for (int q = 0; q < 4; ++q) {
+            out += QString("push_latency_seconds{stage=\"%1\",quantile=\"%2\"} %3\n")
+                       .arg(stage).arg(quantiles[q]).arg(seconds(values[q]));
+        }
+        out += QString("push_latency_seconds_sum{stage=\"%1\"} %2\n").arg(stage).arg(seconds(s.sumUs));
+        out += QString("push_latency_seconds_count{stage=\"%1\"} %2\n").arg(stage).arg(s.count);
+    }
+    out += "# HELP push_latency_max_seconds Maximum observed stage latency.\n"
+           "# TYPE push_latency_max_seconds gauge\n";
+    for (int i = 0; i < int(LatencyMetric::count); ++i) {
+        out += QString("push_latency_max_seconds{stage=\"%1\"} %2\n")
+                   .arg(metricName(LatencyMetric(i))).arg(seconds(latency.metrics[i].maxUs));
+    }
+
+    appendStream(out, "push_bytes_written_total", "Bytes written to the output.", "counter",
+                 stats.video.bytesWritten, stats.audio.bytesWritten);
+    appendStream(out, "push_packets_written_total", "Packets written to the output.", "counter",
+                 stats.video.packetsWritten, stats.audio.packetsWritten);
+    appendStream(out, "push_frames_encoded_total", "Frames produced by the encoder.", "counter",
+                 stats.video.framesEncoded, stats.audio.framesEncoded);
+    appendStream(out, "push_key_frames_total", "Key frames produced by the encoder.", "counter",
+                 stats.video.keyFrames, stats.audio.keyFrames);
+    appendStream(out, "push_bitrate_bps", "Measured output bitrate over the last interval.", "gauge",
+                 stats.video.bitrate, stats.audio.bitrate);
+    appendStream(out, "push_queue_depth", "Send queue depth.", "gauge",
+                 stats.video.queueDepth, stats.audio.queueDepth);
+
+    out += "# HELP push_drops_total Dropped frames or packets by reason.\n"
+           "# TYPE push_drops_total counter\n";
+    for (int i = 0; i < int(DropReason::count); ++i) {
+        out += QString("push_drops_total{reason=\"%1\"} %2\n")
+                   .arg(PushStatsCounters::dropReasonName(DropReason(i))).arg(stats.drops[i]);
+    }
+    out += "# HELP push_silence_ratio Fraction of audio frames detected as silence.\n"
+           "# TYPE push_silence_ratio gauge\n";
+    out += QString("push_silence_ratio %1\n").arg(stats.silenceRatio);
+    out += "# HELP push_audio_deadline_misses_total Audio work started later than one encoder frame after its data arrived.\n"
+           "# TYPE push_audio_deadline_misses_total counter\n";
+    out += QString("push_audio_deadline_misses_total %1\n").arg(stats.audioDeadlineMisses);
+    if (stats.timeToFirstPacketMs >= 0) {
+        out += "# HELP push_time_to_first_packet_seconds Time from start to the first packet written to the output.\n"
+               "# TYPE push_time_to_first_packet_seconds gauge\n";
+        out += QString("push_time_to_first_packet_seconds %1\n").arg(stats.timeToFirstPacketMs / 1000.0);
+    }
+    if (stats.shutdownMs >= 0) {
+        out += "# HELP push_shutdown_seconds Time from the stop request until all resources were released.\n"
+               "# TYPE push_shutdown_seconds gauge\n";
+        out += QString("push_shutdown_seconds %1\n").arg(stats.shutdownMs / 1000.0);
+    }
+    out += "# HELP push_reconnect_attempts_total Output reconnect attempts after a write failure.\n"
+           "# TYPE push_reconnect_attempts_total counter\n";
+    out += QString("push_reconnect_attempts_total %1\n").arg(stats.reconnectAttempts);
+    out += "# HELP push_reconnects_total Successful output reconnects.\n"
+           "# TYPE push_reconnects_total counter\n";
+    out += QString("push_reconnects_total %1\n").arg(stats.reconnects);
+    out += "# HELP push_output_downtime_seconds_total Time the output was disconnected.\n"
+           "# TYPE push_output_downtime_seconds_total counter\n";
+    out += QString("push_output_downtime_seconds_total %1\n").arg(stats.downtimeMs / 1000.0);
+    out += "# HELP push_output_up Whether the output connection is currently up.\n"
+           "# TYPE push_output_up gauge\n";
+    out += QString("push_output_up %1\n").arg(stats.outputDown ? 0 : 1);
+    out += "# HELP push_sched_wait_seconds_total Time pipeline threads spent runnable but waiting for a CPU.\n"
+           "# TYPE push_sched_wait_seconds_total counter\n";
+    for (int i = 0; i < int(PipelineStage::count); ++i) {
+        out += QString("push_sched_wait_seconds_total{stage=\"%1\"} %2\n")
+                   .arg(ThreadTuning::stageName(PipelineStage(i))).arg(seconds(stats.sched[i].runQueueWaitUs));
+    }
+    out += "# HELP push_sched_timeslices_total Times pipeline threads were scheduled onto a CPU.\n"
+           "# TYPE push_sched_timeslices_total counter\n";
+    for (int i = 0; i < int(PipelineStage::count); ++i) {
+        out += QString("push_sched_timeslices_total{stage=\"%1\"} %2\n")
+                   .arg(ThreadTuning::stageName(PipelineStage(i))).arg(stats.sched[i].timeslices);
+    }
+    return out.toUtf8();
+}
@@ -0,0 +1,50 @@
+﻿// PushMetrics.h
+#ifndef PUSHMETRICS_H
+#define PUSHMETRICS_H
+
+#include <QMetaType>
+#include <QByteArray>
+#include "latencyhistogram.h"
+#include "pushstats.h"
+
+enum class LatencyMetric {
+    captureToEncode = 0,    // 视频采集完成到送入编码器
+    encodeDuration,         // 视频编码耗时
+    encodeToWire,           // 视频编码输出到写入输出
+    audioToWire,            // 音频帧首个采样采集到写入输出
+    audioSchedule,          // 音频数据送达编码线程到开始处理（调度延迟）
+    captureJitter,          // 帧时钟唤醒晚于计划时刻的时长
+    count
+};
+
+// 随编码包传递的时间戳（av_gettime_relative），-1表示未知
+struct PacketTiming {
+    qint64 captureUs = -1;      // 采集完成（音频为帧首个采样）
+    qint64 encodeEndUs = -1;    // 编码器输出该包
+};
+Q_DECLARE_METATYPE(PacketTiming)
+
+struct LatencyReport {
+    LatencySummary metrics[int(LatencyMetric::count)];
+
+    const LatencySummary& metric(LatencyMetric m) const { return metrics[int(m)]; }
+};
+Q_DECLARE_METATYPE(LatencyReport)
+
+// 推流延迟直方图集合，热路径直接record，统计定时器采样
+class PushMetrics
+{
+public:
+    void record(LatencyMetric metric, int64_t valueUs) { m_histograms[int(metric)].record(valueUs); }
+    void reset();
+    LatencyReport report() const;
+
+    static const char* metricName(LatencyMetric metric);
+    // Prometheus文本格式（exposition format 0.0.4）
+    static QByteArray toPrometheus(const LatencyReport& latency, const PushStatistics& stats);
+
+private:
+    LatencyHistogram m_histograms[int(LatencyMetric::count)];
+};
+
+#endif // PUSHMETRICS_H
@@ -0,0 +1,185 @@
+﻿// PushStats.cpp
+#include "pushstats.h"
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+qint64 PushStatistics::totalDrops() const
+{
+    qint64 total = 0;
+    for (qint64 n : drops) {
+        total += n;
+    }
+    return total;
+}
+
+PushStatsCounters::PushStatsCounters()
+{
+    reset();
+}
+
+void PushStatsCounters::reset()
+{
+    for (StreamCounters& s : m_streams) {
+        s.packetsWritten.store(0, std::memory_order_relaxed);
+        s.bytesWritten.store(0, std::memory_order_relaxed);
+        s.framesEncoded.store(0, std::memory_order_relaxed);
+        s.encodedBytes.store(0, std::memory_order_relaxed);
+        s.maxFrameBytes.store(0, std::memory_order_relaxed);
+        s.keyFrames.store(0, std::memory_order_relaxed);
+        s.lastKeyFrameBytes.store(0, std::memory_order_relaxed);
+        s.maxKeyFrameBytes.store(0, std::memory_order_relaxed);
+        s.queueDepth.store(0, std::memory_order_relaxed);
+        s.maxQueueDepth.store(0, std::memory_order_relaxed);
+        s.lastBytes = 0;
+    }
+    for (std::atomic<int64_t>& d : m_drops) {
+        d.store(0, std::memory_order_relaxed);
+    }
+    m_silenceRatioPermille.store(0, std::memory_order_relaxed);
+    m_audioDeadlineMisses.store(0, std::memory_order_relaxed);
+    m_reconnectAttempts.store(0, std::memory_order_relaxed);
+    m_reconnects.store(0, std::memory_order_relaxed);
+    m_downtimeUs.store(0, std::memory_order_relaxed);
+    m_downSinceUs.store(0, std::memory_order_relaxed);
+    m_firstPacketMs.store(-1, std::memory_order_relaxed);
+    m_shutdownMs.store(-1, std::memory_order_relaxed);
+    m_startUs.store(av_gettime_relative(), std::memory_order_relaxed);
+    m_lastSampleUs = m_startUs.load(std::memory_order_relaxed);
+}
+
+void PushStatsCounters::updateMax(std::atomic<int>& target, int value)
+{
+    int cur = target.load(std::memory_order_relaxed);
+    while (value > cur && !target.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {
+    }
+}
+
+void PushStatsCounters::addEncodedFrame(StatsStream stream, int bytes, bool keyFrame)
+{
+    StreamCounters& s = m_streams[int(stream)];
+    s.framesEncoded.fetch_add(1, std::memory_order_relaxed);
+    s.encodedBytes.fetch_add(bytes, std::memory_order_relaxed);
+    updateMax(s.maxFrameBytes, bytes);
+    if (keyFrame) {
+        s.keyFrames.fetch_add(1, std::memory_order_relaxed);
+        s.lastKeyFrameBytes.store(bytes, std::memory_order_relaxed);
+        updateMax(s.maxKeyFrameBytes, bytes);
+    }
+}
+
+void PushStatsCounters::addPacketWritten(StatsStream stream, int bytes)
+{
+    StreamCounters& s = m_streams[int(stream)];
+    s.packetsWritten.fetch_add(1, std::memory_order_relaxed);
+    s.bytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void PushStatsCounters::addDrop(DropReason reason, qint64 count)
+{
+    m_drops[int(reason)].fetch_add(count, std::memory_order_relaxed);
+}
+
+void PushStatsCounters::setQueueDepth(StatsStream stream, int depth)
+{
+    StreamCounters& s = m_streams[int(stream)];
+    s.queueDepth.store(depth, std::memory_order_relaxed);
+    updateMax(s.maxQueueDepth, depth);
+}
+
+void PushStatsCounters::setSilenceRatio(double ratio)
+{
+    m_silenceRatioPermille.store(int64_t(ratio * 1000.0 + 0.5), std::memory_order_relaxed);
+}
+
+void PushStatsCounters::addAudioDeadlineMiss()
+{
+    m_audioDeadlineMisses.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PushStatsCounters::addReconnectAttempt()
+{
+    m_reconnectAttempts.fetch_add(1, std::memory_order_relaxed);
+}
+
+qint64 PushStatsCounters::markFirstPacket()
+{
+    int64_t elapsedMs = (av_gettime_relative() - m_startUs.load(std::memory_order_relaxed)) / 1000;
+    int64_t expected = -1;
+    return m_firstPacketMs.compare_exchange_strong(expected, elapsedMs, std::memory_order_relaxed) ? elapsedMs : -1;
+}
+
+void PushStatsCounters::setOutputDown(bool down)
+{
+    int64_t now = av_gettime_relative();
+    if (down) {
+        int64_t expected = 0;
+        m_downSinceUs.compare_exchange_strong(expected, now, std::memory_order_relaxed);
+        return;
+    }
+    int64_t since = m_downSinceUs.exchange(0, std::memory_order_relaxed);
+    if (since > 0) {
+        m_downtimeUs.fetch_add(now - since, std::memory_order_relaxed);
+        m_reconnects.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+PushStatistics PushStatsCounters::sample()
+{
+    PushStatistics stats;
+    int64_t now = av_gettime_relative();
+    stats.elapsedMs = (now - m_startUs.load(std::memory_order_relaxed)) / 1000;
+    stats.intervalMs = (now - m_lastSampleUs) / 1000;
+
+    StreamStatistics* outs[int(StatsStream::count)] = {&stats.video, &stats.audio};
+    for (int i = 0; i < int(StatsStream::count); ++i) {
+        StreamCounters& s = m_streams[i];
+        StreamStatistics& out = *outs[i];
+        out.packetsWritten = s.packetsWritten.load(std::memory_order_relaxed);
+        out.bytesWritten = s.bytesWritten.load(std::memory_order_relaxed);
+        out.framesEncoded = s.framesEncoded.load(std::memory_order_relaxed);
+        out.encodedBytes = s.encodedBytes.load(std::memory_order_relaxed);
+        out.avgFrameBytes = out.framesEncoded > 0 ? int(out.encodedBytes / out.framesEncoded) : 0;
+        out.maxFrameBytes = s.maxFrameBytes.load(std::memory_order_relaxed);
+        out.keyFrames = s.keyFrames.load(std::memory_order_relaxed);
+        out.lastKeyFrameBytes = s.lastKeyFrameBytes.load(std::memory_order_relaxed);
+        out.maxKeyFrameBytes = s.maxKeyFrameBytes.load(std::memory_order_relaxed);
+        out.queueDepth = s.queueDepth.load(std::memory_order_relaxed);
+        out.maxQueueDepth = s.maxQueueDepth.load(std::memory_order_relaxed);
+        if (stats.intervalMs > 0) {
+            out.bitrate = (out.bytesWritten - s.lastBytes) * 8 * 1000 / stats.intervalMs;
+        }
+        s.lastBytes = out.bytesWritten;
+    }
+    for (int i = 0; i < int(DropReason::count); ++i) {
+        stats.drops[i] = m_drops[i].load(std::memory_order_relaxed);
+    }
+    stats.silenceRatio = m_silenceRatioPermille.load(std::memory_order_relaxed) / 1000.0;
+    stats.audioDeadlineMisses = m_audioDeadlineMisses.load(std::memory_order_relaxed);
+    stats.timeToFirstPacketMs = m_firstPacketMs.load(std::memory_order_relaxed);
+    stats.shutdownMs = m_shutdownMs.load(std::memory_order_relaxed);
+    stats.reconnectAttempts = m_reconnectAttempts.load(std::memory_order_relaxed);
+    stats.reconnects = m_reconnects.load(std::memory_order_relaxed);
+    int64_t downSince = m_downSinceUs.load(std::memory_order_relaxed);
+    stats.outputDown = downSince > 0;
+    stats.downtimeMs = (m_downtimeUs.load(std::memory_order_relaxed) + (downSince > 0 ? now - downSince : 0)) / 1000;
+    m_lastSampleUs = now;
+    return stats;
+}
+
+const char* PushStatsCounters::dropReasonName(DropReason reason)
+{
+    switch (reason) {
+    case DropReason::syncWaitAudio: return "sync_wait_audio";
+    case DropReason::syncAhead: return "sync_ahead";
+    case DropReason::syncBehind: return "sync_behind";
+    case DropReason::queueFull: return "queue_full";
+    case DropReason::writeError: return "write_error";
+    case DropReason::writeTimeout: return "write_timeout";
+    case DropReason::disconnected: return "disconnected";
+    case DropReason::silence: return "silence";
+    case DropReason::captureMissed: return "capture_missed";
+    default: return "unknown";
+    }
+}
@@ -0,0 +1,128 @@
+﻿// PushStats.h
+#ifndef PUSHSTATS_H
+#define PUSHSTATS_H
+
+#include <QMetaType>
+#include <QtGlobal>
+#include <atomic>
+#include <cstdint>
+#include "threadtuning.h"
+
+enum class StatsStream {
+    video = 0,
+    audio,
+    count
+};
+
+// 丢帧/丢包原因
+enum class DropReason {
+    syncWaitAudio = 0,  // 等待首个音频帧期间丢弃的视频帧
+    syncAhead,          // 视频超前超过最大等待
+    syncBehind,         // 视频滞后
+    queueFull,          // 发送队列已满
+    writeError,         // 写入输出失败
+    writeTimeout,       // 写出超时及之后连接失效期间丢弃的包
+    disconnected,       // 断线期间积压、重连后因过期被清掉的包
+    silence,            // 静音门限跳过的音频帧
+    captureMissed,      // 采集错过帧时钟截止时刻而跳过的tick
+    count
+};
+
+// 单路流的统计快照
+struct StreamStatistics {
+    qint64 packetsWritten = 0;      // 成功写入输出的包数
+    qint64 bytesWritten = 0;
+    qint64 bitrate = 0;             // 采样区间内实测码率(bps)
+    qint64 framesEncoded = 0;       // 编码器输出的帧数
+    qint64 encodedBytes = 0;
+    int avgFrameBytes = 0;
+    int maxFrameBytes = 0;
+    qint64 keyFrames = 0;           // 视频为IDR帧
+    int lastKeyFrameBytes = 0;
+    int maxKeyFrameBytes = 0;
+    int queueDepth = 0;             // 采样时刻的发送队列深度
+    int maxQueueDepth = 0;
+};
+
+// 推流统计快照，按设定间隔由计数器采样生成
+struct PushStatistics {
+    qint64 elapsedMs = 0;           // 自开始推流起的时长
+    qint64 intervalMs = 0;          // 距上次采样的时长
+    StreamStatistics video;
+    StreamStatistics audio;
+    qint64 drops[int(DropReason::count)] = {};
+    double silenceRatio = 0.0;
+    qint64 audioDeadlineMisses = 0; // 音频数据到达后超过一个编码帧时长才开始处理的次数
+    qint64 reconnectAttempts = 0;   // 输出断线后的重连尝试次数
+    qint64 reconnects = 0;          // 重连成功次数
+    qint64 downtimeMs = 0;          // 输出断线累计时长（含当前仍在断线的部分）
+    bool outputDown = false;
+    qint64 timeToFirstPacketMs = -1; // 开始推流到首个包写出的耗时，尚未写出为-1
+    qint64 shutdownMs = -1;          // 上次停止从请求到资源释放的耗时，未停止过为-1
+    StageSchedStats sched[int(PipelineStage::count)];   // 各阶段线程的调度统计（进程级累计）
+
+    qint64 totalDrops() const;
+    qint64 drop(DropReason reason) const { return drops[int(reason)]; }
+};
+Q_DECLARE_METATYPE(PushStatistics)
+
+// 热路径上无锁更新的计数器，编码/发送线程直接累加，统计定时器在其他线程采样
+class PushStatsCounters
+{
+public:
+    PushStatsCounters();
+
+    void reset();
+
+    // 编码器输出一帧（包）
+    void addEncodedFrame(StatsStream stream, int bytes, bool keyFrame);
+    // 一个包成功写入输出
+    void addPacketWritten(StatsStream stream, int bytes);
+    void addDrop(DropReason reason, qint64 count = 1);
+    void setQueueDepth(StatsStream stream, int depth);
+    void setSilenceRatio(double ratio);
+    void addAudioDeadlineMiss();
+    void addReconnectAttempt();
+    // 首个包写出，只有第一次调用生效并返回距reset的毫秒数，之后返回-1
+    qint64 markFirstPacket();
+    void setShutdownMs(qint64 ms) { m_shutdownMs.store(ms, std::memory_order_relaxed); }
+    // 输出断线/恢复，恢复时累计断线时长并计一次重连成功
+    void setOutputDown(bool down);
+
+    // 生成快照并计算与上次采样之间的码率，只应在一个线程中调用
+    PushStatistics sample();
+
+    static const char* dropReasonName(DropReason reason);
+
+private:
+    struct StreamCounters {
+        std::atomic<int64_t> packetsWritten{0};
+        std::atomic<int64_t> bytesWritten{0};
+        std::atomic<int64_t> framesEncoded{0};
+        std::atomic<int64_t> encodedBytes{0};
+        std::atomic<int> maxFrameBytes{0};
+        std::atomic<int64_t> keyFrames{0};
+        std::atomic<int> lastKeyFrameBytes{0};
+        std::atomic<int> maxKeyFrameBytes{0};
+        std::atomic<int> queueDepth{0};
+        std::atomic<int> maxQueueDepth{0};
+        int64_t lastBytes = 0;      // 采样线程私有
+    };
+
+    static void updateMax(std::atomic<int>& target, int value);
+
+    StreamCounters m_streams[int(StatsStream::count)];
+    std::atomic<int64_t> m_drops[int(DropReason::count)];
+    std::atomic<int64_t> m_silenceRatioPermille{0};
+    std::atomic<int64_t> m_audioDeadlineMisses{0};
+    std::atomic<int64_t> m_reconnectAttempts{0};
+    std::atomic<int64_t> m_reconnects{0};
+    std::atomic<int64_t> m_downtimeUs{0};
+    std::atomic<int64_t> m_downSinceUs{0};     // 0为输出正常
+    std::atomic<int64_t> m_firstPacketMs{-1};
+    std::atomic<int64_t> m_shutdownMs{-1};
+    std::atomic<int64_t> m_startUs{0};
+    int64_t m_lastSampleUs = 0;
+};
+
+#endif // PUSHSTATS_H
@@ -0,0 +1,347 @@
+﻿// ThreadTuning.cpp
+#include "threadtuning.h"
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QThread>
+#include "Logger.h"
+#include "pushstats.h"
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <windows.h>
+#endif
+
+namespace
+{
+const int STAGE_COUNT = int(PipelineStage::count);
+
+struct Registry {
+    QMutex mutex;
+    StageTuning stages[STAGE_COUNT];
+    bool isolateEncoder = false;
+    StageSchedStats exited[STAGE_COUNT];        // 已退出线程的累计值
+    QHash<qint64, PipelineStage> threads;       // tid -> 阶段
+};
+
+Registry& registry()
+{
+    static Registry r;
+    return r;
+}
+
+qint64 currentTid()
+{
+#ifdef Q_OS_LINUX
+    return qint64(syscall(SYS_gettid));
+#elif defined(Q_OS_WIN)
+    return qint64(GetCurrentThreadId());
+#else
+    return 0;
+#endif
+}
+
+bool readSchedStat(qint64 tid, qint64* waitUs, qint64* slices)
+{
+#ifdef Q_OS_LINUX
+    // 三个字段：运行时间(ns) 运行队列等待时间(ns) 被调度运行的次数
+    QFile file(QString("/proc/self/task/%1/schedstat").arg(tid));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QList<QByteArray> fields = file.readAll().simplified().split(' ');
+    if (fields.size() < 3) {
+        return false;
+    }
+    *waitUs = fields[1].toLongLong() / 1000;
+    *slices = fields[2].toLongLong();
+    return true;
+#else
+    Q_UNUSED(tid);
+    Q_UNUSED(waitUs);
+    Q_UNUSED(slices);
+    return false;
+#endif
+}
+
+bool parseCpuList(const QString& text, QList<int>* cpus)
+{
+    for (const QString& part : text.split(',', QString::SkipEmptyParts)) {
+        QStringList range = part.split('-');
+        bool ok1 = false, ok2 = false;
+        int first = range[0].toInt(&ok1);
+        int last = range.size() == 2 ? range[1].toInt(&ok2) : first;
+        if (!ok1 || (range.size() == 2 && !ok2) || range.size() > 2 || first < 0 || last < first) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; ++cpu) {
+            if (!cpus->contains(cpu)) {
+                cpus->append(cpu);
+            }
+        }
+    }
+    return !cpus->isEmpty();
+}
+
+// 显式配置优先；编码隔离时其余阶段让出编码CPU
+QList<int> effectiveCpus(Registry& r, PipelineStage stage)
+{
+    const QList<int>& own = r.stages[int(stage)].cpus;
+    const QList<int>& encoder = r.stages[int(PipelineStage::videoEncode)].cpus;
+    if (!own.isEmpty() || !r.isolateEncoder || stage == PipelineStage::videoEncode || encoder.isEmpty()) {
+        return own;
+    }
+    QList<int> rest;
+    for (int cpu = 0; cpu < QThread::idealThreadCount(); ++cpu) {
+        if (!encoder.contains(cpu)) {
+            rest.append(cpu);
+        }
+    }
+    return rest;
+}
+
+bool setCurrentAffinity(const QList<int>& cpus)
+{
+#ifdef Q_OS_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(Q_OS_WIN)
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus) {
+        if (cpu < int(sizeof(DWORD_PTR) * 8)) {
+            mask |= DWORD_PTR(1) << cpu;
+        }
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    Q_UNUSED(cpus);
+    return false;
+#endif
+}
+
+void applyPriority(const StageTuning& tuning, const char* name)
+{
+#ifdef Q_OS_LINUX
+    if (tuning.fifoPriority > 0) {
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = qBound(1, tuning.fifoPriority, 99);
+        int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (ret == 0) {
+            return;
+        }
+        LogWarn << "【线程调优】" << name << "设置SCHED_FIFO失败:" << strerror(ret)
+                << (tuning.nice != 0 ? "，改用nice" : "");
+    }
+    // Linux上setpriority对单个线程(tid)生效
+    if (tuning.nice != 0 && setpriority(PRIO_PROCESS, id_t(currentTid()), tuning.nice) != 0) {
+        LogWarn << "【线程调优】" << name << "设置nice失败:" << strerror(errno);
+    }
+#elif defined(Q_OS_WIN)
+    int priority = THREAD_PRIORITY_NORMAL;
+    if (tuning.fifoPriority > 0) {
+        priority = THREAD_PRIORITY_TIME_CRITICAL;
+    } else if (tuning.nice < 0) {
+        priority = tuning.nice <= -10 ? THREAD_PRIORITY_HIGHEST : THREAD_PRIORITY_ABOVE_NORMAL;
+    } else if (tuning.nice > 0) {
+        priority = tuning.nice >= 10 ? THREAD_PRIORITY_LOWEST : THREAD_PRIORITY_BELOW_NORMAL;
+    }
+    if ((tuning.fifoPriority > 0 || tuning.nice != 0) && !SetThreadPriority(GetCurrentThread(), priority)) {
+        LogWarn << "【线程调优】" << name << "设置线程优先级失败:" << GetLastError();
+    }
+#else
+    Q_UNUSED(tuning);
+    Q_UNUSED(name);
+#endif
+}
+} // namespace
+
+QString StageTuning::toString() const
+{
+    QStringList parts;
+    if (!cpus.isEmpty()) {
+        QStringList list;
+        for (int cpu : cpus) {
+            list << QString::number(cpu);
+        }
+        parts << "cpus=" + list.join(',');
+    }
+    if (fifoPriority > 0) {
+        parts << QString("fifo=%1").arg(fifoPriority);
+    }
+    if (nice != 0) {
+        parts << QString("nice=%1").arg(nice);
+    }
+    return parts.join(' ');
+}
+
+bool ThreadTuning::parse(const QString& spec, StageTuning* out, QString* errMsg)
+{
+    StageTuning tuning;
+    for (const QString& token : spec.split(' ', QString::SkipEmptyParts)) {
+        int eq = token.indexOf('=');
+        QString key = token.left(eq).toLower();
+        QString value = eq > 0 ? token.mid(eq + 1) : QString();
+        bool ok = false;
+        if (key == "cpus") {
+            ok = parseCpuList(value, &tuning.cpus);
+        } else if (key == "fifo") {
+            tuning.fifoPriority = value.toInt(&ok);
+            ok = ok && tuning.fifoPriority >= 1 && tuning.fifoPriority <= 99;
+        } else if (key == "nice") {
+            tuning.nice = value.toInt(&ok);
+            ok = ok && tuning.nice >= -20 && tuning.nice <= 19;
+        }
+        if (!ok) {
+            *errMsg = QString("invalid thread tuning '%1' in '%2'").arg(token, spec);
+            return false;
+        }
+    }
+    *out = tuning;
+    return true;
+}
+
+void ThreadTuning::setStage(PipelineStage stage, const StageTuning& tuning)
+{
+    Registry& r = registry();
+    QMutexLocker locker(&r.mutex);
+    r.stages[int(stage)] = tuning;
+}
+
+StageTuning ThreadTuning::stage(PipelineStage stage)
+{
+    Registry& r = registry();
+    QMutexLocker locker(&r.mutex);
+    return r.stages[int(stage)];
+}
+
+void ThreadTuning::setEncoderIsolation(bool enabled)
+{
+    Registry& r = registry();
+    QMutexLocker locker(&r.mutex);
+    r.isolateEncoder = enabled;
+}
+
+StageSchedStats ThreadTuning::schedStats(PipelineStage stage)
+{
+    Registry& r = registry();
+    QMutexLocker locker(&r.mutex);
+    StageSchedStats stats = r.exited[int(stage)];
+    for (auto it = r.threads.constBegin(); it != r.threads.constEnd(); ++it) {
+        qint64 waitUs = 0, slices = 0;
+        if (it.value() == stage && readSchedStat(it.key(), &waitUs, &slices)) {
+            stats.runQueueWaitUs += waitUs;
+            stats.timeslices += slices;
+            ++stats.threads;
+        }
+    }
+    return stats;
+}
+
+void ThreadTuning::sampleSchedStats(PushStatistics* stats)
+{
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        stats->sched[i] = schedStats(PipelineStage(i));
+    }
+}
+
+bool ThreadTuning::schedStatsAvailable()
+{
+#ifdef Q_OS_LINUX
+    return QFile::exists("/proc/self/schedstat");
+#else
+    return false;
+#endif
+}
+
+ThreadTuning::StageScope::StageScope(PipelineStage stage)
+    : m_stage(stage)
+    , m_tid(currentTid())
+{
+    Registry& r = registry();
+    StageTuning tuning;
+    QList<int> cpus;
+    {
+        QMutexLocker locker(&r.mutex);
+        tuning = r.stages[int(stage)];
+        cpus = effectiveCpus(r, stage);
+        r.threads.insert(m_tid, stage);
+    }
+    const char* name = stageName(stage);
+    if (!cpus.isEmpty() && !setCurrentAffinity(cpus)) {
+        LogWarn << "【线程调优】" << name << "绑核失败";
+    }
+    applyPriority(tuning, name);
+    if (!tuning.isDefault()) {
+        LogInfo << "【线程调优】" << name << "线程" << m_tid << tuning.toString();
+    }
+}
+
+ThreadTuning::StageScope::~StageScope()
+{
+    Registry& r = registry();
+    QMutexLocker locker(&r.mutex);
+    qint64 waitUs = 0, slices = 0;
+    if (readSchedStat(m_tid, &waitUs, &slices)) {
+        r.exited[int(m_stage)].runQueueWaitUs += waitUs;
+        r.exited[int(m_stage)].timeslices += slices;
+    }
+    r.threads.remove(m_tid);
+}
+
+ThreadTuning::ScopedStageAffinity::ScopedStageAffinity(PipelineStage stage)
+{
+    QList<int> cpus;
+    {
+        Registry& r = registry();
+        QMutexLocker locker(&r.mutex);
+        cpus = effectiveCpus(r, stage);
+    }
+    if (cpus.isEmpty()) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    m_saved.resize(sizeof(cpu_set_t));
+    if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t),
+                               reinterpret_cast<cpu_set_t*>(m_saved.data())) != 0) {
+        return;
+    }
+    m_changed = setCurrentAffinity(cpus);
+#elif defined(Q_OS_WIN)
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus) {
+        if (cpu < int(sizeof(DWORD_PTR) * 8)) {
+            mask |= DWORD_PTR(1) << cpu;
+        }
+    }
+    DWORD_PTR previous = mask ? SetThreadAffinityMask(GetCurrentThread(), mask) : 0;
+    if (previous) {
+        m_saved = QByteArray(reinterpret_cast<const char*>(&previous), sizeof(previous));
+        m_changed = true;
+    }
+#endif
+}
+
+ThreadTuning::ScopedStageAffinity::~ScopedStageAffinity()
+{
+    if (!m_changed) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), reinterpret_cast<const cpu_set_t*>(m_saved.constData()));
+#elif defined(Q_OS_WIN)
+    SetThreadAffinityMask(GetCurrentThread(), *reinterpret_cast<const DWORD_PTR*>(m_saved.constData()));
+#endif
+}
@@ -0,0 +1,96 @@
+﻿// ThreadTuning.h
+#ifndef THREADTUNING_H
+#define THREADTUNING_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QtGlobal>
+
+struct PushStatistics;
+
+// 推流流水线中各类线程所属的阶段，按阶段统一配置绑核与调度策略
+enum class PipelineStage {
+    videoCapture = 0,   // 视频采集；legacy流水线的CodeThread（采集、编码、复用同一线程）也归此阶段
+    audioCapture,
+    videoEncode,        // 视频转换与编码；共享线程池normal组的工作线程也归此阶段
+    audioEncode,        // 共享线程池high组（音频编码）的工作线程也归此阶段
+    push,               // 复用与写出
+    count
+};
+
+// 单个阶段的线程调优，全部为默认值时不做任何修改
+struct StageTuning {
+    QList<int> cpus;            // 绑定的CPU，空为不绑定
+    int fifoPriority = 0;       // >0时使用SCHED_FIFO（1-99），需要CAP_SYS_NICE或rtprio限额
+    int nice = 0;               // 非实时线程的nice值（-20~19），fifoPriority>0时忽略
+
+    bool isDefault() const { return cpus.isEmpty() && fifoPriority == 0 && nice == 0; }
+    QString toString() const;
+};
+
+// 调度统计（累计值）：线程可运行但在运行队列中等待的总时长与被调度运行的次数，
+// 两者之比为平均调度延迟。数据来自/proc/<tid>/schedstat，其他平台为0
+struct StageSchedStats {
+    qint64 runQueueWaitUs = 0;
+    qint64 timeslices = 0;
+    int threads = 0;            // 当前存活的线程数
+};
+
+// 进程级的阶段调优配置。各线程在run()开头构造StageScope，按所属阶段应用配置并登记调度统计
+namespace ThreadTuning
+{
+// 格式："cpus=2-3,6 fifo=50" 或 "cpus=0-1 nice=-5"，空串为默认
+bool parse(const QString& spec, StageTuning* out, QString* errMsg);
+void setStage(PipelineStage stage, const StageTuning& tuning);
+StageTuning stage(PipelineStage stage);
+// 编码隔离：videoEncode配置了CPU时，其他未显式绑核的阶段绑定到其余CPU上
+void setEncoderIsolation(bool enabled);
+
+// 头文件内联，统计导出（pushmetrics）无需链接本模块
+inline const char* stageName(PipelineStage stage)
+{
+    switch (stage) {
+    case PipelineStage::videoCapture: return "video-capture";
+    case PipelineStage::audioCapture: return "audio-capture";
+    case PipelineStage::videoEncode: return "video-encode";
+    case PipelineStage::audioEncode: return "audio-encode";
+    case PipelineStage::push: return "push";
+    default: return "unknown";
+    }
+}
+
+StageSchedStats schedStats(PipelineStage stage);
+bool schedStatsAvailable();
+// 把各阶段调度统计填入统计快照
+void sampleSchedStats(PushStatistics* stats);
+
+// 对当前线程应用阶段配置并登记调度统计，析构时注销（累计值保留）
+class StageScope
+{
+public:
+    explicit StageScope(PipelineStage stage);
+    ~StageScope();
+
+private:
+    Q_DISABLE_COPY(StageScope)
+    PipelineStage m_stage;
+    qint64 m_tid;
+};
+
+// 临时把当前线程绑定到某阶段的CPU上，析构时恢复。编码器在avcodec_open2中创建的
+// 工作线程继承创建线程的亲和性，打开编码器时使用，使编码隔离对x264线程同样生效
+class ScopedStageAffinity
+{
+public:
+    explicit ScopedStageAffinity(PipelineStage stage);
+    ~ScopedStageAffinity();
+
+private:
+    Q_DISABLE_COPY(ScopedStageAffinity)
+    bool m_changed = false;
+    QByteArray m_saved;         // 平台相关的原亲和性掩码
+};
+} // namespace ThreadTuning
+
+#endif // THREADTUNING_H
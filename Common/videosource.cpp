@@ -0,0 +1,580 @@
+﻿// VideoSource.cpp
+#include "videosource.h"
+#include "Logger.h"
+#include "capturefile.h"
+#include "pushmetrics.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QUrl>
+#include <QUrlQuery>
+#include <memory>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavdevice/avdevice.h>
+#include <libavformat/avformat.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+}
+
+namespace
+{
+const char* const TEST_PATTERNS[] = {"testsrc", "testsrc2", "smptebars", "smptehdbars", "rgbtestsrc",
+                                     "yuvtestsrc", "mandelbrot", "life", "cellauto"};
+
+// 零拷贝帧引用映射内存时，AVBuffer持有映射所有者的一份shared_ptr，最后一个帧引用释放后才解除映射
+template <typename T>
+void releaseShared(void* opaque, uint8_t*)
+{
+    delete static_cast<std::shared_ptr<T>*>(opaque);
+}
+
+// 屏幕采集、lavfi测试图与媒体文件共用：avformat读包 + 解码
+class FFmpegVideoSource : public VideoSource
+{
+public:
+    explicit FFmpegVideoSource(const VideoSourceConfig& config) : VideoSource(config) {}
+    ~FFmpegVideoSource() override { close(); }
+
+    bool open(QString* errMsg) override;
+    void close() override;
+
+protected:
+    int readFrame(AVFrame* frame, FrameTrace::FrameStamps* stamps) override;
+    bool selfPaced() const override { return m_config.type == VideoSourceType::screen && !m_config.frameClock; }
+
+private:
+    bool openInput(const QString& url, AVInputFormat* inputFmt, AVDictionary** options, QString* errMsg);
+    QString testPatternGraph(bool withCounter) const;
+    bool rawVideoKnown() const;
+
+    AVFormatContext* m_fmtCtx = nullptr;
+    AVCodecContext* m_codecCtx = nullptr;
+    AVPacket* m_packet = nullptr;
+    int m_streamIndex = -1;
+    bool m_draining = false;
+};
+
+QString FFmpegVideoSource::testPatternGraph(bool withCounter) const
+{
+    QString graph = QString("%1=size=%2x%3:rate=%4")
+                        .arg(m_config.location).arg(m_config.width).arg(m_config.height).arg(m_config.fps);
+    if (withCounter) {
+        // 帧号叠加在左上角，便于接收端肉眼核对丢帧/卡顿
+        int fontSize = qMax(16, m_config.height / 12);
+        graph += QString(",drawtext=text='%{frame_num}':x=16:y=16:fontsize=%1:fontcolor=white"
+                         ":box=1:boxcolor=black@0.6:boxborderw=8").arg(fontSize);
+    }
+    return graph + ",format=bgra";
+}
+
+bool FFmpegVideoSource::rawVideoKnown() const
+{
+    // 抓屏设备与lavfi在打开时已给出rawvideo的尺寸与像素格式，无需抓帧探测
+    if (m_config.type != VideoSourceType::screen && m_config.type != VideoSourceType::testPattern) {
+        return false;
+    }
+    if (m_fmtCtx->nb_streams != 1) {
+        return false;
+    }
+    const AVCodecParameters* codecPar = m_fmtCtx->streams[0]->codecpar;
+    return codecPar->codec_type == AVMEDIA_TYPE_VIDEO && codecPar->codec_id == AV_CODEC_ID_RAWVIDEO &&
+           codecPar->width > 0 && codecPar->height > 0 && codecPar->format != AV_PIX_FMT_NONE;
+}
+
+bool FFmpegVideoSource::openInput(const QString& url, AVInputFormat* inputFmt, AVDictionary** options,
+                                  QString* errMsg)
+{
+    int ret = avformat_open_input(&m_fmtCtx, url.toUtf8().constData(), inputFmt, options);
+    if (ret < 0) {
+        char errbuf[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        if (errMsg) {
+            *errMsg = QString("打开视频源失败: %1 (%2)").arg(url, errbuf);
+        }
+        return false;
+    }
+    return true;
+}
+
+bool FFmpegVideoSource::open(QString* errMsg)
+{
+    close();
+    avdevice_register_all();
+
+    AVDictionary* options = nullptr;
+    bool opened = false;
+    if (m_config.type == VideoSourceType::screen) {
+#ifdef  Q_OS_WIN
+        AVInputFormat* inputFmt = av_find_input_format("gdigrab");//获取GDI屏幕录制设备
+#else
+        AVInputFormat* inputFmt = av_find_input_format("x11grab");//获取X11屏幕录制设备
+#endif
+        if (!inputFmt) {
+            if (errMsg) {
+                *errMsg = "无法找到屏幕录制设备";
+            }
+            return false;
+        }
+        // 帧时钟触发抓屏时，把设备帧率设得远高于目标帧率，设备内部不再睡眠等待，
+        // 否则两套节拍叠加会在帧时钟的tick上再等设备的下一帧
+        int deviceFps = m_config.frameClock ? qMax(240, m_config.fps * 8) : m_config.fps;
+        av_dict_set(&options, "framerate", QString::number(deviceFps).toUtf8().constData(), 0);
+        av_dict_set(&options, "video_size",
+                    QString("%1x%2").arg(m_config.width).arg(m_config.height).toUtf8().constData(), 0);
+        av_dict_set(&options, "draw_mouse", m_config.drawMouse ? "1" : "0", 0);
+        opened = openInput(m_config.location, inputFmt, &options, errMsg);
+    } else if (m_config.type == VideoSourceType::testPattern) {
+        AVInputFormat* inputFmt = av_find_input_format("lavfi");
+        if (!inputFmt) {
+            if (errMsg) {
+                *errMsg = "FFmpeg未编译lavfi输入设备";
+            }
+            return false;
+        }
+        opened = openInput(testPatternGraph(true), inputFmt, nullptr, errMsg);
+        if (!opened) {
+            // drawtext依赖freetype/fontconfig，缺失时退回不带帧号的测试图
+            LogWarn << "【视频源】drawtext不可用，测试图不叠加帧号";
+            opened = openInput(testPatternGraph(false), inputFmt, nullptr, errMsg);
+        }
+    } else {
+        opened = openInput(m_config.location, nullptr, nullptr, errMsg);
+    }
+    av_dict_free(&options);
+    if (!opened) {
+        return false;
+    }
+
+    // find_stream_info会先读若干帧分析，抓屏时要白等几个帧间隔，已知格式的采集源跳过
+    if (!rawVideoKnown() && avformat_find_stream_info(m_fmtCtx, nullptr) < 0) {
+        if (errMsg) {
+            *errMsg = "查找流信息失败";
+        }
+        close();
+        return false;
+    }
+    m_streamIndex = av_find_best_stream(m_fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (m_streamIndex < 0) {
+        if (errMsg) {
+            *errMsg = "未找到视频流";
+        }
+        close();
+        return false;
+    }
+
+    AVCodecParameters* codecPar = m_fmtCtx->streams[m_streamIndex]->codecpar;
+    AVCodec* codec = avcodec_find_decoder(codecPar->codec_id);
+    m_codecCtx = codec ? avcodec_alloc_context3(codec) : nullptr;
+    if (!m_codecCtx || avcodec_parameters_to_context(m_codecCtx, codecPar) < 0 ||
+        avcodec_open2(m_codecCtx, codec, nullptr) < 0) {
+        if (errMsg) {
+            *errMsg = "打开解码器失败";
+        }
+        close();
+        return false;
+    }
+
+    m_packet = av_packet_alloc();
+    m_width = m_codecCtx->width;
+    m_height = m_codecCtx->height;
+    m_pixelFormat = m_codecCtx->pix_fmt;
+    m_draining = false;
+    return true;
+}
+
+void FFmpegVideoSource::close()
+{
+    av_packet_free(&m_packet);
+    avcodec_free_context(&m_codecCtx);
+    avformat_close_input(&m_fmtCtx);
+    m_streamIndex = -1;
+}
+
+int FFmpegVideoSource::readFrame(AVFrame* frame, FrameTrace::FrameStamps* stamps)
+{
+    if (!m_fmtCtx) {
+        return AVERROR(EINVAL);
+    }
+    while (true) {
+        int ret = avcodec_receive_frame(m_codecCtx, frame);
+        if (ret == 0) {
+            if (stamps) {
+                stamps->decodeEndUs = FrameTrace::nowUs();
+            }
+            return 0;
+        }
+        if (ret == AVERROR_EOF) {
+            if (m_config.type == VideoSourceType::mediaFile && m_config.loop) {
+                // 文件循环：回到开头并清空解码器
+                av_seek_frame(m_fmtCtx, m_streamIndex, 0, AVSEEK_FLAG_BACKWARD);
+                avcodec_flush_buffers(m_codecCtx);
+                m_draining = false;
+                continue;
+            }
+            return AVERROR_EOF;
+        }
+        if (ret != AVERROR(EAGAIN)) {
+            return ret;
+        }
+        if (m_draining) {
+            return AVERROR_EOF;
+        }
+
+        if (stamps) {
+            stamps->readBeginUs = FrameTrace::nowUs();
+        }
+        ret = av_read_frame(m_fmtCtx, m_packet);
+        if (stamps) {
+            stamps->readEndUs = FrameTrace::nowUs();
+        }
+        if (ret == AVERROR_EOF) {
+            avcodec_send_packet(m_codecCtx, nullptr);   // 取出解码器中剩余的帧
+            m_draining = true;
+            continue;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        if (m_packet->stream_index == m_streamIndex) {
+            ret = avcodec_send_packet(m_codecCtx, m_packet);
+        }
+        av_packet_unref(m_packet);
+        if (ret < 0 && ret != AVERROR(EAGAIN)) {
+            return ret;
+        }
+    }
+}
+
+// 原始像素文件：整体mmap，帧直接引用映射内存（只读）
+struct RawMapping {
+    QFile file;
+    uchar* data = nullptr;
+    ~RawMapping()
+    {
+        if (data) {
+            file.unmap(data);
+        }
+    }
+};
+
+class RawVideoSource : public VideoSource
+{
+public:
+    explicit RawVideoSource(const VideoSourceConfig& config) : VideoSource(config) {}
+    ~RawVideoSource() override { close(); }
+
+    bool open(QString* errMsg) override;
+    void close() override { m_mapping.reset(); }
+
+protected:
+    int readFrame(AVFrame* frame, FrameTrace::FrameStamps* stamps) override;
+
+private:
+    std::shared_ptr<RawMapping> m_mapping;
+    qint64 m_frameBytes = 0;
+    qint64 m_frameCount = 0;
+    qint64 m_nextFrame = 0;
+};
+
+bool RawVideoSource::open(QString* errMsg)
+{
+    close();
+    std::shared_ptr<RawMapping> mapping = std::make_shared<RawMapping>();
+    mapping->file.setFileName(m_config.location);
+    if (!mapping->file.open(QIODevice::ReadOnly)) {
+        if (errMsg) {
+            *errMsg = QString("打开原始视频文件失败: %1").arg(m_config.location);
+        }
+        return false;
+    }
+    m_frameBytes = av_image_get_buffer_size(m_config.rawFormat, m_config.width, m_config.height, 1);
+    m_frameCount = m_frameBytes > 0 ? mapping->file.size() / m_frameBytes : 0;
+    if (m_frameCount == 0) {
+        if (errMsg) {
+            *errMsg = QString("原始视频文件不足一帧: %1").arg(m_config.location);
+        }
+        return false;
+    }
+    if (mapping->file.size() % m_frameBytes != 0) {
+        LogWarn << "【视频源】文件大小不是帧大小的整数倍，忽略末尾" << mapping->file.size() % m_frameBytes << "字节";
+    }
+    mapping->data = mapping->file.map(0, m_frameCount * m_frameBytes);
+    if (!mapping->data) {
+        if (errMsg) {
+            *errMsg = QString("映射原始视频文件失败: %1").arg(mapping->file.errorString());
+        }
+        return false;
+    }
+
+    m_mapping = mapping;
+    m_nextFrame = 0;
+    m_width = m_config.width;
+    m_height = m_config.height;
+    m_pixelFormat = m_config.rawFormat;
+    return true;
+}
+
+int RawVideoSource::readFrame(AVFrame* frame, FrameTrace::FrameStamps* stamps)
+{
+    if (!m_mapping) {
+        return AVERROR(EINVAL);
+    }
+    if (m_nextFrame >= m_frameCount) {
+        if (!m_config.loop) {
+            return AVERROR_EOF;
+        }
+        m_nextFrame = 0;
+    }
+    int64_t nowUs = FrameTrace::nowUs();
+    uint8_t* data = m_mapping->data + m_nextFrame * m_frameBytes;
+    ++m_nextFrame;
+
+    frame->buf[0] = av_buffer_create(data, int(m_frameBytes), releaseShared<RawMapping>,
+                                     new std::shared_ptr<RawMapping>(m_mapping), AV_BUFFER_FLAG_READONLY);
+    if (!frame->buf[0]) {
+        return AVERROR(ENOMEM);
+    }
+    av_image_fill_arrays(frame->data, frame->linesize, data, m_pixelFormat, m_width, m_height, 1);
+    frame->format = m_pixelFormat;
+    frame->width = m_width;
+    frame->height = m_height;
+    if (stamps) {
+        stamps->readBeginUs = nowUs;
+        stamps->readEndUs = nowUs;
+        stamps->decodeEndUs = nowUs;
+    }
+    return 0;
+}
+
+// 采集录制回放：未压缩的帧直接引用映射内存，LZ4压缩的帧逐帧解压；
+// realtime时按录制的采集时刻输出，与AudioProcessor的音频回放共用同一时间零点与循环周期
+class ReplayVideoSource : public VideoSource
+{
+public:
+    explicit ReplayVideoSource(const VideoSourceConfig& config) : VideoSource(config) {}
+    ~ReplayVideoSource() override { close(); }
+
+    bool open(QString* errMsg) override;
+    void close() override { m_reader.reset(); }
+
+protected:
+    int readFrame(AVFrame* frame, FrameTrace::FrameStamps* stamps) override;
+    bool selfPaced() const override { return true; }
+
+private:
+    std::shared_ptr<CaptureFileReader> m_reader;
+    QVector<int> m_frames;
+    int m_nextFrame = 0;
+    int64_t m_firstUs = 0;
+    int64_t m_loopUs = 0;
+    int64_t m_loops = 0;
+    int64_t m_startUs = -1;
+};
+
+bool ReplayVideoSource::open(QString* errMsg)
+{
+    close();
+    std::shared_ptr<CaptureFileReader> reader = std::make_shared<CaptureFileReader>();
+    if (!reader->open(m_config.location, errMsg)) {
+        return false;
+    }
+    m_frames = reader->indicesOf(CaptureFile::RecordType::video);
+    if (m_frames.isEmpty()) {
+        if (errMsg) {
+            *errMsg = QString("录制文件中没有视频帧: %1").arg(m_config.location);
+        }
+        return false;
+    }
+
+    const CaptureFile::RecordInfo& first = reader->records()[m_frames.first()];
+    m_reader = reader;
+    m_width = first.width;
+    m_height = first.height;
+    m_pixelFormat = AVPixelFormat(first.format);
+    m_firstUs = reader->firstCaptureUs();
+    m_loopUs = reader->loopDurationUs();
+    m_nextFrame = 0;
+    m_loops = 0;
+    m_startUs = m_config.replayStartUs;
+    LogInfo << "【视频源】回放录制文件:" << m_config.location << m_frames.size() << "帧"
+            << m_loopUs / 1000 << "ms";
+    return true;
+}
+
+int ReplayVideoSource::readFrame(AVFrame* frame, FrameTrace::FrameStamps* stamps)
+{
+    if (!m_reader) {
+        return AVERROR(EINVAL);
+    }
+    if (m_nextFrame >= m_frames.size()) {
+        if (!m_config.loop) {
+            return AVERROR_EOF;
+        }
+        m_nextFrame = 0;
+        ++m_loops;
+    }
+    const CaptureFile::RecordInfo& record = m_reader->records()[m_frames[m_nextFrame++]];
+    // 打开时已校验负载长度与尺寸一致；下游按首帧参数建立转换，中途变化的帧无法处理
+    if (record.width != m_width || record.height != m_height || record.format != m_pixelFormat) {
+        LogErr << "【视频源】录制文件中的帧尺寸或格式发生变化:" << record.width << "x" << record.height
+               << record.format;
+        return AVERROR_INVALIDDATA;
+    }
+
+    if (m_config.realtime) {
+        // 按录制时间轴输出，下游阻塞后补发而不重新起算，保证与音频回放的相对时序不变
+        int64_t now = av_gettime_relative();
+        if (m_startUs < 0) {
+            m_startUs = now;
+        }
+        int64_t dueUs = m_startUs + m_loops * m_loopUs + (record.captureUs - m_firstUs);
+        if (dueUs > now) {
+            av_usleep(unsigned(dueUs - now));
+        }
+    }
+
+    int64_t readBeginUs = FrameTrace::nowUs();
+    if (const uint8_t* data = m_reader->payload(record)) {
+        frame->buf[0] = av_buffer_create(const_cast<uint8_t*>(data), record.rawBytes,
+                                         releaseShared<CaptureFileReader>,
+                                         new std::shared_ptr<CaptureFileReader>(m_reader), AV_BUFFER_FLAG_READONLY);
+    } else {
+        frame->buf[0] = av_buffer_alloc(record.rawBytes);
+        if (frame->buf[0] && !m_reader->read(record, frame->buf[0]->data)) {
+            av_buffer_unref(&frame->buf[0]);
+            return AVERROR_INVALIDDATA;
+        }
+    }
+    if (!frame->buf[0]) {
+        return AVERROR(ENOMEM);
+    }
+    if (av_image_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data,
+                             AVPixelFormat(record.format), record.width, record.height, 1) != record.rawBytes) {
+        av_buffer_unref(&frame->buf[0]);
+        return AVERROR_INVALIDDATA;
+    }
+    frame->format = record.format;
+    frame->width = record.width;
+    frame->height = record.height;
+    if (stamps) {
+        stamps->readBeginUs = readBeginUs;
+        stamps->readEndUs = FrameTrace::nowUs();
+        stamps->decodeEndUs = stamps->readEndUs;
+    }
+    return 0;
+}
+} // namespace
+
+VideoSourceConfig VideoSourceConfig::fromUrl(const QString& url, int width, int height, int fps)
+{
+    VideoSourceConfig config;
+    config.width = width;
+    config.height = height;
+    config.fps = fps;
+    config.location = url;
+
+    QUrl parsed(url);
+    QString scheme = parsed.scheme().toLower();
+    QUrlQuery query(parsed);
+    if (query.hasQueryItem("realtime")) {
+        config.realtime = query.queryItemValue("realtime") != "0";
+    }
+    if (query.hasQueryItem("clock")) {
+        config.frameClock = query.queryItemValue("clock") != "0";
+    }
+    if (query.hasQueryItem("loop")) {
+        config.loop = query.queryItemValue("loop") != "0";
+    }
+
+    for (const char* pattern : TEST_PATTERNS) {
+        if (scheme == pattern) {
+            config.type = VideoSourceType::testPattern;
+            config.location = scheme;
+            return config;
+        }
+    }
+    if (scheme == "raw") {
+        config.type = VideoSourceType::rawFile;
+        config.location = parsed.path();
+        if (query.hasQueryItem("pix_fmt")) {
+            AVPixelFormat fmt = av_get_pix_fmt(query.queryItemValue("pix_fmt").toUtf8().constData());
+            if (fmt != AV_PIX_FMT_NONE) {
+                config.rawFormat = fmt;
+            }
+        }
+        return config;
+    }
+    if (scheme == "replay") {
+        config.type = VideoSourceType::replay;
+        config.location = parsed.path();
+        return config;
+    }
+    if (scheme == "file") {
+        config.type = VideoSourceType::mediaFile;
+        config.location = parsed.toLocalFile();
+        return config;
+    }
+    // 单字母scheme为Windows盘符
+    if ((scheme.isEmpty() || scheme.size() == 1) && !url.startsWith(':') && QFileInfo(url).isFile()) {
+        config.type = VideoSourceType::mediaFile;
+        return config;
+    }
+    config.type = VideoSourceType::screen;
+    return config;
+}
+
+VideoSource* VideoSource::create(const VideoSourceConfig& config)
+{
+    if (config.type == VideoSourceType::rawFile) {
+        return new RawVideoSource(config);
+    }
+    if (config.type == VideoSourceType::replay) {
+        return new ReplayVideoSource(config);
+    }
+    return new FFmpegVideoSource(config);
+}
+
+int VideoSource::read(AVFrame* frame, FrameTrace::FrameStamps* stamps)
+{
+    av_frame_unref(frame);
+    pace();
+    if (!m_recorder) {
+        return readFrame(frame, stamps);
+    }
+    FrameTrace::FrameStamps localStamps;
+    FrameTrace::FrameStamps* st = stamps ? stamps : &localStamps;
+    int ret = readFrame(frame, st);
+    if (ret == 0) {
+        m_recorder->writeVideo(frame, st->readEndUs);
+    }
+    return ret;
+}
+
+void VideoSource::pace()
+{
+    if (!paced()) {
+        return;
+    }
+    if (!m_clockStarted) {
+        m_clock.setFrameRate(m_config.fps);
+        m_clockStarted = true;
+    }
+    FrameClock::Tick tick = m_clock.wait();
+    if (m_metrics) {
+        m_metrics->record(LatencyMetric::captureJitter, tick.latenessUs);
+    }
+    if (tick.skipped > 0 && m_stats) {
+        m_stats->addDrop(DropReason::captureMissed, tick.skipped);
+    }
+}
+
+QString VideoSource::description() const
+{
+    static const char* const names[] = {"screen", "pattern", "raw", "file", "replay"};
+    return QString("%1:%2 %3x%4@%5%6")
+        .arg(names[int(m_config.type)], m_config.location)
+        .arg(m_width).arg(m_height).arg(m_config.fps)
+        .arg(!m_config.realtime ? " (unpaced)" : paced() ? " (frame clock)" : "");
+}
@@ -0,0 +1,102 @@
+﻿// VideoSource.h
+#ifndef VIDEOSOURCE_H
+#define VIDEOSOURCE_H
+
+#include <QString>
+#include "frameclock.h"
+#include "frametrace.h"
+
+class CaptureFileWriter;
+class PushMetrics;
+class PushStatsCounters;
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+enum class VideoSourceType {
+    screen = 0,     // gdigrab/x11grab屏幕采集
+    testPattern,    // lavfi测试图（testsrc2/smptebars等），叠加帧号
+    rawFile,        // 原始像素文件，mmap后零拷贝逐帧读取
+    mediaFile,      // 任意FFmpeg可解码的媒体文件
+    replay          // 采集录制文件（.pscap），按录制时的时序回放
+};
+
+// 视频源配置。推流器仍通过源地址字符串配置，由fromUrl解析：
+//   ":0.0" / "desktop"                    屏幕采集
+//   "testsrc2://" / "smptebars://"        测试图，scheme即lavfi源名
+//   "raw:///path/capture.bgra?pix_fmt=bgra"  原始像素文件
+//   "file:///path/clip.mp4" 或已存在的文件路径   媒体文件
+//   "replay:///path/desktop.pscap"        采集录制回放，realtime时按录制的帧间隔输出
+// 所有形式都支持查询参数 realtime=0（不按帧率节拍，尽快输出）与 loop=0（文件到尾后结束）；
+// 屏幕采集默认由FrameClock按绝对时刻触发每次抓屏，clock=0时退回采集设备自身的framerate节拍
+struct VideoSourceConfig {
+    VideoSourceType type = VideoSourceType::screen;
+    QString location;               // 屏幕名、文件路径或测试图名
+    int width = 1920;
+    int height = 1080;
+    int fps = 30;
+    AVPixelFormat rawFormat = AV_PIX_FMT_BGRA;
+    bool realtime = true;
+    bool loop = true;
+    bool drawMouse = true;
+    bool frameClock = true;
+    int64_t replayStartUs = -1;     // 回放零点对应的av_gettime_relative()时刻，与音频回放共用；-1为读第一帧时起算
+
+    static VideoSourceConfig fromUrl(const QString& url, int width, int height, int fps);
+};
+
+// 视频源：read()输出解码后的帧（格式与尺寸见pixelFormat()/width()/height()），
+// realtime时由帧时钟按配置帧率节拍输出（回放源按录制时序），否则尽快输出
+class VideoSource
+{
+public:
+    static VideoSource* create(const VideoSourceConfig& config);
+    virtual ~VideoSource() = default;
+
+    virtual bool open(QString* errMsg) = 0;
+    virtual void close() = 0;
+
+    // 成功返回0；AVERROR(EAGAIN)表示本次没有产出帧；AVERROR_EOF表示源结束
+    // frame原有引用会先被释放；stamps可为空
+    int read(AVFrame* frame, FrameTrace::FrameStamps* stamps);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    AVPixelFormat pixelFormat() const { return m_pixelFormat; }
+    const VideoSourceConfig& config() const { return m_config; }
+    QString description() const;
+
+    // 录制read()输出的每一帧（原始像素与采集时刻），writer由调用方持有
+    void setRecorder(CaptureFileWriter* recorder) { m_recorder = recorder; }
+    // 采集抖动记入captureJitter延迟指标，错过截止时刻跳过的tick记为captureMissed丢帧
+    void setMetrics(PushMetrics* metrics, PushStatsCounters* stats) { m_metrics = metrics; m_stats = stats; }
+    // 由帧时钟节拍时有效，否则为nullptr
+    const FrameClock* frameClock() const { return paced() ? &m_clock : nullptr; }
+    // 暂停后恢复：帧时钟从当前时刻重新计时，暂停期间不计为错过的tick
+    void restartClock() { m_clock.reset(); }
+
+protected:
+    explicit VideoSource(const VideoSourceConfig& config) : m_config(config) {}
+    virtual int readFrame(AVFrame* frame, FrameTrace::FrameStamps* stamps) = 0;
+    // 源自身按时序阻塞输出（回放、关闭帧时钟的屏幕采集），不再额外节拍
+    virtual bool selfPaced() const { return false; }
+
+    VideoSourceConfig m_config;
+    int m_width = 0;
+    int m_height = 0;
+    AVPixelFormat m_pixelFormat = AV_PIX_FMT_NONE;
+
+private:
+    bool paced() const { return m_config.realtime && !selfPaced() && m_config.fps > 0; }
+    void pace();
+
+    CaptureFileWriter* m_recorder = nullptr;
+    PushMetrics* m_metrics = nullptr;
+    PushStatsCounters* m_stats = nullptr;
+    FrameClock m_clock;
+    bool m_clockStarted = false;
+};
+
+#endif // VIDEOSOURCE_H
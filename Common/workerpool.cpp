@@ -0,0 +1,272 @@
+﻿// WorkerPool.cpp
+#include "workerpool.h"
+#include <chrono>
+#include "threadtuning.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace
+{
+// 当前工作线程所属的池与序号，池外线程为nullptr/-1
+thread_local const WorkerPool* t_pool = nullptr;
+thread_local int t_workerIndex = -1;
+
+int64_t steadyUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef Q_OS_WIN
+int64_t fileTimeUs(const FILETIME& kernel, const FILETIME& user)
+{
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    return int64_t((k.QuadPart + u.QuadPart) / 10);     // 100ns单位
+}
+#endif
+} // namespace
+
+int64_t CpuClock::threadUs()
+{
+#ifdef Q_OS_WIN
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    return fileTimeUs(kernel, user);
+#else
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+int64_t CpuClock::processUs()
+{
+#ifdef Q_OS_WIN
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0;
+    }
+    return fileTimeUs(kernel, user);
+#else
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+Strand::Strand(WorkerPool* pool, const std::shared_ptr<WorkGroup>& group, const QString& name,
+               StrandPriority priority)
+    : m_pool(pool)
+    , m_group(group)
+    , m_name(name)
+    , m_priority(priority)
+{
+}
+
+void Strand::post(std::function<void()> task)
+{
+    bool needSchedule = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_tasks.push_back(Task{std::move(task), steadyUs()});
+        if (!m_scheduled) {
+            m_scheduled = true;
+            needSchedule = true;
+        }
+    }
+    if (needSchedule) {
+        m_pool->schedule(shared_from_this());
+    }
+}
+
+void Strand::waitIdle()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_scheduled) {
+        m_idle.wait(&m_mutex);
+    }
+}
+
+int Strand::pending() const
+{
+    QMutexLocker locker(&m_mutex);
+    return int(m_tasks.size());
+}
+
+bool Strand::runSlice()
+{
+    int64_t sliceBeginUs = steadyUs();
+    for (int n = 0; n < SLICE_TASKS; ++n) {
+        Task task;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_tasks.empty()) {
+                m_scheduled = false;
+                m_idle.wakeAll();
+                return false;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        int64_t beginUs = steadyUs();
+        int64_t waitUs = beginUs - task.postUs;
+        int64_t prevMax = m_group->m_maxQueueWaitUs.load(std::memory_order_relaxed);
+        while (waitUs > prevMax &&
+               !m_group->m_maxQueueWaitUs.compare_exchange_weak(prevMax, waitUs, std::memory_order_relaxed)) {
+        }
+
+        int64_t cpuBeginUs = CpuClock::threadUs();
+        task.fn();
+        int64_t cpuUs = CpuClock::threadUs() - cpuBeginUs;
+        m_group->m_cpuUs.fetch_add(cpuUs, std::memory_order_relaxed);
+        m_group->m_tasks.fetch_add(1, std::memory_order_relaxed);
+        m_pool->m_cpuUs.fetch_add(cpuUs, std::memory_order_relaxed);
+
+        if (steadyUs() - sliceBeginUs >= SLICE_US) {
+            break;
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (m_tasks.empty()) {
+        m_scheduled = false;
+        m_idle.wakeAll();
+        return false;
+    }
+    return true;
+}
+
+WorkerPool::WorkerPool(int threads)
+{
+    int normal = threads > 0 ? threads : qMax(1, QThread::idealThreadCount());
+    m_laneSize[int(StrandPriority::normal)] = normal;
+    m_laneSize[int(StrandPriority::high)] = qMax(2, (normal + 3) / 4);
+    m_laneFirst[int(StrandPriority::high)] = normal;
+    int count = normal + m_laneSize[int(StrandPriority::high)];
+    for (int i = 0; i < count; ++i) {
+        m_queues.emplace_back(new Queue);
+    }
+    for (int i = 0; i < count; ++i) {
+        StrandPriority lane = i < normal ? StrandPriority::normal : StrandPriority::high;
+        QThread* worker = QThread::create([this, i, lane] { workerLoop(i, lane); });
+        worker->setObjectName(lane == StrandPriority::high ? QString("PushAudioWorker%1").arg(i - normal)
+                                                           : QString("PushWorker%1").arg(i));
+        m_workers.append(worker);
+        // 与专用线程模式的音频编码线程一致，未配置audioEncode调优时音频仍优先于视频编码获得CPU
+        worker->start(lane == StrandPriority::high ? QThread::HighPriority : QThread::InheritPriority);
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    m_running = false;
+    {
+        QMutexLocker locker(&m_sleepMutex);
+        for (QWaitCondition& wake : m_wake) {
+            wake.wakeAll();
+        }
+    }
+    for (QThread* worker : m_workers) {
+        worker->wait();
+        delete worker;
+    }
+}
+
+std::shared_ptr<WorkGroup> WorkerPool::createGroup(const QString& name)
+{
+    return std::make_shared<WorkGroup>(name);
+}
+
+std::shared_ptr<Strand> WorkerPool::createStrand(const std::shared_ptr<WorkGroup>& group, const QString& name,
+                                                 StrandPriority priority)
+{
+    return std::make_shared<Strand>(this, group, name, priority);
+}
+
+void WorkerPool::schedule(std::shared_ptr<Strand> strand)
+{
+    // 工作线程上重新调度的strand排到自己队列的队尾，与同队列的其他会话轮转
+    int lane = int(strand->priority());
+    int index = t_pool == this && t_workerIndex >= m_laneFirst[lane] &&
+                        t_workerIndex < m_laneFirst[lane] + m_laneSize[lane]
+                    ? t_workerIndex
+                    : m_laneFirst[lane] + int(m_nextQueue[lane]++ % unsigned(m_laneSize[lane]));
+    {
+        QMutexLocker locker(&m_queues[index]->mutex);
+        m_queues[index]->strands.push_back(std::move(strand));
+    }
+    QMutexLocker locker(&m_sleepMutex);
+    m_wake[lane].wakeOne();
+}
+
+std::shared_ptr<Strand> WorkerPool::take(int self, StrandPriority lane)
+{
+    {
+        Queue* own = m_queues[self].get();
+        QMutexLocker locker(&own->mutex);
+        if (!own->strands.empty()) {
+            std::shared_ptr<Strand> strand = std::move(own->strands.front());
+            own->strands.pop_front();
+            return strand;
+        }
+    }
+    // 从同组其他线程队尾窃取，队首留给所属线程，减少争用
+    int first = m_laneFirst[int(lane)];
+    int count = m_laneSize[int(lane)];
+    for (int k = 1; k < count; ++k) {
+        Queue* victim = m_queues[first + (self - first + k) % count].get();
+        QMutexLocker locker(&victim->mutex);
+        if (!victim->strands.empty()) {
+            std::shared_ptr<Strand> strand = std::move(victim->strands.back());
+            victim->strands.pop_back();
+            return strand;
+        }
+    }
+    return nullptr;
+}
+
+bool WorkerPool::hasWork(StrandPriority lane)
+{
+    int first = m_laneFirst[int(lane)];
+    for (int i = first; i < first + m_laneSize[int(lane)]; ++i) {
+        QMutexLocker locker(&m_queues[i]->mutex);
+        if (!m_queues[i]->strands.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkerPool::workerLoop(int self, StrandPriority lane)
+{
+    // normal组是视频转换/编码，high组是音频编码，各按所属阶段绑核与设置调度策略
+    ThreadTuning::StageScope tuning(lane == StrandPriority::high ? PipelineStage::audioEncode
+                                                                 : PipelineStage::videoEncode);
+    t_pool = this;
+    t_workerIndex = self;
+    while (m_running) {
+        std::shared_ptr<Strand> strand = take(self, lane);
+        if (!strand) {
+            // 持有m_sleepMutex再次检查，schedule入队后才加锁唤醒，不会丢失唤醒
+            QMutexLocker locker(&m_sleepMutex);
+            if (m_running && !hasWork(lane)) {
+                m_wake[int(lane)].wait(&m_sleepMutex);
+            }
+            continue;
+        }
+        if (strand->runSlice()) {
+            schedule(std::move(strand));
+        }
+    }
+}
@@ -0,0 +1,133 @@
+﻿// WorkerPool.h
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+
+class WorkerPool;
+
+// strand调度优先级：high（音频编码）与normal（视频转换与编码）在各自的工作线程上运行，
+// 两组线程按audioEncode/videoEncode阶段分别绑核与设置调度策略，音频不会落到编码CPU与编码优先级上
+enum class StrandPriority {
+    normal = 0,
+    high,
+    count
+};
+
+// 线程CPU时间（微秒）：Linux用CLOCK_THREAD_CPUTIME_ID，Windows用GetThreadTimes
+namespace CpuClock
+{
+int64_t threadUs();
+int64_t processUs();
+}
+
+// 统计单元，一般对应一个推流会话；同组的所有strand累计CPU时间与任务数
+class WorkGroup
+{
+public:
+    explicit WorkGroup(const QString& name) : m_name(name) {}
+
+    QString name() const { return m_name; }
+    int64_t cpuUs() const { return m_cpuUs.load(std::memory_order_relaxed); }
+    int64_t tasks() const { return m_tasks.load(std::memory_order_relaxed); }
+    int64_t maxQueueWaitUs() const { return m_maxQueueWaitUs.load(std::memory_order_relaxed); }
+    // 读取并清零最大排队等待，用于按周期上报
+    int64_t takeMaxQueueWaitUs() { return m_maxQueueWaitUs.exchange(0, std::memory_order_relaxed); }
+
+private:
+    friend class Strand;
+    QString m_name;
+    std::atomic<int64_t> m_cpuUs{0};
+    std::atomic<int64_t> m_tasks{0};
+    std::atomic<int64_t> m_maxQueueWaitUs{0};
+};
+
+// 串行执行器：同一strand上的任务按提交顺序依次执行（编码器不可并发），
+// 不同strand之间在线程池上并行。每次被调度最多执行一个时间片，剩余任务排到队尾，
+// 保证单个会话的积压不会长期占住工作线程
+class Strand : public std::enable_shared_from_this<Strand>
+{
+public:
+    Strand(WorkerPool* pool, const std::shared_ptr<WorkGroup>& group, const QString& name,
+           StrandPriority priority = StrandPriority::normal);
+
+    void post(std::function<void()> task);
+    // 等待已提交的任务全部执行完（不能在本strand的任务中调用）
+    void waitIdle();
+    int pending() const;
+
+    QString name() const { return m_name; }
+    WorkGroup* group() const { return m_group.get(); }
+    StrandPriority priority() const { return m_priority; }
+
+private:
+    friend class WorkerPool;
+    struct Task {
+        std::function<void()> fn;
+        int64_t postUs;
+    };
+    // 由工作线程调用，返回true表示仍有任务需重新调度
+    bool runSlice();
+
+    WorkerPool* m_pool;
+    std::shared_ptr<WorkGroup> m_group;
+    QString m_name;
+    StrandPriority m_priority;
+    mutable QMutex m_mutex;
+    QWaitCondition m_idle;
+    std::deque<Task> m_tasks;
+    bool m_scheduled = false;       // 已在某个工作线程队列中或正在执行
+    static const int SLICE_US = 2000;
+    static const int SLICE_TASKS = 8;
+};
+
+// 工作窃取线程池，按strand优先级分为两组工作线程：normal组threads个（默认CPU核数），
+// high组为其四分之一（至少2个，一路音频编码占用线程时其他会话的音频仍有线程可用）。
+// 每个工作线程有自己的strand队列，空闲时从同组其他线程队列尾部窃取。外部线程提交的strand轮流分配到组内各线程
+class WorkerPool
+{
+public:
+    explicit WorkerPool(int threads = 0);
+    ~WorkerPool();
+
+    // 池销毁前需先停止所有会话，未执行的任务会被直接丢弃
+    int threadCount() const { return m_workers.size(); }
+    int threadCount(StrandPriority priority) const { return m_laneSize[int(priority)]; }
+    std::shared_ptr<WorkGroup> createGroup(const QString& name);
+    std::shared_ptr<Strand> createStrand(const std::shared_ptr<WorkGroup>& group, const QString& name,
+                                         StrandPriority priority = StrandPriority::normal);
+    // 池内工作线程累计CPU时间
+    int64_t cpuUs() const { return m_cpuUs.load(std::memory_order_relaxed); }
+
+private:
+    friend class Strand;
+    void schedule(std::shared_ptr<Strand> strand);
+    std::shared_ptr<Strand> take(int self, StrandPriority lane);
+    bool hasWork(StrandPriority lane);
+    void workerLoop(int self, StrandPriority lane);
+
+    struct Queue {
+        QMutex mutex;
+        std::deque<std::shared_ptr<Strand>> strands;
+    };
+    static const int LANE_COUNT = int(StrandPriority::count);
+    QVector<QThread*> m_workers;
+    std::vector<std::unique_ptr<Queue>> m_queues;     // 按组连续排列，组内序号从m_laneFirst起
+    int m_laneFirst[LANE_COUNT] = {};
+    int m_laneSize[LANE_COUNT] = {};
+    std::atomic<unsigned> m_nextQueue[LANE_COUNT] = {};
+    std::atomic<bool> m_running{true};
+    std::atomic<int64_t> m_cpuUs{0};
+    QMutex m_sleepMutex;
+    QWaitCondition m_wake[LANE_COUNT];      // 每组单独唤醒，不会唤醒到取不到该组任务的线程
+};
+
+#endif // WORKERPOOL_H
@@ -11,4 +11,34 @@ enum class PushState {
 };
 Q_DECLARE_METATYPE(PushState); // 在类的声明之后添加这个宏
 
+// 音频编码类型
+enum class AudioCodecType {
+    aac = 0,    // FFmpeg原生AAC，1024采样/帧
+    opus        // libopus，10/20ms帧，低延迟
+};
+Q_DECLARE_METATYPE(AudioCodecType);
+
+// 持续静音时的处理方式
+enum class SilenceMode {
+    off = 0,        // 不检测，全部编码
+    skip,           // 跳过编码，时间戳照常递增
+    comfortNoise    // 跳过编码，按固定间隔发送舒适噪声帧
+};
+
+// 音频采集后端
+enum class AudioCaptureBackend {
+    qt = 0,     // QAudioInput
+    pulse,      // FFmpeg pulse输入设备
+    alsa,       // FFmpeg alsa输入设备
+    dshow       // FFmpeg dshow输入设备(Windows)
+};
+
+// 非RTSP输出的复用与传输参数，见OutputFormat
+struct OutputOptions {
+    int tsPacketSize = 1316;    // UDP/SRT每个数据报的字节数，需为188的整数倍（默认7个TS包）
+    int pcrPeriodMs = 20;       // MPEG-TS的PCR间隔
+    int patPeriodMs = 100;      // MPEG-TS的PAT/PMT重复间隔，读端中途接入时最多等待这么久
+    int srtLatencyMs = 120;     // SRT重传窗口
+};
+
 #endif // DATASTRUCT_H
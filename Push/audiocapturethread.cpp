@@ -1,5 +1,11 @@
 ﻿#include "audiocapturethread.h"
 #include "Logger.h"
+#include "audioformat.h"
+#include "threadtuning.h"
+
+extern "C" {
+#include <libavutil/time.h>
+}
 
 AudioCaptureThread::AudioCaptureThread(QObject *parent)
     : QThread{parent}
@@ -19,40 +25,61 @@ bool AudioCaptureThread::initialize(int sampleRate, int channels) {
     m_audioFormat.setByteOrder(QAudioFormat::LittleEndian);
     m_audioFormat.setSampleType(QAudioFormat::SignedInt);
 
-
-//    QAudioDeviceInfo info = QAudioDeviceInfo::defaultInputDevice();
-//    if (!info.isFormatSupported(m_audioFormat)) {
-//        m_audioFormat = info.nearestFormat(m_audioFormat);
-//        LogInfo << "使用最接近的音频格式:" << m_audioFormat.sampleRate() << "Hz,"
-//                << m_audioFormat.channelCount() << "channels";
-//    }
-
-    return true;
-}
-
-void AudioCaptureThread::run() {
-
-    QAudioDeviceInfo monitorDev;
+    // 优先采集立体声混音（系统声音），没有时使用默认输入设备
+    m_deviceInfo = QAudioDeviceInfo();
     for (auto &dev : QAudioDeviceInfo::availableDevices(QAudio::AudioInput)) {
         if (dev.deviceName().contains("立体声混音", Qt::CaseInsensitive)||
             dev.deviceName().contains("Stereo Mix", Qt::CaseInsensitive)) {
-            monitorDev = dev;
+            m_deviceInfo = dev;
             break;
         }
     }
-    if (!monitorDev.isNull()) {
-        m_audioInput = new QAudioInput(monitorDev, m_audioFormat);
-        LogDebug << "音频输入设备" <<monitorDev.deviceName();
-    }else{
-        monitorDev = QAudioDeviceInfo::defaultInputDevice();
-        m_audioInput = new QAudioInput(monitorDev, m_audioFormat);
-        LogDebug << "音频初始化失败，没有找到立体声混音设备,使用默认输入设备";
+    if (!m_deviceInfo.isNull()) {
+        LogDebug << "音频输入设备" << m_deviceInfo.deviceName();
+    } else {
+        m_deviceInfo = QAudioDeviceInfo::defaultInputDevice();
+        LogDebug << "没有找到立体声混音设备,使用默认输入设备";
+    }
+
+    // 设备只支持48kHz或单声道时按协商结果采集，由编码线程重采样到编码器格式
+    if (!m_deviceInfo.isFormatSupported(m_audioFormat)) {
+        m_audioFormat = m_deviceInfo.nearestFormat(m_audioFormat);
+        LogInfo << "【音频采集】使用最接近的音频格式:" << AudioFormat::describe(m_audioFormat);
+    }
+    if (AudioFormat::toSampleFormat(m_audioFormat) == AV_SAMPLE_FMT_NONE) {
+        LogErr << "【音频采集】不支持的采集格式:" << AudioFormat::describe(m_audioFormat);
+        return false;
+    }
+
+    return true;
+}
+
+void AudioCaptureThread::setLowLatency(bool enabled, int bufferMs)
+{
+    m_lowLatency = enabled;
+    m_bufferMs = bufferMs;
+}
+
+void AudioCaptureThread::run() {
+    ThreadTuning::StageScope tuning(PipelineStage::audioCapture);
+    m_audioInput = new QAudioInput(m_deviceInfo, m_audioFormat);
+    if (m_lowLatency) {
+        // 默认缓冲由后端决定，可达数十到数百毫秒
+        m_audioInput->setBufferSize(m_audioFormat.bytesForDuration(qint64(m_bufferMs) * 1000));
     }
     AudioInputDevice* device = new AudioInputDevice(this);
     device->open(QIODevice::WriteOnly);
     m_audioInput->start(device);
     m_running = true;
 
+    // 实际缓冲与分片大小以后端协商结果为准
+    int bufferBytes = m_audioInput->bufferSize();
+    int periodBytes = m_audioInput->periodSize();
+    LogInfo << "【音频采集】设备缓冲:" << bufferBytes << "字节("
+            << m_audioFormat.durationForBytes(bufferBytes) / 1000 << "ms) 分片:" << periodBytes << "字节("
+            << m_audioFormat.durationForBytes(periodBytes) / 1000 << "ms)";
+    emit captureBufferInfo(bufferBytes, periodBytes);
+
     exec(); // 进入事件循环
 
     m_audioInput->stop();
@@ -70,7 +97,10 @@ void AudioCaptureThread::stopCapture() {
 
 qint64 AudioCaptureThread::AudioInputDevice::writeData(const char* data, qint64 len) {
     if (m_owner && len > 0) {
-        emit m_owner->audioDataAvailable(QByteArray(data, len));
+        // 数据到达时最后一个采样刚采集完成，首个采样的采集时刻需减去数据时长
+        int64_t captureTimeUs = av_gettime_relative()
+                                - m_owner->m_audioFormat.durationForBytes(qint32(len));
+        emit m_owner->audioDataAvailable(QByteArray(data, len), captureTimeUs);
     }
     return len;
 }
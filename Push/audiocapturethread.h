@@ -13,11 +13,18 @@ public:
     explicit AudioCaptureThread(QObject* parent = nullptr);
     ~AudioCaptureThread();
 
+    // 选择采集设备并协商格式，设备不支持请求格式时使用最接近的格式
     bool initialize(int sampleRate, int channels);
+    // 设备实际采集格式，initialize之后有效
+    QAudioFormat format() const { return m_audioFormat; }
+    // 低延迟模式：显式设置设备缓冲时长，需在start之前调用
+    void setLowLatency(bool enabled, int bufferMs = 10);
     void stopCapture();
 
 signals:
-    void audioDataAvailable(const QByteArray& data);
+    // captureTimeUs为数据首个采样的采集时刻（av_gettime_relative）
+    void audioDataAvailable(const QByteArray& data, qint64 captureTimeUs);
+    void captureBufferInfo(int bufferBytes, int periodBytes);
 
 protected:
     void run() override;
@@ -26,7 +33,10 @@ private:
     QAudioInput* m_audioInput = nullptr;
     QIODevice* m_audioDevice = nullptr;
     QAudioFormat m_audioFormat;
+    QAudioDeviceInfo m_deviceInfo;
     volatile bool m_running = false;
+    bool m_lowLatency = false;
+    int m_bufferMs = 10;
 
     class AudioInputDevice : public QIODevice {
     public:
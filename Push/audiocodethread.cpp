@@ -1,5 +1,13 @@
 ﻿#include "audiocodethread.h"
 #include "Logger.h"
+#include "audioencoder.h"
+#include "frametrace.h"
+#include "threadtuning.h"
+#include "workerpool.h"
+
+extern "C" {
+#include <libavutil/time.h>
+}
 
 AudioCodeThread::AudioCodeThread(QObject* parent)
     : QThread(parent)
@@ -14,101 +22,267 @@ AudioCodeThread::~AudioCodeThread()
         avcodec_free_context(&m_codecCtx);
         m_codecCtx = nullptr;
     }
-    if (m_swrCtx) {
-        swr_free(&m_swrCtx);
-        m_swrCtx = nullptr;
-    }
+}
+
+void AudioCodeThread::setAudioCodec(AudioCodecType codec, int opusFrameMs, bool opusDtx)
+{
+    m_codecType = codec;
+    m_opusFrameMs = opusFrameMs;
+    m_opusDtx = opusDtx;
+}
+
+void AudioCodeThread::setSilenceDetection(SilenceMode mode, double thresholdDb, int hangoverMs)
+{
+    m_silenceGate.setMode(mode);
+    m_silenceGate.setThresholdDb(thresholdDb);
+    m_silenceGate.setHangoverMs(hangoverMs);
+}
+
+void AudioCodeThread::setInputFormat(int sampleRate, int channels, AVSampleFormat format)
+{
+    m_inSampleRate = sampleRate;
+    m_inChannels = channels;
+    m_inFormat = format;
 }
 
 bool AudioCodeThread::initialize(AVFormatContext* fmtCtx, int sampleRate, int channels) {
-    // ...初始化音频编码器...
-    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_AAC);
-    if (!codec) return false;
-    m_codecCtx = avcodec_alloc_context3(codec);
-    m_codecCtx->sample_rate = sampleRate;
-    m_codecCtx->channels = channels;
-    m_codecCtx->channel_layout = av_get_default_channel_layout(channels);
-    m_codecCtx->sample_fmt = codec->sample_fmts[0];
-    m_codecCtx->bit_rate = 64000;
-    m_codecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-    m_codecCtx->time_base = {1, sampleRate};
-
-    if (avcodec_open2(m_codecCtx, codec, nullptr) < 0) {
+    // 释放历史资源，避免重复初始化
+    if (m_codecCtx) {
         avcodec_free_context(&m_codecCtx);
+    }
+    m_stream = nullptr;
+
+    // 初始化音频编码器（AAC或Opus），采集端需按encoderSampleRate()给出的采样率采集
+    AudioEncoderParam param;
+    param.codec = m_codecType;
+    param.sampleRate = sampleRate;
+    param.channels = channels;
+    param.opusFrameMs = m_opusFrameMs;
+    param.opusDtx = m_opusDtx;
+    QString errMsg;
+    m_codecCtx = AudioEncoder::open(param, AV_SAMPLE_FMT_NONE, &errMsg);
+    if (!m_codecCtx) {
+        LogErr << "【音频编码】" << errMsg;
         return false;
     }
+    const AVCodec* codec = m_codecCtx->codec;
+    sampleRate = m_codecCtx->sample_rate;
 
     m_stream = avformat_new_stream(fmtCtx, codec);
     if (!m_stream) return false;
     m_stream->time_base = {1, sampleRate};
     avcodec_parameters_from_context(m_stream->codecpar, m_codecCtx);
 
-    m_swrCtx = swr_alloc_set_opts(nullptr,
-                                  av_get_default_channel_layout(channels), m_codecCtx->sample_fmt, sampleRate,
-                                  av_get_default_channel_layout(channels), AV_SAMPLE_FMT_S16, sampleRate,
-                                  0, nullptr);
-    if (!m_swrCtx || swr_init(m_swrCtx) < 0) {
+    // 采集格式与编码器格式/采样率不同时在此重采样，编码帧从重采样输出侧切分
+    int inRate = m_inSampleRate > 0 ? m_inSampleRate : sampleRate;
+    int inChannels = m_inChannels > 0 ? m_inChannels : channels;
+    if (!m_resampler.init(inRate, inChannels, m_inFormat,
+                          sampleRate, m_codecCtx->channels, m_codecCtx->sample_fmt)) {
         return false;
     }
+    m_audioBuffer.clear();
+    m_pendingSinceUs = -1;
     m_running = true;
+    m_paused = false;
     m_pts = 0;
+    m_silenceGate.reset();
+    m_timeline.reset(inRate * m_resampler.inBytesPerFrame());
+    m_latencySumUs = 0;
+    m_latencyMaxUs = 0;
+    m_latencyCount = 0;
+    m_latencyReportUs = av_gettime_relative();
     return true;
 }
 
-void AudioCodeThread::addAudioData(const QByteArray& data) {
+void AudioCodeThread::addAudioData(const QByteArray& data, qint64 captureTimeUs) {
     QMutexLocker locker(&m_mutex);
     m_audioBuffer.append(data);
+    if (captureTimeUs >= 0) {
+        m_timeline.append(data.size(), captureTimeUs);
+    }
+    if (m_pendingSinceUs < 0) {
+        m_pendingSinceUs = av_gettime_relative();
+    }
     m_cond.wakeAll();
+    locker.unlock();
+
+    if (m_strand && m_running && !m_taskPosted.exchange(true)) {
+        m_strand->post([this] {
+            // 先清标志再处理，处理期间到达的数据会再投递一次
+            m_taskPosted = false;
+            if (m_running) {
+                processPending();
+            }
+        });
+    }
+}
+
+void AudioCodeThread::startEncoding()
+{
+    // 专用线程模式下同样让音频编码先于视频转换/编码获得CPU
+    if (!m_strand) {
+        start(QThread::HighPriority);
+    }
 }
 
 void AudioCodeThread::run() {
+    ThreadTuning::StageScope tuning(PipelineStage::audioEncode);
+    const int frameSize = m_codecCtx->frame_size;
+    const int inBytesPerFrame = m_resampler.inBytesPerFrame();
+
     while (m_running) {
-        QMutexLocker locker(&m_mutex);
-        if (m_audioBuffer.isEmpty()) {
-            m_cond.wait(&m_mutex);
-            continue;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_audioBuffer.size() < inBytesPerFrame && m_resampler.available() < frameSize) {
+                m_cond.wait(&m_mutex, 10);
+                continue;
+            }
         }
+        processPending();
+    }
+}
 
-        // 处理音频数据并编码...
-        // 假设每帧为 m_codecCtx->frame_size * channels * 2 字节
-        int frameBytes = m_codecCtx->frame_size * m_codecCtx->channels * 2;
-        if (m_audioBuffer.size() < frameBytes) {
-            m_cond.wait(&m_mutex, 10);
-            continue;
+bool AudioCodeThread::processPending()
+{
+    const int frameSize = m_codecCtx->frame_size;
+    const int inBytesPerFrame = m_resampler.inBytesPerFrame();
+
+    QMutexLocker locker(&m_mutex);
+    if (m_audioBuffer.size() < inBytesPerFrame && m_resampler.available() < frameSize) {
+        return false;
+    }
+
+    // 取出全部完整采样帧，锁外重采样，避免阻塞采集线程
+    int inSamples = m_audioBuffer.size() / inBytesPerFrame;
+    QByteArray pcm = m_audioBuffer.left(inSamples * inBytesPerFrame);
+    m_audioBuffer.remove(0, inSamples * inBytesPerFrame);
+    int64_t pendingSinceUs = m_pendingSinceUs;
+    m_pendingSinceUs = m_audioBuffer.isEmpty() ? -1 : av_gettime_relative();
+    locker.unlock();
+
+    // 截止时间为一个编码帧时长：超过后采集端已攒出下一帧，继续拖延会在接收端表现为断音
+    if (pendingSinceUs >= 0) {
+        int64_t scheduleUs = av_gettime_relative() - pendingSinceUs;
+        if (m_metrics) {
+            m_metrics->record(LatencyMetric::audioSchedule, scheduleUs);
         }
-        QByteArray frameData = m_audioBuffer.left(frameBytes);
-        m_audioBuffer.remove(0, frameBytes);
+        if (m_stats && scheduleUs > int64_t(frameSize) * 1000000 / m_codecCtx->sample_rate) {
+            m_stats->addAudioDeadlineMiss();
+        }
+    }
+
+    if (inSamples > 0) {
+        TraceSpan span("resample", FrameTrace::Stream::audio, m_pts);
+        if (!m_resampler.write(reinterpret_cast<const uint8_t*>(pcm.constData()), inSamples)) {
+            LogErr << "【音频编码】重采样失败";
+        }
+    }
 
-        // 构造 AVFrame
+    while (m_running && m_resampler.available() >= frameSize) {
         AVFrame* frame = av_frame_alloc();
-        frame->nb_samples = m_codecCtx->frame_size;
+        frame->nb_samples = frameSize;
         frame->channel_layout = m_codecCtx->channel_layout;
         frame->format = m_codecCtx->sample_fmt;
         frame->sample_rate = m_codecCtx->sample_rate;
+        if (av_frame_get_buffer(frame, 0) < 0) {
+            av_frame_free(&frame);
+            break;
+        }
+        m_resampler.read(frame, frameSize);
 
-        av_frame_get_buffer(frame, 0);
+        int64_t captureTimeUs;
+        {
+            QMutexLocker timelineLocker(&m_mutex);
+            captureTimeUs = m_timeline.consumeSamples(frameSize, m_codecCtx->sample_rate);
+        }
+        recordCaptureLatency(captureTimeUs);
+        if (captureTimeUs >= 0) {
+            // 帧首个采样采集到切出编码帧，包含设备缓冲与跨线程排队
+            FrameTrace::record("capture", FrameTrace::Stream::audio, m_pts,
+                               captureTimeUs, FrameTrace::nowUs());
+        }
 
-        const uint8_t* src = reinterpret_cast<const uint8_t*>(frameData.constData());
-        //重采样
-        swr_convert(m_swrCtx, frame->data, frame->nb_samples, &src, frame->nb_samples);
+        // 暂停与持续静音时跳过编码，时间戳照常递增保证单调连续
+        if (m_paused) {
+            av_frame_free(&frame);
+            emit audioPtsUpdated(m_pts);
+            m_pts += frameSize;
+            continue;
+        }
+        if (checkSilence(frame)) {
+            av_frame_free(&frame);
+            if (m_stats) {
+                m_stats->addDrop(DropReason::silence);
+            }
+            emit audioPtsUpdated(m_pts);
+            m_pts += frameSize;
+            continue;
+        }
+        encodeFrame(frame, captureTimeUs);
+        av_frame_free(&frame);
+    }
+    return true;
+}
 
-        frame->pts = m_pts;
-        LogDebug << "编码音频帧PTS:"<<frame->pts;
-        m_pts += frame->nb_samples;
+bool AudioCodeThread::checkSilence(AVFrame* frame)
+{
+    bool reportDue = false;
+    bool skip = m_silenceGate.processFrame(frame->data, m_codecCtx->sample_fmt, frame->nb_samples,
+                                           m_codecCtx->channels, m_codecCtx->sample_rate, &reportDue);
+    if (reportDue) {
+        emit silenceStatistics(m_silenceGate.totalFrames(), m_silenceGate.silentFrames());
+        if (m_stats) {
+            m_stats->setSilenceRatio(m_silenceGate.silenceRatio());
+        }
+    }
+    return skip;
+}
 
-        // 编码
-        if (avcodec_send_frame(m_codecCtx, frame) == 0) {
-            AVPacket* pkt = av_packet_alloc();
+void AudioCodeThread::encodeFrame(AVFrame* frame, int64_t captureTimeUs)
+{
+    frame->pts = m_pts;
+    LogDebug << "编码音频帧PTS:"<<frame->pts;
+    m_pts += frame->nb_samples;
+
+    // 编码
+    // 编码器有帧延迟，包的采集时刻按当前送入帧近似
+    PacketTiming timing;
+    timing.captureUs = captureTimeUs;
+    int64_t encodeBeginUs = FrameTrace::nowUs();
+    if (avcodec_send_frame(m_codecCtx, frame) == 0) {
+        AVPacket* pkt = av_packet_alloc();
+        av_init_packet(pkt);
+        while (avcodec_receive_packet(m_codecCtx, pkt) == 0) {
+            pkt->stream_index = m_stream->index;
+            timing.encodeEndUs = FrameTrace::nowUs();
+            FrameTrace::record("encode", FrameTrace::Stream::audio, pkt->pts,
+                               encodeBeginUs, timing.encodeEndUs);
+            emit packetEncoded(pkt, timing); // 发送给主线程或推流线程
+            pkt = av_packet_alloc();
             av_init_packet(pkt);
-            while (avcodec_receive_packet(m_codecCtx, pkt) == 0) {
-                emit packetEncoded(pkt); // 发送给主线程或推流线程
-                pkt = av_packet_alloc();
-                av_init_packet(pkt);
-            }
-            av_packet_free(&pkt);
         }
-        emit audioPtsUpdated(frame->pts);
-        av_frame_free(&frame);
+        av_packet_free(&pkt);
+    }
+    emit audioPtsUpdated(frame->pts);
+}
+
+void AudioCodeThread::recordCaptureLatency(int64_t captureTimeUs)
+{
+    int64_t now = av_gettime_relative();
+    if (captureTimeUs >= 0) {
+        qint64 latencyUs = now - captureTimeUs;
+        m_latencySumUs += latencyUs;
+        m_latencyMaxUs = qMax(m_latencyMaxUs, latencyUs);
+        ++m_latencyCount;
+    }
+    if (now - m_latencyReportUs >= 1000000) {
+        if (m_latencyCount > 0) {
+            emit captureLatency(m_latencySumUs / m_latencyCount, m_latencyMaxUs);
+        }
+        m_latencySumUs = 0;
+        m_latencyMaxUs = 0;
+        m_latencyCount = 0;
+        m_latencyReportUs = now;
     }
 }
 
@@ -124,6 +298,26 @@ AVCodecContext *AudioCodeThread::codecCtx() const
 
 void AudioCodeThread::stopEncoding() {
     m_running = false;
+    if (m_strand) {
+        m_strand->waitIdle();
+        return;
+    }
     m_cond.wakeAll();
     wait();
 }
+
+void AudioCodeThread::flush(const std::function<void(AVPacket*, const PacketTiming&)>& sink)
+{
+    if (!m_codecCtx || avcodec_send_frame(m_codecCtx, nullptr) < 0) {
+        return;
+    }
+    AVPacket* pkt = av_packet_alloc();
+    while (avcodec_receive_packet(m_codecCtx, pkt) == 0) {
+        pkt->stream_index = m_stream->index;
+        PacketTiming timing;
+        timing.encodeEndUs = FrameTrace::nowUs();
+        sink(pkt, timing);
+        pkt = av_packet_alloc();
+    }
+    av_packet_free(&pkt);
+}
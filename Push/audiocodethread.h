@@ -5,42 +5,99 @@
 #include <QThread>
 #include <QMutex>
 #include <QWaitCondition>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "DataStruct.h"
+#include "audiodsp.h"
+#include "pcmtimeline.h"
+#include "audioresampler.h"
+#include "pushstats.h"
+#include "pushmetrics.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavdevice/avdevice.h>
-#include <libswresample/swresample.h>
 }
 
+class Strand;
+
 class AudioCodeThread : public QThread {
     Q_OBJECT
 public:
     explicit AudioCodeThread(QObject* parent = nullptr);
     ~AudioCodeThread();
 
+    // 需在initialize之前调用，默认AAC
+    void setAudioCodec(AudioCodecType codec, int opusFrameMs = 20, bool opusDtx = false);
+    // 静音检测：阈值(dBFS)以下持续hangoverMs后按mode处理
+    void setSilenceDetection(SilenceMode mode, double thresholdDb = -60.0, int hangoverMs = 300);
+    // 采集端实际输出的PCM格式（交错），需在initialize之前调用；未设置时视为与编码器同采样率/通道数的S16
+    void setInputFormat(int sampleRate, int channels, AVSampleFormat format);
     bool initialize(AVFormatContext* fmtCtx, int sampleRate, int channels);
-    void addAudioData(const QByteArray& data);
+    // captureTimeUs为数据首个采样的采集时刻，-1表示未知
+    void addAudioData(const QByteArray& data, qint64 captureTimeUs = -1);
+    // 设置strand后不再启动专用线程，新数据到达时向共享线程池投递一次编码任务，需在startEncoding之前调用
+    void setStrand(const std::shared_ptr<Strand>& strand) { m_strand = strand; }
+    void startEncoding();
     void stopEncoding();
+    // stopEncoding之后调用：取出编码器内缓存的帧交给sink（调用线程上同步执行），不足一帧的采样丢弃
+    void flush(const std::function<void(AVPacket*, const PacketTiming&)>& sink);
+    void setStatsCounters(PushStatsCounters* stats) { m_stats = stats; }
+    void setMetrics(PushMetrics* metrics) { m_metrics = metrics; }
+    // 暂停时采集数据照常切帧但不编码，时间戳照常递增，恢复后与视频时间轴保持一致
+    void setPaused(bool paused) { m_paused = paused; }
 
     AVCodecContext *codecCtx() const;
     AVStream *stream() const;
 
 signals:
-    void packetEncoded(AVPacket* packet);
+    void packetEncoded(AVPacket* packet, const PacketTiming& timing);
     void audioPtsUpdated(int64_t pts);
+    void silenceStatistics(qint64 totalFrames, qint64 silentFrames);
+    // 每秒上报一次采集到编码的延迟（以帧首个采样计）
+    void captureLatency(qint64 avgUs, qint64 maxUs);
 
 protected:
     void run() override;
 
 private:
     AVCodecContext* m_codecCtx = nullptr;
-    SwrContext* m_swrCtx = nullptr;
     AVStream* m_stream = nullptr;
+    AudioResampler m_resampler;
+    PushStatsCounters* m_stats = nullptr;
+    PushMetrics* m_metrics = nullptr;
+    int m_inSampleRate = 0;
+    int m_inChannels = 0;
+    AVSampleFormat m_inFormat = AV_SAMPLE_FMT_S16;
     QByteArray m_audioBuffer;
     QMutex m_mutex;
     QWaitCondition m_cond;
     volatile bool m_running = false;
+    std::atomic<bool> m_paused{false};
     int64_t m_pts = 0;
+    std::shared_ptr<Strand> m_strand;
+    std::atomic<bool> m_taskPosted{false};     // 已投递尚未执行的编码任务，多次到达的数据合并处理
+    int64_t m_pendingSinceUs = -1;              // 缓冲中最早一批未处理数据的到达时刻，受m_mutex保护
+
+    AudioCodecType m_codecType = AudioCodecType::aac;
+    int m_opusFrameMs = 20;
+    bool m_opusDtx = false;
+
+    // 静音检测
+    SilenceGate m_silenceGate;
+
+    // 采集到编码延迟统计
+    PcmTimeline m_timeline;
+    qint64 m_latencySumUs = 0;
+    qint64 m_latencyMaxUs = 0;
+    int m_latencyCount = 0;
+    int64_t m_latencyReportUs = 0;
+    void recordCaptureLatency(int64_t captureTimeUs);
+    // 编码缓冲中的全部完整帧，无完整帧时返回false
+    bool processPending();
+    bool checkSilence(AVFrame* frame);
+    void encodeFrame(AVFrame* frame, int64_t captureTimeUs);
 };
 
 #endif // AUDIOCODETHREAD_H
@@ -0,0 +1,385 @@
+﻿#include "audiomixerthread.h"
+#include "Logger.h"
+#include "audiodsp.h"
+#include "audioformat.h"
+#include "audioresampler.h"
+#include "threadtuning.h"
+#include <QTimer>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+extern "C" {
+#include <libswresample/swresample.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/time.h>
+}
+
+namespace
+{
+// 交错float环形缓冲，写满时扩容；混音与丢弃都在队首进行，不搬移数据
+class SampleRing
+{
+public:
+    int size() const { return m_size; }
+
+    void reserve(int values)
+    {
+        if (values <= m_buf.size()) {
+            return;
+        }
+        QVector<float> buf(qMax(values, m_buf.size() * 2));
+        int first = qMin(m_size, m_buf.size() - m_head);
+        std::memcpy(buf.data(), m_buf.constData() + m_head, first * sizeof(float));
+        std::memcpy(buf.data() + first, m_buf.constData(), (m_size - first) * sizeof(float));
+        m_buf.swap(buf);
+        m_head = 0;
+    }
+
+    // src为nullptr时写入静音
+    void write(const float* src, int values)
+    {
+        if (values <= 0) {
+            return;
+        }
+        reserve(m_size + values);
+        int cap = m_buf.size();
+        int tail = (m_head + m_size) % cap;
+        int first = qMin(values, cap - tail);
+        float* dst = m_buf.data();
+        if (src) {
+            std::memcpy(dst + tail, src, first * sizeof(float));
+            std::memcpy(dst, src + first, (values - first) * sizeof(float));
+        } else {
+            std::fill(dst + tail, dst + tail + first, 0.0f);
+            std::fill(dst, dst + values - first, 0.0f);
+        }
+        m_size += values;
+    }
+
+    void discard(int values)
+    {
+        values = qMin(values, m_size);
+        if (values > 0) {
+            m_head = (m_head + values) % m_buf.size();
+            m_size -= values;
+        }
+    }
+
+    // 队首values个值乘增益累加到dst，不出队
+    void mixInto(float* dst, float gain, int values) const
+    {
+        values = qMin(values, m_size);
+        int first = qMin(values, m_buf.size() - m_head);
+        AudioDsp::mixAddScaled(dst, m_buf.constData() + m_head, gain, first);
+        AudioDsp::mixAddScaled(dst + first, m_buf.constData(), gain, values - first);
+    }
+
+private:
+    QVector<float> m_buf;
+    int m_head = 0;
+    int m_size = 0;
+};
+} // namespace
+
+struct AudioMixerThread::InputState {
+    QAudioInput* audioInput = nullptr;
+    InputDevice* device = nullptr;
+    SwrContext* swrCtx = nullptr;
+    QAudioFormat format;        // 设备实际协商的格式
+    QVector<float> convBuffer;  // 重采样输出，只增不减
+    SampleRing fifo;            // 已重采样到混音格式的交错float数据
+    bool aligned = false;       // 是否已按首包到达时刻对齐到混音时钟
+    bool priming = false;       // 欠载后该路按静音处理，直到重新积累MIX_LATENCY_MS余量
+    int64_t fillSum = 0;        // 本校正窗口内各混音周期开始时的FIFO水位（每通道采样数）之和
+    int fillCount = 0;
+    int driftPpm = 0;           // 当前重采样比例调整量
+    bool driftSupported = true;
+    qint64 underruns = 0;
+    qint64 droppedSamples = 0;
+};
+
+AudioMixerThread::AudioMixerThread(QObject* parent)
+    : QThread(parent)
+{
+
+}
+
+AudioMixerThread::~AudioMixerThread()
+{
+    stopCapture();
+}
+
+void AudioMixerThread::setInputs(const QList<AudioMixerInput>& inputs)
+{
+    m_inputConfigs = inputs;
+    m_gains.reset(new std::atomic<float>[inputs.size()]);
+    for (int i = 0; i < inputs.size(); ++i) {
+        m_gains[i].store(inputs[i].gain);
+    }
+}
+
+void AudioMixerThread::setInputGain(int index, float gain)
+{
+    if (index >= 0 && index < m_inputConfigs.size()) {
+        m_gains[index].store(gain, std::memory_order_relaxed);
+    }
+}
+
+void AudioMixerThread::setLowLatency(bool enabled, int bufferMs)
+{
+    m_lowLatency = enabled;
+    m_bufferMs = bufferMs;
+}
+
+bool AudioMixerThread::initialize(int sampleRate, int channels)
+{
+    if (m_inputConfigs.isEmpty()) {
+        LogErr << "【混音】未配置输入设备";
+        return false;
+    }
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    return true;
+}
+
+void AudioMixerThread::run()
+{
+    ThreadTuning::StageScope tuning(PipelineStage::audioCapture);
+    m_running = true;
+    m_startTimeUs = av_gettime_relative();
+    m_mixedSamples = 0;
+
+    m_inputs.fill(nullptr, m_inputConfigs.size());
+    int opened = 0;
+    for (int i = 0; i < m_inputConfigs.size(); ++i) {
+        if (openInput(i)) {
+            ++opened;
+        }
+    }
+    if (opened == 0) {
+        LogErr << "【混音】没有可用的输入设备";
+        closeInputs();
+        m_running = false;
+        return;
+    }
+
+    // 混音周期的一半触发一次，每次输出所有已到期的混音周期
+    QTimer timer;
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, &QTimer::timeout, [this]() { mixPending(); });
+    timer.start(MIX_PERIOD_MS / 2);
+
+    exec(); // 进入事件循环
+
+    timer.stop();
+    closeInputs();
+    m_running = false;
+}
+
+void AudioMixerThread::stopCapture()
+{
+    if (m_running) {
+        quit();
+        wait();
+    }
+}
+
+bool AudioMixerThread::openInput(int index)
+{
+    const AudioMixerInput& cfg = m_inputConfigs[index];
+    QAudioDeviceInfo info = AudioFormat::findInputDevice(cfg.deviceName);
+    if (info.isNull()) {
+        LogWarn << "【混音】找不到输入设备:" << cfg.deviceName;
+        return false;
+    }
+
+    QAudioFormat format;
+    format.setSampleRate(m_sampleRate);
+    format.setChannelCount(m_channels);
+    format.setSampleSize(16);
+    format.setCodec("audio/pcm");
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(QAudioFormat::SignedInt);
+    if (!info.isFormatSupported(format)) {
+        format = info.nearestFormat(format);
+    }
+    AVSampleFormat inFmt = AudioFormat::toSampleFormat(format);
+    if (inFmt == AV_SAMPLE_FMT_NONE) {
+        LogWarn << "【混音】不支持的设备格式:" << info.deviceName() << AudioFormat::describe(format);
+        return false;
+    }
+
+    std::unique_ptr<InputState> in(new InputState);
+    in->format = format;
+    QString engine;
+    // soxr不支持比例补偿，漂移校正需要swr内置重采样器
+    in->swrCtx = AudioResampler::createContext(format.sampleRate(), format.channelCount(), inFmt,
+                                               m_sampleRate, m_channels, AV_SAMPLE_FMT_FLT, &engine, false);
+    if (!in->swrCtx) {
+        LogWarn << "【混音】swr上下文初始化失败:" << info.deviceName();
+        return false;
+    }
+    // 采样率相同时swr不会创建重采样器，先设置一次零补偿，在收到数据前把重采样器建好
+    if (swr_set_compensation(in->swrCtx, 0, m_sampleRate) < 0) {
+        in->driftSupported = false;
+        LogWarn << "【混音】输入" << index << "不支持漂移校正，仅靠积压丢弃与欠载重新缓冲";
+    }
+    in->fifo.reserve((MIX_LATENCY_MS + MAX_INPUT_BACKLOG_MS) * m_sampleRate / 1000 * m_channels * 2);
+
+    in->audioInput = new QAudioInput(info, format);
+    if (m_lowLatency) {
+        in->audioInput->setBufferSize(format.bytesForDuration(qint64(m_bufferMs) * 1000));
+    }
+    in->device = new InputDevice(this, index);
+    in->device->open(QIODevice::WriteOnly);
+    m_inputs[index] = in.release();
+    m_inputs[index]->audioInput->start(m_inputs[index]->device);
+    LogInfo << "【混音】输入" << index << info.deviceName() << AudioFormat::describe(format)
+            << "增益:" << cfg.gain << "缓冲:" << m_inputs[index]->audioInput->bufferSize()
+            << "分片:" << m_inputs[index]->audioInput->periodSize() << "重采样:" << engine;
+    return true;
+}
+
+void AudioMixerThread::closeInputs()
+{
+    for (int i = 0; i < m_inputs.size(); ++i) {
+        InputState* in = m_inputs[i];
+        if (!in) {
+            continue;
+        }
+        in->audioInput->stop();
+        delete in->audioInput;
+        delete in->device;
+        swr_free(&in->swrCtx);
+        LogInfo << "【混音】输入" << i << "欠载次数:" << in->underruns
+                << "漂移丢弃采样:" << in->droppedSamples << "漂移校正:" << in->driftPpm << "ppm";
+        delete in;
+    }
+    m_inputs.clear();
+}
+
+void AudioMixerThread::onInputData(int index, const char* data, qint64 len)
+{
+    InputState* in = m_inputs.value(index);
+    int bytesPerFrame = in ? in->format.bytesPerFrame() : 0;
+    if (!in || bytesPerFrame <= 0 || len < bytesPerFrame) {
+        return;
+    }
+    int inSamples = int(len / bytesPerFrame);
+    int64_t arriveUs = av_gettime_relative();
+
+    // 重采样到混音格式
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
+    int outCap = swr_get_out_samples(in->swrCtx, inSamples);
+    if (in->convBuffer.size() < outCap * m_channels) {
+        in->convBuffer.resize(outCap * m_channels);
+    }
+    uint8_t* dst = reinterpret_cast<uint8_t*>(in->convBuffer.data());
+    int got = qMax(swr_convert(in->swrCtx, &dst, outCap, &src, inSamples), 0);
+
+    int64_t skip = 0;
+    if (!in->aligned) {
+        // 首包对齐：首个采样的采集时刻 = 到达时刻 - 本包时长，映射到混音时钟上的位置
+        int64_t firstUs = arriveUs - int64_t(inSamples) * 1000000 / in->format.sampleRate() - m_startTimeUs;
+        int64_t offset = firstUs * m_sampleRate / 1000000 - m_mixedSamples;
+        if (offset > 0) {
+            in->fifo.write(nullptr, int(offset) * m_channels);
+        } else {
+            skip = -offset;
+        }
+        in->aligned = true;
+    }
+    in->fifo.write(in->convBuffer.constData(), got * m_channels);
+    if (skip > 0) {
+        in->fifo.discard(int(qMin<int64_t>(skip * m_channels, in->fifo.size())));
+    }
+
+    // 漂移校正正常时不会走到这里；设备长时间停顿后集中到达等情况下丢弃最旧数据
+    int maxSamples = (MIX_LATENCY_MS + MAX_INPUT_BACKLOG_MS) * m_sampleRate / 1000;
+    int frames = in->fifo.size() / m_channels;
+    if (frames > maxSamples) {
+        in->fifo.discard((frames - maxSamples) * m_channels);
+        in->droppedSamples += frames - maxSamples;
+    }
+}
+
+void AudioMixerThread::mixPending()
+{
+    // 混音时钟比采集时钟滞后MIX_LATENCY_MS，保证各路数据在混音时已到达
+    int64_t elapsedUs = av_gettime_relative() - m_startTimeUs - MIX_LATENCY_MS * 1000;
+    int64_t targetSamples = elapsedUs * m_sampleRate / 1000000;
+    int period = m_sampleRate * MIX_PERIOD_MS / 1000;
+    int periodValues = period * m_channels;
+    int cushionValues = MIX_LATENCY_MS * m_sampleRate / 1000 * m_channels;
+
+    while (m_mixedSamples + period <= targetSamples) {
+        m_mixBuffer.fill(0.0f, periodValues);
+        for (int i = 0; i < m_inputs.size(); ++i) {
+            InputState* in = m_inputs[i];
+            if (!in || !in->aligned) {
+                continue;   // 尚未收到数据的输入按静音处理
+            }
+            if (in->priming) {
+                if (in->fifo.size() < cushionValues) {
+                    continue;
+                }
+                in->priming = false;
+            }
+            if (in->fifo.size() < periodValues) {
+                // 不输出残缺的一段（中间补零会产生爆音），该路静音到重新积累满余量
+                ++in->underruns;
+                in->priming = true;
+                in->fillSum = 0;
+                in->fillCount = 0;
+                continue;
+            }
+            in->fillSum += in->fifo.size() / m_channels;
+            if (++in->fillCount >= DRIFT_WINDOW_PERIODS) {
+                correctDrift(i, in);
+            }
+            in->fifo.mixInto(m_mixBuffer.data(), m_gains[i].load(std::memory_order_relaxed), periodValues);
+            in->fifo.discard(periodValues);
+        }
+
+        QByteArray out(periodValues * int(sizeof(int16_t)), Qt::Uninitialized);
+        AudioDsp::floatToS16(m_mixBuffer.constData(), reinterpret_cast<int16_t*>(out.data()), periodValues);
+        // 混音输出滞后于采集MIX_LATENCY_MS，该段的采集时刻即其在混音时钟上的位置
+        emit audioDataAvailable(out, m_startTimeUs + m_mixedSamples * 1000000 / m_sampleRate);
+        m_mixedSamples += period;
+    }
+}
+
+void AudioMixerThread::correctDrift(int index, InputState* in)
+{
+    // 设备偏快时水位上涨，偏慢时余量被耗尽。按窗口内平均水位与目标余量的差值微调该路输出采样率，
+    // 约DRIFT_CORRECT_S秒追平；补偿距离取两个窗口，下次校正前不会失效
+    int64_t avgFill = in->fillSum / in->fillCount;
+    in->fillSum = 0;
+    in->fillCount = 0;
+    if (!in->driftSupported) {
+        return;
+    }
+    int64_t error = avgFill - int64_t(MIX_LATENCY_MS) * m_sampleRate / 1000;
+    int ppm = int(qBound<int64_t>(-MAX_DRIFT_PPM, -error * 1000000 / (int64_t(m_sampleRate) * DRIFT_CORRECT_S),
+                                  MAX_DRIFT_PPM));
+    int distance = m_sampleRate * MIX_PERIOD_MS / 1000 * DRIFT_WINDOW_PERIODS * 2;
+    if (swr_set_compensation(in->swrCtx, int(int64_t(ppm) * distance / 1000000), distance) < 0) {
+        in->driftSupported = false;
+        LogWarn << "【混音】输入" << index << "漂移校正失败，停止校正";
+        return;
+    }
+    if (qAbs(ppm - in->driftPpm) >= MAX_DRIFT_PPM / 4) {
+        LogInfo << "【混音】输入" << index << "水位偏差" << error * 1000 / m_sampleRate << "ms，重采样比例调整"
+                << ppm << "ppm";
+    }
+    in->driftPpm = ppm;
+}
+
+qint64 AudioMixerThread::InputDevice::writeData(const char* data, qint64 len)
+{
+    if (m_owner && len > 0) {
+        m_owner->onInputData(m_index, data, len);
+    }
+    return len;
+}
@@ -0,0 +1,85 @@
+﻿#ifndef AUDIOMIXERTHREAD_H
+#define AUDIOMIXERTHREAD_H
+
+#include <QThread>
+#include <QAudioInput>
+#include <QAudioDeviceInfo>
+#include <QIODevice>
+#include <QVector>
+#include <QList>
+#include <atomic>
+#include <memory>
+
+struct SwrContext;
+
+// 混音输入配置
+struct AudioMixerInput {
+    QString deviceName;     // 设备名（包含匹配，"default"表示默认输入设备）
+    float gain = 1.0f;      // 线性增益
+};
+
+// 多路音频采集混音线程：同时采集多个输入设备，按媒体时钟对齐、重采样后按增益混音，
+// 输出与AudioCaptureThread相同的S16交错PCM，可直接送入AudioCodeThread。
+// 各设备时钟与混音时钟（单调时钟）之间的漂移按FIFO水位逐步微调重采样比例来吸收
+class AudioMixerThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit AudioMixerThread(QObject* parent = nullptr);
+    ~AudioMixerThread();
+
+    void setInputs(const QList<AudioMixerInput>& inputs);
+    void setInputGain(int index, float gain);  // 推流过程中可调整
+    bool initialize(int sampleRate, int channels);
+    // 低延迟模式：显式设置各输入设备缓冲时长，需在start之前调用
+    void setLowLatency(bool enabled, int bufferMs = 10);
+    void stopCapture();
+
+signals:
+    // captureTimeUs为混音时钟上该段首个采样对应的采集时刻
+    void audioDataAvailable(const QByteArray& data, qint64 captureTimeUs);
+
+protected:
+    void run() override;
+
+private:
+    struct InputState;
+
+    class InputDevice : public QIODevice {
+    public:
+        InputDevice(AudioMixerThread* owner, int index) : m_owner(owner), m_index(index) {}
+        qint64 readData(char*, qint64) override { return 0; }
+        qint64 writeData(const char* data, qint64 len) override;
+    private:
+        AudioMixerThread* m_owner;
+        int m_index;
+    };
+
+    bool openInput(int index);
+    void closeInputs();
+    void onInputData(int index, const char* data, qint64 len);
+    void mixPending();
+    void correctDrift(int index, InputState* in);
+
+    QList<AudioMixerInput> m_inputConfigs;
+    std::unique_ptr<std::atomic<float>[]> m_gains;  // 各路增益，可跨线程调整
+    QVector<InputState*> m_inputs;
+    int m_sampleRate = 44100;
+    int m_channels = 2;
+    volatile bool m_running = false;
+    bool m_lowLatency = false;
+    int m_bufferMs = 10;
+
+    int64_t m_startTimeUs = 0;          // 混音时钟起点（单调时钟）
+    int64_t m_mixedSamples = 0;         // 已输出的采样数（每通道）
+    QVector<float> m_mixBuffer;
+
+    static const int MIX_PERIOD_MS = 10;        // 混音周期
+    static const int MIX_LATENCY_MS = 40;       // 混音时钟落后于采集的余量，吸收设备抖动
+    static const int MAX_INPUT_BACKLOG_MS = 120; // 单路积压超过该值时丢弃最旧数据（漂移校正跟不上时兜底）
+    static const int DRIFT_WINDOW_PERIODS = 100; // 每100个混音周期（1秒）按平均水位校正一次
+    static const int DRIFT_CORRECT_S = 10;      // 水位偏差约在10秒内追平
+    static const int MAX_DRIFT_PPM = 2000;      // 重采样比例最多调整0.2%，听不出音调变化
+};
+
+#endif // AUDIOMIXERTHREAD_H
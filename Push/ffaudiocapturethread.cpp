@@ -0,0 +1,143 @@
+﻿#include "ffaudiocapturethread.h"
+#include "Logger.h"
+#include "threadtuning.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavdevice/avdevice.h>
+#include <libavutil/time.h>
+}
+
+FFAudioCaptureThread::FFAudioCaptureThread(QObject *parent)
+    : QThread{parent}
+{
+
+}
+
+FFAudioCaptureThread::~FFAudioCaptureThread()
+{
+    stopCapture();
+}
+
+void FFAudioCaptureThread::setDevice(AudioCaptureBackend backend, const QString &device)
+{
+    m_backend = backend;
+    m_device = device.isEmpty() ? QString("default") : device;
+}
+
+bool FFAudioCaptureThread::initialize(int sampleRate, int channels)
+{
+    if (m_backend == AudioCaptureBackend::qt) {
+        LogErr << "【音频采集】FFmpeg采集线程不支持Qt后端";
+        return false;
+    }
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    return true;
+}
+
+bool FFAudioCaptureThread::openDevice()
+{
+    const char* fmtName = "pulse";
+    QString url = m_device;
+    int bytesPerMs = m_sampleRate * m_channels * 2 / 1000;
+
+    AVDictionary* options = nullptr;
+    av_dict_set_int(&options, "sample_rate", m_sampleRate, 0);
+    av_dict_set_int(&options, "channels", m_channels, 0);
+    switch (m_backend) {
+    case AudioCaptureBackend::pulse:
+        fmtName = "pulse";
+        if (m_bufferMs > 0) {
+            av_dict_set_int(&options, "fragment_size", bytesPerMs * m_bufferMs, 0);
+        }
+        break;
+    case AudioCaptureBackend::alsa:
+        // alsa输入由FFmpeg按设备能力选择period，无可调选项
+        fmtName = "alsa";
+        break;
+    case AudioCaptureBackend::dshow:
+        fmtName = "dshow";
+        url = "audio=" + m_device;
+        if (m_bufferMs > 0) {
+            av_dict_set_int(&options, "audio_buffer_size", m_bufferMs, 0);
+        }
+        break;
+    default:
+        break;
+    }
+
+    AVInputFormat* inputFmt = av_find_input_format(fmtName);
+    if (!inputFmt) {
+        av_dict_free(&options);
+        emit errorOccurred(QString("FFmpeg未编译%1输入设备").arg(fmtName));
+        return false;
+    }
+
+    int ret = avformat_open_input(&m_fmtCtx, url.toUtf8().data(), inputFmt, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        emit errorOccurred(QString("打开音频设备失败:%1 %2").arg(fmtName).arg(url));
+        return false;
+    }
+
+    // 设备直接输出PCM，不经过探测；格式与请求不一致时编码线程无法处理
+    AVCodecParameters* par = m_fmtCtx->streams[0]->codecpar;
+    if (par->codec_id != AV_CODEC_ID_PCM_S16LE || par->sample_rate != m_sampleRate
+        || par->channels != m_channels) {
+        emit errorOccurred(QString("音频设备格式不匹配: %1 %2Hz %3ch")
+                           .arg(avcodec_get_name(par->codec_id)).arg(par->sample_rate).arg(par->channels));
+        avformat_close_input(&m_fmtCtx);
+        return false;
+    }
+    LogInfo << "【音频采集】FFmpeg设备:" << fmtName << url << "缓冲:" << m_bufferMs << "ms";
+    return true;
+}
+
+void FFAudioCaptureThread::run()
+{
+    ThreadTuning::StageScope tuning(PipelineStage::audioCapture);
+    m_running = true;
+    if (!openDevice()) {
+        m_running = false;
+        return;
+    }
+
+    const int bytesPerSecond = m_sampleRate * m_channels * 2;
+    AVPacket* pkt = av_packet_alloc();
+    bool firstPacket = true;
+
+    while (m_running) {
+        int ret = av_read_frame(m_fmtCtx, pkt);
+        if (ret == AVERROR(EAGAIN)) {
+            msleep(1);
+            continue;
+        }
+        if (ret < 0) {
+            emit errorOccurred("读取音频设备失败: " + QString::number(ret));
+            break;
+        }
+
+        // 包到达时最后一个采样刚采集完成，首个采样的采集时刻需减去包时长
+        int64_t captureTimeUs = av_gettime_relative() - int64_t(pkt->size) * 1000000 / bytesPerSecond;
+        if (firstPacket) {
+            firstPacket = false;
+            int bufferBytes = m_bufferMs > 0 ? m_bufferMs * bytesPerSecond / 1000 : pkt->size;
+            LogInfo << "【音频采集】设备缓冲:" << bufferBytes << "字节 分片:" << pkt->size << "字节("
+                    << pkt->size * 1000 / bytesPerSecond << "ms)";
+            emit captureBufferInfo(bufferBytes, pkt->size);
+        }
+        emit audioDataAvailable(QByteArray(reinterpret_cast<const char*>(pkt->data), pkt->size), captureTimeUs);
+        av_packet_unref(pkt);
+    }
+
+    av_packet_free(&pkt);
+    avformat_close_input(&m_fmtCtx);
+    m_running = false;
+}
+
+void FFAudioCaptureThread::stopCapture()
+{
+    m_running = false;
+    wait();
+}
@@ -0,0 +1,46 @@
+﻿#ifndef FFAUDIOCAPTURETHREAD_H
+#define FFAUDIOCAPTURETHREAD_H
+
+#include <QThread>
+#include <QString>
+#include "DataStruct.h"
+
+struct AVFormatContext;
+
+// 直接使用FFmpeg的pulse/alsa/dshow输入设备采集音频，绕过QAudioInput的缓冲，
+// 在独立线程中阻塞读取，输出S16交错PCM
+class FFAudioCaptureThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit FFAudioCaptureThread(QObject* parent = nullptr);
+    ~FFAudioCaptureThread();
+
+    // backend为pulse/alsa/dshow，device为设备名（pulse为source名，alsa如hw:0，dshow为设备友好名）
+    void setDevice(AudioCaptureBackend backend, const QString& device);
+    // 设备缓冲/分片时长，0表示使用设备默认值
+    void setBufferMs(int ms) { m_bufferMs = ms; }
+    bool initialize(int sampleRate, int channels);
+    void stopCapture();
+
+signals:
+    void audioDataAvailable(const QByteArray& data, qint64 captureTimeUs);
+    void captureBufferInfo(int bufferBytes, int periodBytes);
+    void errorOccurred(const QString& message);
+
+protected:
+    void run() override;
+
+private:
+    bool openDevice();
+
+    AVFormatContext* m_fmtCtx = nullptr;
+    AudioCaptureBackend m_backend = AudioCaptureBackend::pulse;
+    QString m_device = "default";
+    int m_bufferMs = 0;
+    int m_sampleRate = 44100;
+    int m_channels = 2;
+    volatile bool m_running = false;
+};
+
+#endif // FFAUDIOCAPTURETHREAD_H
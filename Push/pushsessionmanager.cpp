@@ -0,0 +1,152 @@
+﻿#include "pushsessionmanager.h"
+#include <QEventLoop>
+#include <QTimer>
+#include "Logger.h"
+#include "rtspsyncpush.h"
+#include "workerpool.h"
+
+PushSessionManager::PushSessionManager(int workerThreads, QObject* parent)
+    : QObject(parent)
+    , m_pool(new WorkerPool(workerThreads))
+{
+    qRegisterMetaType<PushCpuReport>("PushCpuReport");
+    LogInfo << "【会话管理】工作线程数: 视频" << m_pool->threadCount(StrandPriority::normal)
+            << "音频" << m_pool->threadCount(StrandPriority::high);
+
+    m_cpuTimer = new QTimer(this);
+    connect(m_cpuTimer, &QTimer::timeout, this, &PushSessionManager::updateCpuReport);
+    m_lastProcessUs = CpuClock::processUs();
+    m_lastPoolUs = m_pool->cpuUs();
+    m_reportClock.start();
+    m_cpuTimer->start(1000);
+}
+
+PushSessionManager::~PushSessionManager()
+{
+    // 会话的strand引用线程池，先停止并销毁全部会话再销毁线程池
+    stopAll();
+    qDeleteAll(m_sessions);
+    m_sessions.clear();
+    m_pool.reset();
+}
+
+RTSPSyncPush* PushSessionManager::createSession(const QString& name)
+{
+    if (name.isEmpty() || m_sessions.contains(name)) {
+        LogWarn << "【会话管理】会话名为空或已存在:" << name;
+        return nullptr;
+    }
+    RTSPSyncPush* push = new RTSPSyncPush(this);
+    push->setObjectName(name);
+    push->setWorkerPool(m_pool.get(), name);
+    m_sessions.insert(name, push);
+    m_lastGroup.insert(name, GroupSample());
+    return push;
+}
+
+void PushSessionManager::removeSession(const QString& name)
+{
+    RTSPSyncPush* push = m_sessions.take(name);
+    if (!push) {
+        return;
+    }
+    push->stop();
+    delete push;
+    m_lastGroup.remove(name);
+}
+
+RTSPSyncPush* PushSessionManager::session(const QString& name) const
+{
+    return m_sessions.value(name, nullptr);
+}
+
+QStringList PushSessionManager::sessionNames() const
+{
+    return m_sessions.keys();
+}
+
+void PushSessionManager::stopAll()
+{
+    // 逐个同步停止时总耗时是会话数乘以停止超时；先全部发起，各会话的写文件尾等阶段并行进行
+    QList<RTSPSyncPush*> pending;
+    int timeoutMs = 0;
+    for (RTSPSyncPush* push : qAsConst(m_sessions)) {
+        push->stopAsync();
+        if (push->isStopping()) {
+            pending.append(push);
+            timeoutMs = qMax(timeoutMs, push->stopTimeout());
+        }
+    }
+    if (pending.isEmpty()) {
+        return;
+    }
+
+    // 停止的各阶段靠本线程的事件循环推进
+    QEventLoop loop;
+    int remaining = pending.size();
+    for (RTSPSyncPush* push : qAsConst(pending)) {
+        connect(push, &RTSPSyncPush::stopped, &loop, [&remaining, &loop] {
+            if (--remaining == 0) {
+                loop.quit();
+            }
+        });
+    }
+    QTimer::singleShot(timeoutMs + STOP_GRACE_MS, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    // 采集或编码线程卡住而未在截止时刻内完成的，同步做完剩余阶段
+    for (RTSPSyncPush* push : qAsConst(pending)) {
+        if (push->isStopping()) {
+            LogWarn << "【会话管理】会话" << push->objectName() << "未在" << timeoutMs + STOP_GRACE_MS
+                    << "ms内停止完成";
+            push->stop();
+        }
+    }
+}
+
+void PushSessionManager::setCpuReportInterval(int ms)
+{
+    if (ms <= 0) {
+        m_cpuTimer->stop();
+        return;
+    }
+    m_cpuTimer->start(qMax(100, ms));
+}
+
+void PushSessionManager::updateCpuReport()
+{
+    qint64 elapsedMs = m_reportClock.restart();
+    if (elapsedMs <= 0) {
+        return;
+    }
+    double wallUs = elapsedMs * 1000.0;
+    int64_t processUs = CpuClock::processUs();
+    int64_t poolUs = m_pool->cpuUs();
+
+    PushCpuReport report;
+    report.intervalMs = elapsedMs;
+    report.workerThreads = m_pool->threadCount();
+    report.processCpuPercent = (processUs - m_lastProcessUs) * 100.0 / wallUs;
+    report.poolCpuPercent = (poolUs - m_lastPoolUs) * 100.0 / wallUs;
+    m_lastProcessUs = processUs;
+    m_lastPoolUs = poolUs;
+
+    for (auto it = m_sessions.constBegin(); it != m_sessions.constEnd(); ++it) {
+        WorkGroup* group = it.value()->workGroup();
+        if (!group) {
+            continue;
+        }
+        int64_t groupCpuUs = group->cpuUs();
+        int64_t groupTasks = group->tasks();
+        GroupSample& last = m_lastGroup[it.key()];
+        PushSessionCpu cpu;
+        cpu.name = it.key();
+        cpu.cpuPercent = (groupCpuUs - last.cpuUs) * 100.0 / wallUs;
+        cpu.tasks = groupTasks - last.tasks;
+        cpu.maxQueueWaitUs = group->takeMaxQueueWaitUs();
+        last.cpuUs = groupCpuUs;
+        last.tasks = groupTasks;
+        report.sessions.append(cpu);
+    }
+    emit cpuReport(report);
+}
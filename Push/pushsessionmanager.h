@@ -0,0 +1,80 @@
+﻿#ifndef PUSHSESSIONMANAGER_H
+#define PUSHSESSIONMANAGER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QMetaType>
+#include <QObject>
+#include <QStringList>
+#include <memory>
+
+class QTimer;
+class RTSPSyncPush;
+class WorkerPool;
+
+// 单个会话在采样区间内的CPU占用，100%为一个核
+struct PushSessionCpu {
+    QString name;
+    double cpuPercent = 0.0;        // 仅统计线程池上执行的编码/转换任务
+    qint64 tasks = 0;               // 区间内执行的任务数
+    qint64 maxQueueWaitUs = 0;      // 区间内任务从投递到开始执行的最长等待
+};
+
+struct PushCpuReport {
+    qint64 intervalMs = 0;
+    double processCpuPercent = 0.0; // 整个进程，包含采集线程与主线程
+    double poolCpuPercent = 0.0;    // 线程池全部任务
+    int workerThreads = 0;
+    QList<PushSessionCpu> sessions;
+};
+Q_DECLARE_METATYPE(PushCpuReport)
+
+// 在一个进程内承载多路RTSPSyncPush推流会话。各会话的采集与写出仍是专用线程，
+// 编码与格式转换共用一个按CPU核数创建的工作窃取线程池，按时间片在会话间轮转
+class PushSessionManager : public QObject
+{
+    Q_OBJECT
+public:
+    // workerThreads为0时按CPU核数创建
+    explicit PushSessionManager(int workerThreads = 0, QObject* parent = nullptr);
+    ~PushSessionManager();
+
+    // 创建已接入线程池的会话，名称重复时返回nullptr；返回的会话由管理器持有，
+    // 调用方继续完成setXxx/initialize/start
+    RTSPSyncPush* createSession(const QString& name);
+    // 停止并销毁会话
+    void removeSession(const QString& name);
+    RTSPSyncPush* session(const QString& name) const;
+    QStringList sessionNames() const;
+    // 所有会话同时异步停止，再按同一截止时刻等待全部完成，总耗时约为单个会话的停止超时
+    void stopAll();
+
+    WorkerPool* workerPool() const { return m_pool.get(); }
+    // CPU上报间隔，0为关闭，默认1000ms
+    void setCpuReportInterval(int ms);
+
+signals:
+    void cpuReport(const PushCpuReport& report);
+
+private slots:
+    void updateCpuReport();
+
+private:
+    std::unique_ptr<WorkerPool> m_pool;
+    QMap<QString, RTSPSyncPush*> m_sessions;
+    QTimer* m_cpuTimer = nullptr;
+    QElapsedTimer m_reportClock;
+    int64_t m_lastProcessUs = 0;
+    int64_t m_lastPoolUs = 0;
+    struct GroupSample {
+        int64_t cpuUs = 0;
+        int64_t tasks = 0;
+    };
+    QHash<QString, GroupSample> m_lastGroup;
+
+    static const int STOP_GRACE_MS = 1000;      // 停止超时之外再等的余量，超出后同步做完
+};
+
+#endif // PUSHSESSIONMANAGER_H
@@ -1,12 +1,29 @@
 ﻿#include "rtspsyncpush.h"
 
 #include "audiocapturethread.h"
+#include "audiomixerthread.h"
+#include "ffaudiocapturethread.h"
 #include "videocapturethread.h"
 #include "audiocodethread.h"
 #include "videocodethread.h"
 #include "streampushthread.h"
+#include "frametrace.h"
+#include "metricsserver.h"
+#include "outputformat.h"
+#include "packettap.h"
+#include "threadtuning.h"
+#include "workerpool.h"
+#include <QCoreApplication>
+#include <QTimer>
+#include <QtConcurrent>
 
 #include "Logger.h"
+#include "audioencoder.h"
+#include "audioformat.h"
+
+extern "C" {
+#include <libavutil/time.h>
+}
 
 RTSPSyncPush::RTSPSyncPush(QObject* parent)
     : QObject(parent)
@@ -15,10 +32,28 @@ RTSPSyncPush::RTSPSyncPush(QObject* parent)
     avdevice_register_all();//初始化ffmpeg
     // 实例化线程对象
     m_audioCapThread = new AudioCaptureThread(this);
+    m_audioMixerThread = new AudioMixerThread(this);
+    m_ffAudioCapThread = new FFAudioCaptureThread(this);
+
+    qRegisterMetaType<PushStatistics>("PushStatistics");
+    qRegisterMetaType<PacketTiming>("PacketTiming");
+    qRegisterMetaType<LatencyReport>("LatencyReport");
+    m_statsTimer = new QTimer(this);
+    connect(m_statsTimer, &QTimer::timeout, this, &RTSPSyncPush::updateStatistics);
     m_audioCodeThread = new AudioCodeThread(this);
     m_videoCapThread = new VideoCaptureThread(this);
     m_videoCodeThread = new VideoCodeThread(this);
     m_streamPushThread = new StreamPushThread( this);
+    m_headerWatcher = new QFutureWatcher<int>(this);
+    connect(m_headerWatcher, &QFutureWatcher<int>::finished, this, &RTSPSyncPush::onOutputOpened);
+    m_stopWatcher = new QFutureWatcher<void>(this);
+    connect(m_stopWatcher, &QFutureWatcher<void>::finished, this, &RTSPSyncPush::onStopPhaseFinished);
+    m_stopDeadlineTimer = new QTimer(this);
+    m_stopDeadlineTimer->setSingleShot(true);
+    connect(m_stopDeadlineTimer, &QTimer::timeout, this, [this] {
+        LogWarn << "【推流】停止超过" << m_stopTimeoutMs << "ms，中止网络IO";
+        m_streamPushThread->abortOutput();
+    });
 }
 
 RTSPSyncPush::~RTSPSyncPush()
@@ -35,22 +70,69 @@ bool RTSPSyncPush::initialize(const QString &videoSrc, int videoW, int videoH, i
     m_videoH = videoH;
     m_videoFps = videoFps;
     m_videoBitrate = videoBitrate;
-    m_audioSampleRate = audioSampleRate;
+    // Opus只支持8/12/16/24/48kHz，采集直接使用编码器采样率，避免编码线程重采样
+    m_audioSampleRate = AudioEncoder::encoderSampleRate(m_audioCodec, audioSampleRate);
+    if (m_audioSampleRate != audioSampleRate) {
+        LogInfo << "【推流】" << AudioEncoder::codecName(m_audioCodec)
+                << "编码采样率调整为:" << m_audioSampleRate;
+    }
     m_audioChannels = audioChannels;
     m_rtspUrl = rtspUrl;
 
-    // 创建推流输出上下文
+    // 创建推流输出上下文，复用格式按地址选择（rtsp/rtmp/udp/srt等）
     avformat_network_init();
-    if (avformat_alloc_output_context2(&m_fmtCtx, nullptr, "rtsp", m_rtspUrl.toUtf8().data()) < 0) {
-        emit error("创建RTSP输出上下文失败");
+    QString muxer = OutputFormat::muxerForUrl(m_rtspUrl);
+    if (avformat_alloc_output_context2(&m_fmtCtx, nullptr, muxer.toUtf8().data(), m_rtspUrl.toUtf8().data()) < 0) {
+        emit error("创建" + muxer + "输出上下文失败");
+        return false;
+    }
+    QString errMsg;
+    if (!OutputFormat::canMux(m_fmtCtx->oformat,
+                              m_audioCodec == AudioCodecType::opus ? AV_CODEC_ID_OPUS : AV_CODEC_ID_AAC, &errMsg)) {
+        avformat_free_context(m_fmtCtx);
+        m_fmtCtx = nullptr;
+        emit error(errMsg);
         return false;
     }
 
     //设置输出上下文
     m_streamPushThread->setFmtCtx(m_fmtCtx);
+    m_streamPushThread->setStatsCounters(&m_stats);
+    m_streamPushThread->setMetrics(&m_metrics);
+    m_videoCodeThread->setMetrics(&m_metrics);
+    m_videoCapThread->setMetrics(&m_metrics, &m_stats);
+    m_videoCodeThread->setLatencySei(m_latencySei);
+    m_videoCodeThread->setFrameShm(m_frameShm.get());
 
     // 初始化采集和编码线程
-    if (!m_audioCapThread->initialize(m_audioSampleRate, m_audioChannels) ||
+    m_audioCodeThread->setAudioCodec(m_audioCodec, m_opusFrameMs, m_opusDtx);
+    m_audioCodeThread->setSilenceDetection(m_silenceMode, m_silenceThresholdDb, m_silenceHangoverMs);
+    m_audioCodeThread->setStatsCounters(&m_stats);
+    m_audioCodeThread->setMetrics(&m_metrics);
+    bool useMixer = m_audioInputs.size() > 1;
+    bool useFFmpeg = !useMixer && m_audioBackend != AudioCaptureBackend::qt;
+    bool audioReady = false;
+    if (useMixer) {
+        m_audioMixerThread->setInputs(m_audioInputs);
+        m_audioMixerThread->setLowLatency(m_audioLowLatency, m_audioBufferMs);
+        audioReady = m_audioMixerThread->initialize(m_audioSampleRate, m_audioChannels);
+    } else if (useFFmpeg) {
+        m_ffAudioCapThread->setDevice(m_audioBackend, m_audioDevice);
+        m_ffAudioCapThread->setBufferMs(m_audioLowLatency ? m_audioBufferMs : 0);
+        audioReady = m_ffAudioCapThread->initialize(m_audioSampleRate, m_audioChannels);
+    } else {
+        m_audioCapThread->setLowLatency(m_audioLowLatency, m_audioBufferMs);
+        audioReady = m_audioCapThread->initialize(m_audioSampleRate, m_audioChannels);
+    }
+    // 混音与FFmpeg设备线程按请求格式输出S16；Qt采集以设备协商结果为准，由编码线程重采样
+    if (useMixer || useFFmpeg) {
+        m_audioCodeThread->setInputFormat(m_audioSampleRate, m_audioChannels, AV_SAMPLE_FMT_S16);
+    } else {
+        QAudioFormat capFormat = m_audioCapThread->format();
+        m_audioCodeThread->setInputFormat(capFormat.sampleRate(), capFormat.channelCount(),
+                                          AudioFormat::toSampleFormat(capFormat));
+    }
+    if (!audioReady ||
         !m_audioCodeThread->initialize(m_fmtCtx, m_audioSampleRate, m_audioChannels) ||
         !m_videoCapThread->initialize(m_videoSrc, m_videoW, m_videoH, m_videoFps) ||
         !m_videoCodeThread->initialize(m_fmtCtx, m_videoW, m_videoH, m_videoFps, m_videoBitrate)) {
@@ -60,40 +142,76 @@ bool RTSPSyncPush::initialize(const QString &videoSrc, int videoW, int videoH, i
 
     // 断开可能存在的连接信号
     disconnect(m_audioCapThread,nullptr,this,nullptr);
+    disconnect(m_audioMixerThread,nullptr,this,nullptr);
+    disconnect(m_ffAudioCapThread,nullptr,this,nullptr);
     disconnect(m_videoCapThread,nullptr,this,nullptr);
     disconnect(m_audioCodeThread,nullptr,this,nullptr);
     disconnect(m_videoCodeThread,nullptr,this,nullptr);
+    disconnect(m_streamPushThread,nullptr,this,nullptr);
+    disconnect(m_streamPushThread,&StreamPushThread::keyFrameRequested,m_videoCodeThread,nullptr);
 
     // 信号槽连接
-    connect(m_audioCapThread, &AudioCaptureThread::audioDataAvailable,
-            this, &RTSPSyncPush::onAudioDataAvailable, Qt::QueuedConnection);
+    if (useMixer) {
+        connect(m_audioMixerThread, &AudioMixerThread::audioDataAvailable,
+                this, &RTSPSyncPush::onAudioDataAvailable, Qt::QueuedConnection);
+    } else if (useFFmpeg) {
+        connect(m_ffAudioCapThread, &FFAudioCaptureThread::audioDataAvailable,
+                this, &RTSPSyncPush::onAudioDataAvailable, Qt::QueuedConnection);
+        connect(m_ffAudioCapThread, &FFAudioCaptureThread::captureBufferInfo,
+                this, &RTSPSyncPush::audioCaptureBufferInfo, Qt::QueuedConnection);
+        connect(m_ffAudioCapThread, &FFAudioCaptureThread::errorOccurred,
+                this, &RTSPSyncPush::error, Qt::QueuedConnection);
+    } else {
+        connect(m_audioCapThread, &AudioCaptureThread::audioDataAvailable,
+                this, &RTSPSyncPush::onAudioDataAvailable, Qt::QueuedConnection);
+        connect(m_audioCapThread, &AudioCaptureThread::captureBufferInfo,
+                this, &RTSPSyncPush::audioCaptureBufferInfo, Qt::QueuedConnection);
+    }
+    connect(m_audioCodeThread, &AudioCodeThread::captureLatency,
+            this, &RTSPSyncPush::audioCaptureLatency, Qt::QueuedConnection);
 
     connect(m_videoCapThread, &VideoCaptureThread::videoFrameAvailable,
             this, &RTSPSyncPush::onVideoFrameAvailable, Qt::QueuedConnection);
 
+    // 包保持编码器时间基进入发送队列（pts即帧追踪标识），由推流线程写出前换算
+    m_streamPushThread->setStreamTimeBase(m_audioCodeThread->stream()->index,
+                                          m_audioCodeThread->codecCtx()->time_base);
+    m_streamPushThread->setStreamTimeBase(m_videoCodeThread->stream()->index,
+                                          m_videoCodeThread->codecCtx()->time_base);
+    if (m_packetTap) {
+        m_packetTap->setStream(m_audioCodeThread->stream()->index, false, m_audioCodeThread->codecCtx());
+        m_packetTap->setStream(m_videoCodeThread->stream()->index, true, m_videoCodeThread->codecCtx());
+    }
+
     connect(m_audioCodeThread, &AudioCodeThread::packetEncoded,
-        m_streamPushThread, [this](AVPacket* pkt) {
-
-            if (m_audioCodeThread && m_audioCodeThread->codecCtx() && m_audioCodeThread->stream()) {
-                av_packet_rescale_ts(pkt,
-                                     m_audioCodeThread->codecCtx()->time_base,
-                                     m_audioCodeThread->stream()->time_base);
-            }
-            m_streamPushThread->addPacket(pkt, false);
+        m_streamPushThread, [this](AVPacket* pkt, const PacketTiming& timing) {
+            queuePacket(pkt, timing, false);
         }, Qt::QueuedConnection);
 
     connect(m_videoCodeThread, &VideoCodeThread::packetEncoded,
-        m_streamPushThread, [this](AVPacket* pkt) {
-            if (m_videoCodeThread && m_videoCodeThread->codecCtx() && m_videoCodeThread->stream()) {
-                av_packet_rescale_ts(pkt,
-                                     m_videoCodeThread->codecCtx()->time_base,
-                                     m_videoCodeThread->stream()->time_base);
-            }
-            m_streamPushThread->addPacket(pkt, true);
+        m_streamPushThread, [this](AVPacket* pkt, const PacketTiming& timing) {
+            queuePacket(pkt, timing, true);
         }, Qt::QueuedConnection);
 
+    connect(m_audioCodeThread, &AudioCodeThread::silenceStatistics,
+            this, [this](qint64 totalFrames, qint64 silentFrames) {
+        emit audioSilenceStatistics(totalFrames, silentFrames,
+                                    totalFrames > 0 ? double(silentFrames) / totalFrames : 0.0);
+    }, Qt::QueuedConnection);
+
     connect(m_streamPushThread, &StreamPushThread::errorOccurred,
             this, &RTSPSyncPush::error, Qt::QueuedConnection);
+    // 断线重连期间采集与编码不停，恢复时由编码线程插入IDR（原子标志，直接调用）
+    connect(m_streamPushThread, &StreamPushThread::keyFrameRequested,
+            m_videoCodeThread, &VideoCodeThread::requestKeyFrame, Qt::DirectConnection);
+    connect(m_streamPushThread, &StreamPushThread::reconnecting,
+            this, [this](int attempt, int delayMs) {
+        emit info(QString("推流连接断开，%1ms后第%2次重连").arg(delayMs).arg(attempt));
+    }, Qt::QueuedConnection);
+    connect(m_streamPushThread, &StreamPushThread::reconnected,
+            this, [this](qint64 downtimeMs) {
+        emit info(QString("推流已重连，断线%1ms").arg(downtimeMs));
+    }, Qt::QueuedConnection);
 
     return true;
 }
@@ -114,8 +232,123 @@ void RTSPSyncPush::setAudioParam(int audioSampleRate, int audioChannels, int aud
     m_audioSampleSize = audioSamepleSize;
 }
 
+void RTSPSyncPush::setAudioCodec(AudioCodecType codec, int opusFrameMs, bool opusDtx)
+{
+    m_audioCodec = codec;
+    m_opusFrameMs = opusFrameMs;
+    m_opusDtx = opusDtx;
+}
+
+void RTSPSyncPush::setAudioInputs(const QList<AudioMixerInput> &inputs)
+{
+    m_audioInputs = inputs;
+}
+
+void RTSPSyncPush::setAudioInputGain(int index, float gain)
+{
+    if (index >= 0 && index < m_audioInputs.size()) {
+        m_audioInputs[index].gain = gain;
+        m_audioMixerThread->setInputGain(index, gain);
+    }
+}
+
+void RTSPSyncPush::setAudioCapture(AudioCaptureBackend backend, const QString &device, bool lowLatency, int bufferMs)
+{
+    m_audioBackend = backend;
+    m_audioDevice = device;
+    m_audioLowLatency = lowLatency;
+    m_audioBufferMs = bufferMs;
+}
+
+void RTSPSyncPush::setSilenceDetection(SilenceMode mode, double thresholdDb, int hangoverMs)
+{
+    m_silenceMode = mode;
+    m_silenceThresholdDb = thresholdDb;
+    m_silenceHangoverMs = hangoverMs;
+}
+
+void RTSPSyncPush::setOutputOptions(const OutputOptions& options)
+{
+    m_outputOptions = options;
+}
+
+bool RTSPSyncPush::enablePacketTap(const QString& name)
+{
+    if (!m_packetTap) {
+        m_packetTap = new PacketTap(this);
+    }
+    return m_packetTap->listen(name);
+}
+
+bool RTSPSyncPush::enableFrameShm(const QString& name, FrameShm::Source source, int slotCount)
+{
+    if (!m_frameShm) {
+        m_frameShm.reset(new FrameShmPublisher);
+    }
+    QString errMsg;
+    if (!m_frameShm->open(name, source, slotCount, &errMsg)) {
+        LogErr << "【推流】共享内存输出配置失败:" << errMsg;
+        return false;
+    }
+    LogInfo << "【推流】发布" << (source == FrameShm::Source::captured ? "采集帧" : "YUV帧") << "到共享内存:" << name;
+    return true;
+}
+
+void RTSPSyncPush::setLatencySei(bool enabled)
+{
+    m_latencySei = enabled;
+    if (enabled) {
+        FrameTrace::requireStamps();
+    }
+}
+
+void RTSPSyncPush::setWorkerPool(WorkerPool *pool, const QString &sessionName)
+{
+    if (m_running) {
+        LogWarn << "【推流】推流中不能切换线程池";
+        return;
+    }
+    // 同一会话的视频编码、音频编码各自串行，两者之间及与其他会话并行。
+    // 音频晚到比视频晚到更容易察觉，音频编码在high组上调度。复用与写出可能阻塞在网络上，
+    // 仍由会话自己的写出线程执行，不占用池中的线程
+    m_workGroup = pool->createGroup(sessionName);
+    m_videoCodeThread->setStrand(pool->createStrand(m_workGroup, sessionName + "/video"));
+    m_audioCodeThread->setStrand(pool->createStrand(m_workGroup, sessionName + "/audio", StrandPriority::high));
+}
+
+void RTSPSyncPush::setReconnect(bool enabled, int maxBackoffMs)
+{
+    m_streamPushThread->setReconnect(enabled, 500, maxBackoffMs);
+}
+
+void RTSPSyncPush::setStatisticsInterval(int ms)
+{
+    m_statsIntervalMs = qMax(100, ms);
+    if (m_statsTimer->isActive()) {
+        m_statsTimer->start(m_statsIntervalMs);
+    }
+}
+
+bool RTSPSyncPush::enableMetricsEndpoint(quint16 port, const QString &localName)
+{
+    FrameTrace::requireStamps();    // 采集到编码/写出的延迟分位依赖采集时刻
+    if (!m_metricsServer) {
+        m_metricsServer = new MetricsServer(&m_metrics, this);
+        connect(this, &RTSPSyncPush::statistics, m_metricsServer, &MetricsServer::updateStatistics);
+    }
+    return m_metricsServer->listen(port, localName);
+}
+
+void RTSPSyncPush::updateStatistics()
+{
+    PushStatistics stats = m_stats.sample();
+    ThreadTuning::sampleSchedStats(&stats);
+    emit statistics(stats);
+    emit latencyStatistics(m_metrics.report());
+}
+
 void RTSPSyncPush::start() {
-    if (m_running)
+    if (m_running || m_stopPhase != StopPhase::idle)
         return;
 
     // 确保格式上下文已经创建
@@ -124,73 +357,226 @@ void RTSPSyncPush::start() {
         return;
     }
 
-    int ret = -1;
-    //打开输出流
-    LogDebug << "flag1:"<<m_fmtCtx->oformat->flags <<"AVFMT_NOFILE:"<<AVFMT_NOFILE;
-    if (!(m_fmtCtx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&m_fmtCtx->pb, m_rtspUrl.toUtf8().data(), AVIO_FLAG_WRITE);
-        if (ret < 0) {
-            emit error("打开RTSP输出失败");
-            // 如果写头失败，需要关闭已打开的输出流
-            if (!(m_fmtCtx->oformat->flags & AVFMT_NOFILE) && m_fmtCtx->pb) {
-                avio_closep(&m_fmtCtx->pb);
-            }
+    m_running = true;
+    m_paused = false;
+    m_stats.reset();
+    m_metrics.reset();
+    m_statsTimer->start(m_statsIntervalMs);
+    // 启动所有线程；采集设备在initialize时已开始打开，编码器已就绪
+    if (m_audioInputs.size() > 1) {
+        m_audioMixerThread->start();
+    } else if (m_audioBackend != AudioCaptureBackend::qt) {
+        m_ffAudioCapThread->start(QThread::TimeCriticalPriority);
+    } else {
+        m_audioCapThread->start();
+    }
+    m_audioCodeThread->startEncoding();
+    m_videoCapThread->start();
+    m_videoCodeThread->startEncoding();
+
+    // RTSP握手放到后台线程，与采集、编码的启动并行；握手期间编码输出暂存在有界发送队列里
+    m_headerFuture = QtConcurrent::run([this] { return openOutput(); });
+    m_headerWatcher->setFuture(m_headerFuture);
+}
+
+int RTSPSyncPush::openOutput()
+{
+    int64_t beginUs = av_gettime_relative();
+    // setFmtCtx时已安装中断回调，停止时可打断阻塞的打开
+    AVDictionary* ioOptions = nullptr;
+    OutputFormat::ioOptions(m_rtspUrl, m_outputOptions, &ioOptions);
+    int ret = m_streamPushThread->openIo(&ioOptions);
+    av_dict_free(&ioOptions);
+    if (ret < 0) {
+        return ret;
+    }
+    // 写文件头（RTSP握手），限时完成
+    AVDictionary* muxerOptions = nullptr;
+    OutputFormat::muxerOptions(m_fmtCtx->oformat->name, m_outputOptions, &muxerOptions);
+    ret = m_streamPushThread->writeHeader(&muxerOptions);
+    av_dict_free(&muxerOptions);
+    if (ret >= 0) {
+        LogInfo << "【推流】连接建立耗时" << (av_gettime_relative() - beginUs) / 1000 << "ms";
+    }
+    return ret;
+}
+
+void RTSPSyncPush::onOutputOpened()
+{
+    if (!m_running) {
+        return;     // 握手期间已停止
+    }
+    int ret = m_headerWatcher->result();
+    if (ret < 0) {
+        stop();
+        emit error("建立输出连接失败:" + QString::number(ret));
+        return;
+    }
+    m_streamPushThread->startPushing();
+}
+
+void RTSPSyncPush::pause()
+{
+    if (!m_running || m_paused) {
+        return;
+    }
+    m_paused = true;
+    // 编码线程先进入暂停，之后到达的填充帧按墙钟计时间戳
+    m_videoCodeThread->pause();
+    m_videoCapThread->pause();
+    m_audioCodeThread->setPaused(true);
+    setState(PushState::pause);
+    LogInfo << "【推流】已暂停";
+}
+
+void RTSPSyncPush::resume()
+{
+    if (!m_running || !m_paused) {
+        return;
+    }
+    m_paused = false;
+    m_audioCodeThread->setPaused(false);
+    m_videoCodeThread->resume();
+    m_videoCapThread->resume();
+    setState(PushState::play);
+    LogInfo << "【推流】已恢复";
+}
+
+void RTSPSyncPush::stop()
+{
+    if (m_stopPhase == StopPhase::idle) {
+        if (!beginStop()) {
             return;
         }
-    }else{
-        LogDebug << "没有打开输入上下文";
+        m_stopPhase = StopPhase::stopWorkers;
+        stopWorkers();
+        // 编码线程退出前发出的包可能还在本线程的事件队列里，先送进发送队列再冲刷编码器
+        QCoreApplication::sendPostedEvents(m_streamPushThread, QEvent::MetaCall);
+    } else {
+        // 异步停止进行中（析构、重新initialize）：等当前阶段完成后同步做完剩余阶段
+        m_stopWatcher->waitForFinished();
+        if (m_stopPhase == StopPhase::stopWorkers) {
+            QCoreApplication::sendPostedEvents(m_streamPushThread, QEvent::MetaCall);
+        }
+    }
+    if (m_stopPhase == StopPhase::stopWorkers) {
+        flushEncoders();
+        m_stopPhase = StopPhase::closeConnection;
+        closeConnection();
     }
-    LogDebug << "flag2:"<<m_fmtCtx->oformat->flags <<"AVFMT_NOFILE:"<<AVFMT_NOFILE;
+    finishStop();
+}
 
-    // 写文件头
-    ret = avformat_write_header(m_fmtCtx, nullptr);
-    if (ret < 0) {
-        emit error("写入文件头失败:"+QString::number(ret));
+void RTSPSyncPush::stopAsync()
+{
+    if (m_stopPhase != StopPhase::idle || !beginStop()) {
         return;
     }
+    // 线程退出与写文件尾可能卡在设备或网络上，放到后台线程；本线程只在阶段之间切换
+    m_stopPhase = StopPhase::stopWorkers;
+    m_stopWatcher->setFuture(QtConcurrent::run([this] { stopWorkers(); }));
+}
 
-    m_running = true;
-    // 启动所有线程
-    m_audioCapThread->start();
-    m_audioCodeThread->start();
-    m_videoCapThread->start();
-    m_videoCodeThread->start();
-    m_streamPushThread->start();
+void RTSPSyncPush::setStopTimeout(int ms)
+{
+    m_stopTimeoutMs = qMax(100, ms);
 }
 
-void RTSPSyncPush::stop() {
-    if (!m_running) return;
-    m_running = false;
+void RTSPSyncPush::onStopPhaseFinished()
+{
+    switch (m_stopPhase) {
+    case StopPhase::stopWorkers:
+        // 编码线程退出前发出的包先于本通知投递，此时已全部进入发送队列
+        flushEncoders();
+        m_stopPhase = StopPhase::closeConnection;
+        m_stopWatcher->setFuture(QtConcurrent::run([this] { closeConnection(); }));
+        break;
+    case StopPhase::closeConnection:
+        finishStop();
+        break;
+    default:
+        break;     // 已由同步stop()完成
+    }
+}
 
-    if (m_streamPushThread) {
-        m_streamPushThread->stopPushing();
-        m_streamPushThread->wait(); // 阻塞直到真正退出
+bool RTSPSyncPush::beginStop()
+{
+    if (!m_running) {
+        return false;
+    }
+    m_running = false;
+    m_paused = false;
+    m_stopBeginUs = av_gettime_relative();
+    m_statsTimer->stop();
+    // 握手未完成时没有可发送的内容，直接中止
+    if (!m_headerFuture.isFinished()) {
+        m_streamPushThread->abortOutput();
     }
+    // 总截止时刻到达时中止仍在进行的网络IO
+    m_stopDeadlineTimer->start(m_stopTimeoutMs);
+    return true;
+}
+
+void RTSPSyncPush::stopWorkers()
+{
+    // 先停采集再停编码，编码线程退出前编完已采集的数据
+    m_audioMixerThread->stopCapture();
+    m_ffAudioCapThread->stopCapture();
+    m_audioCapThread->stopCapture();
+    m_videoCapThread->stopCapture();
+    m_audioCodeThread->stopEncoding();
+    m_videoCodeThread->stopEncoding();
+}
 
-    // 停止线程
-    if (m_audioCapThread) { m_audioCapThread->stopCapture(); /*m_audioCapThread->quit(); m_audioCapThread->wait();*/ }
-    if (m_audioCodeThread) { m_audioCodeThread->stopEncoding(); /*m_audioCodeThread->quit(); m_audioCodeThread->wait();*/ }
-    if (m_videoCapThread) { m_videoCapThread->stopCapture(); /*m_videoCapThread->quit(); m_videoCapThread->wait();*/ }
-    if (m_videoCodeThread) { m_videoCodeThread->stopEncoding(); /*m_videoCodeThread->quit(); m_videoCodeThread->wait();*/ }
+void RTSPSyncPush::flushEncoders()
+{
+    // 编码线程已退出，在本线程取出编码器缓存的帧，直接进入发送队列
+    m_audioCodeThread->flush([this](AVPacket* pkt, const PacketTiming& timing) {
+        queuePacket(pkt, timing, false);
+    });
+    m_videoCodeThread->flush([this](AVPacket* pkt, const PacketTiming& timing) {
+        queuePacket(pkt, timing, true);
+    });
+}
 
-    // 等待推流线程完全停止后再清理格式上下文
-    if (m_streamPushThread && m_streamPushThread->isRunning()) {
-        m_streamPushThread->wait(3000); // 最多等待3秒
+void RTSPSyncPush::closeConnection()
+{
+    m_headerFuture.waitForFinished();
+    // 剩余时间的一半用来发完队列，其余留给文件尾（RTSP的TEARDOWN）
+    int remainingMs = m_stopTimeoutMs - int((av_gettime_relative() - m_stopBeginUs) / 1000);
+    if (remainingMs > 0 && !m_streamPushThread->drain(remainingMs / 2)) {
+        LogWarn << "【推流】停止时发送队列未发完";
     }
+    m_streamPushThread->stopPushing();
+    remainingMs = m_stopTimeoutMs - int((av_gettime_relative() - m_stopBeginUs) / 1000);
+    // 限时写文件尾并关闭连接（包括重连建立的上下文），初始上下文只剩释放
+    m_streamPushThread->closeOutput(qMax(0, remainingMs));
+}
 
+void RTSPSyncPush::finishStop()
+{
+    m_stopDeadlineTimer->stop();
     if (m_fmtCtx) {
-        // 只有当输出流存在时才写trailer
-        if (m_fmtCtx->pb) {
-            av_write_trailer(m_fmtCtx);
-        }
-
-        if (!(m_fmtCtx->oformat->flags & AVFMT_NOFILE) && m_fmtCtx->pb) {
-            avio_closep(&m_fmtCtx->pb);
-        }
         avformat_free_context(m_fmtCtx);
         m_fmtCtx = nullptr;
         m_streamPushThread->setFmtCtx(nullptr);  // 避免访问已释放的指针
     }
+    m_stopPhase = StopPhase::idle;
+    qint64 elapsedMs = (av_gettime_relative() - m_stopBeginUs) / 1000;
+    m_stats.setShutdownMs(elapsedMs);
+    updateStatistics();     // 上报最终统计
+    LogInfo << "【推流】停止完成，耗时" << elapsedMs << "ms";
+    emit stopped(elapsedMs);
+}
+
+void RTSPSyncPush::queuePacket(AVPacket* pkt, const PacketTiming& timing, bool isVideo)
+{
+    m_stats.addEncodedFrame(isVideo ? StatsStream::video : StatsStream::audio, pkt->size,
+                            isVideo && (pkt->flags & AV_PKT_FLAG_KEY));
+    if (m_packetTap) {
+        m_packetTap->publish(pkt);     // 在交给推流线程之前，addPacket会接管并可能丢弃pkt
+    }
+    m_streamPushThread->addPacket(pkt, isVideo, timing);
 }
 
 void RTSPSyncPush::onVideoFrameAvailable(AVFrame *frame)
@@ -200,11 +586,11 @@ void RTSPSyncPush::onVideoFrameAvailable(AVFrame *frame)
     }
 }
 
-void RTSPSyncPush::onAudioDataAvailable(const QByteArray &data)
+void RTSPSyncPush::onAudioDataAvailable(const QByteArray &data, qint64 captureTimeUs)
 {
     // 采集线程采集到的原始音频数据
     if (m_audioCodeThread) {
-        m_audioCodeThread->addAudioData(data);
+        m_audioCodeThread->addAudioData(data, captureTimeUs);
     }
 }
 
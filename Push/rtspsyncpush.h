@@ -2,19 +2,32 @@
 #define RTSPSYNCPUSH_H
 
 
+#include <QFutureWatcher>
 #include <QObject>
 #include <QMutex>
 #include <QWaitCondition>
 #include <QQueue>
 #include <QThread>
 #include <QString>
+#include <memory>
 #include "DataStruct.h"
-
+#include "audiomixerthread.h"
+#include "frameshm.h"
+#include "pushstats.h"
+#include "pushmetrics.h"
+
+class QTimer;
+class MetricsServer;
+class PacketTap;
 class AudioCaptureThread;
+class AudioMixerThread;
+class FFAudioCaptureThread;
 class VideoCaptureThread;
 class AudioCodeThread;
 class VideoCodeThread;
 class StreamPushThread;
+class WorkerPool;
+class WorkGroup;
 struct AVFormatContext;
 struct AVFrame;
 struct AVPacket;
@@ -30,9 +43,50 @@ public:
                     int audioSampleRate, int audioChannels, const QString& rtspUrl);
     void setVideoParam(const QString& videoSrc, int videoW, int videoH, int videoFps,int videoBitrate);
     void setAudioParam(int audioSampleRate, int audioChannels,int audioSamepleSize);
+    // 音频编码选择，需在initialize之前调用
+    void setAudioCodec(AudioCodecType codec, int opusFrameMs = 20, bool opusDtx = false);
+    // 多路音频输入（如系统立体声混音+麦克风），多于一路时启用内置混音，需在initialize之前调用
+    void setAudioInputs(const QList<AudioMixerInput>& inputs);
+    void setAudioInputGain(int index, float gain);
+    // 音频采集方式：backend非qt时直接使用FFmpeg输入设备；lowLatency时显式设置设备缓冲为bufferMs，需在initialize之前调用
+    void setAudioCapture(AudioCaptureBackend backend, const QString& device = QString(),
+                         bool lowLatency = false, int bufferMs = 10);
+    // 静音检测，需在initialize之前调用
+    void setSilenceDetection(SilenceMode mode, double thresholdDb = -60.0, int hangoverMs = 300);
+    // 输出断线后自动重连（默认开启），退避上限maxBackoffMs；关闭时写出失败即上报error
+    void setReconnect(bool enabled, int maxBackoffMs = 30000);
+    // 统计信号的采样间隔，默认1000ms
+    void setStatisticsInterval(int ms);
+    // 本地Prometheus指标端点（127.0.0.1:port，localName非空时同时监听本地套接字）
+    bool enableMetricsEndpoint(quint16 port, const QString& localName = QString());
+    // 把每帧（采集原始帧或转换后的YUV帧）发布到名为name的共享内存环，本机其他进程只读映射使用，
+    // 布局见frameshm.h；需在initialize之前调用
+    bool enableFrameShm(const QString& name, FrameShm::Source source = FrameShm::Source::converted,
+                        int slotCount = 4);
+    // 非RTSP输出（MPEG-TS over UDP/SRT、RTMP）的复用与传输参数，需在start之前调用
+    void setOutputOptions(const OutputOptions& options);
+    // 在本地套接字name上把编码后的音视频包分发给本机读端（格式见packettap.h），读端可随时连上或断开
+    bool enablePacketTap(const QString& name);
+    // 视频帧携带采集时刻SEI，配合tools/latencyprobe测量端到端延迟，需在initialize之前调用
+    void setLatencySei(bool enabled);
+    // 编码与格式转换改在共享线程池上执行（采集与写出线程仍为专用线程），CPU按sessionName分组统计，需在start之前调用
+    void setWorkerPool(WorkerPool* pool, const QString& sessionName);
+    WorkGroup* workGroup() const { return m_workGroup.get(); }
 
     void start();
+    // 同步停止，阻塞到资源释放完成（析构、重新initialize时使用）；异步停止进行中时接着做完
     void stop();
+    // 异步停止，立即返回，完成后发出stopped：停采集与编码线程 → 冲刷编码器 → 限时发完发送队列并写文件尾。
+    // 耗时超过停止超时时通过中断回调中止网络IO
+    void stopAsync();
+    // 停止超时（毫秒），默认2000
+    void setStopTimeout(int ms);
+    int stopTimeout() const { return m_stopTimeoutMs; }
+    bool isStopping() const { return m_stopPhase != StopPhase::idle; }
+    // 暂停：停止视频采集与音视频编码，连接、编码器与采集设备保留，视频每500ms发一帧填充帧维持会话；
+    // 恢复时下一帧编码为IDR，时间戳跨过暂停时长连续递增
+    void pause();
+    void resume();
 
     PushState state() const;
     void setState(const PushState &newState);
@@ -43,21 +97,58 @@ signals:
     void stateChanged(const QString &objName,const PushState &newState);
     void error(const QString& msg);
     void info(const QString& msg);
+    void audioSilenceStatistics(qint64 totalFrames, qint64 silentFrames, double silenceRatio);
+    void audioCaptureBufferInfo(int bufferBytes, int periodBytes);
+    void audioCaptureLatency(qint64 avgUs, qint64 maxUs);
+    void statistics(const PushStatistics& stats);
+    // 各阶段延迟分位（自start起累计），与statistics同周期上报
+    void latencyStatistics(const LatencyReport& report);
+    // 停止完成，elapsedMs为从请求停止到资源全部释放的耗时
+    void stopped(qint64 elapsedMs);
 
 private slots:
     void onVideoFrameAvailable(AVFrame* frame);
-    void onAudioDataAvailable(const QByteArray& data);
+    void onAudioDataAvailable(const QByteArray& data, qint64 captureTimeUs);
+    void updateStatistics();
+    void onOutputOpened();
+    void onStopPhaseFinished();
 
 private:
+    // 停止的各阶段：stopWorkers与closeConnection可能阻塞，异步停止时在线程池上执行
+    enum class StopPhase {
+        idle,
+        stopWorkers,
+        closeConnection
+    };
+    bool beginStop();
+    void stopWorkers();
+    void flushEncoders();
+    void closeConnection();
+    void finishStop();
+    void queuePacket(AVPacket* pkt, const PacketTiming& timing, bool isVideo);
+
+    // 打开输出并写文件头，在后台线程执行，返回FFmpeg错误码
+    int openOutput();
+
     // 推流上下文
     AVFormatContext* m_fmtCtx = nullptr;
     int m_videoStreamIndex = -1;
     int m_audioStreamIndex = -1;
     bool m_running = false;
+    bool m_paused = false;
     QMutex m_mutex;
+    QFutureWatcher<int>* m_headerWatcher = nullptr;
+    QFuture<int> m_headerFuture;
+    StopPhase m_stopPhase = StopPhase::idle;
+    QFutureWatcher<void>* m_stopWatcher = nullptr;
+    QTimer* m_stopDeadlineTimer = nullptr;
+    int m_stopTimeoutMs = 2000;
+    int64_t m_stopBeginUs = 0;
 
     // 线程成员
     AudioCaptureThread* m_audioCapThread = nullptr;
+    AudioMixerThread* m_audioMixerThread = nullptr;
+    FFAudioCaptureThread* m_ffAudioCapThread = nullptr;
     AudioCodeThread* m_audioCodeThread = nullptr;
     VideoCaptureThread* m_videoCapThread = nullptr;
     VideoCodeThread* m_videoCodeThread = nullptr;
@@ -67,7 +158,30 @@ private:
     QString m_videoSrc;
     int m_videoW = 0, m_videoH = 0, m_videoFps = 0, m_videoBitrate = 0;
     int m_audioSampleRate = 0, m_audioChannels = 0, m_audioSampleSize = 0;
+    QList<AudioMixerInput> m_audioInputs;
+    AudioCaptureBackend m_audioBackend = AudioCaptureBackend::qt;
+    QString m_audioDevice;
+    bool m_audioLowLatency = false;
+    int m_audioBufferMs = 10;
+    AudioCodecType m_audioCodec = AudioCodecType::aac;
+    int m_opusFrameMs = 20;
+    bool m_opusDtx = false;
+    SilenceMode m_silenceMode = SilenceMode::off;
+    double m_silenceThresholdDb = -60.0;
+    int m_silenceHangoverMs = 300;
+    bool m_latencySei = false;
     QString m_rtspUrl;
+    OutputOptions m_outputOptions;
+
+    // 统计信息
+    PushStatsCounters m_stats;
+    QTimer* m_statsTimer = nullptr;
+    int m_statsIntervalMs = 1000;
+    PushMetrics m_metrics;
+    MetricsServer* m_metricsServer = nullptr;
+    std::unique_ptr<FrameShmPublisher> m_frameShm;
+    PacketTap* m_packetTap = nullptr;
+    std::shared_ptr<WorkGroup> m_workGroup;
 
     // 简单音视频同步相关
     int64_t m_lastAudioPts = 0;
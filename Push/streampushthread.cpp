@@ -1,4 +1,29 @@
 ﻿#include "streampushthread.h"
+#include <QRandomGenerator>
+#include "Logger.h"
+#include "frametrace.h"
+#include "threadtuning.h"
+
+extern "C" {
+#include <libavutil/time.h>
+}
+
+namespace
+{
+// 连接层面的失败才重连；参数类错误（如时间戳不单调）重连也无济于事
+bool isConnectionError(int ret, bool timedOut)
+{
+    return timedOut || ret == AVERROR(EPIPE) || ret == AVERROR(ECONNRESET) || ret == AVERROR(ECONNREFUSED) ||
+           ret == AVERROR(ETIMEDOUT) || ret == AVERROR(EIO) || ret == AVERROR_EOF;
+}
+
+QString errorString(int ret)
+{
+    char buf[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_strerror(ret, buf, sizeof(buf));
+    return QString::fromUtf8(buf);
+}
+} // namespace
 
 StreamPushThread::StreamPushThread( QObject* parent)
     : QThread(parent), m_fmtCtx(nullptr), m_running(false)
@@ -8,67 +33,276 @@ StreamPushThread::StreamPushThread( QObject* parent)
 StreamPushThread::~StreamPushThread()
 {
     stopPushing();
+    if (m_ownedCtx) {
+        teardownOutput(false);
+    }
+    av_dict_free(&m_headerOptions);
+    av_dict_free(&m_ioOptions);
+}
+
+void StreamPushThread::addPacket(AVPacket* pkt, bool isVideo, const PacketTiming& timing)
+{
+    PendingPacket item{pkt, FrameTrace::enabled() ? FrameTrace::nowUs() : -1, timing};
+    {
+        QMutexLocker locker(&m_mutex);
+        if (isVideo) {
+            bool key = pkt->flags & AV_PKT_FLAG_KEY;
+            if (!m_waitKeyFrame && m_videoQueue.size() >= m_maxVideoPackets) {
+                dropVideoBacklog();
+            }
+            if (!key && m_waitKeyFrame) {
+                // 参考帧已被丢弃，非关键帧无法解码
+                if (m_stats) {
+                    m_stats->addDrop(DropReason::queueFull);
+                }
+                freeItem(item);
+                return;
+            }
+            if (key) {
+                m_waitKeyFrame = false;
+            }
+            m_videoQueue.enqueue(item);
+        } else {
+            if (m_audioQueue.size() >= m_maxAudioPackets) {
+                PendingPacket oldest = m_audioQueue.dequeue();
+                freeItem(oldest);
+                if (m_stats) {
+                    m_stats->addDrop(DropReason::queueFull);
+                }
+            }
+            m_audioQueue.enqueue(item);
+        }
+        if (m_stats) {
+            m_stats->setQueueDepth(isVideo ? StatsStream::video : StatsStream::audio,
+                                   isVideo ? m_videoQueue.size() : m_audioQueue.size());
+        }
+        m_packetReady.wakeOne();
+    }
+}
+
+void StreamPushThread::dropVideoBacklog()
+{
+    // 从队首丢到下一个关键帧，剩余队列仍可独立解码；没有关键帧时全部丢弃并等待新的关键帧
+    int dropped = 0;
+    do {
+        PendingPacket item = m_videoQueue.dequeue();
+        freeItem(item);
+        ++dropped;
+    } while (!m_videoQueue.isEmpty() && !(m_videoQueue.head().pkt->flags & AV_PKT_FLAG_KEY));
+    if (m_videoQueue.isEmpty()) {
+        m_waitKeyFrame = true;
+    }
+    if (m_stats) {
+        m_stats->addDrop(DropReason::queueFull, dropped);
+    }
+    LogWarn << "【推流】发送队列已满，丢弃视频包" << dropped << "个";
 }
 
-void StreamPushThread::addPacket(AVPacket* pkt, bool isVideo)
+void StreamPushThread::freeItem(PendingPacket& item)
+{
+    av_packet_free(&item.pkt);
+}
+
+void StreamPushThread::setQueueLimit(int videoPackets, int audioPackets)
 {
     QMutexLocker locker(&m_mutex);
-    if (isVideo) {
-        m_videoQueue.enqueue(pkt);
-    } else {
-        m_audioQueue.enqueue(pkt);
+    m_maxVideoPackets = qMax(1, videoPackets);
+    m_maxAudioPackets = qMax(1, audioPackets);
+}
+
+void StreamPushThread::setReconnect(bool enabled, int initialMs, int maxMs)
+{
+    m_reconnect = enabled;
+    m_backoffInitialMs = qMax(10, initialMs);
+    m_backoffMaxMs = qMax(m_backoffInitialMs, maxMs);
+}
+
+void StreamPushThread::startPushing()
+{
+    m_broken = false;
+    m_reconnectAttempt = 0;
+    m_waitKeyFrame = false;
+    m_running = true;
+    start(QThread::HighPriority);     // 音频包的写出与音频编码同等优先
+}
+
+bool StreamPushThread::drain(int timeoutMs)
+{
+    int64_t deadlineUs = av_gettime_relative() + int64_t(timeoutMs) * 1000;
+    while (m_running && !m_broken) {
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_videoQueue.isEmpty() && m_audioQueue.isEmpty() && !m_writing) {
+                return true;
+            }
+        }
+        if (av_gettime_relative() >= deadlineUs) {
+            return false;
+        }
+        QThread::msleep(2);
     }
+    return false;
 }
 
 void StreamPushThread::stopPushing()
 {
     m_running = false;
+    m_deadline.abort();
+    {
+        QMutexLocker locker(&m_mutex);
+        m_packetReady.wakeAll();
+    }
     wait();
+    // 中止标志保留到closeOutput，停止时仍在进行的写文件头同样立即返回
     QMutexLocker locker(&m_mutex);
     while (!m_videoQueue.isEmpty()) {
-        AVPacket* pkt = m_videoQueue.dequeue();
+        AVPacket* pkt = m_videoQueue.dequeue().pkt;
         av_packet_free(&pkt);
     }
     while (!m_audioQueue.isEmpty()) {
-        AVPacket* pkt = m_audioQueue.dequeue();
+        AVPacket* pkt = m_audioQueue.dequeue().pkt;
         av_packet_free(&pkt);
     }
 }
 
+void StreamPushThread::setStreamTimeBase(int streamIndex, AVRational codecTimeBase)
+{
+    QMutexLocker locker(&m_mutex);
+    m_codecTimeBase[streamIndex] = codecTimeBase;
+}
+
 void StreamPushThread::run()
 {
-    m_running = true;
+    ThreadTuning::StageScope tuning(PipelineStage::push);
     while (m_running) {
-        AVPacket* pkt = nullptr;
-        {
-            QMutexLocker locker(&m_mutex);
-            if (!m_videoQueue.isEmpty() && !m_audioQueue.isEmpty()) {
-                AVPacket* videoPkt = m_videoQueue.head();
-                AVPacket* audioPkt = m_audioQueue.head();
-                // 比较 PTS，选择较早的包
-                if (av_compare_ts(videoPkt->pts, m_fmtCtx->streams[videoPkt->stream_index]->time_base,
-                                  audioPkt->pts, m_fmtCtx->streams[audioPkt->stream_index]->time_base) <= 0) {
-                    pkt = m_videoQueue.dequeue();
-                } else {
-                    pkt = m_audioQueue.dequeue();
-                }
-            } else if (!m_videoQueue.isEmpty()) {
-                pkt = m_videoQueue.dequeue();
-            } else if (!m_audioQueue.isEmpty()) {
-                pkt = m_audioQueue.dequeue();
+        if (writeNext()) {
+            continue;
+        }
+        QMutexLocker locker(&m_mutex);
+        if (m_broken && m_reconnect) {
+            // 断线时包留在队列里等重连，按退避时刻轮询
+            locker.unlock();
+            msleep(1);
+        } else if (m_running && m_videoQueue.isEmpty() && m_audioQueue.isEmpty()) {
+            m_packetReady.wait(&m_mutex);
+        }
+    }
+}
+
+bool StreamPushThread::writeNext()
+{
+    if (m_broken && m_reconnect) {
+        // 断线期间包留在有界队列里（满了按拥塞规则丢弃），到点再重连
+        if (!m_running || av_gettime_relative() < m_nextAttemptUs || !reconnect()) {
+            return false;
+        }
+    }
+
+    PendingPacket item{nullptr, -1, PacketTiming()};
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_videoQueue.isEmpty() && !m_audioQueue.isEmpty()) {
+            AVPacket* videoPkt = m_videoQueue.head().pkt;
+            AVPacket* audioPkt = m_audioQueue.head().pkt;
+            // 比较 PTS，选择较早的包（队列中仍为编码器时间基）
+            if (av_compare_ts(videoPkt->pts, m_codecTimeBase.value(videoPkt->stream_index, {1, 1}),
+                              audioPkt->pts, m_codecTimeBase.value(audioPkt->stream_index, {1, 1})) <= 0) {
+                item = m_videoQueue.dequeue();
+            } else {
+                item = m_audioQueue.dequeue();
             }
+        } else if (!m_videoQueue.isEmpty()) {
+            item = m_videoQueue.dequeue();
+        } else if (!m_audioQueue.isEmpty()) {
+            item = m_audioQueue.dequeue();
         }
+        m_writing = item.pkt != nullptr;    // 与出队同在锁内，drain不会看到两者都为空的间隙
+        if (m_stats) {
+            m_stats->setQueueDepth(StatsStream::video, m_videoQueue.size());
+            m_stats->setQueueDepth(StatsStream::audio, m_audioQueue.size());
+        }
+    }
 
-        if (pkt) {
-            int ret = av_interleaved_write_frame(m_fmtCtx, pkt);
-            if (ret < 0) {
-                emit errorOccurred("推流失败: " + QString::number(ret));
+    if (!item.pkt) {
+        return false;
+    }
+    if (m_broken) {
+        if (m_stats) {
+            m_stats->addDrop(DropReason::writeTimeout);
+        }
+        freeItem(item);
+        m_writing = false;
+        return true;
+    }
+    writePacket(item);
+    m_writing = false;
+    return true;
+}
+
+void StreamPushThread::writePacket(const PendingPacket& item)
+{
+    AVPacket* pkt = item.pkt;
+    AVFormatContext* ctx = output();
+    AVStream* stream = ctx->streams[pkt->stream_index];
+    // 写入后包会被复位，先记录流类型、大小与编码器时间基下的pts（帧追踪标识）
+    StatsStream kind = stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+                           ? StatsStream::video : StatsStream::audio;
+    FrameTrace::Stream traceStream = kind == StatsStream::video ? FrameTrace::Stream::video
+                                                                : FrameTrace::Stream::audio;
+    int pktSize = pkt->size;
+    int64_t frameId = pkt->pts;
+    int64_t writeBeginUs = item.enqueueUs >= 0 ? FrameTrace::nowUs() : -1;
+    if (writeBeginUs >= 0) {
+        FrameTrace::record("interleave", traceStream, frameId, item.enqueueUs, writeBeginUs);
+    }
+
+    AVRational codecTb = m_codecTimeBase.value(pkt->stream_index, stream->time_base);
+    av_packet_rescale_ts(pkt, codecTb, stream->time_base);
+    m_deadline.arm(m_writeTimeoutMs);
+    int ret = av_interleaved_write_frame(ctx, pkt);
+    m_deadline.disarm();
+    if (writeBeginUs >= 0) {
+        FrameTrace::record("write", traceStream, frameId, writeBeginUs, FrameTrace::nowUs());
+    }
+    if (ret < 0 && m_deadline.aborted()) {
+        // 停止时主动中断，不算错误
+    } else if (ret < 0 && m_reconnect && isConnectionError(ret, m_deadline.expired())) {
+        if (m_stats) {
+            m_stats->addDrop(m_deadline.expired() ? DropReason::writeTimeout : DropReason::writeError);
+        }
+        onConnectionLost(ret);
+    } else if (ret < 0 && m_deadline.expired()) {
+        // 部分数据可能已发出，连接状态不可恢复，只上报一次
+        m_broken = true;
+        if (m_stats) {
+            m_stats->addDrop(DropReason::writeTimeout);
+        }
+        LogErr << "【推流】写出超时" << m_writeTimeoutMs << "ms，连接已失效";
+        emit errorOccurred(QString("推流写出超时(%1ms)").arg(m_writeTimeoutMs));
+    } else if (ret < 0) {
+        if (m_stats) {
+            m_stats->addDrop(DropReason::writeError);
+        }
+        emit errorOccurred("推流失败: " + QString::number(ret));
+    } else {
+        if (m_stats) {
+            m_stats->addPacketWritten(kind, pktSize);
+        }
+        if (!m_firstPacketWritten) {
+            m_firstPacketWritten = true;
+            qint64 elapsedMs = m_stats ? m_stats->markFirstPacket() : -1;
+            LogInfo << "【推流】首包已写出" << (elapsedMs >= 0 ? QString("，距开始推流%1ms").arg(elapsedMs) : QString());
+        }
+        if (m_metrics) {
+            int64_t wireUs = FrameTrace::nowUs();
+            if (kind == StatsStream::video && item.timing.encodeEndUs >= 0) {
+                m_metrics->record(LatencyMetric::encodeToWire, wireUs - item.timing.encodeEndUs);
+            } else if (kind == StatsStream::audio && item.timing.captureUs >= 0) {
+                m_metrics->record(LatencyMetric::audioToWire, wireUs - item.timing.captureUs);
             }
-            av_packet_free(&pkt);
-        } else {
-            msleep(1); // 避免忙等待
         }
     }
+    av_packet_free(&pkt);
 }
 
 AVFormatContext *StreamPushThread::fmtCtx() const
@@ -79,4 +313,204 @@ AVFormatContext *StreamPushThread::fmtCtx() const
 void StreamPushThread::setFmtCtx(AVFormatContext *newFmtCtx)
 {
     m_fmtCtx = newFmtCtx;
+    m_headerWritten = false;
+    m_firstPacketWritten = false;
+    m_deadline.reset();
+    m_deadline.install(m_fmtCtx);
+}
+
+int StreamPushThread::openIo(AVDictionary** options)
+{
+    av_dict_free(&m_ioOptions);
+    if (options) {
+        av_dict_copy(&m_ioOptions, *options, 0);
+    }
+    return openIo(m_fmtCtx, options);
+}
+
+int StreamPushThread::openIo(AVFormatContext* ctx, AVDictionary** options)
+{
+    if (ctx->oformat->flags & AVFMT_NOFILE) {
+        return 0;   // RTSP等由复用器自己管理连接
+    }
+    m_deadline.arm(m_headerTimeoutMs);
+    int ret = avio_open2(&ctx->pb, ctx->url, AVIO_FLAG_WRITE, &ctx->interrupt_callback, options);
+    m_deadline.disarm();
+    return ret;
+}
+
+int StreamPushThread::writeHeader(AVDictionary** options)
+{
+    // 写头会取走识别出的选项，先留一份给重连
+    av_dict_free(&m_headerOptions);
+    if (options) {
+        av_dict_copy(&m_headerOptions, *options, 0);
+    }
+    int ret = writeHeader(m_fmtCtx, options);
+    m_headerWritten = ret >= 0;
+    return ret;
+}
+
+int StreamPushThread::writeHeader(AVFormatContext* ctx, AVDictionary** options)
+{
+    m_deadline.arm(m_headerTimeoutMs);
+    int ret = avformat_write_header(ctx, options);
+    m_deadline.disarm();
+    if (ret < 0 && m_deadline.expired()) {
+        LogErr << "【推流】写文件头超时" << m_headerTimeoutMs << "ms";
+    }
+    return ret;
+}
+
+void StreamPushThread::closeOutput(int timeoutMs)
+{
+    // 清掉stopPushing的中止标志；连接已失效或没有剩余时间时不再等待（RTSP的TEARDOWN同样会卡住）
+    m_deadline.reset();
+    teardownOutput(!m_broken && timeoutMs != 0, timeoutMs);
+}
+
+void StreamPushThread::teardownOutput(bool graceful, int timeoutMs)
+{
+    AVFormatContext* ctx = output();
+    if (!ctx) {
+        return;
+    }
+    if (m_headerWritten) {
+        if (graceful) {
+            m_deadline.arm(timeoutMs > 0 ? timeoutMs : m_writeTimeoutMs);
+        } else {
+            m_deadline.expire();
+        }
+        av_write_trailer(ctx);
+        m_deadline.disarm();
+        m_headerWritten = false;
+    }
+    if (!(ctx->oformat->flags & AVFMT_NOFILE) && ctx->pb) {
+        avio_closep(&ctx->pb);
+    }
+    if (m_ownedCtx) {
+        avformat_free_context(m_ownedCtx);
+        m_ownedCtx = nullptr;
+    }
+}
+
+void StreamPushThread::onConnectionLost(int ret)
+{
+    LogWarn << "【推流】输出连接断开:" << (m_deadline.expired() ? QString("写出超时%1ms").arg(m_writeTimeoutMs)
+                                                               : errorString(ret));
+    // 立即释放失效的连接，重连时新建上下文
+    teardownOutput(false);
+    m_broken = true;
+    m_downSinceUs = av_gettime_relative();
+    if (m_stats) {
+        m_stats->setOutputDown(true);
+    }
+    m_reconnectAttempt = 0;
+    scheduleReconnect();
+}
+
+void StreamPushThread::scheduleReconnect()
+{
+    int delayMs = qMin(m_backoffMaxMs, m_backoffInitialMs << qMin(m_reconnectAttempt, 16));
+    // ±20%抖动，多个会话同时断线时错开重连
+    delayMs += int(QRandomGenerator::global()->bounded(delayMs * 2 / 5 + 1)) - delayMs / 5;
+    m_nextAttemptUs = av_gettime_relative() + int64_t(delayMs) * 1000;
+    ++m_reconnectAttempt;
+    LogInfo << "【推流】" << delayMs << "ms后第" << m_reconnectAttempt << "次重连";
+    emit reconnecting(m_reconnectAttempt, delayMs);
+}
+
+bool StreamPushThread::reconnect()
+{
+    if (m_stats) {
+        m_stats->addReconnectAttempt();
+    }
+    QString errMsg;
+    AVFormatContext* ctx = openOutput(&errMsg);
+    if (!ctx) {
+        LogWarn << "【推流】第" << m_reconnectAttempt << "次重连失败:" << errMsg;
+        if (m_running) {
+            scheduleReconnect();
+        }
+        return false;
+    }
+    m_ownedCtx = ctx;
+    m_headerWritten = true;
+
+    // 断线期间的积压已过期，参考帧也没有发到新连接上，全部清掉后等待编码器的IDR
+    int flushed = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+        flushed = m_videoQueue.size() + m_audioQueue.size();
+        while (!m_videoQueue.isEmpty()) {
+            PendingPacket item = m_videoQueue.dequeue();
+            freeItem(item);
+        }
+        while (!m_audioQueue.isEmpty()) {
+            PendingPacket item = m_audioQueue.dequeue();
+            freeItem(item);
+        }
+        m_waitKeyFrame = true;
+        if (m_stats) {
+            m_stats->setQueueDepth(StatsStream::video, 0);
+            m_stats->setQueueDepth(StatsStream::audio, 0);
+        }
+    }
+    if (m_stats) {
+        if (flushed > 0) {
+            m_stats->addDrop(DropReason::disconnected, flushed);
+        }
+        m_stats->setOutputDown(false);
+    }
+    m_broken = false;
+    qint64 downtimeMs = (av_gettime_relative() - m_downSinceUs) / 1000;
+    LogInfo << "【推流】第" << m_reconnectAttempt << "次重连成功，断线" << downtimeMs << "ms，清除积压" << flushed << "个包";
+    m_reconnectAttempt = 0;
+    emit keyFrameRequested();
+    emit reconnected(downtimeMs);
+    return true;
+}
+
+AVFormatContext* StreamPushThread::openOutput(QString* errMsg)
+{
+    // 格式、地址与流参数照搬初始上下文，流序号不变，编码线程无需感知重连
+    AVFormatContext* ctx = nullptr;
+    int ret = avformat_alloc_output_context2(&ctx, nullptr, m_fmtCtx->oformat->name, m_fmtCtx->url);
+    if (ret < 0) {
+        *errMsg = "创建输出上下文失败: " + errorString(ret);
+        return nullptr;
+    }
+    for (unsigned i = 0; i < m_fmtCtx->nb_streams; ++i) {
+        AVStream* src = m_fmtCtx->streams[i];
+        AVStream* dst = avformat_new_stream(ctx, nullptr);
+        if (!dst || avcodec_parameters_copy(dst->codecpar, src->codecpar) < 0) {
+            avformat_free_context(ctx);
+            *errMsg = "复制输出流参数失败";
+            return nullptr;
+        }
+        dst->id = src->id;
+        dst->time_base = src->time_base;
+        dst->codecpar->codec_tag = 0;
+    }
+    m_deadline.install(ctx);
+
+    AVDictionary* ioOptions = nullptr;
+    av_dict_copy(&ioOptions, m_ioOptions, 0);
+    ret = openIo(ctx, &ioOptions);
+    av_dict_free(&ioOptions);
+    if (ret >= 0) {
+        AVDictionary* options = nullptr;
+        av_dict_copy(&options, m_headerOptions, 0);
+        ret = writeHeader(ctx, &options);
+        av_dict_free(&options);
+    }
+    if (ret < 0) {
+        *errMsg = errorString(ret);
+        if (!(ctx->oformat->flags & AVFMT_NOFILE) && ctx->pb) {
+            avio_closep(&ctx->pb);
+        }
+        avformat_free_context(ctx);
+        return nullptr;
+    }
+    return ctx;
 }
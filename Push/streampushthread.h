@@ -4,11 +4,23 @@
 #include <QThread>
 #include <QQueue>
 #include <QMutex>
+#include <QWaitCondition>
 #include <QObject>
+#include <QHash>
+#include <atomic>
+#include <memory>
+#include "iodeadline.h"
+#include "pushstats.h"
+#include "pushmetrics.h"
 extern "C" {
 #include <libavformat/avformat.h>
 }
 
+// 复用与写出线程：编码线程只把包放入有界队列，网络写出在本线程上进行。共享线程池模式下每个会话
+// 同样有自己的写出线程，写出与重连可能阻塞数秒，不能占用池中的编码线程。
+// 每次写出都有截止时刻，服务端卡住时既不阻塞编码，也不会让停止无限等待。
+// 连接断开后按指数退避自动重连，期间采集与编码照常进行，包在有界队列中按拥塞规则丢弃，
+// 重连成功后清掉过期积压并请求编码器输出IDR，从关键帧恢复
 class StreamPushThread : public QThread
 {
     Q_OBJECT
@@ -16,24 +28,105 @@ public:
     StreamPushThread(QObject* parent = nullptr);
     ~StreamPushThread();
 
-    void addPacket(AVPacket* pkt, bool isVideo);
+    // pkt时间戳为编码器时间基，写出前再换算到输出流时间基。队列满时视频丢到下一个关键帧，
+    // 音频丢最早的包，均记为queueFull；不会阻塞调用方
+    void addPacket(AVPacket* pkt, bool isVideo, const PacketTiming& timing = PacketTiming());
+    void setStreamTimeBase(int streamIndex, AVRational codecTimeBase);
+    void startPushing();
+    // 停止前尽量发完队列中的包，最多等待timeoutMs；未在推流或连接已断开时立即返回false
+    bool drain(int timeoutMs);
+    // 先中断进行中的写出再等待退出，写出卡住时也能及时返回
     void stopPushing();
+    // 立即中止进行中的网络IO（握手、写出、写文件尾），可在任意线程调用
+    void abortOutput() { m_deadline.abort(); }
+    // 队列上限（包数），需在startPushing之前设置
+    void setQueueLimit(int videoPackets, int audioPackets);
+    // 单次写出的超时，超时后认为连接失效
+    void setWriteTimeout(int ms) { m_writeTimeoutMs = ms; }
+    // 连接失效后自动重连：等待时间从initialMs起每次翻倍直到maxMs，再加±20%随机抖动；
+    // 关闭时写出超时上报错误并丢弃后续的包
+    void setReconnect(bool enabled, int initialMs = 500, int maxMs = 30000);
 
     AVFormatContext *fmtCtx() const;
+    // 同时把截止时刻回调安装到输出上下文。重连时按该上下文的格式、地址与流参数重建输出
     void setFmtCtx(AVFormatContext *newFmtCtx);
+    // 复用器需要时在截止时刻内打开输出IO（UDP/SRT/RTMP连接），在调用线程上执行；options为协议选项，
+    // 同时保留给重连使用
+    int openIo(AVDictionary** options = nullptr);
+    // 在截止时刻内写文件头（RTSP握手），在调用线程上执行；options同时保留给重连使用
+    int writeHeader(AVDictionary** options = nullptr);
+    // 停止后调用：连接正常时限时写文件尾（timeoutMs<0为写出超时，0为不等待），关闭连接并释放
+    // 重连建立的上下文。之后setFmtCtx传入的上下文只需avformat_free_context
+    void closeOutput(int timeoutMs = -1);
+    void setStatsCounters(PushStatsCounters* stats) { m_stats = stats; }
+    void setMetrics(PushMetrics* metrics) { m_metrics = metrics; }
 
 signals:
     void errorOccurred(const QString& error);
+    // 连接断开，delayMs后进行第attempt次重连
+    void reconnecting(int attempt, int delayMs);
+    void reconnected(qint64 downtimeMs);
+    // 重连后从关键帧恢复，编码器应尽快输出IDR
+    void keyFrameRequested();
 
 protected:
     void run() override;
 
 private:
+    struct PendingPacket {
+        AVPacket* pkt;
+        int64_t enqueueUs;              // 帧追踪开启时的入队时刻
+        PacketTiming timing;
+    };
+    void writePacket(const PendingPacket& item);
+    void freeItem(PendingPacket& item);
+    // 队列已满时丢弃积压视频直到队首为关键帧，需持有m_mutex
+    void dropVideoBacklog();
+
+    // 当前写出的上下文：初始上下文或重连后新建的上下文
+    AVFormatContext* output() const { return m_ownedCtx ? m_ownedCtx : m_fmtCtx; }
+    int openIo(AVFormatContext* ctx, AVDictionary** options);
+    int writeHeader(AVFormatContext* ctx, AVDictionary** options);
+    // 关闭当前输出：graceful时限时写文件尾（timeoutMs<=0为写出超时），否则立即超时只走一遍muxer的关闭流程
+    void teardownOutput(bool graceful, int timeoutMs = 0);
+    void onConnectionLost(int ret);
+    void scheduleReconnect();
+    bool reconnect();
+    AVFormatContext* openOutput(QString* errMsg);
+    // 按时间戳交织取出最早的包写出，队列为空时返回false
+    bool writeNext();
+
     AVFormatContext* m_fmtCtx;          // RTSP 输出上下文
-    QQueue<AVPacket*> m_videoQueue;     // 视频包队列
-    QQueue<AVPacket*> m_audioQueue;     // 音频包队列
+    QQueue<PendingPacket> m_videoQueue; // 视频包队列
+    QQueue<PendingPacket> m_audioQueue; // 音频包队列
+    QHash<int, AVRational> m_codecTimeBase;
     QMutex m_mutex;                     // 队列访问保护
+    QWaitCondition m_packetReady;       // 有包入队或停止
     volatile bool m_running;            // 运行状态标志
+    PushStatsCounters* m_stats = nullptr;
+    PushMetrics* m_metrics = nullptr;
+
+    IoDeadline m_deadline;
+    int m_writeTimeoutMs = 3000;
+    int m_headerTimeoutMs = 5000;
+    int m_maxVideoPackets = 90;         // 30fps约3秒
+    int m_maxAudioPackets = 150;        // 20ms一帧约3秒
+    bool m_waitKeyFrame = false;        // 视频积压被整体丢弃后，等待下一个关键帧
+    std::atomic<bool> m_broken{false};  // 写出超时或失败后连接失效
+
+    // 以下由写出线程访问（closeOutput在停止之后调用）
+    AVFormatContext* m_ownedCtx = nullptr;
+    AVDictionary* m_headerOptions = nullptr;
+    AVDictionary* m_ioOptions = nullptr;
+    bool m_headerWritten = false;
+    std::atomic<bool> m_writing{false};     // 已出队的包正在写出，drain需等其完成
+    bool m_firstPacketWritten = false;
+    bool m_reconnect = true;
+    int m_backoffInitialMs = 500;
+    int m_backoffMaxMs = 30000;
+    int m_reconnectAttempt = 0;
+    int64_t m_nextAttemptUs = 0;
+    int64_t m_downSinceUs = 0;
 };
 
 #endif // STREAMPUSHTHREAD_H
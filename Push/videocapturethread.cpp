@@ -1,5 +1,13 @@
 ﻿#include "videocapturethread.h"
 #include "Logger.h"
+#include "frametrace.h"
+#include "threadtuning.h"
+#include "videosource.h"
+#include <QtConcurrent>
+
+extern "C" {
+#include <libavutil/time.h>
+}
 
 VideoCaptureThread::VideoCaptureThread(QObject *parent)
     : QThread{parent}
@@ -12,78 +20,113 @@ VideoCaptureThread::~VideoCaptureThread() {
 }
 
 bool VideoCaptureThread::initialize(const QString& sourceUrl, int width, int height, int fps) {
-    // ...初始化FFmpeg相关资源...
+    stopCapture();  // 释放上次预先打开但未采集的设备
     m_sourceUrl = sourceUrl;
     m_width = width;
     m_height = height;
     m_fps = fps;
+    m_paused = false;
+
+    // 设备打开（枚举、协商格式）可达数百毫秒，提前在线程池上进行，start时多半已就绪
+    m_source.reset(VideoSource::create(VideoSourceConfig::fromUrl(m_sourceUrl, m_width, m_height, m_fps)));
+    m_source->setMetrics(m_metrics, m_stats);
+    m_openError.clear();
+    VideoSource* source = m_source.get();
+    m_opened = QtConcurrent::run([this, source] {
+        int64_t beginUs = av_gettime_relative();
+        if (!source->open(&m_openError)) {
+            return false;
+        }
+        LogInfo << "【视频采集】视频源:" << source->description()
+                << "打开耗时" << (av_gettime_relative() - beginUs) / 1000 << "ms";
+        return true;
+    });
     return true;
 }
 
 void VideoCaptureThread::run() {
+    ThreadTuning::StageScope tuning(PipelineStage::videoCapture);
     m_running = true;
-    m_formatCtx = avformat_alloc_context();
-#ifdef  Q_OS_WIN
-    AVInputFormat* inputFmt = av_find_input_format("gdigrab");//获取GDI屏幕录制设备
-#else
-    AVInputFormat* inputFmt = av_find_input_format("x11grab");//获取X11屏幕录制设备
-#endif
-    if (!inputFmt) {
-        emit errorOccurred("无法找到输入格式");
-        return;
-    }
-    AVDictionary* options = nullptr;
-    av_dict_set(&options, "framerate", QString::number(m_fps).toUtf8().data(), 0);
-    av_dict_set(&options, "video_size", QString("%1x%2").arg(m_width).arg(m_height).toUtf8().data(), 0);
-
-    if (avformat_open_input(&m_formatCtx, m_sourceUrl.toUtf8().data(), inputFmt, &options) < 0) {
-        emit errorOccurred("打开视频源失败");
-        return;
-    }
-    if (avformat_find_stream_info(m_formatCtx, nullptr) < 0) {
-        emit errorOccurred("查找流信息失败");
-        return;
-    }
-
-    // 查找视频流
-    m_videoStreamIndex = av_find_best_stream(m_formatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
-    if (m_videoStreamIndex < 0) {
-        emit errorOccurred("未找到视频流");
+    if (!m_source || !m_opened.result()) {
+        emit errorOccurred(m_source ? m_openError : QString("视频源未初始化"));
+        m_source.reset();
+        m_running = false;
         return;
     }
+    VideoSource* source = m_source.get();
 
-    AVCodecParameters* codecPar = m_formatCtx->streams[m_videoStreamIndex]->codecpar;
-    AVCodec* codec = avcodec_find_decoder(codecPar->codec_id);
-    m_codecCtx = avcodec_alloc_context3(codec);
-    avcodec_parameters_to_context(m_codecCtx, codecPar);
-    if (avcodec_open2(m_codecCtx, codec, nullptr) < 0) {
-        emit errorOccurred("打开解码器失败");
-        return;
-    }
-
-    AVPacket* pkt = av_packet_alloc();
     AVFrame* frame = av_frame_alloc();
 
     while (m_running) {
-        if (av_read_frame(m_formatCtx, pkt) >= 0 && pkt->stream_index == m_videoStreamIndex) {
-            if (avcodec_send_packet(m_codecCtx, pkt) == 0) {
-                while (avcodec_receive_frame(m_codecCtx, frame) == 0) {
-                    AVFrame* cloned = av_frame_clone(frame);
-                    emit videoFrameAvailable(cloned);
-                }
+        if (m_paused) {
+            if (waitWhilePaused(frame) && !m_paused) {
+                source->restartClock();
             }
+            continue;
+        }
+        // 采集/解码时间戳随帧带到编码线程，由编码线程按pts记录追踪与延迟指标
+        FrameTrace::FrameStamps stamps;
+        int ret = source->read(frame, &stamps);
+        if (ret == AVERROR(EAGAIN)) {
+            continue;
         }
-        av_packet_unref(pkt);
+        if (ret == AVERROR_EOF) {
+            LogInfo << "【视频采集】视频源已结束";
+            break;
+        }
+        if (ret < 0) {
+            emit errorOccurred("读取视频帧失败");
+            break;
+        }
+        AVFrame* cloned = av_frame_clone(frame);
+        FrameTrace::attachStamps(cloned, stamps);
+        emit videoFrameAvailable(cloned);
     }
     av_frame_free(&frame);
-    av_packet_free(&pkt);
-    avcodec_close(m_codecCtx);
-    avcodec_free_context(&m_codecCtx);
-    avformat_close_input(&m_formatCtx);
+    source->close();
+    if (const FrameClock* clock = source->frameClock()) {
+        LogInfo << "【视频采集】帧时钟: tick" << clock->ticks() << "错过截止" << clock->missedDeadlines()
+                << "跳过" << clock->skippedTicks() << "最大抖动" << clock->maxLatenessUs() << "us";
+    }
+    m_source.reset();
     m_running = false;
 }
 
+void VideoCaptureThread::pause() {
+    m_paused = true;
+}
+
+void VideoCaptureThread::resume() {
+    QMutexLocker locker(&m_pauseMutex);
+    m_paused = false;
+    m_resumed.wakeAll();
+}
+
+bool VideoCaptureThread::waitWhilePaused(AVFrame* lastFrame) {
+    {
+        QMutexLocker locker(&m_pauseMutex);
+        if (m_paused && m_running) {
+            m_resumed.wait(&m_pauseMutex, FILLER_INTERVAL_MS);
+        }
+    }
+    if (!m_running) {
+        return false;
+    }
+    // 填充帧不带采集时间戳，不计入采集延迟指标
+    if (m_paused && lastFrame->buf[0]) {
+        emit videoFrameAvailable(av_frame_clone(lastFrame));
+    }
+    return true;
+}
+
 void VideoCaptureThread::stopCapture() {
-    m_running = false;
+    {
+        QMutexLocker locker(&m_pauseMutex);
+        m_running = false;
+        m_resumed.wakeAll();
+    }
     wait();
+    // initialize之后没有start时，等打开完成再关闭设备
+    m_opened.waitForFinished();
+    m_source.reset();
 }
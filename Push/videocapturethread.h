@@ -1,14 +1,22 @@
 ﻿#ifndef VIDEOCAPTURETHREAD_H
 #define VIDEOCAPTURETHREAD_H
 
+#include <QFuture>
 #include <QThread>
 #include <QMutex>
+#include <QWaitCondition>
+#include <atomic>
+#include <memory>
 
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 }
 
+class PushMetrics;
+class PushStatsCounters;
+class VideoSource;
+
 class VideoCaptureThread : public QThread
 {
     Q_OBJECT
@@ -16,8 +24,15 @@ public:
     explicit VideoCaptureThread(QObject *parent = nullptr);
     ~VideoCaptureThread();
 
+    // 在线程池上开始打开采集设备后立即返回，与编码器初始化、推流握手并行；打开失败在run()中上报
     bool initialize(const QString& sourceUrl, int width, int height, int fps);
     void stopCapture();
+    // 暂停时不再读取设备，每FILLER_INTERVAL_MS重发一次最后一帧，保持推流会话与接收端解码器活跃；
+    // 恢复时立即唤醒采集，帧时钟从恢复时刻重新计时
+    void pause();
+    void resume();
+    // 采集抖动与错过帧时钟截止时刻的统计
+    void setMetrics(PushMetrics* metrics, PushStatsCounters* stats) { m_metrics = metrics; m_stats = stats; }
 
 signals:
     void videoFrameAvailable(AVFrame* frame);
@@ -27,12 +42,21 @@ protected:
     void run() override;
 
 private:
-    AVFormatContext* m_formatCtx = nullptr;
-    AVCodecContext* m_codecCtx = nullptr;
-    int m_videoStreamIndex = -1;
+    // 暂停时等待恢复，超时发送一次填充帧；返回false表示已停止
+    bool waitWhilePaused(AVFrame* lastFrame);
+
     volatile bool m_running = false;
+    std::atomic<bool> m_paused{false};
+    QMutex m_pauseMutex;
+    QWaitCondition m_resumed;
+    static const int FILLER_INTERVAL_MS = 500;
+    PushMetrics* m_metrics = nullptr;
+    PushStatsCounters* m_stats = nullptr;
+    std::unique_ptr<VideoSource> m_source;     // initialize时创建，采集结束后释放
+    QFuture<bool> m_opened;
+    QString m_openError;
 
-    QString m_sourceUrl;//视频流源地址
+    QString m_sourceUrl;//视频流源地址，格式见VideoSourceConfig::fromUrl
     int m_width = 1920;
     int m_height = 1080;
     int m_fps = 30;
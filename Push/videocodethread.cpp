@@ -1,5 +1,10 @@
 ﻿#include "videocodethread.h"
 #include "Logger.h"
+#include "frameshm.h"
+#include "frametrace.h"
+#include "latencysei.h"
+#include "threadtuning.h"
+#include "workerpool.h"
 
 
 VideoCodeThread::VideoCodeThread(QObject *parent)
@@ -63,6 +68,7 @@ bool VideoCodeThread::initialize(AVFormatContext *fmtCtx, int width, int height,
     // 基础预设
     av_dict_set(&codec_options, "preset", "superfast", 0);
     av_dict_set(&codec_options, "tune", "zerolatency", 0);
+    av_dict_set(&codec_options, "forced-idr", "1", 0);  // 请求的关键帧编码为IDR
     // 固定比特率模式 (CBR)
     av_dict_set(&codec_options, "nal-hrd", "cbr", 0);    // CBR模式
     av_dict_set(&codec_options, "x264-params",
@@ -71,7 +77,13 @@ bool VideoCodeThread::initialize(AVFormatContext *fmtCtx, int width, int height,
                     .arg(m_minBitrate/1000)
                     .toStdString().c_str(), 0);
 
-    if (avcodec_open2(m_codecCtx, codec, &codec_options) < 0) {
+    // x264在打开时创建工作线程，线程继承当前亲和性，按编码阶段配置打开
+    int openRet;
+    {
+        ThreadTuning::ScopedStageAffinity affinity(PipelineStage::videoEncode);
+        openRet = avcodec_open2(m_codecCtx, codec, &codec_options);
+    }
+    if (openRet < 0) {
         avcodec_free_context(&m_codecCtx);
         m_codecCtx = nullptr;
         LogErr << ("打开编码器失败");
@@ -106,25 +118,100 @@ bool VideoCodeThread::initialize(AVFormatContext *fmtCtx, int width, int height,
         return false;
     }
 
+    m_framePts = 0;
+    m_pausePts = -1;
+    m_pauseBeginUs = -1;
+    m_paused = false;
+    m_seiSequence = 0;
     m_running = true;
     return true;
 }
 
 void VideoCodeThread::addVideoFrame(AVFrame *frame)
 {
+    if (m_strand) {
+        if (!m_running) {
+            av_frame_free(&frame);
+            return;
+        }
+        m_strand->post([this, frame]() mutable {
+            if (m_running) {
+                encodeFrame(frame);
+            } else {
+                av_frame_free(&frame);
+            }
+        });
+        return;
+    }
     QMutexLocker locker(&m_mutex);
     m_frameQueue.enqueue(frame);
 }
 
+void VideoCodeThread::startEncoding()
+{
+    if (!m_strand) {
+        start();
+    }
+}
+
 void VideoCodeThread::stopEncoding()
 {
     m_running = false;
-    wait();
+    if (m_strand) {
+        m_strand->waitIdle();
+    } else {
+        wait();
+    }
+}
+
+void VideoCodeThread::flush(const std::function<void(AVPacket*, const PacketTiming&)>& sink)
+{
+    if (!m_codecCtx || avcodec_send_frame(m_codecCtx, nullptr) < 0) {
+        return;
+    }
+    AVPacket* pkt = av_packet_alloc();
+    while (avcodec_receive_packet(m_codecCtx, pkt) == 0) {
+        pkt->stream_index = m_stream->index;
+        PacketTiming timing;
+        timing.encodeEndUs = FrameTrace::nowUs();
+        sink(pkt, timing);
+        pkt = av_packet_alloc();
+    }
+    av_packet_free(&pkt);
+}
+
+void VideoCodeThread::pause()
+{
+    m_pauseBeginUs = FrameTrace::nowUs();
+    m_paused = true;
+}
+
+void VideoCodeThread::resume()
+{
+    m_paused = false;
+    m_forceKeyFrame = true;
+}
+
+int64_t VideoCodeThread::nextPts()
+{
+    int64_t pauseBeginUs = m_pauseBeginUs.load();
+    if (pauseBeginUs >= 0) {
+        // 填充帧间隔远大于帧周期，pts按暂停以来的墙钟时长推进，与照常递增的音频时间轴保持一致
+        if (m_pausePts < 0) {
+            m_pausePts = m_framePts;
+        }
+        int64_t elapsed = av_rescale_q(FrameTrace::nowUs() - pauseBeginUs, {1, 1000000}, m_codecCtx->time_base);
+        m_framePts = qMax(m_framePts, m_pausePts + elapsed);
+        if (!m_paused && m_pauseBeginUs.compare_exchange_strong(pauseBeginUs, -1)) {
+            m_pausePts = -1;
+        }
+    }
+    return m_framePts++;
 }
 
 void VideoCodeThread::run()
 {
-    static int64_t video_frame_pts = 0;
+    ThreadTuning::StageScope tuning(PipelineStage::videoEncode);
     while (m_running) {
         m_mutex.lock();
         if (m_frameQueue.isEmpty()) {
@@ -134,33 +221,90 @@ void VideoCodeThread::run()
         }
         AVFrame* srcFrame = m_frameQueue.dequeue();
         m_mutex.unlock();
-        // 转换为YUV420P
-        AVFrame* yuvFrame = av_frame_alloc();
-        yuvFrame->format = m_codecCtx->pix_fmt;
-        yuvFrame->width = m_codecCtx->width;
-        yuvFrame->height = m_codecCtx->height;
-        av_frame_get_buffer(yuvFrame, 0);
-
-        sws_scale(m_swsCtx,
-                  srcFrame->data, srcFrame->linesize,
-                  0, m_codecCtx->height,
-                  yuvFrame->data, yuvFrame->linesize);
-
-        yuvFrame->pts = video_frame_pts++;
-        LogDebug << "编码视频帧PTS:"<<yuvFrame->pts;
-        // 编码
-        if (avcodec_send_frame(m_codecCtx, yuvFrame) == 0) {
-            AVPacket* pkt = av_packet_alloc();
-            av_init_packet(pkt);
-            while (avcodec_receive_packet(m_codecCtx, pkt) == 0) {
-                pkt->stream_index = m_stream->index;
-                emit packetEncoded(pkt);
-                pkt = av_packet_alloc(); // 下一个
+        encodeFrame(srcFrame);
+    }
+}
+
+void VideoCodeThread::encodeFrame(AVFrame* srcFrame)
+{
+    int64_t pts = nextPts();
+
+    // 采集线程带来的时间戳在此按pts补记，采集到出队之间为跨线程排队
+    PacketTiming timing;
+    if (const FrameTrace::FrameStamps* st = FrameTrace::stamps(srcFrame)) {
+        timing.captureUs = st->readEndUs;
+        if (FrameTrace::enabled()) {
+            int64_t dequeueUs = FrameTrace::nowUs();
+            FrameTrace::record("capture", FrameTrace::Stream::video, pts, st->readBeginUs, st->readEndUs);
+            FrameTrace::record("decode", FrameTrace::Stream::video, pts, st->readEndUs, st->decodeEndUs);
+            FrameTrace::record("encode_queue", FrameTrace::Stream::video, pts, st->decodeEndUs, dequeueUs);
+        }
+    }
+
+    // 转换为YUV420P
+    AVFrame* yuvFrame = av_frame_alloc();
+    yuvFrame->format = m_codecCtx->pix_fmt;
+    yuvFrame->width = m_codecCtx->width;
+    yuvFrame->height = m_codecCtx->height;
+    av_frame_get_buffer(yuvFrame, 0);
+
+    {
+        TraceSpan span("scale", FrameTrace::Stream::video, pts);
+        // 视频源可能是BGRA屏幕/测试图，也可能是YUV媒体文件，按实际帧格式与尺寸复用或重建转换上下文
+        m_swsCtx = sws_getCachedContext(m_swsCtx,
+                                        srcFrame->width, srcFrame->height, AVPixelFormat(srcFrame->format),
+                                        m_codecCtx->width, m_codecCtx->height, m_codecCtx->pix_fmt,
+                                        SWS_BICUBIC, nullptr, nullptr, nullptr);
+        if (m_swsCtx) {
+            sws_scale(m_swsCtx,
+                      srcFrame->data, srcFrame->linesize,
+                      0, srcFrame->height,
+                      yuvFrame->data, yuvFrame->linesize);
+        } else {
+            LogErr << "【视频编码】不支持的源帧格式:" << srcFrame->format;
+        }
+    }
+    if (m_frameShm) {
+        // 在编码线程上拷贝一次，本机读端零拷贝映射；暂停期间的填充帧同样发布
+        TraceSpan span("shm", FrameTrace::Stream::video, pts);
+        m_frameShm->publish(m_frameShm->source() == FrameShm::Source::captured ? srcFrame : yuvFrame,
+                            timing.captureUs >= 0 ? timing.captureUs : FrameTrace::nowUs());
+    }
+
+    yuvFrame->pts = pts;
+    if (m_forceKeyFrame.exchange(false)) {
+        yuvFrame->pict_type = AV_PICTURE_TYPE_I;
+    }
+    LogDebug << "编码视频帧PTS:"<<yuvFrame->pts;
+    // 编码
+    int64_t encodeBeginUs = FrameTrace::nowUs();
+    if (m_metrics && timing.captureUs >= 0) {
+        m_metrics->record(LatencyMetric::captureToEncode, encodeBeginUs - timing.captureUs);
+    }
+    if (avcodec_send_frame(m_codecCtx, yuvFrame) == 0) {
+        AVPacket* pkt = av_packet_alloc();
+        av_init_packet(pkt);
+        while (avcodec_receive_packet(m_codecCtx, pkt) == 0) {
+            pkt->stream_index = m_stream->index;
+            timing.encodeEndUs = FrameTrace::nowUs();
+            FrameTrace::record("encode", FrameTrace::Stream::video, pkt->pts,
+                               encodeBeginUs, timing.encodeEndUs);
+            if (m_metrics) {
+                m_metrics->record(LatencyMetric::encodeDuration, timing.encodeEndUs - encodeBeginUs);
+            }
+            if (m_latencySei) {
+                LatencySei::Payload sei;
+                sei.captureWallUs = LatencySei::toWallClock(timing.captureUs >= 0 ? timing.captureUs
+                                                                                   : encodeBeginUs);
+                sei.sequence = m_seiSequence++;
+                LatencySei::insert(pkt, sei);
             }
+            emit packetEncoded(pkt, timing);
+            pkt = av_packet_alloc(); // 下一个
         }
-        av_frame_free(&yuvFrame);
-        av_frame_free(&srcFrame);
     }
+    av_frame_free(&yuvFrame);
+    av_frame_free(&srcFrame);
 }
 
 AVStream *VideoCodeThread::stream() const
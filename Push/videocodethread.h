@@ -5,6 +5,10 @@
 #include <QThread>
 #include <QMutex>
 #include <QQueue>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "pushmetrics.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -12,6 +16,9 @@ extern "C" {
 #include <libswscale/swscale.h>
 }
 
+class Strand;
+class FrameShmPublisher;
+
 class VideoCodeThread : public QThread {
     Q_OBJECT
 public:
@@ -20,26 +27,54 @@ public:
 
     bool initialize(AVFormatContext* fmtCtx, int width, int height, int fps, int bitrate);
     void addVideoFrame(AVFrame* frame);
+    // 设置strand后不再启动专用线程，每帧作为任务投递到共享线程池串行编码，需在startEncoding之前调用
+    void setStrand(const std::shared_ptr<Strand>& strand) { m_strand = strand; }
+    void startEncoding();
     void stopEncoding();
+    // stopEncoding之后调用：取出编码器内缓存的帧交给sink（调用线程上同步执行），之后需重新initialize
+    void flush(const std::function<void(AVPacket*, const PacketTiming&)>& sink);
 
     AVCodecContext *codecCtx() const;
     AVStream *stream() const;
+    void setMetrics(PushMetrics* metrics) { m_metrics = metrics; }
+    // 每帧插入携带采集时刻与序号的SEI，用于接收端测量端到端延迟
+    void setLatencySei(bool enabled) { m_latencySei = enabled; }
+    // 把采集帧或转换后的YUV帧发布到共享内存环，publisher由推流器持有，需在startEncoding之前设置
+    void setFrameShm(FrameShmPublisher* publisher) { m_frameShm = publisher; }
+    // 下一帧编码为IDR（输出重连后恢复），可在任意线程调用
+    void requestKeyFrame() { m_forceKeyFrame = true; }
+    // 暂停期间只收到采集线程的低频填充帧，其时间戳与恢复后的第一帧按墙钟推进；恢复时编码IDR
+    void pause();
+    void resume();
 
 signals:
-    void packetEncoded(AVPacket* packet);
+    void packetEncoded(AVPacket* packet, const PacketTiming& timing);
 
 protected:
     void run() override;
 
 private:
+    void encodeFrame(AVFrame* srcFrame);
+    int64_t nextPts();
+
     AVCodecContext* m_codecCtx = nullptr;
     SwsContext* m_swsCtx = nullptr;
     AVStream* m_stream = nullptr;
     QQueue<AVFrame*> m_frameQueue;
     QMutex m_mutex;
+    PushMetrics* m_metrics = nullptr;
     int m_maxBitrate = 6000000;      // 最大比特率 (bps)
     int m_minBitrate = 2000000;      // 最小比特率 (bps)
+    int64_t m_framePts = 0;          // 编码帧计数，同时作为帧追踪的帧标识
+    bool m_latencySei = false;
+    uint32_t m_seiSequence = 0;
     volatile bool m_running = false;
+    std::atomic<bool> m_forceKeyFrame{false};
+    std::atomic<bool> m_paused{false};
+    std::atomic<int64_t> m_pauseBeginUs{-1};    // 暂停开始时刻，恢复后第一帧编码完才清除
+    int64_t m_pausePts = -1;                    // 暂停后第一帧的pts，仅编码线程访问
+    std::shared_ptr<Strand> m_strand;
+    FrameShmPublisher* m_frameShm = nullptr;
 };
 
 
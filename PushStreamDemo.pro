@@ -1,4 +1,4 @@
-QT       += core gui multimedia
+QT       += core gui multimedia network concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -11,15 +11,37 @@ CONFIG += c++17
 INCLUDEPATH += $$PWD/include \
     $$PWD/include/FFmpeg \
     $$PWD/LogDemo \
+    $$PWD/Common \
     $$PWD/Push
 
 win32:CONFIG(release, debug|release): DESTDIR += $$PWD/bin/Release
 else:win32:CONFIG(debug, debug|release): DESTDIR += $$PWD/bin/Debug
 
 SOURCES += \
+    Common/audiodsp.cpp \
+    Common/audioencoder.cpp \
+    Common/audioresampler.cpp \
+    Common/capturefile.cpp \
+    Common/frameclock.cpp \
+    Common/frameshm.cpp \
+    Common/frametrace.cpp \
+    Common/iodeadline.cpp \
+    Common/latencyhistogram.cpp \
+    Common/latencysei.cpp \
+    Common/metricsserver.cpp \
+    Common/outputformat.cpp \
+    Common/packettap.cpp \
+    Common/pushmetrics.cpp \
+    Common/pushstats.cpp \
+    Common/threadtuning.cpp \
+    Common/videosource.cpp \
+    Common/workerpool.cpp \
     LogDemo/Logger.cpp \
     Push/audiocapturethread.cpp \
     Push/audiocodethread.cpp \
+    Push/audiomixerthread.cpp \
+    Push/ffaudiocapturethread.cpp \
+    Push/pushsessionmanager.cpp \
     Push/rtspsyncpush.cpp \
     Push/streampushthread.cpp \
     Push/videocapturethread.cpp \
@@ -31,11 +53,34 @@ SOURCES += \
     rtsppusher.cpp
 
 HEADERS += \
+    Common/audiodsp.h \
+    Common/audioencoder.h \
+    Common/audioformat.h \
+    Common/audioresampler.h \
+    Common/capturefile.h \
+    Common/frameclock.h \
+    Common/frameshm.h \
+    Common/frametrace.h \
+    Common/iodeadline.h \
+    Common/latencyhistogram.h \
+    Common/latencysei.h \
+    Common/metricsserver.h \
+    Common/outputformat.h \
+    Common/packettap.h \
+    Common/pcmtimeline.h \
+    Common/pushmetrics.h \
+    Common/pushstats.h \
+    Common/threadtuning.h \
+    Common/videosource.h \
+    Common/workerpool.h \
     DataStruct.h \
     LogDemo/Logger.h \
     LogDemo/LoggerTemplate.h \
     Push/audiocapturethread.h \
     Push/audiocodethread.h \
+    Push/audiomixerthread.h \
+    Push/ffaudiocapturethread.h \
+    Push/pushsessionmanager.h \
     Push/rtspsyncpush.h \
     Push/streampushthread.h \
     Push/videocapturethread.h \
@@ -64,4 +109,12 @@ msvc {
 DEPENDPATH += $$PWD/lib \
               $$PWD/lib/FFmpeg \
 
+# 采集录制的逐帧LZ4压缩：qmake CONFIG+=lz4，需liblz4
+lz4 {
+    DEFINES += HAVE_LZ4
+    LIBS += -llz4
+}
+
 LIBS += -L$$PWD/lib/FFmpeg/ -lavcodec -lavfilter -lavformat -lswscale -lavutil -lswresample -lavdevice
+# 帧共享内存（shm_open），旧版glibc在librt中
+unix:!macx: LIBS += -lrt
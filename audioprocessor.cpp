@@ -1,4 +1,8 @@
 ﻿#include "audioprocessor.h"
+#include "audioformat.h"
+#include "frametrace.h"
+#include "capturefile.h"
+#include <QTimer>
 
 AudioProcessor::AudioProcessor(QObject* parent)
     : QObject(parent)
@@ -8,9 +12,7 @@ AudioProcessor::AudioProcessor(QObject* parent)
 
 AudioProcessor::~AudioProcessor() {
     stopCapture();
-    if (m_swrCtx) {
-        swr_free(&m_swrCtx);
-    }
+    delete m_replayReader;
 }
 
 bool AudioProcessor::initialize(int sampleRate, int channels, AVSampleFormat format) {
@@ -30,42 +32,160 @@ bool AudioProcessor::initialize(int sampleRate, int channels, AVSampleFormat for
     m_audioFormat.setByteOrder(QAudioFormat::LittleEndian);
     m_audioFormat.setSampleType(QAudioFormat::SignedInt);
 
-    // 检查设备支持
+    if (!m_replayPath.isEmpty()) {
+        // 回放时输入格式以录制文件为准，不访问声卡
+        if (!initReplay()) {
+            emit errorOccurred("打开音频回放文件失败");
+            return false;
+        }
+        return initSwr();
+    }
+
+    // 检查设备支持；设备只支持48kHz或单声道等情况下按实际协商的格式重采样到编码器格式
     QAudioDeviceInfo info = QAudioDeviceInfo::defaultInputDevice();
     if (!info.isFormatSupported(m_audioFormat)) {
         m_audioFormat = info.nearestFormat(m_audioFormat);
-        LogInfo << "【音频】使用最接近的音频格式:"
-                << "采样率:" << m_audioFormat.sampleRate()
-                << "通道数:" << m_audioFormat.channelCount()
-                << "采样大小:" << m_audioFormat.sampleSize();
-    }
-
-    m_swrCtx = swr_alloc_set_opts(nullptr,
-                                  av_get_default_channel_layout(channels), AV_SAMPLE_FMT_FLTP, sampleRate, // 输出格式
-                                  av_get_default_channel_layout(channels), AV_SAMPLE_FMT_S16, sampleRate, // 输入格式（QT采集默认S16）
-                                  0, nullptr);
-    if (!m_swrCtx || swr_init(m_swrCtx) < 0) {
-        LogErr << "【音频】swr上下文初始化失败";
+        LogInfo << "【音频】使用最接近的音频格式:" << AudioFormat::describe(m_audioFormat);
+    }
+    if (AudioFormat::toSampleFormat(m_audioFormat) == AV_SAMPLE_FMT_NONE) {
+        LogErr << "【音频】不支持的采集格式:" << AudioFormat::describe(m_audioFormat);
+        emit errorOccurred("不支持的音频采集格式");
         return false;
     }
 
+    return initSwr();
+}
+
+bool AudioProcessor::initSwr()
+{
+    m_audioBuffer.clear();
+    m_timeline.reset(m_audioFormat.bytesForDuration(1000000));
+    return m_resampler.init(m_audioFormat.sampleRate(), m_audioFormat.channelCount(),
+                            AudioFormat::toSampleFormat(m_audioFormat),
+                            m_sampleRate, m_channels, m_sampleFormat);
+}
+
+int AudioProcessor::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+void AudioProcessor::setLowLatency(bool enabled, int bufferMs)
+{
+    m_lowLatency = enabled;
+    m_bufferMs = bufferMs;
+}
+
+void AudioProcessor::setReplayFile(const QString& path, bool loop)
+{
+    m_replayPath = path;
+    m_replayLoop = loop;
+    if (path.isEmpty()) {
+        delete m_replayReader;
+        m_replayReader = nullptr;
+    }
+}
 
+bool AudioProcessor::initReplay()
+{
+    if (!m_replayReader) {
+        m_replayReader = new CaptureFileReader;
+    }
+    QString errMsg;
+    if (!m_replayReader->open(m_replayPath, &errMsg)) {
+        LogErr << "【音频】" << errMsg;
+        return false;
+    }
+    m_replayRecords = m_replayReader->indicesOf(CaptureFile::RecordType::audio);
+    if (m_replayRecords.isEmpty()) {
+        LogErr << "【音频】录制文件中没有音频:" << m_replayPath;
+        return false;
+    }
+    const CaptureFile::RecordInfo& first = m_replayReader->records()[m_replayRecords.first()];
+    if (!AudioFormat::fromSampleFormat(AVSampleFormat(first.format), first.sampleRate(), first.channels(),
+                                       &m_audioFormat)) {
+        LogErr << "【音频】录制文件的采样格式不支持回放:" << first.format;
+        return false;
+    }
+    m_replayFirstUs = m_replayReader->firstCaptureUs();
+    m_replayLoopUs = m_replayReader->loopDurationUs();
+    LogInfo << "【音频】回放录制文件:" << m_replayPath << AudioFormat::describe(m_audioFormat)
+            << m_replayRecords.size() << "个分片";
     return true;
 }
 
+void AudioProcessor::replayDue()
+{
+    // 以录制文件的首条记录为零点，与视频回放源使用同一时间轴和循环周期
+    int64_t elapsedUs = av_gettime_relative() - m_replayStartUs;
+    while (true) {
+        if (m_replayNext >= m_replayRecords.size()) {
+            if (!m_replayLoop) {
+                m_replayTimer->stop();
+                LogInfo << "【音频】录制文件回放结束";
+                return;
+            }
+            m_replayNext = 0;
+            ++m_replayLoops;
+        }
+        const CaptureFile::RecordInfo& record = m_replayReader->records()[m_replayRecords[m_replayNext]];
+        if (m_replayLoops * m_replayLoopUs + record.captureUs - m_replayFirstUs > elapsedUs) {
+            return;
+        }
+        ++m_replayNext;
+        m_replayBuffer.resize(record.rawBytes);
+        if (m_replayReader->read(record, reinterpret_cast<uint8_t*>(m_replayBuffer.data()))) {
+            processAudioData(m_replayBuffer.constData(), record.rawBytes);
+        }
+    }
+}
+
 void AudioProcessor::startCapture()
 {
+    if (!m_replayPath.isEmpty()) {
+        if (!m_replayTimer) {
+            m_replayTimer = new QTimer(this);
+            m_replayTimer->setTimerType(Qt::PreciseTimer);
+            connect(m_replayTimer, &QTimer::timeout, this, &AudioProcessor::replayDue);
+        }
+        m_audioBuffer.clear();
+        m_resampler.reset();
+        m_timeline.reset(m_audioFormat.bytesForDuration(1000000));
+        m_latencyReportUs = av_gettime_relative();
+        m_replayNext = 0;
+        m_replayLoops = 0;
+        m_replayStartUs = m_replayStartRequestUs >= 0 ? m_replayStartRequestUs : av_gettime_relative();
+        m_replayTimer->start(REPLAY_TICK_MS);
+        return;
+    }
     if (!m_audioInput) {
         m_audioInput = new QAudioInput(m_audioFormat, this);
+        if (m_lowLatency) {
+            // 默认缓冲由后端决定，可达数十到数百毫秒
+            m_audioInput->setBufferSize(m_audioFormat.bytesForDuration(qint64(m_bufferMs) * 1000));
+        }
         m_audioDevice = new AudioInputDevice(this);
         m_audioDevice->open(QIODevice::WriteOnly);
         m_audioInput->start(m_audioDevice);
-        LogInfo << "【音频】音频输入已启动";
+        m_audioBuffer.clear();
+        m_resampler.reset();
+        m_timeline.reset(m_audioFormat.bytesForDuration(1000000));
+        m_latencyReportUs = av_gettime_relative();
+
+        int bufferBytes = m_audioInput->bufferSize();
+        int periodBytes = m_audioInput->periodSize();
+        LogInfo << "【音频】音频输入已启动 缓冲:" << bufferBytes << "字节("
+                << m_audioFormat.durationForBytes(bufferBytes) / 1000 << "ms) 分片:" << periodBytes << "字节("
+                << m_audioFormat.durationForBytes(periodBytes) / 1000 << "ms)";
+        emit captureBufferInfo(bufferBytes, periodBytes);
     }
 }
 
 void AudioProcessor::stopCapture()
 {
+    if (m_replayTimer) {
+        m_replayTimer->stop();
+    }
     if (m_audioInput) {
         m_audioInput->stop();
         delete m_audioInput;
@@ -79,28 +199,135 @@ void AudioProcessor::setOutputContext(AVFormatContext* fmtCtx, AVCodecContext* c
     m_outputContext = fmtCtx;
     m_codecCtx = codecCtx;
     m_stream = stream;
+
+    // 编码器要求的采样格式/采样率与初始化时不同（如libopus只接受S16/FLT交错格式），按编码器参数重建重采样
+    if (m_codecCtx && (m_codecCtx->sample_fmt != m_sampleFormat || m_codecCtx->sample_rate != m_sampleRate)) {
+        LogInfo << "【音频】编码器格式:" << av_get_sample_fmt_name(m_codecCtx->sample_fmt)
+                << m_codecCtx->sample_rate << "Hz";
+        m_sampleFormat = m_codecCtx->sample_fmt;
+        m_sampleRate = m_codecCtx->sample_rate;
+        initSwr();
+    }
 }
 
 
 void AudioProcessor::processAudioData(const char *data, qint64 len)
 {
-    if (!data || len <= 0 || !m_codecCtx) return;
+    if (!data || len <= 0) return;
+    if (m_recorder) {
+        // 按设备原始分片录制，回放时分片边界与到达时序都保持一致
+        m_recorder->writeAudio(reinterpret_cast<const uint8_t*>(data), int(len), m_audioFormat.sampleRate(),
+                               m_audioFormat.channelCount(), AudioFormat::toSampleFormat(m_audioFormat),
+                               av_gettime_relative());
+    }
+    if (!m_codecCtx) return;
+
+    // 数据到达时最后一个采样刚采集完成，首个采样的采集时刻需减去数据时长
+    m_timeline.append(len, av_gettime_relative() - m_audioFormat.durationForBytes(qint32(len)));
 
+    // 设备推送的数据可能拆开一个采样帧，只把完整的采样帧送入重采样
     m_audioBuffer.append(data, len);
-    int frameBytes = m_codecCtx->frame_size * m_channels * 2; // 16-bit
+    int inBytesPerFrame = m_resampler.inBytesPerFrame();
+    int inSamples = inBytesPerFrame > 0 ? m_audioBuffer.size() / inBytesPerFrame : 0;
+    if (inSamples > 0) {
+        if (!m_resampler.write(reinterpret_cast<const uint8_t*>(m_audioBuffer.constData()), inSamples)) {
+            LogErr << "【音频】重采样失败";
+        }
+        m_audioBuffer.remove(0, inSamples * inBytesPerFrame);
+    }
+
+    // 采样率不同时输入输出采样数不对应，编码帧从重采样输出侧按frame_size切分
+    int frameSize = m_codecCtx->frame_size;
+    while (m_resampler.available() >= frameSize) {
+        AVFrame* frame = av_frame_alloc();
+        frame->format = m_sampleFormat;
+        frame->channel_layout = av_get_default_channel_layout(m_channels);
+        frame->sample_rate = m_sampleRate;
+        frame->nb_samples = frameSize;
+        if (av_frame_get_buffer(frame, 0) < 0) {
+            av_frame_free(&frame);
+            return;
+        }
+        m_resampler.read(frame, frameSize);
+        int64_t captureTimeUs = m_timeline.consumeSamples(frameSize, m_sampleRate);
+        recordCaptureLatency(captureTimeUs);
+        if (captureTimeUs >= 0) {
+            FrameTrace::record("capture", FrameTrace::Stream::audio, getCurrentAudioPts(),
+                               captureTimeUs, FrameTrace::nowUs());
+            // 采集时刻随帧带到编码线程，用于采集到写出的延迟统计
+            FrameTrace::FrameStamps stamps;
+            stamps.readBeginUs = captureTimeUs;
+            stamps.readEndUs = captureTimeUs;
+            stamps.decodeEndUs = FrameTrace::nowUs();
+            FrameTrace::attachStamps(frame, stamps);
+        }
 
-    while (m_audioBuffer.size() >= frameBytes) {
-        QByteArray frameData = m_audioBuffer.left(frameBytes);
-        m_audioBuffer.remove(0, frameBytes);
-        sendFrame(frameData); // 封装成AVFrame，编码
+        if (checkSilence(frame)) {
+            // 跳过编码，时间戳照常递增，视频同步仍以音频时钟为准
+            av_frame_free(&frame);
+            if (m_stats) {
+                m_stats->addDrop(DropReason::silence);
+            }
+            int64_t pts;
+            {
+                QMutexLocker locker(&m_timestampMutex);
+                pts = m_pts;
+                m_pts += frameSize;
+            }
+            emit audioTimestampUpdated(pts);
+            continue;
+        }
+        sendFrame(frame); // 编码
+    }
+}
+
+void AudioProcessor::recordCaptureLatency(int64_t captureTimeUs)
+{
+    int64_t now = av_gettime_relative();
+    if (captureTimeUs >= 0) {
+        qint64 latencyUs = now - captureTimeUs;
+        m_latencySumUs += latencyUs;
+        m_latencyMaxUs = qMax(m_latencyMaxUs, latencyUs);
+        ++m_latencyCount;
+    }
+    if (now - m_latencyReportUs >= 1000000) {
+        if (m_latencyCount > 0) {
+            emit captureLatency(m_latencySumUs / m_latencyCount, m_latencyMaxUs);
+        }
+        m_latencySumUs = 0;
+        m_latencyMaxUs = 0;
+        m_latencyCount = 0;
+        m_latencyReportUs = now;
     }
 }
 
+void AudioProcessor::setSilenceDetection(SilenceMode mode, double thresholdDb, int hangoverMs)
+{
+    m_silenceGate.setMode(mode);
+    m_silenceGate.setThresholdDb(thresholdDb);
+    m_silenceGate.setHangoverMs(hangoverMs);
+}
+
+bool AudioProcessor::checkSilence(AVFrame* frame)
+{
+    bool reportDue = false;
+    bool skip = m_silenceGate.processFrame(frame->data, m_sampleFormat, frame->nb_samples, m_channels,
+                                           m_sampleRate, &reportDue);
+    if (reportDue) {
+        emit silenceStatistics(m_silenceGate.totalFrames(), m_silenceGate.silentFrames());
+        if (m_stats) {
+            m_stats->setSilenceRatio(m_silenceGate.silenceRatio());
+        }
+    }
+    return skip;
+}
+
 void AudioProcessor::resetTimestamp()
 {
     QMutexLocker locker(&m_timestampMutex);
     m_isFirstFrame = true;
     m_pts = 0;
+    m_silenceGate.reset();
 }
 
 int64_t AudioProcessor::getCurrentAudioPts()
@@ -118,24 +345,8 @@ qint64 AudioProcessor::AudioInputDevice::writeData(const char *data, qint64 len)
     return len;
 }
 
-void AudioProcessor::sendFrame(const QByteArray& frameData)
+void AudioProcessor::sendFrame(AVFrame* frame)
 {
-    int inSamples = frameData.size() / (2 * m_channels);
-    const uint8_t* inData = reinterpret_cast<const uint8_t*>(frameData.constData());
-
-    AVFrame* frame = av_frame_alloc();
-    frame->format = m_sampleFormat;
-    frame->channel_layout = av_get_default_channel_layout(m_channels);
-    frame->sample_rate = m_sampleRate;
-    frame->nb_samples = inSamples;
-
-    if (av_frame_get_buffer(frame, 0) < 0) {
-        av_frame_free(&frame);
-        return;
-    }
-
-    swr_convert(m_swrCtx, frame->data, frame->nb_samples, &inData, inSamples);
-
     {
         QMutexLocker locker(&m_timestampMutex);
         frame->pts = m_pts;
@@ -145,4 +356,3 @@ void AudioProcessor::sendFrame(const QByteArray& frameData)
     emit audioTimestampUpdated(frame->pts);
     emit audioFrameAvailable(frame);
 }
-
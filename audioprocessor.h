@@ -8,7 +8,12 @@
 #include <QIODevice>
 #include <QMutex>
 #include <QByteArray>
+#include <QVector>
 #include "Logger.h"
+#include "audiodsp.h"
+#include "pcmtimeline.h"
+#include "audioresampler.h"
+#include "pushstats.h"
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -25,6 +30,10 @@ extern "C" {
 }
 Q_DECLARE_METATYPE(AVFrame*)
 
+class QTimer;
+class CaptureFileReader;
+class CaptureFileWriter;
+
 class AudioProcessor : public QObject {
     Q_OBJECT
 public:
@@ -32,6 +41,20 @@ public:
     ~AudioProcessor();
 
     bool initialize(int sampleRate, int channels, AVSampleFormat format);
+    int sampleRate() const;
+    // 静音检测：阈值(dBFS)以下持续hangoverMs后按mode处理
+    void setSilenceDetection(SilenceMode mode, double thresholdDb = -60.0, int hangoverMs = 300);
+    // 低延迟模式：显式设置设备缓冲时长，需在startCapture之前调用
+    void setLowLatency(bool enabled, int bufferMs = 10);
+    void setStatsCounters(PushStatsCounters* stats) { m_stats = stats; }
+    // 从采集录制文件回放音频代替声卡输入，按录制时的分片与时序送入处理链路；
+    // path为空时恢复声卡采集。需在initialize之前调用
+    void setReplayFile(const QString& path, bool loop = true);
+    QString replayFile() const { return m_replayPath; }
+    // 回放的时间零点（av_gettime_relative()时刻），与视频回放源取同一个值；-1为startCapture时起算
+    void setReplayStart(int64_t startUs) { m_replayStartRequestUs = startUs; }
+    // 录制声卡送来的原始PCM分片，writer由调用方持有
+    void setRecorder(CaptureFileWriter* recorder) { m_recorder = recorder; }
     void startCapture();
     void stopCapture();
     void setOutputContext(AVFormatContext* fmtCtx, AVCodecContext* codecCtx, AVStream* stream);
@@ -44,19 +67,23 @@ signals:
     void audioFrameAvailable(AVFrame* frame);
     void errorOccurred(const QString& message);
     void audioTimestampUpdated(int64_t pts); // 音频时间戳更新信号
+    void silenceStatistics(qint64 totalFrames, qint64 silentFrames);
+    void captureBufferInfo(int bufferBytes, int periodBytes);
+    // 每秒上报一次采集到送入编码的延迟（以帧首个采样计）
+    void captureLatency(qint64 avgUs, qint64 maxUs);
 
 private:
     QAudioInput* m_audioInput = nullptr;
     QIODevice* m_audioDevice = nullptr;
     QAudioFormat m_audioFormat;
 
-    // FFmpeg相关
-    SwrContext* m_swrCtx = nullptr;
+    // FFmpeg相关：设备实际格式 -> 编码器格式/采样率
+    AudioResampler m_resampler;
     AVFormatContext* m_outputContext = nullptr;
     AVCodecContext* m_codecCtx = nullptr;
     AVStream* m_stream = nullptr;
 
-    // 音频参数
+    // 音频参数（编码器侧）
     int m_sampleRate;
     int m_channels;
     AVSampleFormat m_sampleFormat;
@@ -68,7 +95,39 @@ private:
     bool m_isFirstFrame;          // 是否是第一帧
     QMutex m_timestampMutex;      // 时间戳同步锁
 
-    QByteArray m_audioBuffer;
+    QByteArray m_audioBuffer;     // 不足一个采样帧的残余字节
+    PushStatsCounters* m_stats = nullptr;
+
+    // 静音检测
+    SilenceGate m_silenceGate;
+
+    // 低延迟采集与延迟统计
+    bool m_lowLatency = false;
+    int m_bufferMs = 10;
+    PcmTimeline m_timeline;
+    qint64 m_latencySumUs = 0;
+    qint64 m_latencyMaxUs = 0;
+    int m_latencyCount = 0;
+    int64_t m_latencyReportUs = 0;
+    void recordCaptureLatency(int64_t captureTimeUs);
+
+    // 采集录制与回放
+    CaptureFileWriter* m_recorder = nullptr;
+    QString m_replayPath;
+    bool m_replayLoop = true;
+    CaptureFileReader* m_replayReader = nullptr;
+    QTimer* m_replayTimer = nullptr;
+    QVector<int> m_replayRecords;
+    QByteArray m_replayBuffer;
+    int m_replayNext = 0;
+    int64_t m_replayStartUs = 0;
+    int64_t m_replayStartRequestUs = -1;
+    int64_t m_replayFirstUs = 0;
+    int64_t m_replayLoopUs = 0;
+    int64_t m_replayLoops = 0;
+    static const int REPLAY_TICK_MS = 2;
+    bool initReplay();
+    void replayDue();
 
     class AudioInputDevice : public QIODevice {
     public:
@@ -84,8 +143,10 @@ private:
         AudioProcessor* m_owner;
     };
 
+    bool initSwr();
     void processAudioData(const char* data, qint64 len);
-    void sendFrame(const QByteArray &frameData);
+    bool checkSilence(AVFrame* frame);
+    void sendFrame(AVFrame* frame);
 };
 
 #endif // AUDIOPROCESSOR_H
@@ -0,0 +1,112 @@
+﻿#include "benchcases.h"
+#include "audioresampler.h"
+#include "audiodsp.h"
+#include <QByteArray>
+#include <QVector>
+
+extern "C" {
+#include <libswresample/swresample.h>
+}
+
+namespace
+{
+const int FRAME_SIZE = 1024;        // AAC帧长
+
+// 同采样率S16交错转FLTP平面（编码器输入格式），纯格式转换开销
+void benchS16ToFltp(BenchReport& report, int channels, int seconds)
+{
+    const int rate = 48000;
+    SwrContext* swr = AudioResampler::createContext(rate, channels, AV_SAMPLE_FMT_S16,
+                                                    rate, channels, AV_SAMPLE_FMT_FLTP);
+    if (!swr) {
+        return;
+    }
+    QVector<int16_t> input(FRAME_SIZE * channels);
+    uint32_t seed = 1;
+    AudioDsp::fillComfortNoiseS16(input.data(), input.size(), 0.5f, &seed);
+    QVector<QVector<float>> planes(channels, QVector<float>(FRAME_SIZE + 64));
+    QVector<uint8_t*> outPtrs(channels);
+    for (int ch = 0; ch < channels; ++ch) {
+        outPtrs[ch] = reinterpret_cast<uint8_t*>(planes[ch].data());
+    }
+    const uint8_t* inPtr = reinterpret_cast<const uint8_t*>(input.constData());
+
+    int frames = seconds * rate / FRAME_SIZE;
+    BenchTimer timer;
+    for (int i = 0; i < frames; ++i) {
+        swr_convert(swr, outPtrs.data(), FRAME_SIZE + 64, &inPtr, FRAME_SIZE);
+    }
+    double ns = timer.elapsedNs();
+    swr_free(&swr);
+
+    report.add("audio", QString("s16_to_fltp_%1ch").arg(channels),
+               {{"sample_rate", rate}, {"channels", channels}, {"frame_size", FRAME_SIZE}},
+               {{"ns_per_sample_ch", ns / (double(frames) * FRAME_SIZE * channels)},
+                {"ns_per_frame", ns / frames}});
+}
+
+// 采集分片 -> 字节缓冲累积完整采样帧 -> AudioResampler -> 按frame_size切出编码帧，
+// 与AudioCodeThread/AudioProcessor的数据路径一致。chunkBytes可不为采样帧整数倍
+void benchAccumulator(BenchReport& report, int inRate, int chunkBytes, int seconds)
+{
+    const int outRate = 48000;
+    const int channels = 2;
+    AudioResampler resampler;
+    if (!resampler.init(inRate, channels, AV_SAMPLE_FMT_S16, outRate, channels, AV_SAMPLE_FMT_FLTP)) {
+        return;
+    }
+    QByteArray chunk(chunkBytes, 0);
+    uint32_t seed = 1;
+    AudioDsp::fillComfortNoiseS16(reinterpret_cast<int16_t*>(chunk.data()), chunkBytes / 2, 0.5f, &seed);
+
+    AVFrame* frame = av_frame_alloc();
+    frame->nb_samples = FRAME_SIZE;
+    frame->format = AV_SAMPLE_FMT_FLTP;
+    frame->channel_layout = av_get_default_channel_layout(channels);
+    frame->sample_rate = outRate;
+    av_frame_get_buffer(frame, 0);
+
+    const int inBytesPerFrame = resampler.inBytesPerFrame();
+    qint64 chunks = qint64(seconds) * inRate * inBytesPerFrame / chunkBytes;
+    qint64 outFrames = 0;
+    QByteArray buffer;
+    BenchTimer timer;
+    for (qint64 i = 0; i < chunks; ++i) {
+        buffer.append(chunk);
+        int inSamples = buffer.size() / inBytesPerFrame;
+        if (inSamples > 0) {
+            resampler.write(reinterpret_cast<const uint8_t*>(buffer.constData()), inSamples);
+            buffer.remove(0, inSamples * inBytesPerFrame);
+        }
+        while (resampler.available() >= FRAME_SIZE) {
+            resampler.read(frame, FRAME_SIZE);
+            ++outFrames;
+        }
+    }
+    double ns = timer.elapsedNs();
+    av_frame_free(&frame);
+    if (outFrames == 0) {
+        return;
+    }
+
+    double audioNs = double(outFrames) * FRAME_SIZE / outRate * 1e9;
+    report.add("audio", QString("accumulator_%1_to_%2_chunk%3").arg(inRate).arg(outRate).arg(chunkBytes),
+               {{"in_rate", inRate}, {"out_rate", outRate}, {"channels", channels},
+                {"chunk_bytes", chunkBytes}, {"engine", resampler.engine()}},
+               {{"ns_per_frame", ns / outFrames}, {"cpu_percent", ns / audioNs * 100.0}});
+}
+} // namespace
+
+void runAudioBench(BenchReport& report)
+{
+    const int seconds = report.quick() ? 1 : 30;
+    benchS16ToFltp(report, 1, seconds);
+    benchS16ToFltp(report, 2, seconds);
+
+    // 10ms分片（低延迟采集）、QAudioInput默认周期，以及会拆开采样帧的奇数分片
+    const int chunkSizes[] = {1920, 4096, 1001};
+    for (int chunkBytes : chunkSizes) {
+        benchAccumulator(report, 48000, chunkBytes, seconds);
+        benchAccumulator(report, 44100, chunkBytes, seconds);
+    }
+}
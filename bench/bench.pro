@@ -0,0 +1,61 @@
+QT       += core
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = pushbench
+
+INCLUDEPATH += $$PWD/../include \
+    $$PWD/../include/FFmpeg \
+    $$PWD/../LogDemo \
+    $$PWD/../Common \
+    $$PWD/../Push \
+    $$PWD/..
+
+SOURCES += \
+    ../Common/audiodsp.cpp \
+    ../Common/audioencoder.cpp \
+    ../Common/audioresampler.cpp \
+    ../Common/frametrace.cpp \
+    ../Common/iodeadline.cpp \
+    ../Common/latencyhistogram.cpp \
+    ../Common/pushmetrics.cpp \
+    ../Common/pushstats.cpp \
+    ../Common/threadtuning.cpp \
+    ../Common/workerpool.cpp \
+    ../Push/streampushthread.cpp \
+    audiobench.cpp \
+    benchinput.cpp \
+    benchreport.cpp \
+    encodebench.cpp \
+    main.cpp \
+    queuebench.cpp \
+    resamplebench.cpp \
+    scalebench.cpp
+
+HEADERS += \
+    ../Common/audiodsp.h \
+    ../Common/audioencoder.h \
+    ../Common/audioresampler.h \
+    ../Common/frametrace.h \
+    ../Common/iodeadline.h \
+    ../Common/latencyhistogram.h \
+    ../Common/pushmetrics.h \
+    ../Common/pushstats.h \
+    ../Common/threadtuning.h \
+    ../Common/workerpool.h \
+    ../Push/streampushthread.h \
+    benchcases.h \
+    benchinput.h \
+    benchreport.h
+
+# msvc >= 2017  编译器使用utf-8编码
+msvc {
+    greaterThan(QMAKE_MSC_VER, 1900){
+        QMAKE_CFLAGS += /utf-8
+        QMAKE_CXXFLAGS += /utf-8
+    }
+}
+
+LIBS += -L$$PWD/../lib/FFmpeg/ -lavformat -lavcodec -lswscale -lavutil -lswresample
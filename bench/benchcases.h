@@ -0,0 +1,18 @@
+﻿// BenchCases.h
+#ifndef BENCHCASES_H
+#define BENCHCASES_H
+
+#include "benchreport.h"
+
+// 重采样开销：各采样率组合、通道数与重采样引擎下，每通道每采样耗时
+void runResampleBench(BenchReport& report);
+// BGRA采集帧转YUV420P（sws_scale），各分辨率与缩放算法
+void runScaleBench(BenchReport& report);
+// x264各preset编码吞吐与单帧耗时，AAC编码实时倍率
+void runEncodeBench(BenchReport& report);
+// S16转FLTP与采集分片累积成编码帧（AudioResampler + 字节缓冲）
+void runAudioBench(BenchReport& report);
+// 包队列、StreamPushThread交织发送与复用器写出（null/文件）
+void runQueueBench(BenchReport& report);
+
+#endif // BENCHCASES_H
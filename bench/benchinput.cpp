@@ -0,0 +1,69 @@
+﻿#include "benchinput.h"
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+namespace BenchInput
+{
+namespace
+{
+// 对角渐变叠加平移的方块，带少量伪随机纹理，压缩难度接近桌面/摄像头内容
+uint8_t pattern(int x, int y, int index, int channel, uint32_t* seed)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+    int v = ((x + index * 4) * (channel + 1) + y * 2) & 0xff;
+    if (((x + index * 8) / 64 + y / 64) % 2 == 0) {
+        v = 255 - v;
+    }
+    return uint8_t(v ^ ((*seed >> 28) & 0x0f));
+}
+} // namespace
+
+AVFrame* allocBgraFrame(int width, int height)
+{
+    AVFrame* frame = av_frame_alloc();
+    frame->format = AV_PIX_FMT_BGRA;
+    frame->width = width;
+    frame->height = height;
+    if (av_frame_get_buffer(frame, 32) < 0) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    fillBgraFrame(frame, 0);
+    return frame;
+}
+
+void fillBgraFrame(AVFrame* frame, int index)
+{
+    uint32_t seed = uint32_t(index) + 1;
+    for (int y = 0; y < frame->height; ++y) {
+        uint8_t* row = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < frame->width; ++x) {
+            row[x * 4 + 0] = pattern(x, y, index, 0, &seed);
+            row[x * 4 + 1] = pattern(x, y, index, 1, &seed);
+            row[x * 4 + 2] = pattern(x, y, index, 2, &seed);
+            row[x * 4 + 3] = 0xff;
+        }
+    }
+}
+
+void fillYuvFrame(AVFrame* frame, int index)
+{
+    uint32_t seed = uint32_t(index) + 1;
+    for (int y = 0; y < frame->height; ++y) {
+        uint8_t* row = frame->data[0] + y * frame->linesize[0];
+        for (int x = 0; x < frame->width; ++x) {
+            row[x] = pattern(x, y, index, 0, &seed);
+        }
+    }
+    for (int plane = 1; plane <= 2; ++plane) {
+        for (int y = 0; y < frame->height / 2; ++y) {
+            uint8_t* row = frame->data[plane] + y * frame->linesize[plane];
+            for (int x = 0; x < frame->width / 2; ++x) {
+                row[x] = uint8_t(128 + ((pattern(x * 2, y * 2, index, plane, &seed) - 128) >> 2));
+            }
+        }
+    }
+}
+} // namespace BenchInput
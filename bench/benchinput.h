@@ -0,0 +1,20 @@
+﻿// BenchInput.h
+#ifndef BENCHINPUT_H
+#define BENCHINPUT_H
+
+#include <cstdint>
+
+struct AVFrame;
+
+// 合成输入，不依赖采集设备与显示服务
+namespace BenchInput
+{
+// 分配并填充width x height的BGRA帧，index不同时画面平移，避免编码器退化为全跳过
+AVFrame* allocBgraFrame(int width, int height);
+void fillBgraFrame(AVFrame* frame, int index);
+
+// 以YUV420P填充同样的运动画面（需已分配缓冲）
+void fillYuvFrame(AVFrame* frame, int index);
+} // namespace BenchInput
+
+#endif // BENCHINPUT_H
@@ -0,0 +1,62 @@
+﻿#include "benchreport.h"
+#include <QDateTime>
+#include <QFile>
+#include <QJsonDocument>
+#include <QSysInfo>
+#include <QThread>
+
+extern "C" {
+#include <libavutil/avutil.h>
+}
+
+void BenchReport::add(const QString& suite, const QString& name, const QJsonObject& params,
+                      const QJsonObject& metrics)
+{
+    QJsonObject result;
+    result["suite"] = suite;
+    result["name"] = name;
+    result["params"] = params;
+    result["metrics"] = metrics;
+    m_results.append(result);
+
+    QString line = QString("%1/%2").arg(suite, name);
+    for (auto it = metrics.begin(); it != metrics.end(); ++it) {
+        line += QString("  %1=%2").arg(it.key()).arg(it.value().toDouble(), 0, 'g', 6);
+    }
+    std::fprintf(m_textOut, "%s\n", line.toUtf8().constData());
+    std::fflush(m_textOut);
+}
+
+QJsonObject BenchReport::toJson() const
+{
+    QJsonObject env;
+    env["cpu"] = QSysInfo::currentCpuArchitecture();
+    env["os"] = QSysInfo::prettyProductName();
+    env["kernel"] = QSysInfo::kernelVersion();
+    env["threads"] = QThread::idealThreadCount();
+    env["ffmpeg"] = av_version_info();
+    env["qt"] = qVersion();
+
+    QJsonObject root;
+    root["schema"] = 1;
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["quick"] = m_quick;
+    root["environment"] = env;
+    root["results"] = m_results;
+    return root;
+}
+
+bool BenchReport::writeJson(const QString& path) const
+{
+    QByteArray json = QJsonDocument(toJson()).toJson(QJsonDocument::Indented);
+    if (path == "-") {
+        std::fwrite(json.constData(), 1, size_t(json.size()), stdout);
+        return true;
+    }
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+        std::fprintf(stderr, "cannot write %s\n", path.toUtf8().constData());
+        return false;
+    }
+    return true;
+}
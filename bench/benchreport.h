@@ -0,0 +1,49 @@
+﻿// BenchReport.h
+#ifndef BENCHREPORT_H
+#define BENCHREPORT_H
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+#include <chrono>
+#include <cstdio>
+
+// 基准结果收集：同时输出便于阅读的文本行与便于版本间对比的JSON。
+// 每条结果以suite/name唯一标识，params描述输入，metrics为测得数值（键名带单位后缀）
+class BenchReport
+{
+public:
+    void setQuick(bool quick) { m_quick = quick; }
+    // 快速模式下各用例缩短测量时长，仅用于冒烟检查，数据不宜对比
+    bool quick() const { return m_quick; }
+    // 文本结果的输出位置，JSON写到stdout时改为stderr
+    void setTextOutput(FILE* out) { m_textOut = out; }
+
+    void add(const QString& suite, const QString& name, const QJsonObject& params,
+             const QJsonObject& metrics);
+    QJsonObject toJson() const;
+    bool writeJson(const QString& path) const;
+
+private:
+    QJsonArray m_results;
+    bool m_quick = false;
+    FILE* m_textOut = stdout;
+};
+
+// 单调时钟计时
+class BenchTimer
+{
+public:
+    BenchTimer() : m_begin(std::chrono::steady_clock::now()) {}
+    void restart() { m_begin = std::chrono::steady_clock::now(); }
+    double elapsedNs() const
+    {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - m_begin).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_begin;
+};
+
+#endif // BENCHREPORT_H
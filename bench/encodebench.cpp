@@ -0,0 +1,176 @@
+﻿#include "benchcases.h"
+#include "benchinput.h"
+#include "audiodsp.h"
+#include "audioencoder.h"
+#include "latencyhistogram.h"
+#include <QVector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+
+namespace
+{
+struct VideoCase {
+    const char* preset;
+    int width;
+    int height;
+};
+
+const int VIDEO_FPS = 30;
+const int VIDEO_BITRATE = 2000000;
+
+// 与VideoCodeThread相同的编码参数，仅preset不同
+AVCodecContext* openX264(const VideoCase& c)
+{
+    const AVCodec* codec = avcodec_find_encoder_by_name("libx264");
+    if (!codec) {
+        return nullptr;
+    }
+    AVCodecContext* ctx = avcodec_alloc_context3(codec);
+    ctx->width = c.width;
+    ctx->height = c.height;
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    ctx->time_base = {1, VIDEO_FPS};
+    ctx->framerate = {VIDEO_FPS, 1};
+    ctx->bit_rate = VIDEO_BITRATE;
+    ctx->gop_size = VIDEO_FPS;
+    ctx->max_b_frames = 0;
+    ctx->rc_buffer_size = int(VIDEO_BITRATE * 1.5);
+    ctx->rc_max_rate = int(VIDEO_BITRATE * 1.5);
+
+    AVDictionary* options = nullptr;
+    av_dict_set(&options, "preset", c.preset, 0);
+    av_dict_set(&options, "tune", "zerolatency", 0);
+    av_dict_set(&options, "nal-hrd", "cbr", 0);
+    int ret = avcodec_open2(ctx, codec, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        avcodec_free_context(&ctx);
+    }
+    return ctx;
+}
+
+void benchVideo(BenchReport& report, const VideoCase& c, int frames)
+{
+    AVCodecContext* ctx = openX264(c);
+    if (!ctx) {
+        return;
+    }
+    // 预先生成若干帧循环使用，计时只包含编码
+    const int distinct = 16;
+    QVector<AVFrame*> inputs;
+    for (int i = 0; i < distinct; ++i) {
+        AVFrame* frame = av_frame_alloc();
+        frame->format = AV_PIX_FMT_YUV420P;
+        frame->width = c.width;
+        frame->height = c.height;
+        av_frame_get_buffer(frame, 32);
+        BenchInput::fillYuvFrame(frame, i);
+        inputs.append(frame);
+    }
+
+    LatencyHistogram perFrame;
+    AVPacket* pkt = av_packet_alloc();
+    qint64 outBytes = 0;
+    BenchTimer total;
+    for (int i = 0; i < frames; ++i) {
+        AVFrame* frame = inputs[i % distinct];
+        frame->pts = i;
+        BenchTimer timer;
+        if (avcodec_send_frame(ctx, frame) == 0) {
+            while (avcodec_receive_packet(ctx, pkt) == 0) {
+                outBytes += pkt->size;
+                av_packet_unref(pkt);
+            }
+        }
+        perFrame.record(int64_t(timer.elapsedNs() / 1000));
+    }
+    double totalNs = total.elapsedNs();
+    LatencySummary s = perFrame.summary();
+
+    QJsonObject params{{"codec", "libx264"}, {"preset", c.preset}, {"tune", "zerolatency"},
+                       {"resolution", QString("%1x%2").arg(c.width).arg(c.height)},
+                       {"fps", VIDEO_FPS}, {"bitrate_bps", VIDEO_BITRATE}, {"frames", frames}};
+    report.add("encode", QString("x264_%1_%2p").arg(c.preset).arg(c.height), params,
+               {{"fps", frames / (totalNs / 1e9)},
+                {"realtime_x", frames / (totalNs / 1e9) / VIDEO_FPS},
+                {"frame_us_p50", double(s.p50Us)},
+                {"frame_us_p99", double(s.p99Us)},
+                {"frame_us_max", double(s.maxUs)},
+                {"out_kbps", outBytes * 8.0 / (double(frames) / VIDEO_FPS) / 1000.0}});
+
+    av_packet_free(&pkt);
+    for (AVFrame* frame : inputs) {
+        av_frame_free(&frame);
+    }
+    avcodec_free_context(&ctx);
+}
+
+void benchAudio(BenchReport& report, AudioCodecType codecType, int seconds)
+{
+    AudioEncoderParam param;
+    param.codec = codecType;
+    param.sampleRate = AudioEncoder::encoderSampleRate(codecType, 48000);
+    param.channels = 2;
+    param.bitrate = 128000;
+    QString err;
+    AVCodecContext* ctx = AudioEncoder::open(param, AV_SAMPLE_FMT_NONE, &err);
+    if (!ctx) {
+        return;     // 未编译该编码器
+    }
+
+    AVFrame* frame = av_frame_alloc();
+    frame->nb_samples = ctx->frame_size;
+    frame->format = ctx->sample_fmt;
+    frame->channel_layout = ctx->channel_layout;
+    frame->sample_rate = ctx->sample_rate;
+    av_frame_get_buffer(frame, 0);
+    uint32_t seed = 1;
+    // 宽带噪声为编码最坏情况
+    AudioDsp::fillComfortNoiseFrame(frame->data, ctx->sample_fmt, frame->nb_samples, ctx->channels,
+                                    0.3f, &seed);
+
+    int frames = seconds * ctx->sample_rate / ctx->frame_size;
+    AVPacket* pkt = av_packet_alloc();
+    BenchTimer timer;
+    for (int i = 0; i < frames; ++i) {
+        frame->pts = int64_t(i) * ctx->frame_size;
+        if (avcodec_send_frame(ctx, frame) == 0) {
+            while (avcodec_receive_packet(ctx, pkt) == 0) {
+                av_packet_unref(pkt);
+            }
+        }
+    }
+    double ns = timer.elapsedNs();
+    double audioNs = double(frames) * ctx->frame_size / ctx->sample_rate * 1e9;
+
+    QString name = AudioEncoder::codecName(codecType);
+    QJsonObject params{{"codec", name}, {"sample_rate", ctx->sample_rate}, {"channels", ctx->channels},
+                       {"bitrate_bps", param.bitrate}, {"frame_size", ctx->frame_size}};
+    report.add("encode", QString("%1_%2k_stereo").arg(name).arg(ctx->sample_rate / 1000), params,
+               {{"frame_us", ns / frames / 1000.0}, {"realtime_x", audioNs / ns}});
+
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&ctx);
+}
+} // namespace
+
+void runEncodeBench(BenchReport& report)
+{
+    // placebo无实时意义，不测
+    const char* presets[] = {"ultrafast", "superfast", "veryfast", "faster", "fast",
+                             "medium", "slow", "slower", "veryslow"};
+    const int frames = report.quick() ? 10 : 150;
+    for (const char* preset : presets) {
+        benchVideo(report, {preset, 1280, 720}, frames);
+    }
+    // 推流默认使用superfast，补测1080p
+    benchVideo(report, {"superfast", 1920, 1080}, frames);
+
+    const int audioSeconds = report.quick() ? 1 : 20;
+    benchAudio(report, AudioCodecType::aac, audioSeconds);
+    benchAudio(report, AudioCodecType::opus, audioSeconds);
+}
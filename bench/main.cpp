@@ -0,0 +1,46 @@
+﻿#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <functional>
+#include "benchcases.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("pushbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Synthetic benchmarks for the push pipeline hot paths.");
+    parser.addHelpOption();
+    QCommandLineOption jsonOpt("json", "Write machine-readable results to <file> ('-' for stdout).", "file");
+    QCommandLineOption suiteOpt("suite", "Run only the given suite (repeatable): "
+                                         "resample, scale, encode, audio, queue.", "name");
+    QCommandLineOption quickOpt("quick", "Shorten every case; smoke test only, not for comparison.");
+    parser.addOptions({jsonOpt, suiteOpt, quickOpt});
+    parser.process(a);
+
+    BenchReport report;
+    report.setQuick(parser.isSet(quickOpt));
+    QString jsonPath = parser.value(jsonOpt);
+    if (jsonPath == "-") {
+        report.setTextOutput(stderr);
+    }
+
+    const QList<QPair<QString, std::function<void(BenchReport&)>>> suites = {
+        {"resample", runResampleBench},
+        {"scale", runScaleBench},
+        {"encode", runEncodeBench},
+        {"audio", runAudioBench},
+        {"queue", runQueueBench},
+    };
+    QStringList selected = parser.values(suiteOpt);
+    for (const auto& suite : suites) {
+        if (selected.isEmpty() || selected.contains(suite.first)) {
+            suite.second(report);
+        }
+    }
+
+    if (!jsonPath.isEmpty() && !report.writeJson(jsonPath)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,255 @@
+﻿#include "benchcases.h"
+#include "streampushthread.h"
+#include "pushstats.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QVector>
+#include <atomic>
+#include <cstring>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+namespace
+{
+const int VIDEO_FPS = 30;
+const int AUDIO_RATE = 48000;
+const int AUDIO_FRAME = 1024;
+const int VIDEO_PACKET_BYTES = 8 * 1024;    // 约2Mbps@30fps
+const int AUDIO_PACKET_BYTES = 384;         // 约128kbps AAC
+
+// Annex B起始码开头，满足mpegts对H.264包的检查
+AVPacket* makePacket(int size, int64_t pts, int streamIndex, bool key)
+{
+    AVPacket* pkt = av_packet_alloc();
+    av_new_packet(pkt, size);
+    memset(pkt->data, 0x5a, size_t(size));
+    pkt->data[0] = 0;
+    pkt->data[1] = 0;
+    pkt->data[2] = 0;
+    pkt->data[3] = 1;
+    pkt->data[4] = key ? 0x65 : 0x41;
+    pkt->pts = pkt->dts = pts;
+    pkt->stream_index = streamIndex;
+    if (key) {
+        pkt->flags |= AV_PKT_FLAG_KEY;
+    }
+    return pkt;
+}
+
+// 与推流输出相同的一路H.264+一路AAC，format为"null"时不产生任何输出
+AVFormatContext* openSink(const char* format, const QString& path)
+{
+    AVFormatContext* ctx = nullptr;
+    QByteArray url = path.toUtf8();
+    if (avformat_alloc_output_context2(&ctx, nullptr, format, path.isEmpty() ? nullptr : url.constData()) < 0) {
+        return nullptr;
+    }
+    AVStream* video = avformat_new_stream(ctx, nullptr);
+    video->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    video->codecpar->codec_id = AV_CODEC_ID_H264;
+    video->codecpar->width = 1280;
+    video->codecpar->height = 720;
+    video->time_base = {1, VIDEO_FPS};
+    AVStream* audio = avformat_new_stream(ctx, nullptr);
+    audio->codecpar->codec_type = AVMEDIA_TYPE_AUDIO;
+    audio->codecpar->codec_id = AV_CODEC_ID_AAC;
+    audio->codecpar->sample_rate = AUDIO_RATE;
+    audio->codecpar->channels = 2;
+    audio->codecpar->channel_layout = AV_CH_LAYOUT_STEREO;
+    audio->codecpar->frame_size = AUDIO_FRAME;
+    audio->time_base = {1, AUDIO_RATE};
+
+    if (!(ctx->oformat->flags & AVFMT_NOFILE) && avio_open(&ctx->pb, url.constData(), AVIO_FLAG_WRITE) < 0) {
+        avformat_free_context(ctx);
+        return nullptr;
+    }
+    if (avformat_write_header(ctx, nullptr) < 0) {
+        if (!(ctx->oformat->flags & AVFMT_NOFILE)) {
+            avio_closep(&ctx->pb);
+        }
+        avformat_free_context(ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+void closeSink(AVFormatContext* ctx)
+{
+    av_write_trailer(ctx);
+    if (!(ctx->oformat->flags & AVFMT_NOFILE)) {
+        avio_closep(&ctx->pb);
+    }
+    avformat_free_context(ctx);
+}
+
+struct ScheduledPacket {
+    bool video;
+    int64_t pts;    // 编码器时间基
+};
+
+// 按实际时长交替排列的音视频包序列，与编码线程的产出顺序一致
+QVector<ScheduledPacket> schedule(int videoPackets)
+{
+    QVector<ScheduledPacket> packets;
+    int64_t audioPts = 0;
+    for (int i = 0; i < videoPackets; ++i) {
+        packets.append({true, i});
+        while (av_compare_ts(audioPts, {1, AUDIO_RATE}, i + 1, {1, VIDEO_FPS}) < 0) {
+            packets.append({false, audioPts});
+            audioPts += AUDIO_FRAME;
+        }
+    }
+    return packets;
+}
+
+AVPacket* makeScheduledPacket(const ScheduledPacket& p)
+{
+    return p.video ? makePacket(VIDEO_PACKET_BYTES, p.pts, 0, p.pts % VIDEO_FPS == 0)
+                   : makePacket(AUDIO_PACKET_BYTES, p.pts, 1, false);
+}
+
+// 编码线程与发送线程之间的互斥队列：单生产者单消费者吞吐
+void benchPacketQueue(BenchReport& report, int packets)
+{
+    QQueue<AVPacket*> queue;
+    QMutex mutex;
+    std::atomic<bool> done{false};
+    // 预先分配，计时只包含入队/出队
+    QVector<AVPacket*> pool;
+    for (int i = 0; i < packets; ++i) {
+        pool.append(makePacket(64, i, 0, false));
+    }
+
+    qint64 consumed = 0;
+    QThread* consumer = QThread::create([&]() {
+        while (true) {
+            AVPacket* pkt = nullptr;
+            {
+                QMutexLocker locker(&mutex);
+                if (!queue.isEmpty()) {
+                    pkt = queue.dequeue();
+                }
+            }
+            if (pkt) {
+                ++consumed;
+            } else if (done.load()) {
+                break;
+            } else {
+                QThread::yieldCurrentThread();
+            }
+        }
+    });
+    BenchTimer timer;
+    consumer->start();
+    for (AVPacket* pkt : pool) {
+        QMutexLocker locker(&mutex);
+        queue.enqueue(pkt);
+    }
+    done.store(true);
+    consumer->wait();
+    double ns = timer.elapsedNs();
+    delete consumer;
+    for (AVPacket* pkt : pool) {
+        av_packet_free(&pkt);
+    }
+
+    report.add("queue", "packet_queue_spsc", {{"packets", packets}},
+               {{"ns_per_packet", ns / consumed}, {"packets_per_s", consumed / (ns / 1e9)}});
+}
+
+// StreamPushThread：音视频队列按时间戳交织、换算时间基后写入null复用器
+void benchInterleaver(BenchReport& report, int videoPackets)
+{
+    AVFormatContext* ctx = openSink("null", QString());
+    if (!ctx) {
+        return;
+    }
+    PushStatsCounters stats;
+    StreamPushThread pushThread;
+    pushThread.setFmtCtx(ctx);
+    pushThread.setStatsCounters(&stats);
+    pushThread.setStreamTimeBase(0, {1, VIDEO_FPS});
+    pushThread.setStreamTimeBase(1, {1, AUDIO_RATE});
+
+    // 先全部入队再启动发送线程，测量排空速度而非生产速度；队列上限放宽到全部包，不触发丢包
+    const QVector<ScheduledPacket> packets = schedule(videoPackets);
+    const qint64 total = packets.size();
+    pushThread.setQueueLimit(int(total), int(total));
+    for (const ScheduledPacket& p : packets) {
+        pushThread.addPacket(makeScheduledPacket(p), p.video);
+    }
+
+    BenchTimer timer;
+    pushThread.start();
+    qint64 drops = 0;
+    while (true) {
+        PushStatistics s = stats.sample();
+        drops = s.totalDrops();
+        if (s.video.packetsWritten + s.audio.packetsWritten + drops >= total) {
+            break;
+        }
+        QThread::usleep(200);
+    }
+    double ns = timer.elapsedNs();
+    pushThread.stopPushing();
+    closeSink(ctx);
+    if (drops > 0) {
+        // 丢包时测到的是丢弃路径而不是交织与写出，结果无意义
+        qCritical("stream_push_interleave_null: %lld packets dropped, result discarded", drops);
+        return;
+    }
+
+    report.add("queue", "stream_push_interleave_null", {{"packets", total}, {"sink", "null"}},
+               {{"ns_per_packet", ns / total}, {"packets_per_s", total / (ns / 1e9)}});
+}
+
+// 复用器写出开销：null只测通用层，mpegts写临时文件包含封装与文件IO
+void benchMuxer(BenchReport& report, const char* format, int videoPackets)
+{
+    QString path;
+    if (strcmp(format, "null") != 0) {
+        path = QDir::temp().filePath(QString("pushbench-%1.%2").arg(QCoreApplication::applicationPid())
+                                         .arg(format));
+    }
+    AVFormatContext* ctx = openSink(format, path);
+    if (!ctx) {
+        return;
+    }
+    const QVector<ScheduledPacket> packets = schedule(videoPackets);
+    const qint64 total = packets.size();
+    qint64 bytes = 0;
+    BenchTimer timer;
+    for (const ScheduledPacket& p : packets) {
+        AVPacket* pkt = makeScheduledPacket(p);
+        bytes += pkt->size;
+        AVRational codecTb = p.video ? AVRational{1, VIDEO_FPS} : AVRational{1, AUDIO_RATE};
+        av_packet_rescale_ts(pkt, codecTb, ctx->streams[pkt->stream_index]->time_base);
+        av_interleaved_write_frame(ctx, pkt);
+        av_packet_free(&pkt);
+    }
+    closeSink(ctx);
+    double ns = timer.elapsedNs();
+    if (!path.isEmpty()) {
+        QFile::remove(path);
+    }
+
+    report.add("queue", QString("mux_%1").arg(format), {{"packets", total}, {"sink", path.isEmpty() ? "null" : "file"}},
+               {{"ns_per_packet", ns / total}, {"mb_per_s", bytes / (ns / 1e9) / 1e6}});
+}
+} // namespace
+
+void runQueueBench(BenchReport& report)
+{
+    const int packets = report.quick() ? 10000 : 1000000;
+    const int videoPackets = report.quick() ? 300 : 9000;  // 10秒/5分钟的推流
+    benchPacketQueue(report, packets);
+    benchInterleaver(report, videoPackets);
+    benchMuxer(report, "null", videoPackets);
+    benchMuxer(report, "mpegts", videoPackets);
+}
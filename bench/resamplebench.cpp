@@ -0,0 +1,89 @@
+﻿#include "benchcases.h"
+#include "audioresampler.h"
+#include "audiodsp.h"
+#include <QVector>
+#include <chrono>
+
+extern "C" {
+#include <libswresample/swresample.h>
+}
+
+namespace
+{
+struct ResampleCase {
+    int inRate;
+    int outRate;
+};
+
+const int BENCH_SECONDS = 10;       // 每组处理的音频时长
+const int CHUNK_MS = 10;            // 与采集分片相当的输入块
+
+// 返回每个输出采样每通道的耗时(ns)，失败返回负数
+double measure(const ResampleCase& c, int channels, bool allowSoxr, int seconds, QString* engine)
+{
+    SwrContext* swr = AudioResampler::createContext(c.inRate, channels, AV_SAMPLE_FMT_S16,
+                                                    c.outRate, channels, AV_SAMPLE_FMT_FLTP,
+                                                    engine, allowSoxr);
+    if (!swr) {
+        return -1.0;
+    }
+
+    int chunkSamples = c.inRate * CHUNK_MS / 1000;
+    QVector<int16_t> input(chunkSamples * channels);
+    uint32_t seed = 1;
+    AudioDsp::fillComfortNoiseS16(input.data(), input.size(), 0.5f, &seed);
+
+    int outCap = swr_get_out_samples(swr, chunkSamples) + 64;
+    QVector<QVector<float>> planes(channels, QVector<float>(outCap));
+    QVector<uint8_t*> outPtrs(channels);
+    for (int ch = 0; ch < channels; ++ch) {
+        outPtrs[ch] = reinterpret_cast<uint8_t*>(planes[ch].data());
+    }
+    const uint8_t* inPtr = reinterpret_cast<const uint8_t*>(input.constData());
+
+    int chunks = seconds * 1000 / CHUNK_MS;
+    qint64 outSamples = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int i = 0; i < chunks; ++i) {
+        int got = swr_convert(swr, outPtrs.data(), outCap, &inPtr, chunkSamples);
+        if (got > 0) {
+            outSamples += got;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    swr_free(&swr);
+
+    double ns = std::chrono::duration<double, std::nano>(end - begin).count();
+    return outSamples > 0 ? ns / (double(outSamples) * channels) : -1.0;
+}
+} // namespace
+
+void runResampleBench(BenchReport& report)
+{
+    const ResampleCase cases[] = {
+        {44100, 48000},
+        {48000, 44100},
+        {16000, 48000},
+        {48000, 48000},     // 仅格式转换
+    };
+
+    for (const ResampleCase& c : cases) {
+        for (int channels = 1; channels <= 2; ++channels) {
+            for (int soxr = 0; soxr <= 1; ++soxr) {
+                QString engine;
+                double nsPerSample = measure(c, channels, soxr != 0, report.quick() ? 1 : BENCH_SECONDS,
+                                             &engine);
+                if (nsPerSample < 0 || (soxr && engine != "soxr")) {
+                    continue;   // 未编译soxr或同采样率时不重复测量
+                }
+                // 实时处理单通道所占单核CPU比例
+                double cpuPercent = nsPerSample * c.outRate / 1e9 * 100.0;
+                QJsonObject params{{"engine", engine}, {"in_rate", c.inRate}, {"out_rate", c.outRate},
+                                   {"channels", channels}};
+                report.add("resample", QString("%1_%2_%3_%4ch").arg(engine).arg(c.inRate)
+                                           .arg(c.outRate).arg(channels),
+                           params, {{"ns_per_sample_ch", nsPerSample}, {"cpu_percent_ch", cpuPercent}});
+            }
+        }
+    }
+}
@@ -0,0 +1,81 @@
+﻿#include "benchcases.h"
+#include "benchinput.h"
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+namespace
+{
+struct ScaleCase {
+    int srcW, srcH;
+    int dstW, dstH;
+};
+
+struct ScaleFlag {
+    int flags;
+    const char* name;
+};
+} // namespace
+
+void runScaleBench(BenchReport& report)
+{
+    const ScaleCase cases[] = {
+        {1920, 1080, 1920, 1080},
+        {1920, 1080, 1280, 720},
+        {1280, 720, 1280, 720},
+        {2560, 1440, 1920, 1080},
+    };
+    // SWS_BICUBIC为推流编码线程当前所用
+    const ScaleFlag flags[] = {
+        {SWS_BICUBIC, "bicubic"},
+        {SWS_BILINEAR, "bilinear"},
+        {SWS_FAST_BILINEAR, "fast_bilinear"},
+        {SWS_POINT, "point"},
+    };
+    const int frames = report.quick() ? 20 : 300;
+
+    for (const ScaleCase& c : cases) {
+        AVFrame* src = BenchInput::allocBgraFrame(c.srcW, c.srcH);
+        AVFrame* dst = av_frame_alloc();
+        dst->format = AV_PIX_FMT_YUV420P;
+        dst->width = c.dstW;
+        dst->height = c.dstH;
+        if (!src || av_frame_get_buffer(dst, 32) < 0) {
+            av_frame_free(&src);
+            av_frame_free(&dst);
+            continue;
+        }
+
+        for (const ScaleFlag& f : flags) {
+            SwsContext* sws = sws_getContext(c.srcW, c.srcH, AV_PIX_FMT_BGRA,
+                                             c.dstW, c.dstH, AV_PIX_FMT_YUV420P,
+                                             f.flags, nullptr, nullptr, nullptr);
+            if (!sws) {
+                continue;
+            }
+            // 预热一帧，排除首帧建表开销
+            sws_scale(sws, src->data, src->linesize, 0, c.srcH, dst->data, dst->linesize);
+
+            BenchTimer timer;
+            for (int i = 0; i < frames; ++i) {
+                sws_scale(sws, src->data, src->linesize, 0, c.srcH, dst->data, dst->linesize);
+            }
+            double nsPerFrame = timer.elapsedNs() / frames;
+            sws_freeContext(sws);
+
+            QJsonObject params{{"src", QString("%1x%2").arg(c.srcW).arg(c.srcH)},
+                               {"dst", QString("%1x%2").arg(c.dstW).arg(c.dstH)},
+                               {"src_fmt", "bgra"}, {"dst_fmt", "yuv420p"}, {"algorithm", f.name},
+                               {"frames", frames}};
+            report.add("scale", QString("bgra_%1x%2_to_yuv420p_%3x%4_%5")
+                                    .arg(c.srcW).arg(c.srcH).arg(c.dstW).arg(c.dstH).arg(f.name),
+                       params, {{"ns_per_frame", nsPerFrame},
+                                {"fps", 1e9 / nsPerFrame},
+                                {"mpix_per_s", double(c.srcW) * c.srcH / nsPerFrame * 1e3}});
+        }
+        av_frame_free(&src);
+        av_frame_free(&dst);
+    }
+}
@@ -1,8 +1,15 @@
 ﻿// CodeThread.cpp
 #include "codethread.h"
+#include <QtConcurrent>
 #include <memory>
 #include "Logger.h"
-
+#include "audioencoder.h"
+#include "frametrace.h"
+#include "latencysei.h"
+#include "outputformat.h"
+#include "streampushthread.h"
+#include "threadtuning.h"
+#include "videosource.h"
 
 
 CodeThread::CodeThread(QObject* parent)
@@ -10,14 +17,16 @@ CodeThread::CodeThread(QObject* parent)
 {
     avformat_network_init();//初始化网络
     avdevice_register_all();//初始化ffmpeg
-#ifdef  Q_OS_WIN
-    mInputFormat = av_find_input_format("gdigrab");//获取GDI屏幕录制设备
-#else
-    mInputFormat = av_find_input_format("x11grab");//获取X11屏幕录制设备
-#endif
-    if(!mInputFormat){
-        LogErr<< "【编码器】无法打开屏幕录制设备";
-    }
+    m_writer = new StreamPushThread(this);
+    connect(m_writer, &StreamPushThread::errorOccurred, this, &CodeThread::error);
+    connect(m_writer, &StreamPushThread::keyFrameRequested, this, [this] {
+        m_forceKeyFrame = true;
+    }, Qt::DirectConnection);
+}
+
+void CodeThread::setReconnect(bool enabled, int maxBackoffMs)
+{
+    m_writer->setReconnect(enabled, 500, maxBackoffMs);
 }
 
 CodeThread::~CodeThread()
@@ -33,31 +42,79 @@ void CodeThread::setDestinationUrl(const QString &url)
     inferOutputFormat();
 }
 
+void CodeThread::setAudioCodec(AudioCodecType codec, int opusFrameMs, bool opusDtx)
+{
+    m_audioCodec = codec;
+    m_opusFrameMs = opusFrameMs;
+    m_opusDtx = opusDtx;
+}
+
+int CodeThread::audioSampleRate() const
+{
+    // 配置的采样率保持不变，编码器不支持时（如Opus）按编码器采样率采集
+    return AudioEncoder::encoderSampleRate(m_audioCodec, m_audioSampleRate);
+}
+
 void CodeThread::stop()
 {
+    int64_t expected = 0;
+    m_stopRequestUs.compare_exchange_strong(expected, av_gettime_relative());
     QMutexLocker locker(&mMutex);
-    mRunning = false;
-    emit stateChanged(PushState::end);
+    {
+        QMutexLocker pauseLocker(&m_pauseMutex);
+        mRunning = false;
+        m_resumed.wakeAll();
+    }
+    // 冲刷编码器与写文件尾还在本线程上进行，end由RTSPPusher在停止完成后发出
+}
+
+void CodeThread::abortOutput()
+{
+    m_writer->abortOutput();
+}
+
+void CodeThread::pause()
+{
+    m_paused = true;
+}
+
+void CodeThread::resume()
+{
+    QMutexLocker locker(&m_pauseMutex);
+    m_paused = false;
+    m_resumed.wakeAll();
 }
 
 void CodeThread::run()
 {
+    // 采集、编码、复用在同一线程，按视频采集阶段调优，保证抓屏节拍
+    ThreadTuning::StageScope tuning(PipelineStage::videoCapture);
     cleanup();  // 确保停止后资源释放
     mRunning = true;
+    m_stopRequestUs = 0;
+    m_paused = false;
     mErrorCount = 0;
 
-    if (!initializeSource()) {
+    // 采集设备的打开放到线程池，与编码器初始化、RTSP握手并行，缩短首包时间
+    int64_t initBeginUs = av_gettime_relative();
+    QFuture<bool> sourceReady = QtConcurrent::run([this] { return initializeSource(); });
+    bool destinationReady = initializeDestination();
+    if (!sourceReady.result()) {
         emit error("【编码器】初始化当前源地址失败");
         emit stateChanged(PushState::error);
         return;
     }
 
-    if (!initializeDestination()) {
+    if (!destinationReady) {
         emit error("【编码器】初始化目的地址失败");
         emit stateChanged(PushState::error);
         return;
     }
 
+    LogInfo << "【编码器】源与目标初始化耗时" << (av_gettime_relative() - initBeginUs) / 1000 << "ms";
+    m_writer->setStatsCounters(m_stats);
+    m_writer->setMetrics(m_metrics);
+    m_writer->startPushing();
     emit stateChanged(PushState::play);
 
     // 分配帧缓冲
@@ -95,7 +152,7 @@ void CodeThread::run()
 
     // 创建图像转换上下文
     SwsContext* swsCtx = sws_getContext(
-        mSrcVideoWidth, mSrcVideoHeight, mSrcVideoCodecCtx->pix_fmt,
+        mSrcVideoWidth, mSrcVideoHeight, mVideoSource->pixelFormat(),
         mDstVideoWidth, mDstVideoHeight, mDstVideoCodecCtx->pix_fmt,
         SWS_BICUBIC, nullptr, nullptr, nullptr
         );
@@ -103,6 +160,10 @@ void CodeThread::run()
     qint64 frameCount = 0;
 
     while (mRunning) {
+        if (m_paused) {
+            waitWhilePaused(dstFrame);
+            continue;
+        }
         // 处理音视频同步
         synchronizeFrames();
 
@@ -117,77 +178,60 @@ void CodeThread::run()
         }
     }
 
-    avformat_close_input(&mSrcFmtCtx);
+    // 出错退出时没有stop()请求，从此刻开始计停止预算
+    int64_t expected = 0;
+    bool selfStopped = m_stopRequestUs.compare_exchange_strong(expected, av_gettime_relative());
+    int64_t stopBeginUs = m_stopRequestUs;
+    auto remainingMs = [this, stopBeginUs] {
+        return int(qMax<int64_t>(0, m_stopTimeoutMs - (av_gettime_relative() - stopBeginUs) / 1000));
+    };
+    {
+        // 之后到达的音频帧不再入队；音频编码在调用方线程，持锁冲刷
+        QMutexLocker locker(&mMutex);
+        mRunning = false;
+        flushEncoder(m_audioCodecCtx, m_audioIndex, false);
+    }
+    flushEncoder(mDstVideoCodecCtx, mDstVideoIndex, true);
+    // 一半预算发完队列，剩余的全部留给文件尾；预算用完时不写文件尾直接关闭
+    m_writer->drain(remainingMs() / 2);
+    m_writer->stopPushing();
+    m_writer->closeOutput(remainingMs());
+    m_writer->setFmtCtx(nullptr);
+    LogInfo << "【编码器】停止耗时" << (av_gettime_relative() - stopBeginUs) / 1000 << "ms";
+    mVideoSource->close();
+    if (const FrameClock* clock = mVideoSource->frameClock()) {
+        LogInfo << "【编码器】帧时钟: tick" << clock->ticks() << "错过截止" << clock->missedDeadlines()
+                << "跳过" << clock->skippedTicks() << "最大抖动" << clock->maxLatenessUs() << "us";
+    }
     avformat_close_input(&mDstFmtCtx);
     // 清理
     av_frame_free(&srcFrame);
     av_frame_free(&dstFrame);
     sws_freeContext(swsCtx);
 
-    emit stateChanged(PushState::end);
+    if (selfStopped) {
+        emit stateChanged(PushState::end);      // 请求停止时由RTSPPusher::finishStop发出
+    }
 }
 
 bool CodeThread::initializeSource()
 {
     emit stateChanged(PushState::decode);
-    mSrcFmtCtx = avformat_alloc_context(); // 初始化输入上下文
-    if (!mSrcFmtCtx) {
-        handleFFmpegError(-1,"无法分配输入上下文内存");
-        return false;
-    }
-
-    AVDictionary* fmt_options = NULL; // 初始化输入上下文字典参数
-    av_dict_set(&fmt_options, "framerate", QString::number(mDstVideoFps).toStdString().c_str(), 0);
-    av_dict_set(&fmt_options, "draw_mouse", "1", 0);
-    av_dict_set(&fmt_options, "video_size",
-                QString("%1x%2").arg(mDstVideoWidth).arg(mDstVideoHeight).toStdString().c_str(), 0);
-
-    // 打开输入封装上下文
-    int ret = avformat_open_input(&mSrcFmtCtx, mSrcUrl.toLocal8Bit().data(), mInputFormat, &fmt_options);
-    if (!handleFFmpegError(ret, "打开输入源")) {
-        return false;
-    }
-
-    // 获取流信息
-    ret = avformat_find_stream_info(mSrcFmtCtx, NULL);
-    if (!handleFFmpegError(ret, "获取流信息")) {
-        return false;
-    }
-
-    // 查找最佳视频流
-    mSrcVideoIndex = av_find_best_stream(mSrcFmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
-    if (!handleFFmpegError(mSrcVideoIndex, "查找视频流")) {
-        return false;
-    }
-
-    mSrcVideoStream = mSrcFmtCtx->streams[mSrcVideoIndex];
-    AVCodec* codec = avcodec_find_decoder(mSrcVideoStream->codecpar->codec_id);
-    if (!codec) {
-        handleFFmpegError(-1,"找不到合适的解码器");
-        return false;
-    }
-
-    // 创建解码器上下文
-    mSrcVideoCodecCtx = avcodec_alloc_context3(codec);
-    if (!mSrcVideoCodecCtx) {
-        handleFFmpegError(-1,"无法分配解码器上下文内存");
-        return false;
-    }
-
-    // 复制编解码器参数
-    ret = avcodec_parameters_to_context(mSrcVideoCodecCtx, mSrcVideoStream->codecpar);
-    if (!handleFFmpegError(ret, "复制编解码器参数")) {
+    VideoSourceConfig config = VideoSourceConfig::fromUrl(mSrcUrl, mDstVideoWidth, mDstVideoHeight, mDstVideoFps);
+    config.replayStartUs = m_replayStartUs;
+    mVideoSource = VideoSource::create(config);
+    mVideoSource->setRecorder(m_recorder);
+    mVideoSource->setMetrics(m_metrics, m_stats);
+
+    QString errMsg;
+    if (!mVideoSource->open(&errMsg)) {
+        handleFFmpegError(-1, errMsg);
         return false;
     }
 
-    // 打开解码器
-    ret = avcodec_open2(mSrcVideoCodecCtx, codec, nullptr);
-    if (!handleFFmpegError(ret, "打开解码器")) {
-        return false;
-    }
-
-    mSrcVideoWidth = mSrcVideoCodecCtx->width;
-    mSrcVideoHeight = mSrcVideoCodecCtx->height;
+    mSrcVideoWidth = mVideoSource->width();
+    mSrcVideoHeight = mVideoSource->height();
+    LogInfo << "【编码器】视频源:" << mVideoSource->description();
 
     return true;
 }
@@ -200,10 +244,19 @@ bool CodeThread::initializeDestination()
     }
 
     // 创建输出上下文
-    int ret = avformat_alloc_output_context2(&mDstFmtCtx, NULL, "rtsp", mDstUrl.toLocal8Bit().data());
-    if (!handleFFmpegError(ret, "创建输出上下文")) {
+    int ret = avformat_alloc_output_context2(&mDstFmtCtx, NULL, mOutputFormat.toUtf8().data(),
+                                             mDstUrl.toLocal8Bit().data());
+    if (!handleFFmpegError(ret, "创建" + mOutputFormat + "输出上下文")) {
+        return false;
+    }
+    QString muxErr;
+    if (!OutputFormat::canMux(mDstFmtCtx->oformat, m_audioCodec == AudioCodecType::opus ? AV_CODEC_ID_OPUS
+                                                                                          : AV_CODEC_ID_AAC, &muxErr)) {
+        emit error("【编码器】" + muxErr);   // 不是FFmpeg调用失败，不附带错误码
         return false;
     }
+    // 安装I/O截止时刻回调，握手与每次写出都限时
+    m_writer->setFmtCtx(mDstFmtCtx);
 
     AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_H264);
     if (!codec) {
@@ -259,6 +312,7 @@ bool CodeThread::initializeDestination()
     // 基础预设
     av_dict_set(&codec_options, "preset", "superfast", 0);
     av_dict_set(&codec_options, "tune", "zerolatency", 0);
+    av_dict_set(&codec_options, "forced-idr", "1", 0);  // 重连后请求的关键帧编码为IDR
 
     // 根据不同的比特率控制模式设置参数
     if (mRateControl == "cbr") {
@@ -288,8 +342,11 @@ bool CodeThread::initializeDestination()
                     QString::number(mMinBitrate).toStdString().c_str(), 0);
     }
 
-    // 打开编码器
-    ret = avcodec_open2(mDstVideoCodecCtx, codec, &codec_options);
+    // 打开编码器，x264工作线程继承打开时的亲和性，按编码阶段绑核
+    {
+        ThreadTuning::ScopedStageAffinity affinity(PipelineStage::videoEncode);
+        ret = avcodec_open2(mDstVideoCodecCtx, codec, &codec_options);
+    }
     if (!handleFFmpegError(ret, "打开编码器")) {
         av_dict_free(&codec_options);
         return false;
@@ -314,39 +371,21 @@ bool CodeThread::initializeDestination()
         return false;
     }
 
-    // 初始化音频编码器
-    const AVCodec* audioCodec = avcodec_find_encoder(AV_CODEC_ID_AAC);
-    if (!audioCodec) {
-        handleFFmpegError(-1, "找不到AAC编码器");
-        return false;
-    }
-
-    m_audioCodecCtx = avcodec_alloc_context3(audioCodec);
+    // 初始化音频编码器（AAC或Opus），Opus的RTP时钟固定为48kHz，采样率不被支持时改用48kHz
+    int audioSampleRate = this->audioSampleRate();
+    AudioEncoderParam audioParam;
+    audioParam.codec = m_audioCodec;
+    audioParam.sampleRate = audioSampleRate;
+    audioParam.channels = m_audioChannels;
+    audioParam.opusFrameMs = m_opusFrameMs;
+    audioParam.opusDtx = m_opusDtx;
+    QString audioErr;
+    m_audioCodecCtx = AudioEncoder::open(audioParam, m_audioSampleFmt, &audioErr);
     if (!m_audioCodecCtx) {
-        handleFFmpegError(-1, "无法分配音频编码器上下文");
-        return false;
-    }
-
-    // 设置音频编码器参数
-    m_audioCodecCtx->codec_type = AVMEDIA_TYPE_AUDIO;
-    m_audioCodecCtx->codec_id = AV_CODEC_ID_AAC;
-    m_audioCodecCtx->sample_rate = m_audioSampleRate;
-    m_audioCodecCtx->channel_layout = av_get_default_channel_layout(m_audioChannels);
-    m_audioCodecCtx->channels = m_audioChannels;
-    m_audioCodecCtx->sample_fmt = m_audioSampleFmt;
-    m_audioCodecCtx->bit_rate = 64000; // 64kbps
-    m_audioCodecCtx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-    m_audioCodecCtx->time_base = {1,m_audioSampleRate};
-
-    AVDictionary* opts = nullptr;
-    av_dict_set(&opts, "strict", "experimental", 0);
-
-    if (avcodec_open2(m_audioCodecCtx, audioCodec, &opts) < 0) {
-        handleFFmpegError(-1, "无法打开音频编码器");
-        av_dict_free(&opts);
+        handleFFmpegError(-1, audioErr);
         return false;
     }
-    av_dict_free(&opts);
+    const AVCodec* audioCodec = m_audioCodecCtx->codec;
 
     // 创建音频流
     m_audioStream = avformat_new_stream(mDstFmtCtx, audioCodec);
@@ -354,35 +393,42 @@ bool CodeThread::initializeDestination()
         handleFFmpegError(-1, "无法创建音频流");
         return false;
     }
-    m_audioStream->time_base = {1,m_audioSampleRate};
+    m_audioStream->time_base = {1, audioSampleRate};
 
     m_audioIndex = m_audioStream->index;
     // 复制编码器参数到音频流
     avcodec_parameters_from_context(m_audioStream->codecpar, m_audioCodecCtx);
 
-    // 设置RTSP选项
+    // 复用器选项：RTSP使用TCP传输并限时握手，其余格式按OutputFormat设置
     AVDictionary* format_options = nullptr;
-    av_dict_set(&format_options, "rtsp_transport", "tcp", 0);
-    av_dict_set(&format_options, "stimeout", "3000000", 0);
-    av_dict_set(&format_options, "rw_timeout", "3000000", 0);
-
-
-
-    // 打开输出URL
-    if (!(mDstFmtCtx->oformat->flags & AVFMT_NOFILE)) {
-        ret = avio_open(&mDstFmtCtx->pb, mDstUrl.toLocal8Bit().data(), AVIO_FLAG_WRITE);
-        if (!handleFFmpegError(ret, "打开输出URL")) {
-            return false;
-        }
+    if (mOutputFormat == "rtsp") {
+        av_dict_set(&format_options, "rtsp_transport", "tcp", 0);
+        av_dict_set(&format_options, "stimeout", "3000000", 0);
+        av_dict_set(&format_options, "rw_timeout", "3000000", 0);
+    } else {
+        OutputFormat::muxerOptions(mOutputFormat, m_outputOptions, &format_options);
+    }
+
+    // 打开输出URL（RTSP等自带IO的格式跳过），重连时沿用同样的协议选项
+    AVDictionary* io_options = nullptr;
+    OutputFormat::ioOptions(mDstUrl, m_outputOptions, &io_options);
+    ret = m_writer->openIo(&io_options);
+    av_dict_free(&io_options);
+    if (!handleFFmpegError(ret, "打开输出URL")) {
+        av_dict_free(&format_options);
+        return false;
     }
 
     // 写入文件头
-    ret = avformat_write_header(mDstFmtCtx, &format_options);
+    ret = m_writer->writeHeader(&format_options);
     if (!handleFFmpegError(ret, "写入文件头")) {
         av_dict_free(&format_options);
         return false;
     }
     av_dict_free(&format_options);
+    // 入队的包保持编码器时间基，由写出线程换算到流时间基
+    m_writer->setStreamTimeBase(mDstVideoIndex, mDstVideoCodecCtx->time_base);
+    m_writer->setStreamTimeBase(m_audioIndex, m_audioCodecCtx->time_base);
     av_dump_format(mDstFmtCtx, 0, mDstUrl.toLocal8Bit().data(), 1);
 
     emit audioContextReady(mDstFmtCtx, m_audioCodecCtx, m_audioStream);
@@ -422,6 +468,15 @@ void CodeThread::encodeAudioFrame(AVFrame* frame) {
         // 更新当前音频帧PTS
         m_audioBasePts = frame->pts;
     }
+    // 暂停时音频照常采集，上面已推进音频时间轴，只是不编码
+    if (m_paused) {
+        av_frame_free(&frame);
+        return;
+    }
+    // 音频处理器附带的采集时刻（帧首个采样），用于采集到写出的延迟统计
+    const FrameTrace::FrameStamps* stamps = FrameTrace::stamps(frame);
+    int64_t captureUs = stamps ? stamps->readEndUs : -1;
+    int64_t encodeBeginUs = FrameTrace::enabled() ? FrameTrace::nowUs() : -1;
     int ret = avcodec_send_frame(m_audioCodecCtx, frame);
     av_frame_free(&frame);
 
@@ -446,14 +501,23 @@ void CodeThread::encodeAudioFrame(AVFrame* frame) {
         }
 
         pkt.stream_index = m_audioIndex;
-        av_packet_rescale_ts(&pkt, m_audioCodecCtx->time_base, m_audioStream->time_base);
-
-        if (av_interleaved_write_frame(mDstFmtCtx, &pkt) < 0) {
-            handleFFmpegError(-1, "写入音频数据包失败");
+        int64_t frameId = pkt.pts;      // 编码器时间基下的pts作为帧追踪标识
+        int64_t encodeEndUs = FrameTrace::nowUs();
+        if (encodeBeginUs >= 0) {
+            FrameTrace::record("encode", FrameTrace::Stream::audio, frameId, encodeBeginUs, encodeEndUs);
+        }
+        if (m_stats) {
+            m_stats->addEncodedFrame(StatsStream::audio, pkt.size, false);
         }
-        LogDebug << "写入音频数据包，pts"<<m_audioBasePts;
 
-        av_packet_unref(&pkt);
+        // 写出、写出统计与audioToWire由写出线程记录
+        PacketTiming timing;
+        timing.captureUs = captureUs;
+        timing.encodeEndUs = encodeEndUs;
+        AVPacket* queued = av_packet_alloc();
+        av_packet_move_ref(queued, &pkt);
+        m_writer->addPacket(queued, false, timing);
+        LogDebug << "写入音频数据包，pts"<<m_audioBasePts;
     }
     QMutexLocker waitLocker(&m_syncWaitMutex);
     m_syncWaitCond.wakeAll();  // 唤醒所有等待视频同步的线程
@@ -466,43 +530,9 @@ bool CodeThread::inferOutputFormat()
         return false;
     }
 
-    QUrl url(mDstUrl);
-    QString scheme = url.scheme().toLower();
-    QString path = url.path().toLower();
-
-    // 根据URL scheme设置输出格式
-    // 重要修改：对RTSP进行特殊处理
-    if (scheme == "rtsp") {
-        mOutputFormat = "rtsp";
-        return true;
-    }
-    else if (scheme == "rtmp" || scheme == "rtmps") {
-        mOutputFormat = "rtmp";
-    }
-    else if (scheme == "udp" || scheme == "rtp") {
-        mOutputFormat = "mpegts";
-    }
-    else {
-        // 根据文件扩展名设置输出格式
-        QFileInfo fileInfo(path);
-        QString ext = fileInfo.suffix().toLower();
-
-        if (ext == "mp4") {
-            mOutputFormat = "mp4";
-        }
-        else if (ext == "flv") {
-            mOutputFormat = "flv";
-        }
-        else if (ext == "ts") {
-            mOutputFormat = "mpegts";
-        }
-        else if (ext == "mkv") {
-            mOutputFormat = "matroska";
-        }
-        else {
-            // 默认使用 MP4 格式
-            mOutputFormat = "mp4";        }
-    }
+    // 根据URL scheme（其次为文件扩展名）选择复用格式
+    mOutputFormat = OutputFormat::muxerForUrl(mDstUrl);
+    LogInfo << "【编码器】输出格式:" << mOutputFormat;
     return true;
 }
 
@@ -536,161 +566,245 @@ AVFormatContext *CodeThread::dstFmtCtx() const
 
 bool CodeThread::processNextFrame(AVFrame* srcFrame, AVFrame* dstFrame, SwsContext* swsCtx)
 {
-    AVPacket packet;
-    av_init_packet(&packet);
-
-    int ret = av_read_frame(mSrcFmtCtx, &packet);
+    // 各阶段时间戳，帧PTS确定后统一记录
+    bool tracing = FrameTrace::enabled();
+    FrameTrace::FrameStamps stamps;
+    int ret = mVideoSource->read(srcFrame, &stamps);
+    if (ret == AVERROR(EAGAIN)) {
+        return true;
+    }
+    if (ret == AVERROR_EOF) {
+        LogInfo << "【编码器】视频源已结束，停止推流";
+        mRunning = false;
+        return true;
+    }
     if (!handleFFmpegError(ret, "读取视频帧")) {
         return false;
     }
+    int64_t readEndUs = stamps.readEndUs;     // 采集完成，延迟指标同样使用
 
-    if (packet.stream_index == mSrcVideoIndex) {
-
-        // 发送数据包到解码器
-        ret = avcodec_send_packet(mSrcVideoCodecCtx, &packet);
-        if (!handleFFmpegError(ret, "发送数据包到解码器")) {
-            av_packet_unref(&packet);
-            return false;
-        }
+    // 图像格式转换
+    ret = sws_scale(swsCtx,
+                    srcFrame->data, srcFrame->linesize, 0, srcFrame->height,
+                    dstFrame->data, dstFrame->linesize);
+    if (ret < 0) {
+        handleFFmpegError(-1,"图像格式转换失败");
+        return false;
+    }
+    int64_t scaleEndUs = tracing ? FrameTrace::nowUs() : -1;
 
-        // 从解码器接收解码后的帧
-        ret = avcodec_receive_frame(mSrcVideoCodecCtx, srcFrame);
-        if (!handleFFmpegError(ret, "从解码器接收帧")) {
-            av_packet_unref(&packet);
-            return false;
-        }
+    QMutexLocker locker(&m_syncMutex);
 
-        // 图像格式转换
-        ret = sws_scale(swsCtx,
-                        srcFrame->data, srcFrame->linesize, 0, mSrcVideoHeight,
-                        dstFrame->data, dstFrame->linesize);
-        if (ret < 0) {
-            handleFFmpegError(-1,"图像格式转换失败");
-            av_packet_unref(&packet);
-            return false;
+    // 如果还在等待第一个音频帧
+    if (m_waitingForFirstAudioFrame) {
+        // 记录开始等待时间
+        if (m_startWaitTime == 0) {
+            m_startWaitTime = av_gettime();
+            LogInfo << "【同步】开始等待第一个音频帧：" << m_startWaitTime;
         }
 
-        QMutexLocker locker(&m_syncMutex);
-
-        // 如果还在等待第一个音频帧
-        if (m_waitingForFirstAudioFrame) {
-            // 记录开始等待时间
-            if (m_startWaitTime == 0) {
-                m_startWaitTime = av_gettime();
-                LogInfo << "【同步】开始等待第一个音频帧：" << m_startWaitTime;
+        // 检查是否超时
+        int64_t currentTime = av_gettime();
+        if (currentTime - m_startWaitTime > MAX_WAIT_TIME_US) {
+            LogWarn << "【同步】等待音频帧超时，继续处理视频帧 ,"<<currentTime;
+            m_waitingForFirstAudioFrame = false;
+            m_syncInitialized = false; // 不使用音视频同步
+            // 重置视频帧计数器
+            m_videoFrameCount = 0;
+            m_firstVideoPts = 0;
+        } else {
+            // 继续等待，丢弃当前视频帧
+            LogDebug << "【同步】等待第一个音频帧，丢弃视频帧";
+            if (m_stats) {
+                m_stats->addDrop(DropReason::syncWaitAudio);
             }
-
-            // 检查是否超时
-            int64_t currentTime = av_gettime();
-            if (currentTime - m_startWaitTime > MAX_WAIT_TIME_US) {
-                LogWarn << "【同步】等待音频帧超时，继续处理视频帧 ,"<<currentTime;
-                m_waitingForFirstAudioFrame = false;
-                m_syncInitialized = false; // 不使用音视频同步
-                // 重置视频帧计数器
-                m_videoFrameCount = 0;
-                m_firstVideoPts = 0;
-            } else {
-                // 继续等待，丢弃当前视频帧
-                LogDebug << "【同步】等待第一个音频帧，丢弃视频帧";
-                av_packet_unref(&packet);
 //                msleep(10); // 短暂等待
-                return true;
-            }
-        }
-
-        // 重要修改：使用实际编码的帧数作为PTS
-        int64_t currentVideoPts = m_videoFrameCount++;
-
-        // 记录第一个视频帧的PTS（应该总是0）
-        if (m_firstVideoPts == AV_NOPTS_VALUE) {
-            m_firstVideoPts = 0;
-            LogInfo << "【同步】记录第一个视频帧 PTS:" << m_firstVideoPts;
+            return true;
         }
+    }
 
-        if (m_syncInitialized) {
-            // 视频/音频相对时间（以微秒为单位）
-            int64_t videoPtsUs = av_rescale_q(currentVideoPts - m_firstVideoPts,
-                                              {1, mDstVideoFps}, {1, AV_TIME_BASE});
-            int64_t audioPtsUs = av_rescale_q(m_audioBasePts - m_firstAudioPts,
-                                              {1, m_audioSampleRate}, {1, AV_TIME_BASE});
-            int64_t diffUs = videoPtsUs - audioPtsUs;
-            int waitMs = qMin((int)(diffUs / 1000), 20);
-            // 超前：视频太快
-            if (waitMs > SYNC_THRESHOLD_MS) {
-                if (waitMs > SYNC_MAX_WAIT_MS) {
-                    LogWarn << QString("【同步】视频帧超前 %1us，超过最大等待时间，丢弃").arg(diffUs);
-                    av_packet_unref(&packet);
+    // 重要修改：使用实际编码的帧数作为PTS
+    int64_t currentVideoPts = m_videoFrameCount++;
+
+    // 记录第一个视频帧的PTS（应该总是0）
+    if (m_firstVideoPts == AV_NOPTS_VALUE) {
+        m_firstVideoPts = 0;
+        LogInfo << "【同步】记录第一个视频帧 PTS:" << m_firstVideoPts;
+    }
+
+    if (m_syncInitialized) {
+        // 视频/音频相对时间（以微秒为单位）
+        int64_t videoPtsUs = av_rescale_q(currentVideoPts - m_firstVideoPts,
+                                          {1, mDstVideoFps}, {1, AV_TIME_BASE});
+        int64_t audioPtsUs = av_rescale_q(m_audioBasePts - m_firstAudioPts,
+                                          {1, m_audioCodecCtx->sample_rate}, {1, AV_TIME_BASE});
+        int64_t diffUs = videoPtsUs - audioPtsUs;
+        int waitMs = qMin((int)(diffUs / 1000), 20);
+        // 超前：视频太快
+        if (waitMs > SYNC_THRESHOLD_MS) {
+            if (waitMs > SYNC_MAX_WAIT_MS) {
+                LogWarn << QString("【同步】视频帧超前 %1us，超过最大等待时间，丢弃").arg(diffUs);
+                if (m_stats) {
+                    m_stats->addDrop(DropReason::syncAhead);
+                }
                     return true; // 丢帧
-                } else {
-                    LogDebug << QString("【同步】视频帧超前 %1us，等待音频追上").arg(diffUs);
+            } else {
+                LogDebug << QString("【同步】视频帧超前 %1us，等待音频追上").arg(diffUs);
 //                    msleep(diffUs / 1000); // sleep（但上限已经限制）
-                    QMutexLocker waitLocker(&m_syncWaitMutex);
-                    m_syncWaitCond.wait(&m_syncWaitMutex, waitMs);
-                }
+                QMutexLocker waitLocker(&m_syncWaitMutex);
+                m_syncWaitCond.wait(&m_syncWaitMutex, waitMs);
             }
+        }
 
-            // 滞后：视频太慢
-            if (waitMs < -SYNC_THRESHOLD_MS) {
-                LogWarn << QString("【同步】视频帧滞后 %1us，丢弃").arg(-diffUs);
-                av_packet_unref(&packet);
-                return true;
+        // 滞后：视频太慢
+        if (waitMs < -SYNC_THRESHOLD_MS) {
+            LogWarn << QString("【同步】视频帧滞后 %1us，丢弃").arg(-diffUs);
+            if (m_stats) {
+                m_stats->addDrop(DropReason::syncBehind);
             }
+            return true;
         }
+    }
+
+    // 只有真正要编码的帧才设置PTS并递增计数器
+    dstFrame->pts = currentVideoPts;
+    if (tracing) {
+        FrameTrace::record("capture", FrameTrace::Stream::video, currentVideoPts, stamps.readBeginUs, readEndUs);
+        FrameTrace::record("decode", FrameTrace::Stream::video, currentVideoPts, readEndUs, stamps.decodeEndUs);
+        FrameTrace::record("scale", FrameTrace::Stream::video, currentVideoPts, stamps.decodeEndUs, scaleEndUs);
+        // 转换结束到送入编码器之间为音视频同步等待
+        FrameTrace::record("sync_wait", FrameTrace::Stream::video, currentVideoPts, scaleEndUs,
+                           FrameTrace::nowUs());
+    }
+    return encodeVideoFrame(dstFrame, readEndUs);
+}
+
+bool CodeThread::encodeVideoFrame(AVFrame* frame, int64_t captureUs)
+{
+    bool tracing = FrameTrace::enabled();
+    int64_t encodeBeginUs = FrameTrace::nowUs();
+    if (m_metrics && captureUs >= 0) {
+        m_metrics->record(LatencyMetric::captureToEncode, encodeBeginUs - captureUs);
+    }
+
+    // 发送帧到编码器，dstFrame每帧复用，需显式复位帧类型
+    frame->pict_type = m_forceKeyFrame.exchange(false) ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+    int ret = avcodec_send_frame(mDstVideoCodecCtx, frame);
+    if (!handleFFmpegError(ret, "发送帧到编码器")) {
+        return false;
+    }
 
-        // 只有真正要编码的帧才设置PTS并递增计数器
-        dstFrame->pts = currentVideoPts;
+    while (ret >= 0) {
+        AVPacket outPacket;
+        av_init_packet(&outPacket);
+        outPacket.data = nullptr;
+        outPacket.size = 0;
 
-        // 发送帧到编码器
-        ret = avcodec_send_frame(mDstVideoCodecCtx, dstFrame);
-        if (!handleFFmpegError(ret, "发送帧到编码器")) {
-            av_packet_unref(&packet);
+        ret = avcodec_receive_packet(mDstVideoCodecCtx, &outPacket);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+            av_packet_unref(&outPacket);
+            break;
+        }
+        if (!handleFFmpegError(ret, "从编码器接收数据包")) {
+            av_packet_unref(&outPacket);
             return false;
         }
 
-        while (ret >= 0) {
-            AVPacket outPacket;
-            av_init_packet(&outPacket);
-            outPacket.data = nullptr;
-            outPacket.size = 0;
+        outPacket.stream_index = mDstVideoStream->index;
+        int64_t frameId = outPacket.pts;
+        int64_t encodeEndUs = FrameTrace::nowUs();
+        if (tracing) {
+            FrameTrace::record("encode", FrameTrace::Stream::video, frameId, encodeBeginUs, encodeEndUs);
+        }
+        if (m_metrics) {
+            m_metrics->record(LatencyMetric::encodeDuration, encodeEndUs - encodeBeginUs);
+        }
+        if (m_latencySei) {
+            LatencySei::Payload sei;
+            sei.captureWallUs = LatencySei::toWallClock(captureUs >= 0 ? captureUs : encodeBeginUs);
+            sei.sequence = m_seiSequence++;
+            LatencySei::insert(&outPacket, sei);
+        }
 
-            ret = avcodec_receive_packet(mDstVideoCodecCtx, &outPacket);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                av_packet_unref(&outPacket);
-                break;
-            }
-            if (!handleFFmpegError(ret, "从编码器接收数据包")) {
-                av_packet_unref(&outPacket);
-                av_packet_unref(&packet);
-                return false;
-            }
+        if (m_stats) {
+            m_stats->addEncodedFrame(StatsStream::video, outPacket.size, outPacket.flags & AV_PKT_FLAG_KEY);
+        }
 
-            outPacket.stream_index = mDstVideoStream->index;
-
-            // 转换时间戳
-            outPacket.pts = av_rescale_q(outPacket.pts,
-                                         mDstVideoCodecCtx->time_base,
-                                         mDstVideoStream->time_base);
-            outPacket.dts = av_rescale_q(outPacket.dts,
-                                         mDstVideoCodecCtx->time_base,
-                                         mDstVideoStream->time_base);
-            outPacket.duration = av_rescale_q(outPacket.duration,
-                                              mDstVideoCodecCtx->time_base,
-                                              mDstVideoStream->time_base);
-
-            // 写入数据包
-            ret = av_interleaved_write_frame(mDstFmtCtx, &outPacket);
-            if (!handleFFmpegError(ret, "写入数据包")) {
-                av_packet_unref(&outPacket);
-                av_packet_unref(&packet);
-                return false;
-            }
+        // 交给写出线程（时间戳换算、写出统计与encodeToWire在写出时记录），队列满时由其丢包
+        PacketTiming timing;
+        timing.captureUs = captureUs;
+        timing.encodeEndUs = encodeEndUs;
+        AVPacket* queued = av_packet_alloc();
+        av_packet_move_ref(queued, &outPacket);
+        m_writer->addPacket(queued, true, timing);
+    }
 
-            av_packet_unref(&outPacket);
+    return true;
+}
+
+void CodeThread::waitWhilePaused(AVFrame* dstFrame)
+{
+    LogInfo << "【编码器】已暂停";
+    int64_t pauseBeginUs = av_gettime_relative();
+    int64_t pausePts;
+    {
+        QMutexLocker locker(&m_syncMutex);
+        pausePts = m_videoFrameCount;
+    }
+    bool hasFrame = pausePts > 0;     // 尚未编码过任何帧时dstFrame里没有画面
+    while (mRunning && m_paused) {
+        {
+            QMutexLocker locker(&m_pauseMutex);
+            if (mRunning && m_paused) {
+                m_resumed.wait(&m_pauseMutex, FILLER_INTERVAL_MS);
+            }
         }
+        // 填充帧与恢复后的第一帧按暂停以来的墙钟时长推进pts，与照常采集的音频时间轴保持一致
+        bool filler = mRunning && m_paused && hasFrame;
+        {
+            QMutexLocker locker(&m_syncMutex);
+            int64_t elapsed = av_rescale_q(av_gettime_relative() - pauseBeginUs, {1, 1000000}, {1, mDstVideoFps});
+            m_videoFrameCount = qMax(m_videoFrameCount, pausePts + elapsed);
+            if (filler) {
+                dstFrame->pts = m_videoFrameCount++;
+            }
+        }
+        if (filler) {
+            encodeVideoFrame(dstFrame, -1);
+        }
+    }
+    if (!mRunning) {
+        return;
     }
+    // 帧时钟从恢复时刻重新计时，不把暂停计为错过的tick；下一帧编码为IDR
+    mVideoSource->restartClock();
+    m_forceKeyFrame = true;
+    LogInfo << "【编码器】已恢复，暂停" << (av_gettime_relative() - pauseBeginUs) / 1000 << "ms";
+}
 
-    av_packet_unref(&packet);
-    return true;
+void CodeThread::flushEncoder(AVCodecContext* codecCtx, int streamIndex, bool isVideo)
+{
+    if (!codecCtx || avcodec_send_frame(codecCtx, nullptr) < 0) {
+        return;
+    }
+    int flushed = 0;
+    AVPacket* pkt = av_packet_alloc();
+    while (avcodec_receive_packet(codecCtx, pkt) >= 0) {
+        pkt->stream_index = streamIndex;
+        if (m_stats) {
+            m_stats->addEncodedFrame(isVideo ? StatsStream::video : StatsStream::audio, pkt->size,
+                                     isVideo && (pkt->flags & AV_PKT_FLAG_KEY));
+        }
+        PacketTiming timing;
+        timing.encodeEndUs = FrameTrace::nowUs();
+        m_writer->addPacket(pkt, isVideo, timing);
+        pkt = av_packet_alloc();
+        ++flushed;
+    }
+    av_packet_free(&pkt);
+    if (flushed > 0) {
+        LogInfo << "【编码器】" << (isVideo ? "视频" : "音频") << "编码器冲刷出" << flushed << "个包";
+    }
 }
 
 void CodeThread::synchronizeFrames() {
@@ -710,20 +824,16 @@ void CodeThread::onAudioTimestampUpdated(int64_t audioPts) {
 }
 
 void CodeThread::cleanup() {
-    if (mSrcVideoCodecCtx) {
-        avcodec_flush_buffers(mSrcVideoCodecCtx);  // 刷新解码器缓冲区
-        avcodec_free_context(&mSrcVideoCodecCtx);
-        mSrcVideoCodecCtx = nullptr;
-    }
+    m_writer->stopPushing();
+    m_writer->closeOutput();
+    m_writer->setFmtCtx(nullptr);
+    delete mVideoSource;
+    mVideoSource = nullptr;
     if (mDstVideoCodecCtx) {
         avcodec_flush_buffers(mDstVideoCodecCtx);  // 刷新编码器缓冲区
         avcodec_free_context(&mDstVideoCodecCtx);
         mDstVideoCodecCtx = nullptr;
     }
-    if (mSrcFmtCtx) {
-        avformat_close_input(&mSrcFmtCtx);
-        mSrcFmtCtx = nullptr;
-    }
     if (mDstFmtCtx) {
         if (mDstFmtCtx->pb) {
             avio_closep(&mDstFmtCtx->pb);
@@ -9,7 +9,14 @@
 #include <QQueue>
 #include <QFileInfo>
 #include "DataStruct.h"
+#include "pushstats.h"
+#include "pushmetrics.h"
 #include <QWaitCondition>
+#include <atomic>
+
+class VideoSource;
+class CaptureFileWriter;
+class StreamPushThread;
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -32,6 +39,7 @@ public:
     ~CodeThread();
 
     // 配置方法
+    // 源地址格式见VideoSourceConfig::fromUrl（屏幕、测试图、原始文件、媒体文件）
     void setSourceUrl(const QString& url) { mSrcUrl = url; }
     void setDestinationUrl(const QString& url);
     void setVideoSize(int width, int height) {
@@ -46,6 +54,30 @@ public:
     }
     void setFramerate(int fps) { mDstVideoFps = fps; }
     void setRateControl(const QString& mode) { mRateControl = mode; }
+    // 音频编码：AAC或Opus（Opus支持10/20ms帧长与DTX）
+    void setAudioCodec(AudioCodecType codec, int opusFrameMs = 20, bool opusDtx = false);
+    int audioSampleRate() const;
+    // 统计计数器由推流器持有，需在start之前设置
+    void setStatsCounters(PushStatsCounters* stats) { m_stats = stats; }
+    void setMetrics(PushMetrics* metrics) { m_metrics = metrics; }
+    // 每帧插入携带采集时刻与序号的SEI，用于接收端测量端到端延迟
+    void setLatencySei(bool enabled) { m_latencySei = enabled; }
+    // 录制视频源输出的原始帧，writer由推流器持有，需在start之前设置
+    void setCaptureRecorder(CaptureFileWriter* recorder) { m_recorder = recorder; }
+    // 回放源的时间零点（av_gettime_relative()时刻），与音频回放取同一个值，需在start之前设置
+    void setReplayStart(int64_t startUs) { m_replayStartUs = startUs; }
+    // 输出断线后自动重连（默认开启），编码不停，恢复时插入IDR；需在start之前设置
+    void setReconnect(bool enabled, int maxBackoffMs = 30000);
+    // 非RTSP目的地址的TS打包、PCR/PAT间隔与SRT延迟，需在start之前设置
+    void setOutputOptions(const OutputOptions& options) { m_outputOptions = options; }
+    // 暂停时不再读取视频源，每FILLER_INTERVAL_MS重编码一次最后一帧维持会话，音频照常采集但不编码；
+    // 恢复时帧时钟重新计时、下一帧编码为IDR，时间戳按墙钟跨过暂停时长。可在任意线程调用
+    void pause();
+    void resume();
+    // 停止的总预算：从stop()起计，先冲刷编码器并发完队列（约一半预算），剩余时间用于写文件尾
+    void setStopTimeout(int ms) { m_stopTimeoutMs = ms; }
+    // 立即中止进行中的网络IO（写出、写文件尾），停止超时时由推流器调用，可在任意线程调用
+    void abortOutput();
 
     AVFormatContext *dstFmtCtx() const;
 
@@ -74,6 +106,12 @@ private:
     bool initializeDestination();
     bool setupEncoderContext();
     bool processNextFrame(AVFrame* srcFrame, AVFrame* dstFrame, SwsContext* swsCtx);
+    // 送入编码器并把输出包交给写出线程，captureUs为-1表示填充帧
+    bool encodeVideoFrame(AVFrame* frame, int64_t captureUs);
+    // 暂停期间在采集线程内等待恢复并发送填充帧，dstFrame保留着最后一帧转换结果
+    void waitWhilePaused(AVFrame* dstFrame);
+    // 送入空帧取出编码器缓存的剩余包（x264 lookahead、音频尾帧）交给写出线程
+    void flushEncoder(AVCodecContext* codecCtx, int streamIndex, bool isVideo);
     void cleanup();
     bool inferOutputFormat();
     bool handleFFmpegError(int errorCode, const QString& operation);    // 统一的错误处理函数
@@ -83,15 +121,16 @@ private:
     QString mSrcUrl;
     QString mDstUrl;
     volatile bool mRunning = false;
+    std::atomic<int64_t> m_stopRequestUs{0};    // stop()被调用的时刻，0为尚未请求停止
+    int m_stopTimeoutMs = 2000;
     QMutex mMutex;
 
     // FFmpeg上下文
-    AVInputFormat* mInputFormat = nullptr;
-    AVFormatContext* mSrcFmtCtx = nullptr;
+    VideoSource* mVideoSource = nullptr;
+    // 音视频包都交给写出线程，网络阻塞不影响采集与编码
+    StreamPushThread* m_writer = nullptr;
     AVFormatContext* mDstFmtCtx = nullptr;
-    AVCodecContext* mSrcVideoCodecCtx = nullptr;
     AVCodecContext* mDstVideoCodecCtx = nullptr;
-    AVStream* mSrcVideoStream = nullptr;
     AVStream* mDstVideoStream = nullptr;
 
     // 添加音频编码相关成员
@@ -103,9 +142,11 @@ private:
     int m_audioSampleRate = 44100;
     int m_audioChannels = 2;
     AVSampleFormat m_audioSampleFmt = AV_SAMPLE_FMT_FLTP;
+    AudioCodecType m_audioCodec = AudioCodecType::aac;
+    int m_opusFrameMs = 20;
+    bool m_opusDtx = false;
 
     // 默认视频参数
-    int mSrcVideoIndex = -1;
     int mDstVideoIndex = -1;
     int mSrcVideoWidth = 2560;
     int mSrcVideoHeight = 1600;
@@ -124,6 +165,19 @@ private:
     static const int MAX_ERROR_COUNT = 5;
 
     QString mOutputFormat;
+    OutputOptions m_outputOptions;
+
+    PushStatsCounters* m_stats = nullptr;
+    PushMetrics* m_metrics = nullptr;
+    bool m_latencySei = false;
+    uint32_t m_seiSequence = 0;
+    std::atomic<bool> m_forceKeyFrame{false};   // 写出线程重连后请求IDR
+    std::atomic<bool> m_paused{false};
+    QMutex m_pauseMutex;
+    QWaitCondition m_resumed;
+    static const int FILLER_INTERVAL_MS = 500;
+    CaptureFileWriter* m_recorder = nullptr;
+    int64_t m_replayStartUs = -1;
 
     // 添加音视频同步相关
     int64_t m_audioBasePts = 0;          // 音频基准PTS
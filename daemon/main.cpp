@@ -0,0 +1,38 @@
+﻿// 无界面推流入口：只依赖QCoreApplication，不加载widgets，用于服务器/容器部署
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <cstdio>
+#include "Logger.h"
+#include "pushconfig.h"
+#include "pushdaemon.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("pushd");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless PushStreamDemo: capture, encode and push without a GUI.");
+    parser.addHelpOption();
+    PushConfig::addOptions(&parser);
+    parser.process(a);
+
+    PushConfig config;
+    QString errMsg;
+    if (!config.load(parser, &errMsg)) {
+        std::fprintf(stderr, "pushd: %s\n", errMsg.toLocal8Bit().constData());
+        return 2;
+    }
+
+    QString logPath = config.logDir.isEmpty() ? QCoreApplication::applicationDirPath() + "/Log" : config.logDir;
+    Logger::initLog(logPath, 1024*15, true);
+
+    if (!PushDaemon::installSignalHandlers()) {
+        LogWarn << "【守护进程】安装信号处理失败，只能强制结束";
+    }
+    PushDaemon daemon(config);
+    if (!daemon.start()) {
+        return 1;
+    }
+    return a.exec();
+}
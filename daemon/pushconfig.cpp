@@ -0,0 +1,261 @@
+﻿// PushConfig.cpp
+#include "pushconfig.h"
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QMap>
+#include <QSettings>
+
+namespace
+{
+struct OptionSpec {
+    const char* name;
+    const char* valueName;      // 为空表示开关选项
+    const char* description;
+};
+
+const OptionSpec OPTIONS[] = {
+    {"pipeline", "name", "Push pipeline: sync (RTSPSyncPush) or legacy (RTSPPusher)."},
+    {"source", "url", "Video source: :0.0/desktop, testsrc2://, raw:///f?pix_fmt=, file:///f, replay:///f."},
+    {"url", "url", "Destination URL; comma separated URLs run one pooled session per destination (sync pipeline)."},
+    {"workers", "n", "Video worker threads for multiple destinations (0 = CPU count); audio encoding gets a quarter more (min 2); each session keeps its own output thread."},
+    {"tune-video-capture", "spec", "Video capture thread tuning, e.g. \"cpus=0-1 fifo=50\" or \"nice=-5\"."},
+    {"tune-audio-capture", "spec", "Audio capture thread tuning."},
+    {"tune-video-encode", "spec", "Video encode thread (and worker pool) tuning."},
+    {"tune-audio-encode", "spec", "Audio encode thread tuning."},
+    {"tune-push", "spec", "Mux/write thread tuning."},
+    {"isolate-encoder", nullptr, "Keep other stages off the video-encode CPUs."},
+    {"size", "WxH", "Video size."},
+    {"fps", "n", "Frame rate."},
+    {"bitrate", "kbps", "Video bitrate in kbit/s."},
+    {"audio-rate", "hz", "Audio sample rate."},
+    {"audio-channels", "n", "Audio channel count."},
+    {"audio-codec", "name", "aac or opus."},
+    {"opus-frame-ms", "ms", "Opus frame duration (10/20)."},
+    {"opus-dtx", nullptr, "Enable Opus DTX."},
+    {"audio-backend", "name", "qt, pulse, alsa or dshow."},
+    {"audio-device", "name", "Audio input device name."},
+    {"audio-mix", "devices", "Comma separated devices to mix (sync pipeline)."},
+    {"low-latency-ms", "ms", "Explicit capture buffer duration."},
+    {"silence", "mode", "Silence handling: off, skip or comfort-noise."},
+    {"silence-threshold-db", "db", "Silence threshold in dBFS."},
+    {"silence-hangover-ms", "ms", "Silence hangover."},
+    {"metrics-port", "port", "Serve Prometheus metrics on 127.0.0.1:port."},
+    {"metrics-socket", "name", "Also serve metrics on a local socket."},
+    {"latency-sei", nullptr, "Embed capture timestamp SEI."},
+    {"stats-interval", "ms", "Statistics log interval."},
+    {"reconnect-max-ms", "ms", "Maximum reconnect backoff after the output drops (0 = exit instead)."},
+    {"record", "path", "Record raw capture to a .pscap file (legacy pipeline)."},
+    {"record-lz4", nullptr, "LZ4 compress recorded frames."},
+    {"frame-shm", "name", "Publish video frames to a shared memory ring for local readers (sync pipeline)."},
+    {"frame-shm-source", "kind", "Frames to publish: converted (encoder YUV) or captured (raw capture)."},
+    {"frame-shm-slots", "n", "Frames kept in the shared memory ring (2-64)."},
+    {"packet-tap", "name", "Stream encoded packets to local readers on a Unix socket (sync pipeline)."},
+    {"ts-packet-size", "bytes", "Datagram size for MPEG-TS over udp/srt/rtp (multiple of 188)."},
+    {"ts-pcr-ms", "ms", "MPEG-TS PCR interval."},
+    {"ts-pat-ms", "ms", "MPEG-TS PAT/PMT repetition interval."},
+    {"srt-latency-ms", "ms", "SRT receiver latency (retransmission window)."},
+    {"trace", "path", "Enable frame tracing and write Chrome trace JSON on exit."},
+    {"log-dir", "dir", "Log directory."},
+    {"duration", "sec", "Stop after N seconds."},
+};
+
+bool parseBool(const QString& value)
+{
+    QString v = value.trimmed().toLower();
+    return v == "1" || v == "true" || v == "yes" || v == "on";
+}
+
+bool parseInt(const QMap<QString, QString>& values, const char* key, int minValue, int* out, QString* errMsg)
+{
+    if (!values.contains(key)) {
+        return true;
+    }
+    bool ok = false;
+    int v = values.value(key).toInt(&ok);
+    if (!ok || v < minValue) {
+        *errMsg = QString("invalid %1: %2").arg(key, values.value(key));
+        return false;
+    }
+    *out = v;
+    return true;
+}
+} // namespace
+
+void PushConfig::addOptions(QCommandLineParser* parser)
+{
+    parser->addOption(QCommandLineOption({"c", "config"}, "INI file with a [push] section.", "file"));
+    for (const OptionSpec& spec : OPTIONS) {
+        if (spec.valueName) {
+            parser->addOption(QCommandLineOption(spec.name, spec.description, spec.valueName));
+        } else {
+            parser->addOption(QCommandLineOption(spec.name, spec.description));
+        }
+    }
+}
+
+bool PushConfig::load(const QCommandLineParser& parser, QString* errMsg)
+{
+    QMap<QString, QString> values;
+    if (parser.isSet("config")) {
+        QString path = parser.value("config");
+        if (!QFileInfo(path).isFile()) {
+            *errMsg = QString("config file not found: %1").arg(path);
+            return false;
+        }
+        QSettings ini(path, QSettings::IniFormat);
+        ini.beginGroup("push");
+        for (const OptionSpec& spec : OPTIONS) {
+            if (ini.contains(spec.name)) {
+                // 逗号分隔的值会被QSettings读成列表
+                QVariant v = ini.value(spec.name);
+                values.insert(spec.name, v.type() == QVariant::StringList ? v.toStringList().join(',') : v.toString());
+            }
+        }
+        ini.endGroup();
+    }
+    for (const OptionSpec& spec : OPTIONS) {
+        if (parser.isSet(spec.name)) {
+            values.insert(spec.name, spec.valueName ? parser.value(spec.name) : QString("true"));
+        }
+    }
+
+    if (values.contains("pipeline")) {
+        pipeline = values.value("pipeline").toLower();
+        if (pipeline != "sync" && pipeline != "legacy") {
+            *errMsg = QString("invalid pipeline: %1").arg(pipeline);
+            return false;
+        }
+    }
+    source = values.value("source", source);
+    destination = values.value("url", destination);
+    if (values.contains("size")) {
+        QStringList wh = values.value("size").toLower().split('x');
+        width = wh.size() == 2 ? wh[0].toInt() : 0;
+        height = wh.size() == 2 ? wh[1].toInt() : 0;
+        if (width <= 0 || height <= 0 || width % 2 || height % 2) {
+            *errMsg = QString("invalid size: %1").arg(values.value("size"));
+            return false;
+        }
+    }
+    int lowLatencyMs = lowLatencyBufferMs;
+    int port = metricsPort;
+    if (!parseInt(values, "fps", 1, &fps, errMsg) ||
+        !parseInt(values, "bitrate", 1, &bitrateKbps, errMsg) ||
+        !parseInt(values, "audio-rate", 8000, &audioSampleRate, errMsg) ||
+        !parseInt(values, "audio-channels", 1, &audioChannels, errMsg) ||
+        !parseInt(values, "opus-frame-ms", 10, &opusFrameMs, errMsg) ||
+        !parseInt(values, "low-latency-ms", 0, &lowLatencyMs, errMsg) ||
+        !parseInt(values, "silence-hangover-ms", 0, &silenceHangoverMs, errMsg) ||
+        !parseInt(values, "metrics-port", 0, &port, errMsg) ||
+        !parseInt(values, "stats-interval", 100, &statsIntervalMs, errMsg) ||
+        !parseInt(values, "duration", 0, &durationSec, errMsg) ||
+        !parseInt(values, "workers", 0, &workerThreads, errMsg) ||
+        !parseInt(values, "reconnect-max-ms", 0, &reconnectMaxMs, errMsg) ||
+        !parseInt(values, "frame-shm-slots", 2, &frameShmSlots, errMsg) ||
+        !parseInt(values, "ts-packet-size", 188, &output.tsPacketSize, errMsg) ||
+        !parseInt(values, "ts-pcr-ms", 1, &output.pcrPeriodMs, errMsg) ||
+        !parseInt(values, "ts-pat-ms", 10, &output.patPeriodMs, errMsg) ||
+        !parseInt(values, "srt-latency-ms", 0, &output.srtLatencyMs, errMsg)) {
+        return false;
+    }
+    if (output.tsPacketSize % 188) {
+        *errMsg = QString("ts-packet-size must be a multiple of 188: %1").arg(output.tsPacketSize);
+        return false;
+    }
+    lowLatencyBufferMs = lowLatencyMs;
+    metricsPort = quint16(qBound(0, port, 65535));
+
+    if (values.contains("audio-codec")) {
+        QString codec = values.value("audio-codec").toLower();
+        if (codec != "aac" && codec != "opus") {
+            *errMsg = QString("invalid audio-codec: %1").arg(codec);
+            return false;
+        }
+        audioCodec = codec == "opus" ? AudioCodecType::opus : AudioCodecType::aac;
+    }
+    if (values.contains("audio-backend")) {
+        static const QMap<QString, AudioCaptureBackend> backends = {
+            {"qt", AudioCaptureBackend::qt}, {"pulse", AudioCaptureBackend::pulse},
+            {"alsa", AudioCaptureBackend::alsa}, {"dshow", AudioCaptureBackend::dshow}};
+        QString name = values.value("audio-backend").toLower();
+        if (!backends.contains(name)) {
+            *errMsg = QString("invalid audio-backend: %1").arg(name);
+            return false;
+        }
+        audioBackend = backends.value(name);
+    }
+    if (values.contains("silence")) {
+        static const QMap<QString, SilenceMode> modes = {
+            {"off", SilenceMode::off}, {"skip", SilenceMode::skip}, {"comfort-noise", SilenceMode::comfortNoise}};
+        QString name = values.value("silence").toLower();
+        if (!modes.contains(name)) {
+            *errMsg = QString("invalid silence mode: %1").arg(name);
+            return false;
+        }
+        silenceMode = modes.value(name);
+    }
+    if (values.contains("frame-shm-source")) {
+        QString kind = values.value("frame-shm-source").toLower();
+        if (kind != "converted" && kind != "captured") {
+            *errMsg = QString("invalid frame-shm-source: %1").arg(kind);
+            return false;
+        }
+        frameShmSource = kind == "captured" ? FrameShm::Source::captured : FrameShm::Source::converted;
+    }
+    if (values.contains("silence-threshold-db")) {
+        silenceThresholdDb = values.value("silence-threshold-db").toDouble();
+    }
+    opusDtx = values.contains("opus-dtx") ? parseBool(values.value("opus-dtx")) : opusDtx;
+    latencySei = values.contains("latency-sei") ? parseBool(values.value("latency-sei")) : latencySei;
+    recordLz4 = values.contains("record-lz4") ? parseBool(values.value("record-lz4")) : recordLz4;
+    isolateEncoder = values.contains("isolate-encoder") ? parseBool(values.value("isolate-encoder")) : isolateEncoder;
+    for (int i = 0; i < int(PipelineStage::count); ++i) {
+        QString key = QString("tune-%1").arg(ThreadTuning::stageName(PipelineStage(i)));
+        if (values.contains(key) && !ThreadTuning::parse(values.value(key), &stageTuning[i], errMsg)) {
+            return false;
+        }
+    }
+    audioDevice = values.value("audio-device", audioDevice);
+    if (values.contains("audio-mix")) {
+        audioMix = values.value("audio-mix").split(',', QString::SkipEmptyParts);
+    }
+    metricsSocket = values.value("metrics-socket", metricsSocket);
+    recordPath = values.value("record", recordPath);
+    frameShm = values.value("frame-shm", frameShm);
+    packetTap = values.value("packet-tap", packetTap);
+    tracePath = values.value("trace", tracePath);
+    logDir = values.value("log-dir", logDir);
+
+    if (destinations().isEmpty()) {
+        *errMsg = "destination url is required (--url or url= in [push])";
+        return false;
+    }
+    if (destinations().size() > 1 && pipeline != "sync") {
+        *errMsg = "multiple destinations require the sync pipeline";
+        return false;
+    }
+    return true;
+}
+
+QStringList PushConfig::destinations() const
+{
+    QStringList urls;
+    for (const QString& url : destination.split(',', QString::SkipEmptyParts)) {
+        if (!url.trimmed().isEmpty()) {
+            urls.append(url.trimmed());
+        }
+    }
+    return urls;
+}
+
+QString PushConfig::effectiveSource() const
+{
+    if (!source.isEmpty()) {
+        return source;
+    }
+#ifdef Q_OS_WIN
+    return "desktop";
+#else
+    return ":0.0";
+#endif
+}
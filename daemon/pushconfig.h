@@ -0,0 +1,63 @@
+﻿// PushConfig.h
+#ifndef PUSHCONFIG_H
+#define PUSHCONFIG_H
+
+#include <QString>
+#include <QStringList>
+#include "DataStruct.h"
+#include "frameshm.h"
+#include "threadtuning.h"
+
+class QCommandLineParser;
+
+// 无界面推流配置。INI文件的[push]分组与命令行长选项同名，命令行覆盖配置文件：
+//   pushd --config /etc/pushd.ini --url rtsp://host/live --bitrate 6000
+struct PushConfig {
+    QString pipeline = "sync";      // sync: RTSPSyncPush多线程流水线；legacy: RTSPPusher（CodeThread）
+    QString source;                 // 视频源地址，格式见VideoSourceConfig::fromUrl，为空时采集桌面
+    QString destination;            // 逗号分隔多个地址时每个地址一个会话，共用线程池（仅sync）
+    int width = 1920;
+    int height = 1080;
+    int fps = 30;
+    int bitrateKbps = 4000;
+
+    int audioSampleRate = 44100;
+    int audioChannels = 2;
+    AudioCodecType audioCodec = AudioCodecType::aac;
+    int opusFrameMs = 20;
+    bool opusDtx = false;
+    AudioCaptureBackend audioBackend = AudioCaptureBackend::qt;
+    QString audioDevice;
+    QStringList audioMix;           // 多于一路时启用混音（仅sync）
+    int lowLatencyBufferMs = 0;     // 0为使用设备默认缓冲
+    SilenceMode silenceMode = SilenceMode::off;
+    double silenceThresholdDb = -60.0;
+    int silenceHangoverMs = 300;
+
+    quint16 metricsPort = 0;        // 0为不开启指标端点
+    QString metricsSocket;
+    bool latencySei = false;
+    int statsIntervalMs = 1000;
+    QString recordPath;             // 采集录制（仅legacy）
+    bool recordLz4 = false;
+    QString frameShm;               // 非空时把视频帧发布到同名共享内存环（仅sync，多目标时只挂在第一个会话上）
+    FrameShm::Source frameShmSource = FrameShm::Source::converted;
+    int frameShmSlots = 4;
+    QString packetTap;              // 非空时在该本地套接字上分发编码包（仅sync，多目标时只挂在第一个会话上）
+    QString tracePath;              // 非空时全程开启逐帧追踪，退出时导出
+    QString logDir;
+    int durationSec = 0;            // 0为一直运行到收到SIGTERM/SIGINT
+    int workerThreads = 0;          // 多会话共享线程池的线程数，0为CPU核数
+    StageTuning stageTuning[int(PipelineStage::count)];    // 各阶段绑核与调度策略
+    bool isolateEncoder = false;
+    int reconnectMaxMs = 30000;     // 输出断线重连的最大退避，0为不重连（断线即退出）
+    OutputOptions output;           // udp/srt/rtp(MPEG-TS)与rtmp(FLV)输出参数，rtsp://不使用
+
+    static void addOptions(QCommandLineParser* parser);
+    // 依次读取--config指定的INI文件与命令行选项
+    bool load(const QCommandLineParser& parser, QString* errMsg);
+    QString effectiveSource() const;
+    QStringList destinations() const;
+};
+
+#endif // PUSHCONFIG_H
@@ -0,0 +1,106 @@
+# 无界面推流进程：与PushStreamDemo共用采集/编码/推流代码，不链接widgets
+QT       += core multimedia network concurrent
+QT       -= widgets
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = pushd
+
+INCLUDEPATH += $$PWD/../include \
+    $$PWD/../include/FFmpeg \
+    $$PWD/../LogDemo \
+    $$PWD/../Common \
+    $$PWD/../Push \
+    $$PWD/..
+
+SOURCES += \
+    ../Common/audiodsp.cpp \
+    ../Common/audioencoder.cpp \
+    ../Common/audioresampler.cpp \
+    ../Common/capturefile.cpp \
+    ../Common/frameclock.cpp \
+    ../Common/frameshm.cpp \
+    ../Common/frametrace.cpp \
+    ../Common/iodeadline.cpp \
+    ../Common/latencyhistogram.cpp \
+    ../Common/latencysei.cpp \
+    ../Common/metricsserver.cpp \
+    ../Common/outputformat.cpp \
+    ../Common/packettap.cpp \
+    ../Common/pushmetrics.cpp \
+    ../Common/pushstats.cpp \
+    ../Common/threadtuning.cpp \
+    ../Common/videosource.cpp \
+    ../Common/workerpool.cpp \
+    ../LogDemo/Logger.cpp \
+    ../Push/audiocapturethread.cpp \
+    ../Push/audiocodethread.cpp \
+    ../Push/audiomixerthread.cpp \
+    ../Push/ffaudiocapturethread.cpp \
+    ../Push/pushsessionmanager.cpp \
+    ../Push/rtspsyncpush.cpp \
+    ../Push/streampushthread.cpp \
+    ../Push/videocapturethread.cpp \
+    ../Push/videocodethread.cpp \
+    ../audioprocessor.cpp \
+    ../codethread.cpp \
+    ../rtsppusher.cpp \
+    main.cpp \
+    pushconfig.cpp \
+    pushdaemon.cpp
+
+HEADERS += \
+    ../Common/audiodsp.h \
+    ../Common/audioencoder.h \
+    ../Common/audioformat.h \
+    ../Common/audioresampler.h \
+    ../Common/capturefile.h \
+    ../Common/frameclock.h \
+    ../Common/frameshm.h \
+    ../Common/frametrace.h \
+    ../Common/iodeadline.h \
+    ../Common/latencyhistogram.h \
+    ../Common/latencysei.h \
+    ../Common/metricsserver.h \
+    ../Common/outputformat.h \
+    ../Common/packettap.h \
+    ../Common/pcmtimeline.h \
+    ../Common/pushmetrics.h \
+    ../Common/pushstats.h \
+    ../Common/threadtuning.h \
+    ../Common/videosource.h \
+    ../Common/workerpool.h \
+    ../DataStruct.h \
+    ../LogDemo/Logger.h \
+    ../LogDemo/LoggerTemplate.h \
+    ../Push/audiocapturethread.h \
+    ../Push/audiocodethread.h \
+    ../Push/audiomixerthread.h \
+    ../Push/ffaudiocapturethread.h \
+    ../Push/pushsessionmanager.h \
+    ../Push/rtspsyncpush.h \
+    ../Push/streampushthread.h \
+    ../Push/videocapturethread.h \
+    ../Push/videocodethread.h \
+    ../audioprocessor.h \
+    ../codethread.h \
+    ../rtsppusher.h \
+    pushconfig.h \
+    pushdaemon.h
+
+# msvc >= 2017  编译器使用utf-8编码
+msvc {
+    greaterThan(QMAKE_MSC_VER, 1900){
+        QMAKE_CFLAGS += /utf-8
+        QMAKE_CXXFLAGS += /utf-8
+    }
+}
+
+lz4 {
+    DEFINES += HAVE_LZ4
+    LIBS += -llz4
+}
+
+LIBS += -L$$PWD/../lib/FFmpeg/ -lavcodec -lavfilter -lavformat -lswscale -lavutil -lswresample -lavdevice
+unix:!macx: LIBS += -lrt
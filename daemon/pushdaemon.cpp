@@ -0,0 +1,302 @@
+﻿// PushDaemon.cpp
+#include "pushdaemon.h"
+#include <QCoreApplication>
+#include <QSocketNotifier>
+#include <QTimer>
+#include "Logger.h"
+#include "frametrace.h"
+#include "rtsppusher.h"
+#include "rtspsyncpush.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <csignal>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+PushDaemon* g_daemon = nullptr;
+
+#ifdef Q_OS_WIN
+BOOL WINAPI consoleHandler(DWORD type)
+{
+    if (type == CTRL_C_EVENT || type == CTRL_BREAK_EVENT || type == CTRL_CLOSE_EVENT) {
+        // 控制台回调运行在单独的线程，投递到主线程处理
+        if (g_daemon) {
+            QMetaObject::invokeMethod(g_daemon, "shutdown", Qt::QueuedConnection);
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+#else
+// 信号处理函数只写管道，实际停止在事件循环里完成
+int g_signalFds[2] = {-1, -1};
+volatile sig_atomic_t g_signalCount = 0;
+
+void signalHandler(int)
+{
+    if (++g_signalCount > 1) {
+        _exit(1);       // 停止卡住时再次Ctrl+C/SIGTERM强制退出
+    }
+    char c = 1;
+    ssize_t ret = ::write(g_signalFds[0], &c, sizeof(c));
+    Q_UNUSED(ret);
+}
+#endif
+} // namespace
+
+PushDaemon::PushDaemon(const PushConfig& config, QObject* parent)
+    : QObject(parent)
+    , m_config(config)
+{
+    g_daemon = this;
+#ifndef Q_OS_WIN
+    if (g_signalFds[1] >= 0) {
+        m_signalNotifier = new QSocketNotifier(g_signalFds[1], QSocketNotifier::Read, this);
+        connect(m_signalNotifier, &QSocketNotifier::activated, this, &PushDaemon::onSignal);
+    }
+#endif
+}
+
+PushDaemon::~PushDaemon()
+{
+    shutdown();
+    g_daemon = nullptr;
+}
+
+bool PushDaemon::installSignalHandlers()
+{
+#ifdef Q_OS_WIN
+    return SetConsoleCtrlHandler(consoleHandler, TRUE);
+#else
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, g_signalFds) != 0) {
+        return false;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signalHandler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    return sigaction(SIGTERM, &sa, nullptr) == 0 && sigaction(SIGINT, &sa, nullptr) == 0;
+#endif
+}
+
+bool PushDaemon::start()
+{
+    QString source = m_config.effectiveSource();
+    QStringList urls = m_config.destinations();
+    LogInfo << "【守护进程】流水线:" << m_config.pipeline << "源:" << source << "目标:" << urls.join(" ")
+            << QString("%1x%2@%3 %4kbps").arg(m_config.width).arg(m_config.height)
+                   .arg(m_config.fps).arg(m_config.bitrateKbps);
+    if (!m_config.tracePath.isEmpty()) {
+        FrameTrace::clear();
+        FrameTrace::setEnabled(true);
+    }
+    for (int i = 0; i < int(PipelineStage::count); ++i) {
+        ThreadTuning::setStage(PipelineStage(i), m_config.stageTuning[i]);
+    }
+    ThreadTuning::setEncoderIsolation(m_config.isolateEncoder);
+    if (m_config.durationSec > 0) {
+        QTimer::singleShot(m_config.durationSec * 1000, this, &PushDaemon::shutdown);
+    }
+    if (ThreadTuning::schedStatsAvailable() && m_config.statsIntervalMs > 0) {
+        for (int i = 0; i < int(PipelineStage::count); ++i) {
+            m_lastSched[i] = ThreadTuning::schedStats(PipelineStage(i));
+        }
+        m_schedTimer = new QTimer(this);
+        connect(m_schedTimer, &QTimer::timeout, this, &PushDaemon::onSchedSample);
+        m_schedTimer->start(qMax(100, m_config.statsIntervalMs));
+    }
+
+    bool lowLatency = m_config.lowLatencyBufferMs > 0;
+    if (m_config.pipeline == "legacy") {
+        if (m_config.audioMix.size() > 1 || m_config.audioBackend != AudioCaptureBackend::qt) {
+            LogWarn << "【守护进程】legacy流水线只支持Qt默认音频输入，忽略audio-mix/audio-backend";
+        }
+        if (!m_config.frameShm.isEmpty() || !m_config.packetTap.isEmpty()) {
+            LogWarn << "【守护进程】legacy流水线不支持本地分发，忽略frame-shm/packet-tap";
+        }
+        m_pusher = new RTSPPusher(this);
+        connect(m_pusher, &RTSPPusher::error, this, &PushDaemon::onError);
+        connect(m_pusher, &RTSPPusher::statistics, this, &PushDaemon::onStatistics);
+        m_pusher->setSource(source);
+        m_pusher->setDestination(urls.first());
+        m_pusher->setVideoSize(m_config.width, m_config.height);
+        m_pusher->setFrameRate(m_config.fps);
+        m_pusher->setBitRate(m_config.bitrateKbps);
+        m_pusher->setAudioCodec(m_config.audioCodec, m_config.opusFrameMs, m_config.opusDtx);
+        m_pusher->setSilenceDetection(m_config.silenceMode, m_config.silenceThresholdDb, m_config.silenceHangoverMs);
+        m_pusher->setLowLatencyCapture(lowLatency, lowLatency ? m_config.lowLatencyBufferMs : 10);
+        m_pusher->setLatencySei(m_config.latencySei);
+        m_pusher->setReconnect(m_config.reconnectMaxMs > 0, m_config.reconnectMaxMs);
+        m_pusher->setOutputOptions(m_config.output);
+        m_pusher->setStatisticsInterval(m_config.statsIntervalMs);
+        m_pusher->setCaptureRecording(m_config.recordPath, m_config.recordLz4);
+        if (m_config.metricsPort > 0 && !m_pusher->enableMetricsEndpoint(m_config.metricsPort, m_config.metricsSocket)) {
+            LogWarn << "【守护进程】指标端点监听失败:" << m_config.metricsPort;
+        }
+        if (!m_pusher->start()) {
+            LogErr << "【守护进程】启动推流失败:" << m_pusher->lastError();
+            return false;
+        }
+        return true;
+    }
+
+    if (!m_config.recordPath.isEmpty()) {
+        LogWarn << "【守护进程】sync流水线不支持采集录制，忽略record";
+    }
+    if (urls.size() == 1) {
+        m_syncPush = new RTSPSyncPush(this);
+        return startSyncSession(m_syncPush, urls.first(), true);
+    }
+
+    // 多个目标：每个目标一个会话，编码共用线程池；指标端点与本地分发只挂在第一个会话上
+    m_sessions = new PushSessionManager(m_config.workerThreads, this);
+    m_sessions->setCpuReportInterval(m_config.statsIntervalMs);
+    connect(m_sessions, &PushSessionManager::cpuReport, this, &PushDaemon::onCpuReport);
+    for (int i = 0; i < urls.size(); ++i) {
+        RTSPSyncPush* push = m_sessions->createSession(QString("session%1").arg(i));
+        if (!startSyncSession(push, urls[i], i == 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PushDaemon::startSyncSession(RTSPSyncPush* push, const QString& url, bool primary)
+{
+    bool lowLatency = m_config.lowLatencyBufferMs > 0;
+    connect(push, &RTSPSyncPush::error, this, &PushDaemon::onError);
+    connect(push, &RTSPSyncPush::statistics, this, &PushDaemon::onStatistics);
+    push->setAudioCodec(m_config.audioCodec, m_config.opusFrameMs, m_config.opusDtx);
+    push->setAudioCapture(m_config.audioBackend, m_config.audioDevice, lowLatency,
+                          lowLatency ? m_config.lowLatencyBufferMs : 10);
+    if (m_config.audioMix.size() > 1) {
+        QList<AudioMixerInput> inputs;
+        for (const QString& device : m_config.audioMix) {
+            AudioMixerInput input;
+            input.deviceName = device.trimmed();
+            inputs.append(input);
+        }
+        push->setAudioInputs(inputs);
+    }
+    push->setSilenceDetection(m_config.silenceMode, m_config.silenceThresholdDb, m_config.silenceHangoverMs);
+    push->setLatencySei(m_config.latencySei);
+    push->setReconnect(m_config.reconnectMaxMs > 0, m_config.reconnectMaxMs);
+    push->setOutputOptions(m_config.output);
+    push->setStatisticsInterval(m_config.statsIntervalMs);
+    if (primary && !m_config.frameShm.isEmpty() &&
+        !push->enableFrameShm(m_config.frameShm, m_config.frameShmSource, m_config.frameShmSlots)) {
+        return false;
+    }
+    if (primary && !m_config.packetTap.isEmpty() && !push->enablePacketTap(m_config.packetTap)) {
+        return false;
+    }
+    if (primary && m_config.metricsPort > 0 &&
+        !push->enableMetricsEndpoint(m_config.metricsPort, m_config.metricsSocket)) {
+        LogWarn << "【守护进程】指标端点监听失败:" << m_config.metricsPort;
+    }
+    if (!push->initialize(m_config.effectiveSource(), m_config.width, m_config.height, m_config.fps,
+                          m_config.bitrateKbps * 1000, m_config.audioSampleRate,
+                          m_config.audioChannels, url)) {
+        return false;
+    }
+    push->start();
+    return m_exitCode == 0;     // start失败时已通过error信号上报
+}
+
+void PushDaemon::shutdown()
+{
+    if (m_stopping) {
+        return;
+    }
+    m_stopping = true;
+    LogInfo << "【守护进程】停止推流";
+    if (m_syncPush) {
+        m_syncPush->stop();
+    }
+    if (m_sessions) {
+        m_sessions->stopAll();
+    }
+    if (m_pusher) {
+        m_pusher->stop();
+    }
+    if (!m_config.tracePath.isEmpty()) {
+        FrameTrace::setEnabled(false);
+        FrameTrace::dumpChromeTrace(m_config.tracePath);
+    }
+    QCoreApplication::exit(m_exitCode);
+}
+
+void PushDaemon::onSignal()
+{
+#ifndef Q_OS_WIN
+    char c;
+    ssize_t ret = ::read(g_signalFds[1], &c, sizeof(c));
+    Q_UNUSED(ret);
+#endif
+    LogInfo << "【守护进程】收到退出信号";
+    shutdown();
+}
+
+void PushDaemon::onStatistics(const PushStatistics& stats)
+{
+    // 多会话时各会话的统计都进入本槽，按会话名区分
+    QString session = sender() ? sender()->objectName() : QString();
+    QString prefix = session.isEmpty() ? QString() : session + " ";
+    LogInfo << QString("【推流统计】%1%2s 视频%3kbps 帧%4 关键帧%5 音频%6kbps 队列%7/%8 丢弃%9 音频超时%10")
+                   .arg(prefix).arg(stats.elapsedMs / 1000.0, 0, 'f', 1)
+                   .arg(stats.video.bitrate / 1000).arg(stats.video.framesEncoded).arg(stats.video.keyFrames)
+                   .arg(stats.audio.bitrate / 1000)
+                   .arg(stats.video.queueDepth).arg(stats.audio.queueDepth)
+                   .arg(stats.totalDrops()).arg(stats.audioDeadlineMisses);
+    if (stats.outputDown || stats.reconnectAttempts > 0) {
+        LogInfo << QString("【推流连接】%1%2 重连尝试%3 成功%4 累计断线%5s")
+                       .arg(prefix).arg(stats.outputDown ? "断线中" : "正常")
+                       .arg(stats.reconnectAttempts).arg(stats.reconnects)
+                       .arg(stats.downtimeMs / 1000.0, 0, 'f', 1);
+    }
+}
+
+void PushDaemon::onSchedSample()
+{
+    // 区间内每次被调度前在运行队列中的平均等待
+    QStringList stages;
+    for (int i = 0; i < int(PipelineStage::count); ++i) {
+        StageSchedStats cur = ThreadTuning::schedStats(PipelineStage(i));
+        qint64 slices = cur.timeslices - m_lastSched[i].timeslices;
+        if (cur.threads > 0 && slices > 0) {
+            stages << QString("%1=%2us").arg(ThreadTuning::stageName(PipelineStage(i)))
+                          .arg((cur.runQueueWaitUs - m_lastSched[i].runQueueWaitUs) / slices);
+        }
+        m_lastSched[i] = cur;
+    }
+    if (!stages.isEmpty()) {
+        LogInfo << "【调度延迟】" << stages.join(' ');
+    }
+}
+
+void PushDaemon::onCpuReport(const PushCpuReport& report)
+{
+    QStringList sessions;
+    for (const PushSessionCpu& cpu : report.sessions) {
+        sessions << QString("%1=%2%(%3ms)").arg(cpu.name).arg(cpu.cpuPercent, 0, 'f', 1)
+                        .arg(cpu.maxQueueWaitUs / 1000.0, 0, 'f', 1);
+    }
+    LogInfo << QString("【CPU】进程%1% 线程池%2%/%3线程 %4")
+                   .arg(report.processCpuPercent, 0, 'f', 1).arg(report.poolCpuPercent, 0, 'f', 1)
+                   .arg(report.workerThreads).arg(sessions.join(' '));
+}
+
+void PushDaemon::onError(const QString& message)
+{
+    LogErr << "【守护进程】推流出错:" << message;
+    m_exitCode = 1;
+    // 可能发生在事件循环启动之前，延后到事件循环里退出
+    QMetaObject::invokeMethod(this, "shutdown", Qt::QueuedConnection);
+}
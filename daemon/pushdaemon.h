@@ -0,0 +1,55 @@
+﻿// PushDaemon.h
+#ifndef PUSHDAEMON_H
+#define PUSHDAEMON_H
+
+#include <QObject>
+#include "pushconfig.h"
+#include "pushsessionmanager.h"
+#include "pushstats.h"
+
+class RTSPPusher;
+class RTSPSyncPush;
+class QSocketNotifier;
+class QTimer;
+
+// 无界面推流进程：按配置创建推流流水线，SIGTERM/SIGINT时停止推流（写trailer、输出最终统计）后退出事件循环。
+// 停止过程中再次收到信号则立即退出
+class PushDaemon : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PushDaemon(const PushConfig& config, QObject* parent = nullptr);
+    ~PushDaemon();
+
+    // 需在QCoreApplication创建之后、start之前调用
+    static bool installSignalHandlers();
+
+    bool start();
+
+public slots:
+    void shutdown();
+
+private slots:
+    void onSignal();
+    void onStatistics(const PushStatistics& stats);
+    void onError(const QString& message);
+    void onCpuReport(const PushCpuReport& report);
+    void onSchedSample();
+
+private:
+    // primary为第一个会话，指标端点、帧共享内存与包分发只挂在它上面
+    bool startSyncSession(RTSPSyncPush* push, const QString& url, bool primary);
+
+    PushConfig m_config;
+    RTSPSyncPush* m_syncPush = nullptr;
+    RTSPPusher* m_pusher = nullptr;
+    PushSessionManager* m_sessions = nullptr;
+    QSocketNotifier* m_signalNotifier = nullptr;
+    bool m_stopping = false;
+    int m_exitCode = 0;
+    // 调度统计是进程级累计值，由守护进程定时采样一次，不随各会话的统计信号重复做差
+    QTimer* m_schedTimer = nullptr;
+    StageSchedStats m_lastSched[int(PipelineStage::count)];    // 上次采样时的调度累计值
+};
+
+#endif // PUSHDAEMON_H
@@ -1,6 +1,7 @@
 ﻿#include "mainwindow.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QCoreApplication>
 #include "Logger.h"
 
@@ -9,7 +10,19 @@ int main(int argc, char *argv[])
     QApplication a(argc, argv);
     QString logPath = QCoreApplication::applicationDirPath() + "/Log";
     Logger::initLog(logPath, 1024*15, false);
+
+    // 指标端点默认关闭，避免每个桌面实例都占用端口
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption metricsPort("metrics-port", "Serve Prometheus metrics on 127.0.0.1:<port>.", "port");
+    parser.addOption(metricsPort);
+    parser.process(a);
+
     MainWindow w;
+    int port = parser.value(metricsPort).toInt();
+    if (port > 0 && port <= 65535) {
+        w.enableMetricsEndpoint(quint16(port));
+    }
     w.show();
     return a.exec();
 }
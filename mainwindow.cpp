@@ -3,6 +3,10 @@
 #include "rtsppusher.h"
 #include "Logger.h"
 #include "rtspsyncpush.h"
+#include "frametrace.h"
+#include <QShortcut>
+#include <QDateTime>
+#include <QCoreApplication>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -34,9 +38,18 @@ MainWindow::MainWindow(QWidget *parent)
     connect(m_rtspPusher,&RTSPSyncPush::error,this,[=](QString msg){
         LogErr << msg;
     });
+    // 异步停止期间按钮不可用，停止完成后才允许再次开始
+    connect(m_rtspPusher, &RTSPSyncPush::stopped, this, [=](qint64 elapsedMs) {
+        LogInfo << "停止推流耗时" << elapsedMs << "ms";
+        ui->btn_Push->setEnabled(true);
+    });
     connect(m_pushThread, &QThread::started, m_rtspPusher, &RTSPSyncPush::start);
     connect(m_pushThread, &QThread::finished, m_rtspPusher, &QThread::deleteLater);
 
+    // Ctrl+T开关逐帧追踪，关闭时导出trace JSON到日志目录
+    QShortcut* traceShortcut = new QShortcut(QKeySequence("Ctrl+T"), this);
+    connect(traceShortcut, &QShortcut::activated, this, &MainWindow::toggleFrameTrace);
+
 }
 
 MainWindow::~MainWindow()
@@ -44,6 +57,16 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+bool MainWindow::enableMetricsEndpoint(quint16 port)
+{
+    // 延迟分位与推流统计：curl http://127.0.0.1:<port>/metrics
+    if (!m_rtspPusher->enableMetricsEndpoint(port)) {
+        LogWarn << "指标端点监听失败:" << port;
+        return false;
+    }
+    return true;
+}
+
 
 void MainWindow::handlePusherStateChanged(const QString &objName, PushState state)
 {
@@ -62,7 +85,8 @@ void MainWindow::on_btn_Push_clicked()
     if(m_isPush){
         ui->btn_Push->setText("开始");
 //        m_pushThread->quit();
-        m_rtspPusher->stop();
+        m_rtspPusher->stopAsync();
+        ui->btn_Push->setEnabled(!m_rtspPusher->isStopping());    // 未在推流时不会发出stopped
 //        m_pusher->stop();
     }else{
         ui->btn_Push->setText("停止");
@@ -78,3 +102,15 @@ void MainWindow::on_btn_Push_clicked()
     m_isPush = !m_isPush;
 }
 
+void MainWindow::toggleFrameTrace()
+{
+    if (!FrameTrace::enabled()) {
+        FrameTrace::clear();
+        FrameTrace::setEnabled(true);
+        return;
+    }
+    FrameTrace::setEnabled(false);
+    QString path = QString("%1/Log/trace-%2.json").arg(QCoreApplication::applicationDirPath())
+                       .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+    FrameTrace::dumpChromeTrace(path);
+}
@@ -19,11 +19,14 @@ class MainWindow : public QMainWindow
 public:
     MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
+    // 本地Prometheus指标端点（127.0.0.1:port），由命令行--metrics-port开启
+    bool enableMetricsEndpoint(quint16 port);
 
 protected slots:
     void handlePusherStateChanged(const QString &objName, PushState state);
 private slots:
     void on_btn_Push_clicked();
+    void toggleFrameTrace();
 
 private:
     Ui::MainWindow *ui;
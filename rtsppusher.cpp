@@ -1,20 +1,40 @@
 ﻿// RTSPPusher.cpp
 #include "rtsppusher.h"
 #include "codethread.h"
-#include <QDateTime>
+#include <QTimer>
 #include "Logger.h"
 #include "audioprocessor.h"
+#include "frametrace.h"
+#include "metricsserver.h"
+#include "capturefile.h"
+#include "videosource.h"
+#include "threadtuning.h"
 
 RTSPPusher::RTSPPusher(QObject* parent)
     : QObject(parent)
     , mState(PushState::none)
 {
     qRegisterMetaType<PushState>("PushState");
+    qRegisterMetaType<PushStatistics>("PushStatistics");
+    qRegisterMetaType<LatencyReport>("LatencyReport");
+
+    m_statsTimer = new QTimer(this);
+    connect(m_statsTimer, &QTimer::timeout, this, &RTSPPusher::updateStatistics);
+
+    m_stopDeadlineTimer = new QTimer(this);
+    m_stopDeadlineTimer->setSingleShot(true);
+    connect(m_stopDeadlineTimer, &QTimer::timeout, this, [this] {
+        if (m_stopping && mPusherThread) {
+            LogWarn << "【RTSP推流器】停止超时，中止网络IO";
+            mPusherThread->abortOutput();
+        }
+    });
 }
 
 RTSPPusher::~RTSPPusher()
 {
     stop();
+    delete m_recorder;
 }
 
 void RTSPPusher::initNewThread() {
@@ -28,14 +48,27 @@ void RTSPPusher::initNewThread() {
     mPusherThread->setVideoSize(mWidth, mHeight);
     mPusherThread->setFramerate(mFrameRate);
     mPusherThread->setBitrate(mBitRate * 1000);  // 转换为bps
+    mPusherThread->setAudioCodec(m_audioCodec, m_opusFrameMs, m_opusDtx);
+    mPusherThread->setStatsCounters(&m_stats);
+    mPusherThread->setMetrics(&m_metrics);
+    mPusherThread->setLatencySei(m_latencySei);
+    mPusherThread->setReconnect(m_reconnect, m_reconnectMaxMs);
+    mPusherThread->setOutputOptions(m_outputOptions);
+    mPusherThread->setCaptureRecorder(m_recordPath.isEmpty() ? nullptr : m_recorder);
+    mPusherThread->setReplayStart(m_replayStartUs);
 
     // 连接信号槽
     connect(mPusherThread, &CodeThread::stateChanged,
             this, &RTSPPusher::handleThreadState);
     connect(mPusherThread, &CodeThread::error,
             this, &RTSPPusher::handleThreadError);
-    connect(mPusherThread, &CodeThread::frameProcessed,
-            this, &RTSPPusher::handleFrameProcessed);
+    // 异步停止时线程退出即完成停止；同步停止先于此完成时m_stopping已复位
+    CodeThread* thread = mPusherThread;
+    connect(mPusherThread, &QThread::finished, this, [this, thread] {
+        if (m_stopping && thread == mPusherThread) {
+            finishStop();
+        }
+    });
 }
 
 
@@ -51,7 +84,7 @@ void RTSPPusher::cleanupThread()
 
 void RTSPPusher::setSource(const QString& url)
 {
-    if (mState == PushState::play) {
+    if (pushing()) {
         LogErr<< "【RTSP推流器】无法在推流时设置源流地址";
         return;
     }
@@ -60,7 +93,7 @@ void RTSPPusher::setSource(const QString& url)
 
 void RTSPPusher::setDestination(const QString& url)
 {
-    if (mState == PushState::play) {
+    if (pushing()) {
         LogErr<< "【RTSP推流器】无法在推流时设置目标流地址";
         return;
     }
@@ -69,7 +102,7 @@ void RTSPPusher::setDestination(const QString& url)
 
 void RTSPPusher::setVideoSize(int width, int height)
 {
-    if (mState == PushState::play) {
+    if (pushing()) {
         LogErr<< "【RTSP推流器】无法在推流时设置推流分辨率";
         return;
     }
@@ -79,7 +112,7 @@ void RTSPPusher::setVideoSize(int width, int height)
 
 void RTSPPusher::setFrameRate(int fps)
 {
-    if (mState == PushState::play) {
+    if (pushing()) {
         LogErr<< "【RTSP推流器】无法在推流时设置帧率";
         return;
     }
@@ -88,16 +121,89 @@ void RTSPPusher::setFrameRate(int fps)
 
 void RTSPPusher::setBitRate(int kbps)
 {
-    if (mState == PushState::play) {
+    if (pushing()) {
         LogErr<< "【RTSP推流器】无法在推流时设置比特率";
         return;
     }
     mBitRate = kbps;
 }
 
+void RTSPPusher::setAudioCodec(AudioCodecType codec, int opusFrameMs, bool opusDtx)
+{
+    if (pushing()) {
+        LogErr<< "【RTSP推流器】无法在推流时设置音频编码";
+        return;
+    }
+    m_audioCodec = codec;
+    m_opusFrameMs = opusFrameMs;
+    m_opusDtx = opusDtx;
+}
+
+void RTSPPusher::setSilenceDetection(SilenceMode mode, double thresholdDb, int hangoverMs)
+{
+    m_silenceMode = mode;
+    m_silenceThresholdDb = thresholdDb;
+    m_silenceHangoverMs = hangoverMs;
+    if (m_audioProcessor) {
+        m_audioProcessor->setSilenceDetection(mode, thresholdDb, hangoverMs);
+    }
+}
+
+void RTSPPusher::setLowLatencyCapture(bool enabled, int bufferMs)
+{
+    if (pushing()) {
+        LogErr<< "【RTSP推流器】无法在推流时设置采集缓冲";
+        return;
+    }
+    m_audioLowLatency = enabled;
+    m_audioBufferMs = bufferMs;
+}
+
+void RTSPPusher::setLatencySei(bool enabled)
+{
+    if (pushing()) {
+        LogErr<< "【RTSP推流器】无法在推流时设置延迟SEI";
+        return;
+    }
+    m_latencySei = enabled;
+    if (enabled) {
+        FrameTrace::requireStamps();
+    }
+}
+
+void RTSPPusher::setReconnect(bool enabled, int maxBackoffMs)
+{
+    // 推流线程在start时创建，推流中修改下次start生效
+    m_reconnect = enabled;
+    m_reconnectMaxMs = maxBackoffMs;
+}
+
+void RTSPPusher::setOutputOptions(const OutputOptions& options)
+{
+    m_outputOptions = options;
+}
+
+void RTSPPusher::setCaptureRecording(const QString& path, bool compress)
+{
+    if (pushing()) {
+        LogErr<< "【RTSP推流器】无法在推流时设置采集录制";
+        return;
+    }
+    m_recordPath = path;
+    m_recordCompress = compress;
+}
+
+void RTSPPusher::setStatisticsInterval(int ms)
+{
+    m_statsIntervalMs = qMax(100, ms);
+    if (m_statsTimer->isActive()) {
+        m_statsTimer->start(m_statsIntervalMs);
+    }
+}
+
 bool RTSPPusher::start()
 {
-    if (mState == PushState::play) {
+    if (pushing() || m_stopping) {
         LogErr << "【RTSP推流器】推流器已启动";
         return false;
     }
@@ -107,11 +213,40 @@ bool RTSPPusher::start()
         setState(PushState::error);
         return false;
     }
+    if (!m_recordPath.isEmpty()) {
+        if (!m_recorder) {
+            m_recorder = new CaptureFileWriter;
+        }
+        QString errMsg;
+        if (!m_recorder->open(m_recordPath, m_recordCompress, &errMsg)) {
+            mLastError = errMsg;
+            setState(PushState::error);
+            return false;
+        }
+        LogInfo << "【RTSP推流器】录制采集数据到:" << m_recordPath;
+    }
+    // 回放录制文件时音视频回放以同一时刻为零点，相对时序不受线程启动先后影响
+    m_replayStartUs = av_gettime_relative();
     // 初始化新的线程
     initNewThread();
     // 重置统计信息
-    mFrameCount = 0;
-    mStartTime = QDateTime::currentMSecsSinceEpoch();
+    m_stats.reset();
+    m_metrics.reset();
+    // 采集采样率跟随编码器（Opus为48kHz），配置的m_audioSampleRate不变
+    int sampleRate = mPusherThread->audioSampleRate();
+    // 回放录制文件时音频同样取自文件
+    VideoSourceConfig sourceConfig = VideoSourceConfig::fromUrl(mSourceUrl, mWidth, mHeight, mFrameRate);
+    QString replayPath = sourceConfig.type == VideoSourceType::replay ? sourceConfig.location : QString();
+    if (m_audioProcessor && (m_audioProcessor->sampleRate() != sampleRate ||
+                             m_audioProcessor->replayFile() != replayPath)) {
+        m_audioProcessor->stopCapture();
+        m_audioProcessor->setReplayFile(replayPath, sourceConfig.loop);
+        if (!m_audioProcessor->initialize(sampleRate, m_audioChannels, m_audioSampleFmt)) {
+            mLastError = "Failed to initialize audio processor";
+            setState(PushState::error);
+            return false;
+        }
+    }
 
     /// 初始化音频处理器
     if (!m_audioProcessor) {
@@ -137,12 +272,24 @@ bool RTSPPusher::start()
             LogInfo << "【同步】音视频同步状态:" << (inSync ? "已同步" : "未同步");
         });
 
-        if (!m_audioProcessor->initialize(m_audioSampleRate, m_audioChannels, m_audioSampleFmt)) {
+        m_audioProcessor->setReplayFile(replayPath, sourceConfig.loop);
+        if (!m_audioProcessor->initialize(sampleRate, m_audioChannels, m_audioSampleFmt)) {
             mLastError = "Failed to initialize audio processor";
             setState(PushState::error);
             return false;
         }
 
+        connect(m_audioProcessor, &AudioProcessor::silenceStatistics,
+                this, [this](qint64 totalFrames, qint64 silentFrames) {
+            emit audioSilenceStatistics(totalFrames, silentFrames,
+                                        totalFrames > 0 ? double(silentFrames) / totalFrames : 0.0);
+        });
+
+        connect(m_audioProcessor, &AudioProcessor::captureBufferInfo,
+                this, &RTSPPusher::audioCaptureBufferInfo);
+        connect(m_audioProcessor, &AudioProcessor::captureLatency,
+                this, &RTSPPusher::audioCaptureLatency);
+
         connect(m_audioProcessor, &AudioProcessor::audioFrameAvailable,
                 this, [this](AVFrame* frame) {
             if (mPusherThread) {
@@ -155,6 +302,12 @@ bool RTSPPusher::start()
         });
     }
 
+    m_audioProcessor->setSilenceDetection(m_silenceMode, m_silenceThresholdDb, m_silenceHangoverMs);
+    m_audioProcessor->setLowLatency(m_audioLowLatency, m_audioBufferMs);
+    m_audioProcessor->setStatsCounters(&m_stats);
+    m_audioProcessor->setRecorder(m_recordPath.isEmpty() ? nullptr : m_recorder);
+    m_audioProcessor->setReplayStart(m_replayStartUs);
+
     // 启动线程
     mPusherThread->start();
     LogInfo << "【RTSP推流器】开始推流,目标地址：" << mDestinationUrl;
@@ -164,21 +317,99 @@ bool RTSPPusher::start()
         m_audioProcessor->resetTimestamp();  // 重置时间戳
         m_audioProcessor->startCapture();
     }
+    m_statsTimer->start(m_statsIntervalMs);
 
     return true;
 }
 
 void RTSPPusher::stop()
 {
-    if (mState == PushState::play) {// 停止音频采集
-        LogDebug << "停止音频采集";
+    if (!m_stopping) {
+        if (!pushing()) {
+            return;
+        }
+        beginStop();
+    }
+    // 同步等待时定时器无法触发，按剩余预算等待，超时后中止网络IO再等线程退出
+    qint64 elapsedMs = (av_gettime_relative() - m_stopBeginUs) / 1000;
+    if (mPusherThread && !mPusherThread->wait(ulong(qMax<qint64>(0, m_stopTimeoutMs - elapsedMs)))) {
+        LogWarn << "【RTSP推流器】停止超时，中止网络IO";
+        mPusherThread->abortOutput();
+        mPusherThread->wait();
+    }
+    finishStop();
+}
+
+void RTSPPusher::stopAsync()
+{
+    if (m_stopping || !pushing()) {
+        return;
+    }
+    beginStop();
+}
+
+void RTSPPusher::setStopTimeout(int ms)
+{
+    m_stopTimeoutMs = qMax(100, ms);
+}
+
+void RTSPPusher::beginStop()
+{
+    LogInfo << "【RTSP推流器】停止推流";
+    m_stopping = true;
+    m_stopBeginUs = av_gettime_relative();
+    // 停止音频采集，之后由CodeThread冲刷编码器、发完队列并在剩余预算内写文件尾
+    if (m_audioProcessor) {
+        m_audioProcessor->stopCapture();
+    }
+    m_statsTimer->stop();
+    if (mPusherThread) {
+        mPusherThread->setStopTimeout(m_stopTimeoutMs);
+        mPusherThread->stop();
+    }
+    m_stopDeadlineTimer->start(m_stopTimeoutMs);
+}
+
+void RTSPPusher::finishStop()
+{
+    m_stopDeadlineTimer->stop();
+    cleanupThread();
+    if (m_recorder) {
         if (m_audioProcessor) {
-            m_audioProcessor->stopCapture();
+            m_audioProcessor->setRecorder(nullptr);
         }
-        cleanupThread();
-        setState(PushState::end);
-        mDestinationUrl.clear();
+        m_recorder->close();
+    }
+    m_stopping = false;
+    qint64 elapsedMs = (av_gettime_relative() - m_stopBeginUs) / 1000;
+    m_stats.setShutdownMs(elapsedMs);
+    updateStatistics();     // 上报最终统计
+    setState(PushState::end);
+    mDestinationUrl.clear();
+    LogInfo << "【RTSP推流器】停止完成，耗时" << elapsedMs << "ms";
+    emit stopped(elapsedMs);
+}
+
+bool RTSPPusher::pause()
+{
+    if (mState != PushState::play || !mPusherThread) {
+        return false;
+    }
+    mPusherThread->pause();
+    setState(PushState::pause);
+    LogInfo << "【RTSP推流器】暂停推流";
+    return true;
+}
+
+bool RTSPPusher::resume()
+{
+    if (mState != PushState::pause || !mPusherThread) {
+        return false;
     }
+    mPusherThread->resume();
+    setState(PushState::play);
+    LogInfo << "【RTSP推流器】恢复推流";
+    return true;
 }
 
 void RTSPPusher::handleThreadState(PushState state)
@@ -196,7 +427,10 @@ void RTSPPusher::handleThreadState(PushState state)
     }
     case PushState::end:
     {
-        setState(PushState::end);
+        // 停止过程中由finishStop在冲刷与写文件尾完成后设置
+        if (!m_stopping) {
+            setState(PushState::end);
+        }
         break;
     }
     case PushState::error:
@@ -227,12 +461,6 @@ void RTSPPusher::handleThreadError(const QString& error)
     setState(PushState::error);
 }
 
-void RTSPPusher::handleFrameProcessed(qint64 frameCount)
-{
-    mFrameCount = frameCount;
-    updateStatistics();
-}
-
 QString RTSPPusher::destinationUrl() const
 {
     return mDestinationUrl;
@@ -246,13 +474,20 @@ void RTSPPusher::setState(PushState newState)
     }
 }
 
-void RTSPPusher::updateStatistics()
+bool RTSPPusher::enableMetricsEndpoint(quint16 port, const QString& localName)
 {
-    // 计算实际比特率
-    qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
-    qint64 duration = currentTime - mStartTime;
-    if (duration > 0) {
-        qint64 actualBitrate = (mFrameCount * mBitRate * 1000) / duration;
-        emit statistics(mFrameCount, actualBitrate);
+    FrameTrace::requireStamps();    // 采集到编码/写出的延迟分位依赖采集时刻
+    if (!m_metricsServer) {
+        m_metricsServer = new MetricsServer(&m_metrics, this);
+        connect(this, &RTSPPusher::statistics, m_metricsServer, &MetricsServer::updateStatistics);
     }
+    return m_metricsServer->listen(port, localName);
+}
+
+void RTSPPusher::updateStatistics()
+{
+    PushStatistics stats = m_stats.sample();
+    ThreadTuning::sampleSchedStats(&stats);
+    emit statistics(stats);
+    emit latencyStatistics(m_metrics.report());
 }
@@ -5,8 +5,13 @@
 #include <QObject>
 #include <QString>
 #include "DataStruct.h"
+#include "pushstats.h"
+#include "pushmetrics.h"
+class QTimer;
+class MetricsServer;
 class CodeThread;
 class AudioProcessor;
+class CaptureFileWriter;
 extern "C"{
 #include <libswresample/swresample.h>
 }
@@ -23,10 +28,38 @@ public:
     void setVideoSize(int width, int height);
     void setFrameRate(int fps);
     void setBitRate(int kbps);
+    void setAudioCodec(AudioCodecType codec, int opusFrameMs = 20, bool opusDtx = false);
+    void setSilenceDetection(SilenceMode mode, double thresholdDb = -60.0, int hangoverMs = 300);
+    // 低延迟采集：显式设置QAudioInput缓冲时长
+    void setLowLatencyCapture(bool enabled, int bufferMs = 10);
+    // 统计信号的采样间隔，默认1000ms
+    void setStatisticsInterval(int ms);
+    // 本地Prometheus指标端点（127.0.0.1:port，localName非空时同时监听本地套接字）
+    bool enableMetricsEndpoint(quint16 port, const QString& localName = QString());
+    // 视频帧携带采集时刻SEI，配合tools/latencyprobe测量端到端延迟
+    void setLatencySei(bool enabled);
+    // 输出断线后自动重连（默认开启），采集与编码不停，退避上限maxBackoffMs
+    void setReconnect(bool enabled, int maxBackoffMs = 30000);
+    // 目的地址为udp/srt/rtp/rtmp或文件时的复用与传输参数，推流中修改下次start生效
+    void setOutputOptions(const OutputOptions& options);
+    // 把原始采集帧与声卡PCM录制到path（.pscap），之后以 replay:///path 作为源地址可按原时序回放；
+    // path为空关闭录制。compress为逐帧LZ4压缩（需以HAVE_LZ4编译）
+    void setCaptureRecording(const QString& path, bool compress = false);
 
     // 操作方法
     bool start();  // 每次调用 start() 都会创建新的 CodeThread
+    // 同步停止，返回时线程与连接均已释放；异步停止进行中时在此完成
     void stop();
+    // 异步停止：立即返回，编码器冲刷、发完队列与写文件尾在CodeThread中完成，完成后发出stopped。
+    // 超过停止超时仍未结束时中止网络IO
+    void stopAsync();
+    // 停止的总预算（毫秒），默认2000
+    void setStopTimeout(int ms);
+    bool isStopping() const { return m_stopping; }
+    // 暂停/恢复不销毁CodeThread：连接与编码器保留，暂停期间停止读取视频源与编码（每500ms发一帧
+    // 填充帧维持RTSP会话），恢复时下一帧为IDR且时间戳连续
+    bool pause();
+    bool resume();
 
     // 状态查询
     PushState state() const { return mState; }
@@ -38,18 +71,28 @@ public:
 signals:
     void stateChanged(const QString &objName, PushState newState);
     void error(const QString& errorMessage);
-    void statistics(qint64 frameCount, qint64 bitrate);
+    void statistics(const PushStatistics& stats);
+    // 各阶段延迟分位（自start起累计），与statistics同周期上报
+    void latencyStatistics(const LatencyReport& report);
+    void audioSilenceStatistics(qint64 totalFrames, qint64 silentFrames, double silenceRatio);
+    void audioCaptureBufferInfo(int bufferBytes, int periodBytes);
+    void audioCaptureLatency(qint64 avgUs, qint64 maxUs);
+    // 停止完成（同步与异步停止均发出），elapsedMs为从请求停止到资源释放的耗时
+    void stopped(qint64 elapsedMs);
 
 private:
     void setState(PushState newState);
+    // 推流中（含暂停），此时配置不可修改
+    bool pushing() const { return mState == PushState::play || mState == PushState::pause; }
     void updateStatistics();
     void cleanupThread();  // 清理旧的线程
+    void beginStop();
+    void finishStop();
     void initNewThread();  // 初始化新的线程
 
 private slots:
     void handleThreadState(PushState state);
     void handleThreadError(const QString& error);
-    void handleFrameProcessed(qint64 frameCount);
 
 private:
     CodeThread* mPusherThread = nullptr;  // 每次推流时重新创建
@@ -59,6 +102,27 @@ private:
     int m_audioSampleRate = 44100;
     int m_audioChannels = 2;
     AVSampleFormat m_audioSampleFmt = AV_SAMPLE_FMT_FLTP;
+    AudioCodecType m_audioCodec = AudioCodecType::aac;
+    int m_opusFrameMs = 20;
+    bool m_opusDtx = false;
+    SilenceMode m_silenceMode = SilenceMode::off;
+    double m_silenceThresholdDb = -60.0;
+    int m_silenceHangoverMs = 300;
+    bool m_audioLowLatency = false;
+    int m_audioBufferMs = 10;
+    bool m_latencySei = false;
+    bool m_reconnect = true;
+    int m_reconnectMaxMs = 30000;
+    OutputOptions m_outputOptions;
+    QString m_recordPath;
+    bool m_recordCompress = false;
+    CaptureFileWriter* m_recorder = nullptr;
+    int64_t m_replayStartUs = -1;
+
+    bool m_stopping = false;
+    int m_stopTimeoutMs = 2000;
+    qint64 m_stopBeginUs = 0;
+    QTimer* m_stopDeadlineTimer = nullptr;
 
     PushState mState;
     QString mLastError;
@@ -72,8 +136,11 @@ private:
     int mBitRate = 2000;  // kbps
 
     // 统计信息
-    qint64 mFrameCount = 0;
-    qint64 mStartTime = 0;
+    PushStatsCounters m_stats;
+    QTimer* m_statsTimer = nullptr;
+    int m_statsIntervalMs = 1000;
+    PushMetrics m_metrics;
+    MetricsServer* m_metricsServer = nullptr;
 };
 
 #endif // RTSPPUSHER_H
@@ -0,0 +1,31 @@
+QT       += core
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = latencyprobe
+
+INCLUDEPATH += $$PWD/../../include \
+    $$PWD/../../include/FFmpeg \
+    $$PWD/../../LogDemo \
+    $$PWD/../../Common
+
+SOURCES += \
+    ../../Common/latencyhistogram.cpp \
+    ../../Common/latencysei.cpp \
+    main.cpp
+
+HEADERS += \
+    ../../Common/latencyhistogram.h \
+    ../../Common/latencysei.h
+
+# msvc >= 2017  编译器使用utf-8编码
+msvc {
+    greaterThan(QMAKE_MSC_VER, 1900){
+        QMAKE_CFLAGS += /utf-8
+        QMAKE_CXXFLAGS += /utf-8
+    }
+}
+
+LIBS += -L$$PWD/../../lib/FFmpeg/ -lavformat -lavcodec -lavutil
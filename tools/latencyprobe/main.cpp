@@ -0,0 +1,243 @@
+﻿// 端到端延迟探针：拉取推流端输出（RTSP/MPEG-TS/UDP），解析视频帧中的采集时刻SEI，
+// 按固定间隔输出延迟分位与丢帧统计。收发两端需同一台机器或已对时
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QMap>
+#include <QSet>
+#include <cstdio>
+#include "latencyhistogram.h"
+#include "latencysei.h"
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/time.h>
+}
+
+namespace
+{
+struct ProbeOptions {
+    QString url;
+    QString transport = "tcp";
+    int durationSec = 0;        // 0表示直到输入结束
+    int intervalMs = 1000;
+    bool decode = true;         // false时在收到包时计时，不含解码耗时
+};
+
+class SequenceTracker
+{
+public:
+    // 丢帧直接按序号跳跃计数：跳过的序号记为丢失并记下，之后迟到补上的再扣回；
+    // 重复的序号不计数。序号大幅回退视为推流端重启（序号从头开始），从新序号重新跟踪
+    void add(uint32_t seq)
+    {
+        int32_t diff = int32_t(seq - m_highest);
+        if (m_received == 0 || diff < -RESET_WINDOW) {
+            m_highest = seq;
+            m_missing.clear();
+        } else if (diff > 0) {
+            m_lost += diff - 1;
+            // 只记最近RESET_WINDOW个缺口，更早的不会再补上
+            for (uint32_t s = seq - uint32_t(qMin(diff - 1, RESET_WINDOW)); s != seq; ++s) {
+                m_missing.insert(s);
+            }
+            m_highest = seq;
+            auto it = m_missing.begin();
+            while (it != m_missing.end()) {
+                if (int32_t(m_highest - *it) > RESET_WINDOW) {
+                    it = m_missing.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        } else if (m_missing.remove(seq)) {
+            ++m_reordered;      // 迟到的帧补上了之前记为丢失的缺口
+            --m_lost;
+        } else {
+            return;             // 重复或已超出跟踪窗口
+        }
+        ++m_received;
+    }
+    qint64 received() const { return m_received; }
+    qint64 lost() const { return m_lost; }
+    qint64 reordered() const { return m_reordered; }
+
+private:
+    static const int32_t RESET_WINDOW = 1000;
+    uint32_t m_highest = 0;
+    qint64 m_received = 0;
+    qint64 m_lost = 0;
+    qint64 m_reordered = 0;
+    QSet<uint32_t> m_missing;   // 记为丢失、仍可能迟到补上的序号
+};
+
+void printSummary(const char* label, const LatencySummary& s, qint64 frames, qint64 lost,
+                  qint64 reordered, qint64 noSei)
+{
+    std::printf("%-7s frames=%-7lld lost=%-5lld reorder=%-4lld nosei=%-4lld "
+                "p50=%7.2fms p90=%7.2fms p99=%7.2fms p999=%7.2fms max=%7.2fms\n",
+                label, frames, lost, reordered, noSei,
+                s.p50Us / 1000.0, s.p90Us / 1000.0, s.p99Us / 1000.0, s.p999Us / 1000.0, s.maxUs / 1000.0);
+    std::fflush(stdout);
+}
+
+int runProbe(const ProbeOptions& opt)
+{
+    AVDictionary* options = nullptr;
+    if (opt.url.startsWith("rtsp://")) {
+        av_dict_set(&options, "rtsp_transport", opt.transport.toUtf8().constData(), 0);
+    }
+    // 关闭输入缓冲，避免把接收端排队计入推流延迟
+    av_dict_set(&options, "fflags", "nobuffer", 0);
+    av_dict_set(&options, "probesize", "65536", 0);
+    av_dict_set(&options, "analyzeduration", "500000", 0);
+
+    AVFormatContext* fmtCtx = nullptr;
+    int ret = avformat_open_input(&fmtCtx, opt.url.toUtf8().constData(), nullptr, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        std::fprintf(stderr, "open %s failed: %d\n", opt.url.toUtf8().constData(), ret);
+        return 1;
+    }
+    avformat_find_stream_info(fmtCtx, nullptr);
+    int videoIndex = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (videoIndex < 0) {
+        std::fprintf(stderr, "no video stream\n");
+        avformat_close_input(&fmtCtx);
+        return 1;
+    }
+
+    AVCodecContext* decCtx = nullptr;
+    if (opt.decode) {
+        AVCodecParameters* par = fmtCtx->streams[videoIndex]->codecpar;
+        AVCodec* codec = avcodec_find_decoder(par->codec_id);
+        decCtx = avcodec_alloc_context3(codec);
+        avcodec_parameters_to_context(decCtx, par);
+        decCtx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        decCtx->thread_count = 1;   // 帧级多线程会引入额外帧延迟
+        if (avcodec_open2(decCtx, codec, nullptr) < 0) {
+            std::fprintf(stderr, "open decoder failed\n");
+            avcodec_free_context(&decCtx);
+            avformat_close_input(&fmtCtx);
+            return 1;
+        }
+    }
+
+    LatencyHistogram total;
+    LatencyHistogram interval;
+    SequenceTracker sequence;
+    qint64 noSei = 0;
+    qint64 negative = 0;
+    QMap<int64_t, LatencySei::Payload> pending;     // pts -> SEI，等待解码输出
+    AVPacket* pkt = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+
+    auto measure = [&](const LatencySei::Payload& sei) {
+        int64_t latencyUs = av_gettime() - sei.captureWallUs;
+        if (latencyUs < 0) {
+            ++negative;     // 时钟未对齐
+        }
+        total.record(latencyUs);
+        interval.record(latencyUs);
+        sequence.add(sei.sequence);
+    };
+
+    int64_t startUs = av_gettime_relative();
+    int64_t reportUs = startUs;
+    // 间隔内的增量，丢帧按序号跨间隔连续计算
+    qint64 reportedFrames = 0, reportedLost = 0, reportedReordered = 0, reportedNoSei = 0;
+    while (opt.durationSec <= 0 || av_gettime_relative() - startUs < int64_t(opt.durationSec) * 1000000) {
+        if (av_read_frame(fmtCtx, pkt) < 0) {
+            break;
+        }
+        if (pkt->stream_index == videoIndex) {
+            LatencySei::Payload sei;
+            bool hasSei = LatencySei::find(pkt->data, pkt->size, &sei);
+            if (!hasSei) {
+                ++noSei;
+            }
+            if (!decCtx) {
+                if (hasSei) {
+                    measure(sei);
+                }
+            } else {
+                if (hasSei) {
+                    pending.insert(pkt->pts, sei);
+                }
+                if (avcodec_send_packet(decCtx, pkt) == 0) {
+                    while (avcodec_receive_frame(decCtx, frame) == 0) {
+                        auto it = pending.find(frame->pts);
+                        if (it != pending.end()) {
+                            measure(it.value());
+                            pending.erase(it);
+                        }
+                        av_frame_unref(frame);
+                    }
+                }
+                // 解码器丢弃的帧不会输出，限制待匹配表大小
+                while (pending.size() > 64) {
+                    pending.erase(pending.begin());
+                }
+            }
+        }
+        av_packet_unref(pkt);
+
+        int64_t now = av_gettime_relative();
+        if (now - reportUs >= int64_t(opt.intervalMs) * 1000) {
+            // 迟到帧会扣回之前间隔计入的丢失，本间隔的增量可能为负
+            printSummary("[int]", interval.summary(), sequence.received() - reportedFrames,
+                         qMax<qint64>(0, sequence.lost() - reportedLost), sequence.reordered() - reportedReordered,
+                         noSei - reportedNoSei);
+            interval.reset();
+            reportedFrames = sequence.received();
+            reportedLost = sequence.lost();
+            reportedReordered = sequence.reordered();
+            reportedNoSei = noSei;
+            reportUs = now;
+        }
+    }
+
+    printSummary("[total]", total.summary(), sequence.received(), sequence.lost(),
+                 sequence.reordered(), noSei);
+    if (negative > 0) {
+        std::fprintf(stderr, "warning: %lld frames arrived before capture time, clocks are not synchronized\n",
+                     negative);
+    }
+
+    av_frame_free(&frame);
+    av_packet_free(&pkt);
+    avcodec_free_context(&decCtx);
+    avformat_close_input(&fmtCtx);
+    return 0;
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("latencyprobe");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measure glass-to-glass latency from PushStreamDemo timestamp SEI.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("url", "rtsp://, udp:// or file input carrying the pushed H.264 stream");
+    QCommandLineOption transportOpt("transport", "RTSP transport (tcp/udp).", "name", "tcp");
+    QCommandLineOption durationOpt("duration", "Stop after N seconds (0 = until end of input).", "sec", "0");
+    QCommandLineOption intervalOpt("interval", "Report interval in milliseconds.", "ms", "1000");
+    QCommandLineOption noDecodeOpt("no-decode", "Timestamp on packet arrival instead of decoded frame.");
+    parser.addOptions({transportOpt, durationOpt, intervalOpt, noDecodeOpt});
+    parser.process(a);
+
+    if (parser.positionalArguments().isEmpty()) {
+        parser.showHelp(1);
+    }
+    ProbeOptions opt;
+    opt.url = parser.positionalArguments().first();
+    opt.transport = parser.value(transportOpt);
+    opt.durationSec = parser.value(durationOpt).toInt();
+    opt.intervalMs = qMax(100, parser.value(intervalOpt).toInt());
+    opt.decode = !parser.isSet(noDecodeOpt);
+
+    avformat_network_init();
+    return runProbe(opt);
+}